@@ -97,6 +97,13 @@ echo "#######################################################################"
 echo ""
 command_success "of_v0.8.4_linuxarmv7l_release/scripts/linux/debian/install_dependencies.sh"
 
+echo ""
+echo "#######################################################################"
+echo "Install dependencies of visicamRPiGPU"
+echo "#######################################################################"
+echo ""
+command_success "apt-get install -y libjpeg-dev"
+
 echo ""
 echo "#######################################################################"
 echo "Finished install"
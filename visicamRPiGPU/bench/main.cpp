@@ -0,0 +1,99 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "visicamRPiGPU-bench.h"
+
+// Arguments: Pairs of --<name> <value>, all are optional
+// Output: JSON document with the settings of the sweep and one object for each run on stdout, progress and stage messages on stderr
+int main(int argc, char *argv[])
+{
+    BenchSettings settings;
+
+    if (!parseBenchArguments(argc, argv, &settings))
+    {
+        fprintf(stderr, "\n####### USAGE: #######\n");
+        fprintf(stderr, "--backends <list>        Backends: cpu (CPU backend), omx (mock camera and image_encode), default %s\n", BENCH_DEFAULT_BACKENDS);
+        fprintf(stderr, "--resolutions <list>     Resolutions <width>x<height>, default %s\n", BENCH_DEFAULT_RESOLUTIONS);
+        fprintf(stderr, "--buffers <list>         Encoder buffer counts (1 to %d), default %s\n", BENCH_MAX_BUFFER_COUNT, BENCH_DEFAULT_BUFFER_COUNTS);
+        fprintf(stderr, "--qualities <list>       JPEG qualities (0 to 100), default %s\n", BENCH_DEFAULT_QUALITIES);
+        fprintf(stderr, "--modes <list>           Pipeline modes: pipelined, same_iteration, default %s (PIPELINE_MODE)\n", BENCH_PIPELINE_MODE_NAME(PIPELINE_MODE));
+        fprintf(stderr, "--frames <int>           Measured frames of each run, default %d\n", BENCH_DEFAULT_FRAMES);
+        fprintf(stderr, "--warmup <int>           Frames before the measurement, default %d\n", BENCH_DEFAULT_WARMUP_FRAMES);
+        fprintf(stderr, "--input <path>           Recorded JPEG frame, default synthetic test frames\n");
+        fprintf(stderr, "--output-dir <path>      Directory for output images and homography, default %s\n", BENCH_DEFAULT_OUTPUT_DIRECTORY);
+        fprintf(stderr, "--framerate <int>        Mock camera frame rate, 0 delivers frames without waiting, default %d\n", BENCH_DEFAULT_CAMERA_FRAMERATE);
+        fprintf(stderr, "--refresh <int>          Seconds between original captured images, default %d\n", BENCH_DEFAULT_REFRESH_SECONDS);
+        fprintf(stderr, "--omx-input-mps <float>  Mock image_encode input throughput in megapixels per second, default %.1f\n", BENCH_DEFAULT_OMX_INPUT_MPS);
+        fprintf(stderr, "--omx-encode-mps <float> Mock image_encode compression throughput in megapixels per second, default %.1f\n", BENCH_DEFAULT_OMX_ENCODE_MPS);
+        fprintf(stderr, "--omx-stall <int>        Mock image_encode of processed images hangs after this many buffers of each setup, 0 never, default %d\n", BENCH_DEFAULT_OMX_STALL_BUFFERS);
+        fprintf(stderr, "--omx-settle <int>       Mock camera settles exposure and white balance after this many frames of each setup, default %d\n\n", BENCH_DEFAULT_OMX_SETTLE_FRAMES);
+
+        fprintf(stderr, "Argument error: Invalid arguments - EXITING APPLICATION\n");
+        return 1;
+    }
+
+    if (mkdir(settings.outputDirectory.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "Bench Error: Can not create output directory %s - EXITING APPLICATION\n", settings.outputDirectory.c_str());
+        return 1;
+    }
+
+    // Settings which are compiled into the stages
+    printf("{\"frame_format\":\"%s\",\"frame_loop_callback\":%s,\"dual_output\":%s,\"publish_mode\":%d,\"publish_queue_length\":%d,\"warped_region\":%s,\"warp_threads\":%d,",
+        (PIPELINE_FRAME_FORMAT == FRAME_FORMAT_YUV420 ? "yuv420" : "rgba"), (FRAME_LOOP_CALLBACK_ENABLE ? "true" : "false"), (DUAL_OUTPUT_ENABLE ? "true" : "false"),
+        PUBLISH_MODE, PUBLISH_QUEUE_LENGTH, (WARPED_REGION_ENABLE ? "true" : "false"), CPU_WARP_THREAD_COUNT);
+    printf("\"input\":\"%s\",\"frames\":%d,\"warmup_frames\":%d,\"camera_framerate\":%d,\"refresh_seconds\":%d,\"omx_input_mps\":%g,\"omx_encode_mps\":%g,\"omx_stall_buffers\":%d,\"omx_settle_frames\":%d,\"runs\":[",
+        (settings.inputPath.empty() ? "synthetic" : settings.inputPath.c_str()), settings.frames, settings.warmupFrames,
+        settings.framerate, settings.refreshSeconds, settings.omxInputMegapixelsPerSecond, settings.omxEncodeMegapixelsPerSecond, settings.omxStallBuffers, settings.omxSettleFrames);
+
+    bool firstRun = true;
+
+    for (size_t b = 0; b < settings.backends.size(); b++)
+    {
+        for (size_t r = 0; r < settings.widths.size(); r++)
+        {
+            for (size_t n = 0; n < settings.bufferCounts.size(); n++)
+            {
+                for (size_t q = 0; q < settings.qualities.size(); q++)
+                {
+                    for (size_t m = 0; m < settings.pipelineModes.size(); m++)
+                    {
+                        BenchRun run;
+                        run.backend = settings.backends[b];
+                        run.width = settings.widths[r];
+                        run.height = settings.heights[r];
+                        run.bufferCount = settings.bufferCounts[n];
+                        run.quality = settings.qualities[q];
+                        run.pipelineMode = settings.pipelineModes[m];
+
+                        fprintf(stderr, "Bench: %s %dx%d, %d buffers, quality %d, %s\n", (run.backend == BENCH_BACKEND_OMX ? "omx" : "cpu"),
+                            run.width, run.height, run.bufferCount, run.quality, BENCH_PIPELINE_MODE_NAME(run.pipelineMode));
+
+                        std::string result = runBenchProcess(&settings, &run);
+                        printf("%s\n%s", (firstRun ? "" : ","), result.c_str());
+                        fflush(stdout);
+                        firstRun = false;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("\n]}\n");
+
+    return 0;
+}
@@ -0,0 +1,1096 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "visicamRPiGPU-bench.h"
+
+/* #####################################
+MOCK OMX BACKEND
+##################################### */
+
+MockOMXFrameSource::MockOMXFrameSource(std::string path, int frameFormat, int settleFrames) : cpuSource(path, frameFormat)
+{
+    this->settleFrames = settleFrames;
+    framerate = 0;
+    stopping = false;
+    frameEvent = NULL;
+}
+
+// Camera starts capturing with setup
+bool MockOMXFrameSource::setup(int width, int height)
+{
+    cpuSource.setup(width, height);
+    clock_gettime(CLOCK_MONOTONIC, &nextFrameTimespec);
+    frameRequested = false;
+    frameFilled = false;
+    filledCount = 0;
+
+    pthread_mutex_init(&cameraMutex, NULL);
+    pthread_cond_init(&cameraCondition, NULL);
+
+    if (pthread_create(&cameraThread, NULL, MockOMXFrameSourceThread, this))
+    {
+        printf("Bench Error: Create camera thread - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    return true;
+}
+
+// Same behaviour as OMXFrameSource: Request buffer if release did not, wait until it is filled
+void MockOMXFrameSource::acquire(Frame* frame)
+{
+    pthread_mutex_lock(&cameraMutex);
+
+    if (!frameRequested)
+    {
+        requestFrame();
+    }
+
+    while (!frameFilled)
+    {
+        pthread_cond_wait(&cameraCondition, &cameraMutex);
+    }
+
+    frameRequested = false;
+    *frame = filledFrame;
+    pthread_mutex_unlock(&cameraMutex);
+}
+
+bool MockOMXFrameSource::poll(Frame* frame)
+{
+    pthread_mutex_lock(&cameraMutex);
+
+    if (!frameRequested)
+    {
+        requestFrame();
+    }
+
+    bool ready = frameFilled;
+
+    if (ready)
+    {
+        frameRequested = false;
+        *frame = filledFrame;
+    }
+
+    pthread_mutex_unlock(&cameraMutex);
+
+    return ready;
+}
+
+void MockOMXFrameSource::release()
+{
+    pthread_mutex_lock(&cameraMutex);
+
+    if (!frameRequested)
+    {
+        requestFrame();
+    }
+
+    pthread_mutex_unlock(&cameraMutex);
+}
+
+void MockOMXFrameSource::setFrameEvent(FrameEvent* event)
+{
+    frameEvent = event;
+}
+
+// Exposure and white balance of the camera are emulated by the number of delivered frames
+bool MockOMXFrameSource::settled()
+{
+    pthread_mutex_lock(&cameraMutex);
+    bool cameraSettled = (filledCount >= settleFrames);
+    pthread_mutex_unlock(&cameraMutex);
+
+    return cameraSettled;
+}
+
+// Camera thread always delivers frames, deadlines are only emulated for image_encode
+bool MockOMXFrameSource::failed()
+{
+    return false;
+}
+
+void MockOMXFrameSource::requestFrame()
+{
+    frameRequested = true;
+    clock_gettime(CLOCK_MONOTONIC, &requestedTimespec);
+    frameFilled = false;
+    pthread_cond_broadcast(&cameraCondition);
+}
+
+// Only the frame rate changes the timing of the camera, it is read by the camera thread
+void MockOMXFrameSource::setCameraSettings(const CameraSettings* settings)
+{
+    cpuSource.setCameraSettings(settings);
+    __atomic_store_n(&framerate, settings->framerate, __ATOMIC_RELAXED);
+}
+
+// Camera stops capturing with teardown
+void MockOMXFrameSource::teardown()
+{
+    pthread_mutex_lock(&cameraMutex);
+    stopping = true;
+    pthread_cond_broadcast(&cameraCondition);
+    pthread_mutex_unlock(&cameraMutex);
+
+    pthread_join(cameraThread, NULL);
+    pthread_mutex_destroy(&cameraMutex);
+    pthread_cond_destroy(&cameraCondition);
+    stopping = false;
+
+    cpuSource.teardown();
+}
+
+// A requested buffer is filled with the next frame of the camera, the camera does not wait for the application
+// Frame is generated after the capture time, the CPU source only writes its buffer while it is requested
+void MockOMXFrameSource::processFrames()
+{
+    while (true)
+    {
+        pthread_mutex_lock(&cameraMutex);
+
+        while ((!frameRequested || frameFilled) && !stopping)
+        {
+            pthread_cond_wait(&cameraCondition, &cameraMutex);
+        }
+
+        if (stopping)
+        {
+            pthread_mutex_unlock(&cameraMutex);
+            return;
+        }
+
+        pthread_mutex_unlock(&cameraMutex);
+
+        // Next captured frame after the request, frames in between were dropped
+        int currentFramerate = __atomic_load_n(&framerate, __ATOMIC_RELAXED);
+
+        if (currentFramerate > 0)
+        {
+            long long frameNanoseconds = 1000000000LL / currentFramerate;
+            struct timespec currentTimespec;
+            clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
+            addTimespecNanoseconds(&nextFrameTimespec, frameNanoseconds);
+
+            double lateSeconds = elapsedSeconds(&nextFrameTimespec, &currentTimespec);
+
+            if (lateSeconds > 0.0)
+            {
+                long long lateFrames = (long long)(lateSeconds * 1000000000.0) / frameNanoseconds + 1;
+                addTimespecNanoseconds(&nextFrameTimespec, lateFrames * frameNanoseconds);
+            }
+
+            sleepUntilTimespec(&nextFrameTimespec);
+        }
+
+        Frame frame;
+        cpuSource.acquire(&frame);
+
+        pthread_mutex_lock(&cameraMutex);
+        frame.requestTimespec = requestedTimespec;
+        filledFrame = frame;
+        frameFilled = true;
+        filledCount++;
+        pthread_cond_broadcast(&cameraCondition);
+        pthread_mutex_unlock(&cameraMutex);
+
+        if (frameEvent)
+        {
+            frameEvent->signal();
+        }
+    }
+}
+
+MockOMXFrameEncoder::MockOMXFrameEncoder(int bufferCount, int frameFormat, double inputMegapixelsPerSecond, double encodeMegapixelsPerSecond, unsigned int stallBuffers)
+{
+    this->bufferCount = bufferCount;
+    this->frameFormat = frameFormat;
+    this->inputMegapixelsPerSecond = inputMegapixelsPerSecond;
+    this->encodeMegapixelsPerSecond = encodeMegapixelsPerSecond;
+    this->stallBuffers = stallBuffers;
+    componentFailed = false;
+    submittedCount = 0;
+    collectedCount = 0;
+    emptyBufferDoneCount = 0;
+    fillBufferDoneCount = 0;
+    quality = 100;
+    compressor = NULL;
+    stopping = false;
+    frameEvent = NULL;
+}
+
+// Allocate buffers like image_encode, start component thread
+bool MockOMXFrameEncoder::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    // Same limits as the OMX encoder
+    if (bufferCount < 1 || bufferCount > BENCH_MAX_BUFFER_COUNT)
+    {
+        printf("Bench Error: Encoder needs 1 to %d buffers - EXITING APPLICATION\n", BENCH_MAX_BUFFER_COUNT);
+        kill(getpid(), SIGKILL);
+    }
+
+    submittedFrames = (Frame*)(calloc(bufferCount, sizeof(Frame)));
+    submittedQualities = (int*)(calloc(bufferCount, sizeof(int)));
+    submittedTimespecs = (struct timespec*)(calloc(bufferCount, sizeof(struct timespec)));
+    emptyBufferDoneTimespecs = (struct timespec*)(calloc(bufferCount, sizeof(struct timespec)));
+    fillBufferDoneTimespecs = (struct timespec*)(calloc(bufferCount, sizeof(struct timespec)));
+    inputBuffers = (unsigned char**)(malloc(bufferCount * sizeof(unsigned char*)));
+    outputBuffers = (unsigned char**)(malloc(bufferCount * sizeof(unsigned char*)));
+    outputBufferSizes = (size_t*)(malloc(bufferCount * sizeof(size_t)));
+    outputLengths = (size_t*)(calloc(bufferCount, sizeof(size_t)));
+
+    for (int i = 0; i < bufferCount; i++)
+    {
+        inputBuffers[i] = (unsigned char*)(calloc(frameBytes(width, height, frameFormat), 1));
+
+        // Output buffers are enlarged if a compressed frame does not fit
+        outputBufferSizes[i] = width * height;
+        outputBuffers[i] = (unsigned char*)(malloc(outputBufferSizes[i]));
+    }
+
+    // Compression of the component thread
+    compressor = new CPUFrameEncoder(1, frameFormat);
+    compressor->setQuality(quality);
+    compressor->setup(width, height);
+
+    pthread_mutex_init(&componentMutex, NULL);
+    monotonicConditionInit(&componentCondition);
+    componentFailed = false;
+
+    if (pthread_create(&componentThread, NULL, MockOMXFrameEncoderThread, this))
+    {
+        printf("Bench Error: Create component thread - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    return true;
+}
+
+// Input buffer of next slot, its previous frame was already collected
+void MockOMXFrameEncoder::getInputFrame(Frame* frame)
+{
+    frame->data = inputBuffers[submittedCount % bufferCount];
+    frame->handle = NULL;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = (frameFormat == FRAME_FORMAT_YUV420 ? width : 4 * width);
+    frame->format = frameFormat;
+    frame->original = false;
+    frame->offsetX = 0;
+    frame->offsetY = 0;
+}
+
+// Same behaviour as OMXFrameEncoder: Submit buffer, return oldest frame if it is finished or if all buffers are in use
+void MockOMXFrameEncoder::encode(const Frame* input, EncodedFrame* output)
+{
+    int slot = submittedCount % bufferCount;
+
+    // Failed component: Nothing is submitted
+    if (componentFailed)
+    {
+        output->data = NULL;
+        output->length = 0;
+        output->header = NULL;
+        output->headerLength = 0;
+        output->original = input->original;
+        return;
+    }
+
+    pthread_mutex_lock(&componentMutex);
+    submittedFrames[slot] = *input;
+    submittedQualities[slot] = quality;
+    clock_gettime(CLOCK_MONOTONIC, &submittedTimespecs[slot]);
+    submittedCount++;
+    pthread_cond_broadcast(&componentCondition);
+
+    output->data = NULL;
+    output->length = 0;
+    output->header = NULL;
+    output->headerLength = 0;
+    output->original = false;
+
+    if ((fillBufferDoneCount != collectedCount || (submittedCount - collectedCount) >= (unsigned int)(bufferCount)) && waitOldestFinished())
+    {
+        int oldestSlot = collectedCount % bufferCount;
+        collectedCount++;
+        collectSlot(oldestSlot, output);
+    }
+
+    pthread_mutex_unlock(&componentMutex);
+}
+
+bool MockOMXFrameEncoder::flush(EncodedFrame* output)
+{
+    if (collectedCount == submittedCount || componentFailed)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&componentMutex);
+
+    if (!waitOldestFinished())
+    {
+        pthread_mutex_unlock(&componentMutex);
+        return false;
+    }
+
+    int oldestSlot = collectedCount % bufferCount;
+    collectedCount++;
+    collectSlot(oldestSlot, output);
+
+    pthread_mutex_unlock(&componentMutex);
+
+    return true;
+}
+
+bool MockOMXFrameEncoder::collect(EncodedFrame* output)
+{
+    if (collectedCount == submittedCount || componentFailed)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&componentMutex);
+    bool oldestFinished = (fillBufferDoneCount != collectedCount);
+
+    if (oldestFinished)
+    {
+        int oldestSlot = collectedCount % bufferCount;
+        collectedCount++;
+        collectSlot(oldestSlot, output);
+    }
+
+    pthread_mutex_unlock(&componentMutex);
+
+    return oldestFinished;
+}
+
+void MockOMXFrameEncoder::setFrameEvent(FrameEvent* event)
+{
+    frameEvent = event;
+}
+
+bool MockOMXFrameEncoder::failed()
+{
+    return componentFailed;
+}
+
+// Same deadline and messages as the waits of OMX components
+bool MockOMXFrameEncoder::waitOldestFinished()
+{
+    struct timespec timeoutTimespec;
+    monotonicDeadline(&timeoutTimespec, OMX_ENCODE_TIMEOUT_MS);
+
+    while (fillBufferDoneCount == collectedCount)
+    {
+        if (pthread_cond_timedwait(&componentCondition, &componentMutex, &timeoutTimespec) == ETIMEDOUT && fillBufferDoneCount == collectedCount)
+        {
+            if (!STAGE_RECOVERY_ENABLE)
+            {
+                printf("Bench Error: Mock image_encode missed its deadline - EXITING APPLICATION\n");
+                kill(getpid(), SIGKILL);
+            }
+
+            printf("Bench Warning: Mock image_encode missed its deadline, stage is set up again\n");
+            componentFailed = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Output of a finished slot with information of its submitted frame
+void MockOMXFrameEncoder::collectSlot(int slot, EncodedFrame* output)
+{
+    output->data = outputBuffers[slot];
+    output->length = outputLengths[slot];
+    output->header = NULL;
+    output->headerLength = 0;
+    output->original = submittedFrames[slot].original;
+    output->width = submittedFrames[slot].width;
+    output->height = submittedFrames[slot].height;
+    output->offsetX = submittedFrames[slot].offsetX;
+    output->offsetY = submittedFrames[slot].offsetY;
+    output->sequence = submittedFrames[slot].sequence;
+    output->captureTimespec = submittedFrames[slot].captureTimespec;
+    output->warpTimespec = submittedFrames[slot].warpTimespec;
+    output->encodedTimespec = fillBufferDoneTimespecs[slot];
+    output->quality = submittedQualities[slot];
+    output->inputSeconds = elapsedSeconds(&submittedTimespecs[slot], &emptyBufferDoneTimespecs[slot]);
+    output->encodeSeconds = elapsedSeconds(&submittedTimespecs[slot], &fillBufferDoneTimespecs[slot]);
+}
+
+// Quality is taken by the next submitted frame
+void MockOMXFrameEncoder::setQuality(int quality)
+{
+    this->quality = quality;
+}
+
+void MockOMXFrameEncoder::setBufferCount(int bufferCount)
+{
+    this->bufferCount = bufferCount;
+}
+
+// Stop component thread and free buffers, all frames were collected before
+void MockOMXFrameEncoder::teardown()
+{
+    pthread_mutex_lock(&componentMutex);
+    stopping = true;
+    pthread_cond_broadcast(&componentCondition);
+    pthread_mutex_unlock(&componentMutex);
+
+    pthread_join(componentThread, NULL);
+    pthread_mutex_destroy(&componentMutex);
+    pthread_cond_destroy(&componentCondition);
+    stopping = false;
+
+    compressor->teardown();
+    delete compressor;
+    compressor = NULL;
+
+    for (int i = 0; i < bufferCount; i++)
+    {
+        free(inputBuffers[i]);
+        free(outputBuffers[i]);
+    }
+
+    free(submittedFrames);
+    free(submittedQualities);
+    free(submittedTimespecs);
+    free(emptyBufferDoneTimespecs);
+    free(fillBufferDoneTimespecs);
+    free(inputBuffers);
+    free(outputBuffers);
+    free(outputBufferSizes);
+    free(outputLengths);
+
+    submittedCount = 0;
+    collectedCount = 0;
+    emptyBufferDoneCount = 0;
+    fillBufferDoneCount = 0;
+}
+
+// Buffers are processed one after another like by image_encode, a buffer starts when it was submitted and the previous one is finished
+void MockOMXFrameEncoder::processBuffers()
+{
+    unsigned int processedCount = 0;
+    struct timespec componentTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &componentTimespec);
+
+    while (true)
+    {
+        pthread_mutex_lock(&componentMutex);
+
+        // Fault injection: Component hangs until teardown
+        while ((processedCount == submittedCount || (stallBuffers > 0 && processedCount == stallBuffers)) && !stopping)
+        {
+            pthread_cond_wait(&componentCondition, &componentMutex);
+        }
+
+        if (stopping)
+        {
+            pthread_mutex_unlock(&componentMutex);
+            return;
+        }
+
+        int slot = processedCount % bufferCount;
+        Frame frame = submittedFrames[slot];
+        int frameQuality = submittedQualities[slot];
+        struct timespec startTimespec = submittedTimespecs[slot];
+
+        pthread_mutex_unlock(&componentMutex);
+
+        if (elapsedSeconds(&startTimespec, &componentTimespec) > 0.0)
+        {
+            startTimespec = componentTimespec;
+        }
+
+        double megapixels = frame.width * frame.height / 1000000.0;
+
+        // Input buffer is read with the input throughput: EmptyBufferDone
+        struct timespec doneTimespec = startTimespec;
+        addTimespecNanoseconds(&doneTimespec, (long long)(megapixels / inputMegapixelsPerSecond * 1000000000.0));
+        sleepUntilTimespec(&doneTimespec);
+
+        pthread_mutex_lock(&componentMutex);
+        clock_gettime(CLOCK_MONOTONIC, &emptyBufferDoneTimespecs[slot]);
+        emptyBufferDoneCount++;
+        pthread_mutex_unlock(&componentMutex);
+
+        // Compress, input buffer is not reused before the frame was collected
+        EncodedFrame encodedFrame;
+        compressor->setQuality(frameQuality);
+        compressor->encode(&frame, &encodedFrame);
+
+        if (encodedFrame.length > outputBufferSizes[slot])
+        {
+            outputBufferSizes[slot] = encodedFrame.length;
+            outputBuffers[slot] = (unsigned char*)(realloc(outputBuffers[slot], outputBufferSizes[slot]));
+        }
+
+        memcpy(outputBuffers[slot], encodedFrame.data, encodedFrame.length);
+
+        // Compressed frame is ready with the encode throughput: FillBufferDone
+        doneTimespec = startTimespec;
+        addTimespecNanoseconds(&doneTimespec, (long long)(megapixels / encodeMegapixelsPerSecond * 1000000000.0));
+        sleepUntilTimespec(&doneTimespec);
+
+        pthread_mutex_lock(&componentMutex);
+        outputLengths[slot] = encodedFrame.length;
+        clock_gettime(CLOCK_MONOTONIC, &fillBufferDoneTimespecs[slot]);
+        componentTimespec = fillBufferDoneTimespecs[slot];
+        fillBufferDoneCount++;
+        pthread_cond_broadcast(&componentCondition);
+        pthread_mutex_unlock(&componentMutex);
+
+        if (frameEvent)
+        {
+            frameEvent->signal();
+        }
+
+        processedCount++;
+    }
+}
+
+/* #####################################
+BENCHMARK
+##################################### */
+
+CountingFramePublisher::CountingFramePublisher(FramePublisher* target)
+{
+    this->target = target;
+    publishedCount = 0;
+    publishedBytes = 0;
+}
+
+void CountingFramePublisher::setup(int width, int height)
+{
+    target->setup(width, height);
+}
+
+void CountingFramePublisher::publish(const EncodedFrame* frame, const std::string& path)
+{
+    target->publish(frame, path);
+    __atomic_add_fetch(&publishedCount, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&publishedBytes, (unsigned long long)(frame->headerLength + frame->length), __ATOMIC_RELAXED);
+}
+
+void CountingFramePublisher::resize(int width, int height)
+{
+    target->resize(width, height);
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+void* MockOMXFrameSourceThread(void* source)
+{
+    ((MockOMXFrameSource*)(source))->processFrames();
+    return NULL;
+}
+
+void* MockOMXFrameEncoderThread(void* encoder)
+{
+    ((MockOMXFrameEncoder*)(encoder))->processBuffers();
+    return NULL;
+}
+
+void addTimespecNanoseconds(struct timespec* timespec, long long nanoseconds)
+{
+    long long total = timespec->tv_nsec + nanoseconds;
+    timespec->tv_sec += total / 1000000000LL;
+    timespec->tv_nsec = total % 1000000000LL;
+}
+
+void sleepUntilTimespec(const struct timespec* timespec)
+{
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, timespec, NULL) == EINTR)
+    {
+    }
+}
+
+bool parseIntegerList(const std::string& text, std::vector<int>* values)
+{
+    std::istringstream input(text);
+    std::string item;
+    values->clear();
+
+    while (std::getline(input, item, ','))
+    {
+        char* end = NULL;
+        long value = strtol(item.c_str(), &end, 10);
+
+        if (item.empty() || *end != '\0')
+        {
+            return false;
+        }
+
+        values->push_back((int)(value));
+    }
+
+    return !values->empty();
+}
+
+bool parseBenchArguments(int argc, char* argv[], BenchSettings* settings)
+{
+    std::string backends = BENCH_DEFAULT_BACKENDS;
+    std::string resolutions = BENCH_DEFAULT_RESOLUTIONS;
+    std::string bufferCounts = BENCH_DEFAULT_BUFFER_COUNTS;
+    std::string qualities = BENCH_DEFAULT_QUALITIES;
+    std::string pipelineModes = BENCH_PIPELINE_MODE_NAME(PIPELINE_MODE);
+
+    settings->frames = BENCH_DEFAULT_FRAMES;
+    settings->warmupFrames = BENCH_DEFAULT_WARMUP_FRAMES;
+    settings->inputPath = "";
+    settings->outputDirectory = BENCH_DEFAULT_OUTPUT_DIRECTORY;
+    settings->framerate = BENCH_DEFAULT_CAMERA_FRAMERATE;
+    settings->refreshSeconds = BENCH_DEFAULT_REFRESH_SECONDS;
+    settings->omxInputMegapixelsPerSecond = BENCH_DEFAULT_OMX_INPUT_MPS;
+    settings->omxEncodeMegapixelsPerSecond = BENCH_DEFAULT_OMX_ENCODE_MPS;
+    settings->omxStallBuffers = BENCH_DEFAULT_OMX_STALL_BUFFERS;
+    settings->omxSettleFrames = BENCH_DEFAULT_OMX_SETTLE_FRAMES;
+
+    // Arguments are pairs of name and value
+    if (argc % 2 != 1)
+    {
+        return false;
+    }
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+
+        if (name == "--backends")
+        {
+            backends = value;
+        }
+        else if (name == "--resolutions")
+        {
+            resolutions = value;
+        }
+        else if (name == "--buffers")
+        {
+            bufferCounts = value;
+        }
+        else if (name == "--qualities")
+        {
+            qualities = value;
+        }
+        else if (name == "--modes")
+        {
+            pipelineModes = value;
+        }
+        else if (name == "--frames")
+        {
+            settings->frames = atoi(value.c_str());
+        }
+        else if (name == "--warmup")
+        {
+            settings->warmupFrames = atoi(value.c_str());
+        }
+        else if (name == "--input")
+        {
+            settings->inputPath = value;
+        }
+        else if (name == "--output-dir")
+        {
+            settings->outputDirectory = value;
+        }
+        else if (name == "--framerate")
+        {
+            settings->framerate = atoi(value.c_str());
+        }
+        else if (name == "--refresh")
+        {
+            settings->refreshSeconds = atoi(value.c_str());
+        }
+        else if (name == "--omx-input-mps")
+        {
+            settings->omxInputMegapixelsPerSecond = atof(value.c_str());
+        }
+        else if (name == "--omx-encode-mps")
+        {
+            settings->omxEncodeMegapixelsPerSecond = atof(value.c_str());
+        }
+        else if (name == "--omx-stall")
+        {
+            settings->omxStallBuffers = atoi(value.c_str());
+        }
+        else if (name == "--omx-settle")
+        {
+            settings->omxSettleFrames = atoi(value.c_str());
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Backends
+    std::istringstream backendInput(backends);
+    std::string backend;
+    settings->backends.clear();
+
+    while (std::getline(backendInput, backend, ','))
+    {
+        if (backend == "cpu")
+        {
+            settings->backends.push_back(BENCH_BACKEND_CPU);
+        }
+        else if (backend == "omx")
+        {
+            settings->backends.push_back(BENCH_BACKEND_OMX);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Pipeline modes
+    std::istringstream modeInput(pipelineModes);
+    std::string mode;
+    settings->pipelineModes.clear();
+
+    while (std::getline(modeInput, mode, ','))
+    {
+        if (mode == BENCH_PIPELINE_MODE_NAME(PIPELINE_MODE_PIPELINED))
+        {
+            settings->pipelineModes.push_back(PIPELINE_MODE_PIPELINED);
+        }
+        else if (mode == BENCH_PIPELINE_MODE_NAME(PIPELINE_MODE_SAME_ITERATION))
+        {
+            settings->pipelineModes.push_back(PIPELINE_MODE_SAME_ITERATION);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Resolutions, same limits as the arguments of the application
+    std::istringstream resolutionInput(resolutions);
+    std::string resolution;
+    settings->widths.clear();
+    settings->heights.clear();
+
+    while (std::getline(resolutionInput, resolution, ','))
+    {
+        int width = 0;
+        int height = 0;
+
+        if (sscanf(resolution.c_str(), "%dx%d", &width, &height) != 2
+            || width < 640 || width > 1920 || (width % 32) != 0
+            || height < 480 || height > 1080 || (height % 16) != 0)
+        {
+            return false;
+        }
+
+        settings->widths.push_back(width);
+        settings->heights.push_back(height);
+    }
+
+    if (!parseIntegerList(bufferCounts, &settings->bufferCounts) || !parseIntegerList(qualities, &settings->qualities))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < settings->bufferCounts.size(); i++)
+    {
+        if (settings->bufferCounts[i] < 1 || settings->bufferCounts[i] > BENCH_MAX_BUFFER_COUNT)
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < settings->qualities.size(); i++)
+    {
+        if (settings->qualities[i] < 0 || settings->qualities[i] > 100)
+        {
+            return false;
+        }
+    }
+
+    return (!settings->backends.empty() && !settings->pipelineModes.empty() && !settings->widths.empty() && settings->frames > 0 && settings->warmupFrames >= 0
+        && settings->framerate >= 0 && settings->refreshSeconds > 0 && settings->omxInputMegapixelsPerSecond > 0.0 && settings->omxEncodeMegapixelsPerSecond > 0.0 && settings->omxStallBuffers >= 0 && settings->omxSettleFrames >= 0);
+}
+
+std::string runBenchProcess(const BenchSettings* settings, const BenchRun* run)
+{
+    int resultPipe[2];
+
+    if (pipe(resultPipe) == -1)
+    {
+        printf("Bench Error: Create pipe - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+
+    if (child == -1)
+    {
+        printf("Bench Error: Create child process - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    // Child process: Messages of the stages go to stderr, stdout only contains the JSON output of the parent
+    if (child == 0)
+    {
+        close(resultPipe[0]);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+
+        std::string result = runBench(settings, run);
+        size_t written = 0;
+
+        while (written < result.size())
+        {
+            ssize_t length = write(resultPipe[1], result.c_str() + written, result.size() - written);
+
+            if (length <= 0)
+            {
+                break;
+            }
+
+            written += length;
+        }
+
+        // Stage threads are still running, exit without destructors
+        fflush(stdout);
+        _exit(0);
+    }
+
+    close(resultPipe[1]);
+
+    std::string result;
+    char buffer[4096];
+    ssize_t length;
+
+    while ((length = read(resultPipe[0], buffer, sizeof(buffer))) != 0)
+    {
+        if (length > 0)
+        {
+            result.append(buffer, length);
+        }
+        else if (errno != EINTR)
+        {
+            break;
+        }
+    }
+
+    close(resultPipe[0]);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    if (!result.empty() && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        return result;
+    }
+
+    // Stages exit the application on errors
+    std::ostringstream output;
+    output << "{\"backend\":\"" << (run->backend == BENCH_BACKEND_OMX ? "omx" : "cpu") << "\""
+        << ",\"width\":" << run->width << ",\"height\":" << run->height
+        << ",\"buffers\":" << run->bufferCount << ",\"quality\":" << run->quality
+        << ",\"mode\":\"" << BENCH_PIPELINE_MODE_NAME(run->pipelineMode) << "\""
+        << ",\"error\":\"run did not finish (" << (WIFSIGNALED(status) ? "signal " : "exit status ")
+        << (WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status)) << ")\"}";
+
+    return output.str();
+}
+
+std::string runBench(const BenchSettings* settings, const BenchRun* run)
+{
+    std::string homographyPath = settings->outputDirectory + "/homography.txt";
+    std::string processedPath = settings->outputDirectory + "/processed.jpg";
+    std::string capturedPath = settings->outputDirectory + "/captured.jpg";
+
+    // Mild perspective correction with the same shape for each resolution
+    std::ofstream homographyOutput(homographyPath.c_str());
+    homographyOutput << 0.95 << "\n" << 0.03 << "\n" << 0.02 * run->width << "\n"
+        << -0.02 << "\n" << 0.97 << "\n" << 0.015 * run->height << "\n"
+        << 0.00002 * 640 / run->width << "\n" << 0.00001 * 480 / run->height << "\n" << 1.0 << "\n";
+    homographyOutput.close();
+
+    Pipeline pipeline;
+    pipeline.width = run->width;
+    pipeline.height = run->height;
+    pipeline.refreshTimeSeconds = settings->refreshSeconds;
+    pipeline.parentCheckPid = 0;
+    pipeline.homographyInputPath = homographyPath;
+    pipeline.processedOutputPath = processedPath;
+    pipeline.capturedOutputPath = capturedPath;
+    pipeline.jpegQuality = run->quality;
+    pipeline.encodeBufferCount = run->bufferCount;
+    pipeline.pipelineMode = run->pipelineMode;
+    pipeline.cameraSettings.framerate = settings->framerate;
+
+    // Stages: Warp always runs on the CPU, the OMX run emulates camera and image_encode
+    if (run->backend == BENCH_BACKEND_OMX)
+    {
+        pipeline.source = new MockOMXFrameSource(settings->inputPath, PIPELINE_FRAME_FORMAT, settings->omxSettleFrames);
+        pipeline.encoder = new MockOMXFrameEncoder(run->bufferCount, PIPELINE_FRAME_FORMAT, settings->omxInputMegapixelsPerSecond, settings->omxEncodeMegapixelsPerSecond, settings->omxStallBuffers);
+        pipeline.capturedEncoder = (DUAL_OUTPUT_ENABLE ? new MockOMXFrameEncoder(CAPTURED_ENCODE_BUFFER_COUNT, PIPELINE_FRAME_FORMAT, settings->omxInputMegapixelsPerSecond, settings->omxEncodeMegapixelsPerSecond, 0) : NULL);
+    }
+    else
+    {
+        pipeline.source = new CPUFrameSource(settings->inputPath, PIPELINE_FRAME_FORMAT);
+        pipeline.encoder = new CPUFrameEncoder(run->bufferCount, PIPELINE_FRAME_FORMAT);
+        pipeline.capturedEncoder = (DUAL_OUTPUT_ENABLE ? new CPUFrameEncoder(CAPTURED_ENCODE_BUFFER_COUNT, PIPELINE_FRAME_FORMAT) : NULL);
+    }
+
+    pipeline.warper = new CPUFrameWarper(CPU_WARP_THREAD_COUNT, PIPELINE_FRAME_FORMAT);
+
+    // Same publisher as the application, bytes are counted where they are written
+    FramePublisher* publisher = NULL;
+
+    switch (PUBLISH_MODE)
+    {
+        case PUBLISH_MODE_RENAME:
+        {
+            publisher = new RenameFramePublisher(PUBLISH_RENAME_TEMP_COUNT);
+            break;
+        }
+        case PUBLISH_MODE_SHM:
+        {
+            publisher = new ShmFramePublisher(PUBLISH_SHM_SLOT_COUNT);
+            break;
+        }
+        default:
+        {
+            publisher = new FileFramePublisher();
+            break;
+        }
+    }
+
+    CountingFramePublisher* countingPublisher = new CountingFramePublisher(publisher);
+    pipeline.publisher = countingPublisher;
+
+    if (PUBLISH_QUEUE_LENGTH > 0)
+    {
+        pipeline.publisher = new AsyncFramePublisher(countingPublisher, PUBLISH_QUEUE_LENGTH, PUBLISH_DROP_POLICY);
+    }
+
+    pipeline.setup();
+
+    // Warm up: Remap tables, first original captured image, filled encoder
+    for (int i = 0; i < settings->warmupFrames; i++)
+    {
+        pipeline.update();
+        pipeline.draw();
+    }
+
+    latencyStats.reset();
+    unsigned int startPublishedCount = __atomic_load_n(&countingPublisher->publishedCount, __ATOMIC_RELAXED);
+    unsigned long long startPublishedBytes = __atomic_load_n(&countingPublisher->publishedBytes, __ATOMIC_RELAXED);
+    unsigned int startSkippedCount = pipeline.skippedFrameCount;
+    unsigned int startRecoveryCount = pipeline.recoveryCount;
+
+    struct rusage startUsage;
+    struct rusage endUsage;
+    struct timespec startTimespec;
+    struct timespec endTimespec;
+    getrusage(RUSAGE_SELF, &startUsage);
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+
+    for (int i = 0; i < settings->frames; i++)
+    {
+        pipeline.update();
+        pipeline.draw();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+    getrusage(RUSAGE_SELF, &endUsage);
+
+    double seconds = elapsedSeconds(&startTimespec, &endTimespec);
+    double cpuSeconds = (endUsage.ru_utime.tv_sec - startUsage.ru_utime.tv_sec) + (endUsage.ru_utime.tv_usec - startUsage.ru_utime.tv_usec) / 1000000.0
+        + (endUsage.ru_stime.tv_sec - startUsage.ru_stime.tv_sec) + (endUsage.ru_stime.tv_usec - startUsage.ru_stime.tv_usec) / 1000000.0;
+    unsigned int publishedCount = __atomic_load_n(&countingPublisher->publishedCount, __ATOMIC_RELAXED) - startPublishedCount;
+    unsigned long long publishedBytes = __atomic_load_n(&countingPublisher->publishedBytes, __ATOMIC_RELAXED) - startPublishedBytes;
+
+    std::ostringstream output;
+    output << "{\"backend\":\"" << (run->backend == BENCH_BACKEND_OMX ? "omx" : "cpu") << "\""
+        << ",\"width\":" << run->width << ",\"height\":" << run->height
+        << ",\"buffers\":" << run->bufferCount << ",\"quality\":" << run->quality
+        << ",\"mode\":\"" << BENCH_PIPELINE_MODE_NAME(run->pipelineMode) << "\""
+        << ",\"frames\":" << settings->frames
+        << ",\"seconds\":" << seconds
+        << ",\"fps\":" << settings->frames / seconds
+        << ",\"cpu_seconds\":" << cpuSeconds
+        << ",\"published_frames\":" << publishedCount
+        << ",\"skipped_frames\":" << pipeline.skippedFrameCount - startSkippedCount
+        << ",\"recoveries\":" << pipeline.recoveryCount - startRecoveryCount
+        << ",\"setup_ms\":" << pipeline.setupSeconds * 1000.0
+        << ",\"first_frame_ms\":" << pipeline.firstFrameSeconds * 1000.0
+        << ",\"settled_frame_ms\":" << pipeline.settledFrameSeconds * 1000.0
+        << ",\"bytes_written\":" << publishedBytes
+        << ",\"bytes_per_frame\":" << (publishedCount > 0 ? publishedBytes / publishedCount : 0)
+        << ",\"memory_peak_kb\":" << readProcessStatusKilobytes("VmHWM")
+        << ",\"memory_rss_kb\":" << readProcessStatusKilobytes("VmRSS")
+        << ",\"latency_ms\":{";
+
+    // Percentiles of all stages with samples
+    bool firstStage = true;
+
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        LatencyHistogram* histogram = &latencyStats.histograms[stage];
+        unsigned int count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        output << (firstStage ? "" : ",") << "\"" << latencyStageName(stage) << "\":{"
+            << "\"count\":" << count
+            << ",\"mean\":" << __atomic_load_n(&histogram->sumMicroseconds, __ATOMIC_RELAXED) / 1000.0 / count
+            << ",\"p50\":" << histogram->quantile(0.5) * 1000.0
+            << ",\"p95\":" << histogram->quantile(0.95) * 1000.0
+            << ",\"p99\":" << histogram->quantile(0.99) * 1000.0 << "}";
+        firstStage = false;
+    }
+
+    output << "}}";
+
+    return output.str();
+}
+
+long readProcessStatusKilobytes(const char* name)
+{
+    std::ifstream statusInput("/proc/self/status");
+    std::string line;
+    std::string prefix = std::string(name) + ":";
+
+    while (std::getline(statusInput, line))
+    {
+        if (line.compare(0, prefix.size(), prefix) == 0)
+        {
+            return atol(line.c_str() + prefix.size());
+        }
+    }
+
+    return 0;
+}
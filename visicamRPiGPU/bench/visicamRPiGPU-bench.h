@@ -0,0 +1,261 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+// Note: The benchmark is built without openFrameworks and OMX (see Makefile of this directory),
+// stages of the OMX backend are replaced by mocks which emulate the timing of their components
+#include "../src/visicamRPiGPU-pipeline.h"
+#include "../src/visicamRPiGPU-cpu.h"
+#include "../src/visicamRPiGPU-latency.h"
+#include "../src/visicamRPiGPU-publish.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sstream>
+
+// Backends of a benchmark run
+#define BENCH_BACKEND_CPU                       0       // CPU backend of the application
+#define BENCH_BACKEND_OMX                       1       // CPU source and warper, mock camera timing and mock image_encode
+
+// Default sweep, 1920 x 1072 is the largest resolution of the application (height multiple of 16)
+#define BENCH_DEFAULT_BACKENDS                  "cpu,omx"
+#define BENCH_DEFAULT_RESOLUTIONS               "640x480,1280x720,1920x1072"
+#define BENCH_DEFAULT_BUFFER_COUNTS             "1,2,3"
+#define BENCH_DEFAULT_QUALITIES                 "50,75,90"
+#define BENCH_DEFAULT_FRAMES                    100
+#define BENCH_DEFAULT_WARMUP_FRAMES             10
+#define BENCH_DEFAULT_OUTPUT_DIRECTORY          "/tmp/visicamRPiGPU-bench"
+#define BENCH_DEFAULT_REFRESH_SECONDS           3600    // Only the first original captured image is published during a run
+
+// Name of PIPELINE_MODE_* in arguments and output
+#define BENCH_PIPELINE_MODE_NAME(mode)          ((mode) == PIPELINE_MODE_SAME_ITERATION ? "same_iteration" : "pipelined")
+
+// Same range as ENCODE_BUFFER_COUNT
+#define BENCH_MAX_BUFFER_COUNT                  8
+
+// Default timing of the mock OMX components, rough values of a Raspberry Pi 2, measure and pass own values for other models
+#define BENCH_DEFAULT_CAMERA_FRAMERATE          30      // Camera: Frames per second delivered by egl_render, 0 delivers frames without waiting
+#define BENCH_DEFAULT_OMX_INPUT_MPS             200.0   // image_encode: Megapixels per second for reading the input buffer (EmptyBufferDone)
+#define BENCH_DEFAULT_OMX_ENCODE_MPS            40.0    // image_encode: Megapixels per second for compressing (FillBufferDone)
+#define BENCH_DEFAULT_OMX_STALL_BUFFERS         0       // image_encode: Hangs after this many buffers of each setup to exercise stage recovery, 0 never hangs
+#define BENCH_DEFAULT_OMX_SETTLE_FRAMES         15      // Camera: Exposure and white balance settled after this many frames of each setup (EARLY_REFRESH_ENABLE)
+
+/* #####################################
+MOCK OMX BACKEND
+##################################### */
+
+// Source: Synthetic or recorded frames of CPUFrameSource, delivered at the frame rate of the camera settings
+// Like egl_render, a camera thread fills the requested buffer with the next frame of the running camera, frames which were not requested in time are dropped
+class MockOMXFrameSource : public FrameSource
+{
+    public:
+        MockOMXFrameSource(std::string path, int frameFormat, int settleFrames);
+
+        bool setup(int width, int height);
+        void acquire(Frame* frame);
+        bool poll(Frame* frame);
+        void release();
+        void setFrameEvent(FrameEvent* event);
+        void setCameraSettings(const CameraSettings* settings);
+        bool settled();
+        bool failed();
+        void teardown();
+
+        // Hand buffer to the camera thread, called with cameraMutex locked
+        void requestFrame();
+
+        // Camera thread: Fill requested buffers until teardown
+        void processFrames();
+
+        // Frames of the camera are generated by the CPU source, only while the buffer is requested
+        CPUFrameSource cpuSource;
+
+        // Capture time of the next camera frame, frame rate 0 fills requested buffers without waiting, read atomically
+        int framerate;
+        struct timespec nextFrameTimespec;
+
+        // Requested buffer and its frame, protected by cameraMutex
+        // Camera is settled after settleFrames filled buffers of each setup
+        bool frameRequested;
+        struct timespec requestedTimespec;
+        bool frameFilled;
+        Frame filledFrame;
+        int filledCount;
+        int settleFrames;
+
+        // Camera thread, signals frameEvent after each filled buffer like the FillBufferDone callback
+        pthread_t cameraThread;
+        pthread_mutex_t cameraMutex;
+        pthread_cond_t cameraCondition;
+        bool stopping;
+        FrameEvent* frameEvent;
+};
+
+// Encoder: Emulates image_encode, a component thread reads and compresses the submitted buffers in order
+// EmptyBufferDone and FillBufferDone are signalled like by the OMX callbacks, not before the time of the given throughput
+// Compression uses libjpeg, completion is later than the emulated time if libjpeg is slower
+// Like image_encode, the encoder fails if a frame is not finished within OMX_ENCODE_TIMEOUT_MS
+class MockOMXFrameEncoder : public FrameEncoder
+{
+    public:
+        MockOMXFrameEncoder(int bufferCount, int frameFormat, double inputMegapixelsPerSecond, double encodeMegapixelsPerSecond, unsigned int stallBuffers);
+
+        bool setup(int width, int height);
+        void getInputFrame(Frame* frame);
+        void encode(const Frame* input, EncodedFrame* output);
+        bool flush(EncodedFrame* output);
+        bool collect(EncodedFrame* output);
+        void setFrameEvent(FrameEvent* event);
+        void setQuality(int quality);
+        void setBufferCount(int bufferCount);
+        bool failed();
+        void teardown();
+
+        // Set output to the finished frame of slot
+        void collectSlot(int slot, EncodedFrame* output);
+
+        // Wait with componentMutex locked until the oldest frame in flight is finished, returns false if the deadline is missed
+        bool waitOldestFinished();
+
+        // Component thread: Process submitted buffers until teardown
+        void processBuffers();
+
+        int width;
+        int height;
+        int frameFormat;
+        int quality;
+        double inputMegapixelsPerSecond;
+        double encodeMegapixelsPerSecond;
+
+        // Fault injection: Component thread stops processing after stallBuffers buffers of each setup (0 never), deadline is missed afterwards
+        unsigned int stallBuffers;
+        bool componentFailed;
+
+        // Ring of buffers, slot of a frame is its submit number modulo bufferCount
+        // Counters are protected by componentMutex, done counters and times are written by the component thread
+        int bufferCount;
+        unsigned int submittedCount;
+        unsigned int collectedCount;
+        unsigned int emptyBufferDoneCount;
+        unsigned int fillBufferDoneCount;
+        Frame* submittedFrames;
+        int* submittedQualities;
+        struct timespec* submittedTimespecs;
+        struct timespec* emptyBufferDoneTimespecs;
+        struct timespec* fillBufferDoneTimespecs;
+        unsigned char** inputBuffers;
+        unsigned char** outputBuffers;
+        size_t* outputBufferSizes;
+        size_t* outputLengths;
+
+        // Component thread, compresses with a synchronous CPU encoder (one buffer), exits if stopping is set
+        // Signals frameEvent after each FillBufferDone
+        CPUFrameEncoder* compressor;
+        pthread_t componentThread;
+        pthread_mutex_t componentMutex;
+        pthread_cond_t componentCondition;
+        bool stopping;
+        FrameEvent* frameEvent;
+};
+
+/* #####################################
+BENCHMARK
+##################################### */
+
+// Publisher: Counts frames and bytes written by the target publisher
+class CountingFramePublisher : public FramePublisher
+{
+    public:
+        CountingFramePublisher(FramePublisher* target);
+
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+
+        FramePublisher* target;
+
+        // Changed by the thread which publishes, read atomically
+        unsigned int publishedCount;
+        unsigned long long publishedBytes;
+};
+
+// Settings of one benchmark run
+typedef struct
+{
+    int                 backend;
+    int                 width;
+    int                 height;
+    int                 bufferCount;
+    int                 quality;
+    int                 pipelineMode;
+} BenchRun;
+
+// Settings of the sweep, all combinations of backends, resolutions, buffer counts and qualities are run
+typedef struct
+{
+    std::vector<int>    backends;
+    std::vector<int>    widths;
+    std::vector<int>    heights;
+    std::vector<int>    bufferCounts;
+    std::vector<int>    qualities;
+    std::vector<int>    pipelineModes;
+    int                 frames;
+    int                 warmupFrames;
+    std::string         inputPath;
+    std::string         outputDirectory;
+    int                 framerate;
+    int                 refreshSeconds;
+    double              omxInputMegapixelsPerSecond;
+    double              omxEncodeMegapixelsPerSecond;
+    int                 omxStallBuffers;
+    int                 omxSettleFrames;
+} BenchSettings;
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of MockOMXFrameSource
+void* MockOMXFrameSourceThread(void* source);
+
+// Thread function of MockOMXFrameEncoder
+void* MockOMXFrameEncoderThread(void* encoder);
+
+// Add nanoseconds to timespec
+void addTimespecNanoseconds(struct timespec* timespec, long long nanoseconds);
+
+// Sleep until monotonic time, returns at once if it is over
+void sleepUntilTimespec(const struct timespec* timespec);
+
+// Parse comma separated list of integers, returns false if it is empty or invalid
+bool parseIntegerList(const std::string& text, std::vector<int>* values);
+
+// Parse arguments (--<name> <value>), returns false if they are invalid
+bool parseBenchArguments(int argc, char* argv[], BenchSettings* settings);
+
+// Run benchmark in a child process, stages are never torn down and each run starts with a clean process
+// Returns JSON object of the run, object with an error if the run did not finish
+std::string runBenchProcess(const BenchSettings* settings, const BenchRun* run);
+
+// Child process: Setup pipeline with the stages of the run, drive the update loop and return its results as JSON object
+std::string runBench(const BenchSettings* settings, const BenchRun* run);
+
+// Value of a "<name>: <value> kB" line of /proc/self/status, 0 if it does not exist
+long readProcessStatusKilobytes(const char* name);
@@ -0,0 +1,494 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-control.h"
+
+// Camera setting which can be changed with the control socket
+typedef struct
+{
+    const char* key;
+    size_t offset;
+    int minimum;
+    int maximum;
+} ControlCameraSetting;
+
+// Keys, offsets in CameraSettings and allowed values (see visicamRPiGPU-settings.h)
+static const ControlCameraSetting controlCameraSettings[] =
+{
+    { "sharpness",              offsetof(CameraSettings, sharpness),                -100,   100 },
+    { "contrast",               offsetof(CameraSettings, contrast),                 -100,   100 },
+    { "brightness",             offsetof(CameraSettings, brightness),               0,      100 },
+    { "saturation",             offsetof(CameraSettings, saturation),               -100,   100 },
+    { "iso",                    offsetof(CameraSettings, iso),                      100,    800 },
+    { "iso_auto",               offsetof(CameraSettings, isoAuto),                  0,      1 },
+    { "exposure_compensation",  offsetof(CameraSettings, exposureCompensation),     -24,    24 },
+    { "shutter_speed",          offsetof(CameraSettings, shutterSpeed),             1,      6000000 },
+    { "shutter_speed_auto",     offsetof(CameraSettings, shutterSpeedAuto),         0,      1 },
+    { "exposure",               offsetof(CameraSettings, exposure),                 0,      0x7FFFFFFF },
+    { "metering",               offsetof(CameraSettings, metering),                 0,      0x7FFFFFFF },
+    { "white_balance",          offsetof(CameraSettings, whiteBalance),             0,      0x7FFFFFFF },
+    { "white_balance_red_gain", offsetof(CameraSettings, whiteBalanceRedGain),      0,      8000 },
+    { "white_balance_blue_gain",offsetof(CameraSettings, whiteBalanceBlueGain),     0,      8000 },
+    { "roi_top",                offsetof(CameraSettings, roiTop),                   0,      100 },
+    { "roi_left",               offsetof(CameraSettings, roiLeft),                  0,      100 },
+    { "roi_width",              offsetof(CameraSettings, roiWidth),                 0,      100 },
+    { "roi_height",             offsetof(CameraSettings, roiHeight),                0,      100 },
+    { "framerate",              offsetof(CameraSettings, framerate),                1,      90 },
+    { "drc",                    offsetof(CameraSettings, drc),                      0,      3 }
+};
+
+#define CONTROL_CAMERA_SETTING_COUNT            (sizeof(controlCameraSettings) / sizeof(ControlCameraSetting))
+
+/* #####################################
+CONTROL SOCKET
+##################################### */
+
+ControlServer::ControlServer(std::string path)
+{
+    this->path = path;
+    frameTrigger = NULL;
+    serverSocket = -1;
+    commandPending = false;
+    responseReady = false;
+}
+
+// Create socket, a socket file of a previous run is replaced
+bool ControlServer::setup()
+{
+    struct sockaddr_un serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(serverAddress.sun_path))
+    {
+        return false;
+    }
+
+    strcpy(serverAddress.sun_path, path.c_str());
+
+    serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (serverSocket == -1)
+    {
+        return false;
+    }
+
+    unlink(path.c_str());
+
+    // Permissions are set before listen, no client can connect with the ones of the umask in between
+    if (bind(serverSocket, (struct sockaddr*)(&serverAddress), sizeof(serverAddress)) == -1
+        || chmod(path.c_str(), CONTROL_SOCKET_MODE) == -1
+        || listen(serverSocket, 4) == -1)
+    {
+        close(serverSocket);
+        serverSocket = -1;
+        return false;
+    }
+
+    pthread_mutex_init(&commandMutex, NULL);
+    monotonicConditionInit(&commandCondition);
+
+    if (pthread_create(&serverThread, NULL, ControlServerThread, this))
+    {
+        close(serverSocket);
+        serverSocket = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// Render thread: Execute pending command, server thread waits for the response
+void ControlServer::processCommands(Pipeline* pipeline)
+{
+    pthread_mutex_lock(&commandMutex);
+
+    if (commandPending)
+    {
+        commandResponse = executeCommand(pipeline, pendingCommand);
+        commandPending = false;
+        responseReady = true;
+        pthread_cond_broadcast(&commandCondition);
+    }
+
+    pthread_mutex_unlock(&commandMutex);
+}
+
+// Render thread: Parse and execute one command
+std::string ControlServer::executeCommand(Pipeline* pipeline, const std::string& command)
+{
+    std::istringstream input(command);
+    std::string name;
+    std::string key;
+    input >> name >> key;
+
+    std::ostringstream output;
+
+    if (name == "get")
+    {
+        output << "ok";
+
+        if (!controlGetSettings(pipeline, key, output))
+        {
+            return "error unknown key " + key;
+        }
+    }
+    else if (name == "set")
+    {
+        // Value is the rest of the line, homography has 9 values
+        std::string value;
+        std::getline(input, value);
+        size_t valueStart = value.find_first_not_of(" \t");
+        value = (valueStart == std::string::npos ? "" : value.substr(valueStart));
+
+        std::string error = controlSetSetting(pipeline, key, value);
+
+        if (!error.empty())
+        {
+            return "error " + error;
+        }
+
+        output << "ok";
+        controlGetSettings(pipeline, key, output);
+    }
+    else if (name == "stats")
+    {
+        struct timespec currentTimespec;
+        clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
+
+        output << "ok frames=" << pipeline->frameCount
+            << " published=" << pipeline->publishedFrameCount
+            << " skipped=" << pipeline->skippedFrameCount
+            << " processed_quality=" << pipeline->processedQualityController.quality
+            << " triggered=" << pipeline->triggeredFrameCount
+            << " trigger_latency_ms=" << pipeline->triggerLatencySeconds * 1000.0
+            << " recoveries=" << pipeline->recoveryCount
+            << " recovery_downtime_ms=" << pipeline->recoveryDowntimeSeconds * 1000.0
+            << " first_frame_ms=" << pipeline->firstFrameSeconds * 1000.0
+            << " settled_frame_ms=" << pipeline->settledFrameSeconds * 1000.0
+            << " uptime=" << (currentTimespec.tv_sec - pipeline->startTimespec.tv_sec)
+            << " fps=" << (pipeline->frameIntervalAverage > 0.0 ? 1.0 / pipeline->frameIntervalAverage : 0.0);
+    }
+    else if (name == "latency")
+    {
+        output << "ok" << latencyStats.formatSummary();
+    }
+    else
+    {
+        return "error unknown command " + name;
+    }
+
+    return output.str();
+}
+
+// Server thread: Handle clients one after another, each line is one command
+void ControlServer::serveConnections()
+{
+    while (true)
+    {
+        int clientSocket = accept(serverSocket, NULL, NULL);
+
+        if (clientSocket == -1)
+        {
+            continue;
+        }
+
+        // Idle clients are disconnected, other clients are waiting meanwhile
+        struct timeval socketTimeout;
+        socketTimeout.tv_sec = 10;
+        socketTimeout.tv_usec = 0;
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &socketTimeout, sizeof(socketTimeout));
+        setsockopt(clientSocket, SOL_SOCKET, SO_SNDTIMEO, &socketTimeout, sizeof(socketTimeout));
+
+        std::string received;
+        char buffer[512];
+        bool connected = true;
+
+        while (connected)
+        {
+            ssize_t length = recv(clientSocket, buffer, sizeof(buffer), 0);
+
+            if (length <= 0)
+            {
+                break;
+            }
+
+            received.append(buffer, length);
+
+            // Execute all complete lines
+            size_t lineEnd;
+
+            while (connected && (lineEnd = received.find('\n')) != std::string::npos)
+            {
+                std::string command = received.substr(0, lineEnd);
+                received.erase(0, lineEnd + 1);
+
+                if (!command.empty() && command[command.size() - 1] == '\r')
+                {
+                    command.erase(command.size() - 1);
+                }
+
+                if (command.empty())
+                {
+                    continue;
+                }
+
+                // Trigger waits for the frame, render thread is not blocked meanwhile
+                std::string response = (command == "trigger" ? triggerFrame() : submitCommand(command)) + "\n";
+                connected = (send(clientSocket, response.c_str(), response.size(), MSG_NOSIGNAL) == (ssize_t)(response.size()));
+            }
+
+            // Protect against clients which never send a newline
+            if (received.size() > 4096)
+            {
+                break;
+            }
+        }
+
+        close(clientSocket);
+    }
+}
+
+// Server thread: Hand command to render thread and wait for its response
+std::string ControlServer::submitCommand(const std::string& command)
+{
+    struct timespec timeoutTimespec;
+    monotonicDeadline(&timeoutTimespec, 5000);
+
+    std::string response;
+
+    pthread_mutex_lock(&commandMutex);
+
+    pendingCommand = command;
+    commandPending = true;
+    responseReady = false;
+
+    while (!responseReady)
+    {
+        if (pthread_cond_timedwait(&commandCondition, &commandMutex, &timeoutTimespec) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    if (responseReady)
+    {
+        response = commandResponse;
+    }
+    else
+    {
+        commandPending = false;
+        response = "error pipeline does not respond";
+    }
+
+    pthread_mutex_unlock(&commandMutex);
+
+    return response;
+}
+
+// Server thread: Response contains the latency of the published frame
+std::string ControlServer::triggerFrame()
+{
+    if (!frameTrigger)
+    {
+        return "error trigger mode is disabled";
+    }
+
+    double latencySeconds = 0.0;
+
+    if (!frameTrigger->waitCompleted(frameTrigger->request(), 5, &latencySeconds))
+    {
+        return "error pipeline does not respond";
+    }
+
+    std::ostringstream output;
+    output << "ok latency_ms=" << latencySeconds * 1000.0;
+    return output.str();
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of ControlServer
+void* ControlServerThread(void* server)
+{
+    ((ControlServer*)(server))->serveConnections();
+    return NULL;
+}
+
+// Write all settings (empty key) or one setting as key=value pairs, returns false for unknown keys
+bool controlGetSettings(Pipeline* pipeline, const std::string& key, std::ostringstream& output)
+{
+    bool found = false;
+
+    if (key.empty() || key == "quality")
+    {
+        output << " quality=" << pipeline->jpegQuality;
+        found = true;
+    }
+
+    if (key.empty() || key == "refresh")
+    {
+        output << " refresh=" << pipeline->refreshTimeSeconds;
+        found = true;
+    }
+
+    if (key.empty() || key == "homography")
+    {
+        output << " homography=";
+
+        for (int i = 0; i < 9; i++)
+        {
+            output << (i > 0 ? "," : "") << pipeline->homographyInputMatrixValues[i];
+        }
+
+        found = true;
+    }
+
+    if (key.empty() || key == "processed_path")
+    {
+        output << " processed_path=" << pipeline->processedOutputPath;
+        found = true;
+    }
+
+    if (key.empty() || key == "captured_path")
+    {
+        output << " captured_path=" << pipeline->capturedOutputPath;
+        found = true;
+    }
+
+    for (size_t i = 0; i < CONTROL_CAMERA_SETTING_COUNT; i++)
+    {
+        if (key.empty() || key == controlCameraSettings[i].key)
+        {
+            output << " " << controlCameraSettings[i].key << "=" << *(int*)((char*)(&pipeline->cameraSettings) + controlCameraSettings[i].offset);
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+// Change one setting and hand it to the stages, returns error message or empty string
+std::string controlSetSetting(Pipeline* pipeline, const std::string& key, const std::string& value)
+{
+    if (value.empty())
+    {
+        return "missing value";
+    }
+
+    // Output paths: Only the file name changes, clients can not write files into other directories
+    if (key == "processed_path" || key == "captured_path")
+    {
+        std::string& outputPath = (key == "processed_path" ? pipeline->processedOutputPath : pipeline->capturedOutputPath);
+        std::string directory = outputPath.substr(0, outputPath.rfind('/') + 1);
+        std::string fileName = value.substr(value.rfind('/') + 1);
+
+        if (value.substr(0, value.size() - fileName.size()) != directory || fileName.empty() || fileName == "." || fileName == "..")
+        {
+            return "path must be a file in directory " + (directory.empty() ? std::string(".") : directory);
+        }
+
+        outputPath = value;
+        return "";
+    }
+
+    // Homography matrix: 9 values in openCV format (row by row), separated by commas or spaces
+    if (key == "homography")
+    {
+        std::string values = value;
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (values[i] == ',')
+            {
+                values[i] = ' ';
+            }
+        }
+
+        std::istringstream valuesInput(values);
+        float matrixValues[9];
+        int valuesCounter = 0;
+
+        while (valuesCounter < 9 && (valuesInput >> matrixValues[valuesCounter]))
+        {
+            valuesCounter++;
+        }
+
+        std::string remaining;
+
+        if (valuesCounter != 9 || (valuesInput >> remaining))
+        {
+            return "homography needs 9 values";
+        }
+
+        memcpy(pipeline->homographyInputMatrixValues, matrixValues, sizeof(matrixValues));
+        pipeline->applyHomography();
+        return "";
+    }
+
+    // All other settings are integers
+    char* valueEnd;
+    long integerValue = strtol(value.c_str(), &valueEnd, 0);
+
+    if (*valueEnd != '\0')
+    {
+        return "invalid value " + value;
+    }
+
+    if (key == "quality")
+    {
+        if (integerValue < 0 || integerValue > 100)
+        {
+            return "quality must be between 0 and 100";
+        }
+
+        pipeline->jpegQuality = integerValue;
+        pipeline->applyQuality();
+        return "";
+    }
+
+    if (key == "refresh")
+    {
+        if (integerValue <= 0)
+        {
+            return "refresh must be more than 0 seconds";
+        }
+
+        pipeline->refreshTimeSeconds = integerValue;
+        return "";
+    }
+
+    for (size_t i = 0; i < CONTROL_CAMERA_SETTING_COUNT; i++)
+    {
+        if (key == controlCameraSettings[i].key)
+        {
+            if (integerValue < controlCameraSettings[i].minimum || integerValue > controlCameraSettings[i].maximum)
+            {
+                std::ostringstream error;
+                error << key << " must be between " << controlCameraSettings[i].minimum << " and " << controlCameraSettings[i].maximum;
+                return error.str();
+            }
+
+            *(int*)((char*)(&pipeline->cameraSettings) + controlCameraSettings[i].offset) = integerValue;
+            pipeline->source->setCameraSettings(&pipeline->cameraSettings);
+            return "";
+        }
+    }
+
+    return "unknown key " + key;
+}
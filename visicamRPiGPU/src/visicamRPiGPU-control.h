@@ -0,0 +1,86 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU-latency.h"
+#include "visicamRPiGPU-pipeline.h"
+#include "visicamRPiGPU-trigger.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sstream>
+
+/* #####################################
+CONTROL SOCKET
+##################################### */
+
+// Line based protocol on a Unix domain stream socket, one response line for each request line
+// Requests:  get | get <key> | set <key> <value> | stats | latency | trigger
+// Responses: ok [<key>=<value> ...] | error <message>
+// Commands are executed by the render thread at the next frame boundary, stages are never restarted
+class ControlServer
+{
+    public:
+        ControlServer(std::string path);
+
+        // Create socket and start server thread, returns false if the socket can not be created
+        bool setup();
+
+        // Render thread: Execute pending command at frame boundary
+        void processCommands(Pipeline* pipeline);
+
+        // Render thread: Execute one command and return response line
+        std::string executeCommand(Pipeline* pipeline, const std::string& command);
+
+        // Server thread: Accept clients and pass their commands to the render thread
+        void serveConnections();
+        std::string submitCommand(const std::string& command);
+
+        // Server thread: Request a frame in trigger mode and wait until it is published
+        std::string triggerFrame();
+
+        std::string path;
+
+        // Trigger of trigger mode, NULL if it is disabled
+        FrameTrigger* frameTrigger;
+        int serverSocket;
+        pthread_t serverThread;
+
+        // Command handed from server thread to render thread, protected by commandMutex
+        pthread_mutex_t commandMutex;
+        pthread_cond_t commandCondition;
+        std::string pendingCommand;
+        std::string commandResponse;
+        bool commandPending;
+        bool responseReady;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of ControlServer
+void* ControlServerThread(void* server);
+
+// Write all settings or one setting as key=value pairs, returns false for unknown keys
+bool controlGetSettings(Pipeline* pipeline, const std::string& key, std::ostringstream& output);
+
+// Change one setting, returns error message or empty string
+std::string controlSetSetting(Pipeline* pipeline, const std::string& key, const std::string& value);
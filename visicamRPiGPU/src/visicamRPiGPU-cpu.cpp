@@ -0,0 +1,906 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-cpu.h"
+
+/* #####################################
+CPU BACKEND
+##################################### */
+
+CPUFrameSource::CPUFrameSource(std::string path, int frameFormat)
+{
+    inputPath = path;
+    this->frameFormat = frameFormat;
+    width = 0;
+    height = 0;
+    frameCounter = 0;
+    pixelBuffer = NULL;
+}
+
+// Allocate frame memory, decode input file once if it is set
+bool CPUFrameSource::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    // Allocate buffer for frame pixels and empty buffer
+    pixelBuffer = (unsigned char*)(malloc(frameBytes(width, height, frameFormat)));
+    memset(pixelBuffer, 0, frameBytes(width, height, frameFormat));
+
+    // Synthetic test frames are generated in acquire
+    if (inputPath.empty())
+    {
+        return true;
+    }
+
+    FILE* inputFile = fopen(inputPath.c_str(), "rb");
+
+    if (!inputFile)
+    {
+        printf("CPU Error: Open source input file %s - EXITING APPLICATION\n", inputPath.c_str());
+        kill(getpid(), SIGKILL);
+    }
+
+    // Decode JPEG to RGB, or to YCbCr for planar frames
+    struct jpeg_decompress_struct jpegDecompress;
+    struct jpeg_error_mgr jpegDecompressError;
+    jpegDecompress.err = jpeg_std_error(&jpegDecompressError);
+    jpegDecompressError.error_exit = jpegErrorExit;
+    jpeg_create_decompress(&jpegDecompress);
+    jpeg_stdio_src(&jpegDecompress, inputFile);
+    jpeg_read_header(&jpegDecompress, TRUE);
+    jpegDecompress.out_color_space = (frameFormat == FRAME_FORMAT_YUV420 ? JCS_YCbCr : JCS_RGB);
+    jpeg_start_decompress(&jpegDecompress);
+
+    int inputWidth = jpegDecompress.output_width;
+    int inputHeight = jpegDecompress.output_height;
+    unsigned char* inputBuffer = (unsigned char*)(malloc(3 * inputWidth * inputHeight));
+
+    while (jpegDecompress.output_scanline < jpegDecompress.output_height)
+    {
+        JSAMPROW inputRow = inputBuffer + 3 * inputWidth * jpegDecompress.output_scanline;
+        jpeg_read_scanlines(&jpegDecompress, &inputRow, 1);
+    }
+
+    jpeg_finish_decompress(&jpegDecompress);
+    jpeg_destroy_decompress(&jpegDecompress);
+    fclose(inputFile);
+
+    // Scale to frame resolution (nearest neighbour), chroma planes average 2 x 2 pixels
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            unsigned char* inputRow = inputBuffer + 3 * inputWidth * ((y * inputHeight) / height);
+
+            for (int x = 0; x < width; x++)
+            {
+                pixelBuffer[width * y + x] = inputRow[3 * ((x * inputWidth) / width)];
+            }
+        }
+
+        for (int y = 0; y < height / 2; y++)
+        {
+            unsigned char* inputRows[2];
+            inputRows[0] = inputBuffer + 3 * inputWidth * ((2 * y * inputHeight) / height);
+            inputRows[1] = inputBuffer + 3 * inputWidth * (((2 * y + 1) * inputHeight) / height);
+
+            for (int x = 0; x < width / 2; x++)
+            {
+                int inputLeft = 3 * ((2 * x * inputWidth) / width);
+                int inputRight = 3 * (((2 * x + 1) * inputWidth) / width);
+
+                for (int plane = 1; plane < 3; plane++)
+                {
+                    int sum = inputRows[0][inputLeft + plane] + inputRows[0][inputRight + plane] + inputRows[1][inputLeft + plane] + inputRows[1][inputRight + plane];
+                    framePlane(pixelBuffer, width, height, plane)[(width / 2) * y + x] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+
+        free(inputBuffer);
+        return true;
+    }
+
+    // Expand to RGBA
+    for (int y = 0; y < height; y++)
+    {
+        unsigned char* inputRow = inputBuffer + 3 * inputWidth * ((y * inputHeight) / height);
+        unsigned char* outputRow = pixelBuffer + 4 * width * y;
+
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char* inputPixel = inputRow + 3 * ((x * inputWidth) / width);
+            outputRow[4 * x + 0] = inputPixel[0];
+            outputRow[4 * x + 1] = inputPixel[1];
+            outputRow[4 * x + 2] = inputPixel[2];
+            outputRow[4 * x + 3] = 255;
+        }
+    }
+
+    free(inputBuffer);
+
+    return true;
+}
+
+// Deliver next frame, synthetic frames change with every call
+void CPUFrameSource::acquire(Frame* frame)
+{
+    // Frame is requested and generated in this call
+    clock_gettime(CLOCK_MONOTONIC, &frame->requestTimespec);
+
+    if (inputPath.empty())
+    {
+        // Checkerboard with a moving vertical bar, deterministic for each frame number
+        int barPosition = (frameCounter * 8) % width;
+
+        for (int y = 0; y < height; y++)
+        {
+            unsigned char* outputRow = pixelBuffer + (frameFormat == FRAME_FORMAT_YUV420 ? width : 4 * width) * y;
+
+            for (int x = 0; x < width; x++)
+            {
+                bool checker = (((x / 40) + (y / 40)) & 1);
+                bool bar = (x >= barPosition && x < barPosition + 16);
+                unsigned char pixel[4];
+                pixel[0] = (bar ? 255 : (checker ? 200 : 40));
+                pixel[1] = (unsigned char)((255 * y) / height);
+                pixel[2] = (unsigned char)((255 * x) / width);
+                pixel[3] = 255;
+
+                if (frameFormat != FRAME_FORMAT_YUV420)
+                {
+                    memcpy(outputRow + 4 * x, pixel, 4);
+                    continue;
+                }
+
+                // Planar frames: Chroma of the top left pixel of each 2 x 2 block
+                unsigned char ycbcr[3];
+                convertRGBToYCbCr(pixel, ycbcr);
+                outputRow[x] = ycbcr[0];
+
+                if (!(x & 1) && !(y & 1))
+                {
+                    framePlane(pixelBuffer, width, height, 1)[(width / 2) * (y / 2) + x / 2] = ycbcr[1];
+                    framePlane(pixelBuffer, width, height, 2)[(width / 2) * (y / 2) + x / 2] = ycbcr[2];
+                }
+            }
+        }
+    }
+
+    frameCounter++;
+
+    frame->data = pixelBuffer;
+    frame->handle = NULL;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = (frameFormat == FRAME_FORMAT_YUV420 ? width : 4 * width);
+    frame->format = frameFormat;
+    frame->original = false;
+    frame->offsetX = 0;
+    frame->offsetY = 0;
+    clock_gettime(CLOCK_MONOTONIC, &frame->captureTimespec);
+}
+
+// Frames are generated on demand, the next one is always ready
+bool CPUFrameSource::poll(Frame* frame)
+{
+    acquire(frame);
+    return true;
+}
+
+// Pixel buffer is only written by acquire
+void CPUFrameSource::release()
+{
+}
+
+// Never waits, nothing to signal
+void CPUFrameSource::setFrameEvent(FrameEvent*)
+{
+}
+
+// Test frames do not depend on camera settings
+void CPUFrameSource::setCameraSettings(const CameraSettings*)
+{
+}
+
+// Frames of the file or test pattern need no camera adjustments
+bool CPUFrameSource::settled()
+{
+    return true;
+}
+
+// Frames are generated or decoded in memory, there are no deadlines
+bool CPUFrameSource::failed()
+{
+    return false;
+}
+
+// Free frame memory, input file is decoded again by the next setup
+void CPUFrameSource::teardown()
+{
+    free(pixelBuffer);
+    pixelBuffer = NULL;
+}
+
+// Allocate warped output memory, start with identity matrix
+CPUFrameWarper::CPUFrameWarper(int threadCount, int frameFormat)
+{
+    this->threadCount = threadCount;
+    this->frameFormat = frameFormat;
+    width = 0;
+    height = 0;
+    warpedBuffer = NULL;
+}
+
+void CPUFrameWarper::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    // Allocate buffer for warped pixels and empty buffer
+    warpedBuffer = (unsigned char*)(malloc(frameBytes(width, height, frameFormat)));
+    memset(warpedBuffer, 0, frameBytes(width, height, frameFormat));
+    warpedRegion.x = 0;
+    warpedRegion.y = 0;
+    warpedRegion.width = width;
+    warpedRegion.height = height;
+
+    float identity[9] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    setHomography(identity);
+
+    // Start warp threads (only once) and remap table builders, chroma planes have a quarter of the pixels
+    if (!threadPool.workerThreads)
+    {
+        threadPool.setup(threadCount);
+    }
+
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        remapCache.setup(width, height, (CPU_WARP_REMAP_MAX_BYTES * 4) / 5);
+        chromaRemapCache.setup(width / 2, height / 2, CPU_WARP_REMAP_MAX_BYTES / 5);
+    }
+    else
+    {
+        remapCache.setup(width, height, CPU_WARP_REMAP_MAX_BYTES);
+    }
+
+    // Initialize throughput measurement
+    measuredFrameCount = 0;
+    measuredPixels = 0.0;
+    measuredSeconds = 0.0;
+}
+
+// Homography maps input to output coordinates, warping needs the inverse mapping
+void CPUFrameWarper::setHomography(const float* values)
+{
+    double matrix[9];
+
+    for (int i = 0; i < 9; i++)
+    {
+        matrix[i] = values[i];
+    }
+
+    // Singular matrix can not be drawn by the GL backend either, output stays black
+    inverseValid = invertMatrix3x3(matrix, inverseMatrix);
+}
+
+// Inverse mapping of each output pixel center into the input frame, split into bands for the warp threads
+// Pixels outside of the input frame stay black, like the background of the GL backend
+void CPUFrameWarper::warp(const Frame* input, const FrameRegion* region)
+{
+    struct timespec startTimespec;
+    struct timespec endTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+    warpedRegion = *region;
+
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        // Black is Y = 0 and neutral chroma
+        const unsigned char blackLuma[4] = { 0, 0, 0, 0 };
+        const unsigned char blackChroma[4] = { 128, 128, 128, 128 };
+
+        warpPlane(input->data, input->stride, warpedBuffer, width, 1, region, blackLuma, &remapCache);
+
+        for (int plane = 1; plane < 3; plane++)
+        {
+            warpPlane(framePlane(input->data, input->stride, input->height, plane), input->stride / 2,
+                framePlane(warpedBuffer, width, height, plane), width / 2, 2, region, blackChroma, &chromaRemapCache);
+        }
+    }
+    else
+    {
+        // Black is R, G, B, A in memory
+        const unsigned char blackPixel[4] = { 0, 0, 0, 255 };
+
+        warpPlane(input->data, input->stride, warpedBuffer, 4 * width, 1, region, blackPixel, &remapCache);
+    }
+
+    // Report throughput once after CPU_WARP_REPORT_FRAMES frames
+    clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+    measuredSeconds += (endTimespec.tv_sec - startTimespec.tv_sec) + (endTimespec.tv_nsec - startTimespec.tv_nsec) / 1000000000.0;
+    measuredPixels += (double)(region->width) * region->height;
+    measuredFrameCount++;
+
+    if (measuredFrameCount == CPU_WARP_REPORT_FRAMES)
+    {
+        printf("CPU warp: %s kernel, %d threads, %s, %.1f MP/s\n", WARP_KERNEL_NAME, threadPool.threadCount,
+            (frameFormat == FRAME_FORMAT_YUV420 ? "YUV420" : "RGBA"), measuredPixels / measuredSeconds / 1000000.0);
+    }
+}
+
+// Plane coordinates are output frame coordinates divided by scale, the region is warped to its position in the full frame
+void CPUFrameWarper::warpPlane(const unsigned char* input, int inputStride, unsigned char* output, int outputStride, int scale,
+    const FrameRegion* region, const unsigned char* blackPixel, WarpRemapCache* cache)
+{
+    int bytesPerPixel = (frameFormat == FRAME_FORMAT_YUV420 ? 1 : 4);
+    int regionX = region->x / scale;
+    int regionY = region->y / scale;
+
+    WarpJob job;
+    job.bytesPerPixel = bytesPerPixel;
+    memcpy(job.blackPixel, blackPixel, sizeof(job.blackPixel));
+    job.input = input;
+    job.inputWidth = width / scale;
+    job.inputHeight = height / scale;
+    job.inputStride = inputStride;
+    job.output = output + outputStride * regionY + bytesPerPixel * regionX;
+    job.outputWidth = region->width / scale;
+    job.outputHeight = region->height / scale;
+    job.outputStride = outputStride;
+    job.inverseValid = inverseValid;
+    job.remapOutput = NULL;
+
+    // Scaled inverse: S * inverse * S^-1 with S = diag(1 / scale, 1 / scale, 1), then translated by region offset
+    memcpy(job.inverseMatrix, inverseMatrix, sizeof(inverseMatrix));
+    job.inverseMatrix[2] /= scale;
+    job.inverseMatrix[5] /= scale;
+    job.inverseMatrix[6] *= scale;
+    job.inverseMatrix[7] *= scale;
+    job.inverseMatrix[2] += job.inverseMatrix[0] * regionX + job.inverseMatrix[1] * regionY;
+    job.inverseMatrix[5] += job.inverseMatrix[3] * regionX + job.inverseMatrix[4] * regionY;
+    job.inverseMatrix[8] += job.inverseMatrix[6] * regionX + job.inverseMatrix[7] * regionY;
+
+    // Use remap table once it is built for this homography, compute mapping until then
+    job.remapTable = cache->getTable(&job);
+
+    threadPool.run(&job);
+}
+
+// Frames are already in CPU memory, just copy the region rows of each plane
+void CPUFrameWarper::readback(const Frame* input, bool original, Frame* output)
+{
+    const unsigned char* pixels = (original ? input->data : warpedBuffer);
+    int stride = (original ? input->stride : (frameFormat == FRAME_FORMAT_YUV420 ? width : 4 * width));
+
+    if (frameFormat != FRAME_FORMAT_YUV420)
+    {
+        for (int y = 0; y < output->height; y++)
+        {
+            memcpy(output->data + output->stride * y, pixels + stride * (output->offsetY + y) + 4 * output->offsetX, 4 * output->width);
+        }
+
+        return;
+    }
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int scale = (plane == 0 ? 1 : 2);
+        const unsigned char* inputPlane = framePlane((unsigned char*)(pixels), stride, height, plane);
+        unsigned char* outputPlane = framePlane(output->data, output->stride, output->height, plane);
+
+        for (int y = 0; y < output->height / scale; y++)
+        {
+            memcpy(outputPlane + (output->stride / scale) * y, inputPlane + (stride / scale) * (output->offsetY / scale + y) + output->offsetX / scale, output->width / scale);
+        }
+    }
+}
+
+// Average of the 2 x 2 pixels at the center of each sample area, like bilinear filtering of the GL backend
+// Luma of RGBA pixels with the weights of JFIF, Y plane of YUV420 frames is used directly
+void CPUFrameWarper::sampleLuma(const Frame*, int sampleWidth, int sampleHeight, unsigned char* output)
+{
+    for (int y = 0; y < sampleHeight; y++)
+    {
+        int frameY = ((2 * y + 1) * height) / (2 * sampleHeight) - 1;
+        frameY = (frameY < 0 ? 0 : (frameY > height - 2 ? height - 2 : frameY));
+
+        for (int x = 0; x < sampleWidth; x++)
+        {
+            int frameX = ((2 * x + 1) * width) / (2 * sampleWidth) - 1;
+            frameX = (frameX < 0 ? 0 : (frameX > width - 2 ? width - 2 : frameX));
+            int sum = 0;
+
+            for (int i = 0; i < 4; i++)
+            {
+                int pixelX = frameX + (i & 1);
+                int pixelY = frameY + (i >> 1);
+
+                // Pixels outside of the region of the last warp are black
+                if (pixelX < warpedRegion.x || pixelX >= warpedRegion.x + warpedRegion.width
+                    || pixelY < warpedRegion.y || pixelY >= warpedRegion.y + warpedRegion.height)
+                {
+                    continue;
+                }
+
+                if (frameFormat == FRAME_FORMAT_YUV420)
+                {
+                    sum += warpedBuffer[width * pixelY + pixelX];
+                }
+                else
+                {
+                    const unsigned char* pixel = warpedBuffer + 4 * (width * pixelY + pixelX);
+                    sum += (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2]) >> 8;
+                }
+            }
+
+            output[sampleWidth * y + x] = (unsigned char)((sum + 2) / 4);
+        }
+    }
+}
+
+// Free warped memory and remap tables, warp threads keep waiting for the next job
+void CPUFrameWarper::teardown()
+{
+    remapCache.teardown();
+    chromaRemapCache.teardown();
+    free(warpedBuffer);
+    warpedBuffer = NULL;
+}
+
+CPUFrameEncoder::CPUFrameEncoder(int bufferCount, int frameFormat)
+{
+    this->bufferCount = bufferCount;
+    this->frameFormat = frameFormat;
+    submittedCount = 0;
+    encodedCount = 0;
+    collectedCount = 0;
+    quality = 100;
+    stopping = false;
+    frameEvent = NULL;
+}
+
+// Allocate input and output buffers, configure JPEG settings, start encoding thread
+bool CPUFrameEncoder::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    // Check buffer count
+    if (bufferCount < 1)
+    {
+        printf("CPU Error: Encoder needs at least one buffer - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    // Allocate ring of buffers and information about submitted frames
+    submittedFrames = (Frame*)(malloc(bufferCount * sizeof(Frame)));
+    memset(submittedFrames, 0, bufferCount * sizeof(Frame));
+    inputBuffers = (unsigned char**)(malloc(bufferCount * sizeof(unsigned char*)));
+    outputBuffers = (unsigned char**)(malloc(bufferCount * sizeof(unsigned char*)));
+    outputBufferSizes = (unsigned long*)(malloc(bufferCount * sizeof(unsigned long)));
+    outputLengths = (unsigned long*)(malloc(bufferCount * sizeof(unsigned long)));
+    submittedQualities = (int*)(malloc(bufferCount * sizeof(int)));
+    submittedTimespecs = (struct timespec*)(calloc(bufferCount, sizeof(struct timespec)));
+    encodedTimespecs = (struct timespec*)(calloc(bufferCount, sizeof(struct timespec)));
+
+    for (int i = 0; i < bufferCount; i++)
+    {
+        // Allocate buffer for input pixels and empty buffer
+        inputBuffers[i] = (unsigned char*)(malloc(frameBytes(width, height, frameFormat)));
+        memset(inputBuffers[i], 0, frameBytes(width, height, frameFormat));
+
+        // Just allocate 2 * width * height bytes for output, libjpeg enlarges it if needed
+        outputBufferSizes[i] = 2 * width * height;
+        outputBuffers[i] = (unsigned char*)(malloc(outputBufferSizes[i]));
+        outputLengths[i] = 0;
+        submittedQualities[i] = quality;
+    }
+
+    // Setup compressor: Error handler, image size, color format, JPEG quality
+    jpegCompress.err = jpeg_std_error(&jpegError);
+    jpegError.error_exit = jpegErrorExit;
+    jpeg_create_compress(&jpegCompress);
+    jpegCompress.image_width = width;
+    jpegCompress.image_height = height;
+
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        // Planar frames are already downsampled, default sampling factors of YCbCr are 2 x 2, 1 x 1, 1 x 1
+        jpegCompress.input_components = 3;
+        jpegCompress.in_color_space = JCS_YCbCr;
+        jpeg_set_defaults(&jpegCompress);
+        jpegCompress.raw_data_in = TRUE;
+    }
+    else
+    {
+#ifdef JCS_EXTENSIONS
+        jpegCompress.input_components = 4;
+        jpegCompress.in_color_space = JCS_EXT_RGBA;
+#else
+        jpegCompress.input_components = 3;
+        jpegCompress.in_color_space = JCS_RGB;
+#endif
+        jpeg_set_defaults(&jpegCompress);
+    }
+
+    jpeg_set_quality(&jpegCompress, quality, TRUE);
+    appliedQuality = quality;
+
+    // Single buffer: Compress directly in encode, no thread needed
+    if (bufferCount == 1)
+    {
+        return true;
+    }
+
+    pthread_mutex_init(&encodeMutex, NULL);
+    pthread_cond_init(&encodeCondition, NULL);
+
+    if (pthread_create(&encodeThread, NULL, CPUFrameEncoderThread, this))
+    {
+        printf("CPU Error: Create encoding thread - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    return true;
+}
+
+// Input buffer of next slot, its previous frame was already collected
+void CPUFrameEncoder::getInputFrame(Frame* frame)
+{
+    frame->data = inputBuffers[submittedCount % bufferCount];
+    frame->handle = NULL;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = (frameFormat == FRAME_FORMAT_YUV420 ? width : 4 * width);
+    frame->format = frameFormat;
+    frame->original = false;
+    frame->offsetX = 0;
+    frame->offsetY = 0;
+}
+
+void CPUFrameEncoder::encode(const Frame* input, EncodedFrame* output)
+{
+    int slot = submittedCount % bufferCount;
+
+    // Remember information about submitted frame for output, quality is compressed with the frame
+    submittedFrames[slot] = *input;
+    submittedQualities[slot] = quality;
+    clock_gettime(CLOCK_MONOTONIC, &submittedTimespecs[slot]);
+
+    // Single buffer: Compress directly
+    if (bufferCount == 1)
+    {
+        encodeSlot(slot);
+        submittedCount++;
+        encodedCount++;
+        collectedCount++;
+        collectSlot(slot, output);
+        return;
+    }
+
+    // Hand frame to encoding thread
+    pthread_mutex_lock(&encodeMutex);
+    submittedCount++;
+    pthread_cond_broadcast(&encodeCondition);
+
+    // Nothing to return, if no frame is finished and there are still free buffers
+    output->data = NULL;
+    output->length = 0;
+    output->header = NULL;
+    output->headerLength = 0;
+    output->original = false;
+
+    if (encodedCount != collectedCount || (submittedCount - collectedCount) >= (unsigned int)(bufferCount))
+    {
+        // Wait until oldest frame is finished
+        while (encodedCount == collectedCount)
+        {
+            pthread_cond_wait(&encodeCondition, &encodeMutex);
+        }
+
+        int oldestSlot = collectedCount % bufferCount;
+        collectedCount++;
+        collectSlot(oldestSlot, output);
+    }
+
+    pthread_mutex_unlock(&encodeMutex);
+}
+
+bool CPUFrameEncoder::flush(EncodedFrame* output)
+{
+    // Counters are only changed by the pipeline and the encoding thread, frames in flight do not change without the pipeline
+    if (collectedCount == submittedCount)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&encodeMutex);
+
+    while (encodedCount == collectedCount)
+    {
+        pthread_cond_wait(&encodeCondition, &encodeMutex);
+    }
+
+    int oldestSlot = collectedCount % bufferCount;
+    collectedCount++;
+    collectSlot(oldestSlot, output);
+
+    pthread_mutex_unlock(&encodeMutex);
+
+    return true;
+}
+
+// Single buffer compresses in encode, frames are never in flight
+bool CPUFrameEncoder::collect(EncodedFrame* output)
+{
+    if (collectedCount == submittedCount)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&encodeMutex);
+    bool oldestFinished = (encodedCount != collectedCount);
+
+    if (oldestFinished)
+    {
+        int oldestSlot = collectedCount % bufferCount;
+        collectedCount++;
+        collectSlot(oldestSlot, output);
+    }
+
+    pthread_mutex_unlock(&encodeMutex);
+
+    return oldestFinished;
+}
+
+void CPUFrameEncoder::setFrameEvent(FrameEvent* event)
+{
+    frameEvent = event;
+}
+
+// Output of a finished slot with information of its submitted frame
+void CPUFrameEncoder::collectSlot(int slot, EncodedFrame* output)
+{
+    output->data = outputBuffers[slot];
+    output->length = outputLengths[slot];
+    output->header = NULL;
+    output->headerLength = 0;
+    output->original = submittedFrames[slot].original;
+    output->width = submittedFrames[slot].width;
+    output->height = submittedFrames[slot].height;
+    output->offsetX = submittedFrames[slot].offsetX;
+    output->offsetY = submittedFrames[slot].offsetY;
+    output->sequence = submittedFrames[slot].sequence;
+    output->captureTimespec = submittedFrames[slot].captureTimespec;
+    output->warpTimespec = submittedFrames[slot].warpTimespec;
+    output->encodedTimespec = encodedTimespecs[slot];
+    output->quality = submittedQualities[slot];
+    output->inputSeconds = -1.0;
+    output->encodeSeconds = elapsedSeconds(&submittedTimespecs[slot], &encodedTimespecs[slot]);
+}
+
+// Quality is taken by the next submitted frame
+void CPUFrameEncoder::setQuality(int quality)
+{
+    this->quality = quality;
+}
+
+void CPUFrameEncoder::setBufferCount(int bufferCount)
+{
+    this->bufferCount = bufferCount;
+}
+
+// libjpeg errors exit the application, there are no deadlines
+bool CPUFrameEncoder::failed()
+{
+    return false;
+}
+
+// Stop encoding thread, free buffers and compressor, all frames were collected before
+void CPUFrameEncoder::teardown()
+{
+    if (bufferCount > 1)
+    {
+        pthread_mutex_lock(&encodeMutex);
+        stopping = true;
+        pthread_cond_broadcast(&encodeCondition);
+        pthread_mutex_unlock(&encodeMutex);
+
+        pthread_join(encodeThread, NULL);
+        pthread_mutex_destroy(&encodeMutex);
+        pthread_cond_destroy(&encodeCondition);
+        stopping = false;
+    }
+
+    jpeg_destroy_compress(&jpegCompress);
+
+    for (int i = 0; i < bufferCount; i++)
+    {
+        free(inputBuffers[i]);
+        free(outputBuffers[i]);
+    }
+
+    free(submittedFrames);
+    free(inputBuffers);
+    free(outputBuffers);
+    free(outputBufferSizes);
+    free(outputLengths);
+    free(submittedQualities);
+    free(submittedTimespecs);
+    free(encodedTimespecs);
+
+    submittedCount = 0;
+    encodedCount = 0;
+    collectedCount = 0;
+}
+
+void CPUFrameEncoder::encodeSlot(int slot)
+{
+    // Apply changed JPEG quality
+    if (submittedQualities[slot] != appliedQuality)
+    {
+        jpeg_set_quality(&jpegCompress, submittedQualities[slot], TRUE);
+        appliedQuality = submittedQualities[slot];
+    }
+
+    // Frames of a warped region are smaller than the setup resolution
+    const Frame* frame = &submittedFrames[slot];
+    jpegCompress.image_width = frame->width;
+    jpegCompress.image_height = frame->height;
+
+    // libjpeg replaces the buffer with a larger one, if it is too small
+    unsigned char* encodeBuffer = outputBuffers[slot];
+    unsigned long encodeLength = outputBufferSizes[slot];
+    jpeg_mem_dest(&jpegCompress, &encodeBuffer, &encodeLength);
+    jpeg_start_compress(&jpegCompress, TRUE);
+
+    // Planar frames: Raw data is written in groups of 16 luma and 8 chroma rows, rows after the last one repeat it
+    // All scanlines are written here, the RGBA loop below is skipped
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        JSAMPROW lumaRows[16];
+        JSAMPROW blueRows[8];
+        JSAMPROW redRows[8];
+        JSAMPARRAY planeRows[3] = { lumaRows, blueRows, redRows };
+
+        while (jpegCompress.next_scanline < jpegCompress.image_height)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int row = (int)(jpegCompress.next_scanline) + i;
+                lumaRows[i] = frame->data + frame->stride * (row < frame->height ? row : frame->height - 1);
+            }
+
+            for (int i = 0; i < 8; i++)
+            {
+                int row = (int)(jpegCompress.next_scanline) / 2 + i;
+                row = (row < frame->height / 2 ? row : frame->height / 2 - 1);
+                blueRows[i] = framePlane(frame->data, frame->stride, frame->height, 1) + (frame->stride / 2) * row;
+                redRows[i] = framePlane(frame->data, frame->stride, frame->height, 2) + (frame->stride / 2) * row;
+            }
+
+            jpeg_write_raw_data(&jpegCompress, planeRows, 16);
+        }
+    }
+
+#ifndef JCS_EXTENSIONS
+    unsigned char* rgbRow = (unsigned char*)(malloc(3 * frame->width));
+#endif
+
+    while (jpegCompress.next_scanline < jpegCompress.image_height)
+    {
+        JSAMPROW inputRow = frame->data + frame->stride * jpegCompress.next_scanline;
+
+#ifndef JCS_EXTENSIONS
+        for (int x = 0; x < frame->width; x++)
+        {
+            rgbRow[3 * x + 0] = inputRow[4 * x + 0];
+            rgbRow[3 * x + 1] = inputRow[4 * x + 1];
+            rgbRow[3 * x + 2] = inputRow[4 * x + 2];
+        }
+
+        inputRow = rgbRow;
+#endif
+
+        jpeg_write_scanlines(&jpegCompress, &inputRow, 1);
+    }
+
+    jpeg_finish_compress(&jpegCompress);
+
+#ifndef JCS_EXTENSIONS
+    free(rgbRow);
+#endif
+
+    // Keep enlarged buffer for next frames
+    if (encodeBuffer != outputBuffers[slot])
+    {
+        free(outputBuffers[slot]);
+        outputBuffers[slot] = encodeBuffer;
+        outputBufferSizes[slot] = encodeLength;
+    }
+
+    outputLengths[slot] = encodeLength;
+
+    // Encode time includes waiting for frames submitted before
+    clock_gettime(CLOCK_MONOTONIC, &encodedTimespecs[slot]);
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// JFIF YCbCr (full range BT.601) of an RGB pixel, same conversion as libjpeg
+void convertRGBToYCbCr(const unsigned char* rgb, unsigned char* ycbcr)
+{
+    double y = 0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2];
+    double cb = 128.0 - 0.168736 * rgb[0] - 0.331264 * rgb[1] + 0.5 * rgb[2];
+    double cr = 128.0 + 0.5 * rgb[0] - 0.418688 * rgb[1] - 0.081312 * rgb[2];
+    ycbcr[0] = (unsigned char)(y + 0.5);
+    ycbcr[1] = (unsigned char)(cb > 255.0 ? 255 : cb + 0.5);
+    ycbcr[2] = (unsigned char)(cr > 255.0 ? 255 : cr + 0.5);
+}
+
+// libjpeg error handler, exits application like all other stage errors
+void jpegErrorExit(j_common_ptr jpegInfo)
+{
+    char jpegMessage[JMSG_LENGTH_MAX];
+    (*jpegInfo->err->format_message)(jpegInfo, jpegMessage);
+    printf("CPU Error: libjpeg %s - EXITING APPLICATION\n", jpegMessage);
+    kill(getpid(), SIGKILL);
+}
+
+// Thread function of CPUFrameEncoder, compresses submitted frames in order
+void* CPUFrameEncoderThread(void* encoder)
+{
+    CPUFrameEncoder* cpuEncoder = (CPUFrameEncoder*)(encoder);
+
+    while (true)
+    {
+        // Wait for next submitted frame
+        pthread_mutex_lock(&cpuEncoder->encodeMutex);
+
+        while (cpuEncoder->encodedCount == cpuEncoder->submittedCount && !cpuEncoder->stopping)
+        {
+            pthread_cond_wait(&cpuEncoder->encodeCondition, &cpuEncoder->encodeMutex);
+        }
+
+        if (cpuEncoder->stopping)
+        {
+            pthread_mutex_unlock(&cpuEncoder->encodeMutex);
+            break;
+        }
+
+        int slot = cpuEncoder->encodedCount % cpuEncoder->bufferCount;
+        pthread_mutex_unlock(&cpuEncoder->encodeMutex);
+
+        // Compress without lock, slot is not touched by pipeline until it is collected
+        cpuEncoder->encodeSlot(slot);
+
+        // Mark frame as finished
+        pthread_mutex_lock(&cpuEncoder->encodeMutex);
+        cpuEncoder->encodedCount++;
+        pthread_cond_broadcast(&cpuEncoder->encodeCondition);
+        pthread_mutex_unlock(&cpuEncoder->encodeMutex);
+
+        if (cpuEncoder->frameEvent)
+        {
+            cpuEncoder->frameEvent->signal();
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,170 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU-pipeline.h"
+#include "visicamRPiGPU-warp.h"
+
+#include <jpeglib.h>
+#include <math.h>
+#include <pthread.h>
+
+/* #####################################
+CPU BACKEND
+##################################### */
+
+// Source: Synthetic test frames or a JPEG file, frames are RGBA or planar YUV420 in CPU memory
+class CPUFrameSource : public FrameSource
+{
+    public:
+        CPUFrameSource(std::string path, int frameFormat);
+
+        bool setup(int width, int height);
+        void acquire(Frame* frame);
+        bool poll(Frame* frame);
+        void release();
+        void setFrameEvent(FrameEvent* event);
+        void setCameraSettings(const CameraSettings* settings);
+        bool settled();
+        bool failed();
+        void teardown();
+
+        // JPEG input file, empty for synthetic test frames
+        std::string inputPath;
+
+        int width;
+        int height;
+        int frameFormat;
+        unsigned int frameCounter;
+        unsigned char* pixelBuffer;
+};
+
+// Warper: Software inverse mapping with bilinear sampling, vector kernels and warp threads
+// Planar YUV420 frames are warped plane by plane, chroma planes with half resolution
+class CPUFrameWarper : public FrameWarper
+{
+    public:
+        CPUFrameWarper(int threadCount, int frameFormat);
+
+        void setup(int width, int height);
+        void setHomography(const float* values);
+        void warp(const Frame* input, const FrameRegion* region);
+        void readback(const Frame* input, bool original, Frame* output);
+        void sampleLuma(const Frame* input, int sampleWidth, int sampleHeight, unsigned char* output);
+        void teardown();
+
+        // Warp region of one plane (scale 1 for full resolution, 2 for half resolution)
+        void warpPlane(const unsigned char* input, int inputStride, unsigned char* output, int outputStride, int scale,
+            const FrameRegion* region, const unsigned char* blackPixel, WarpRemapCache* cache);
+
+        int width;
+        int height;
+        int frameFormat;
+        bool inverseValid;
+        double inverseMatrix[9];
+
+        // Warped frame in the layout of a full frame, only the region of the last warp is valid
+        unsigned char* warpedBuffer;
+        FrameRegion warpedRegion;
+
+        // Warp threads, 0 uses one thread per CPU core, they do not depend on the resolution and are kept by teardown
+        int threadCount;
+        WarpThreadPool threadPool;
+
+        // Remap tables for the current homography and region, chroma planes share their table
+        WarpRemapCache remapCache;
+        WarpRemapCache chromaRemapCache;
+
+        // Throughput measurement, reported once
+        unsigned int measuredFrameCount;
+        double measuredPixels;
+        double measuredSeconds;
+};
+
+// Encoder: libjpeg(-turbo) compression to memory, planar YUV420 frames are passed as raw downsampled data
+// With more than one buffer, frames are compressed by an encoding thread while the pipeline continues
+class CPUFrameEncoder : public FrameEncoder
+{
+    public:
+        CPUFrameEncoder(int bufferCount, int frameFormat);
+
+        bool setup(int width, int height);
+        void getInputFrame(Frame* frame);
+        void encode(const Frame* input, EncodedFrame* output);
+        bool flush(EncodedFrame* output);
+        bool collect(EncodedFrame* output);
+        void setFrameEvent(FrameEvent* event);
+        void setQuality(int quality);
+        void setBufferCount(int bufferCount);
+        bool failed();
+        void teardown();
+
+        // Compress input buffer of slot into output buffer of slot
+        void encodeSlot(int slot);
+
+        // Set output to the finished frame of slot
+        void collectSlot(int slot, EncodedFrame* output);
+
+        int width;
+        int height;
+        int frameFormat;
+
+        // Ring of buffers, slot of a frame is its submit number modulo bufferCount
+        // Counters are protected by encodeMutex
+        int bufferCount;
+        unsigned int submittedCount;
+        unsigned int encodedCount;
+        unsigned int collectedCount;
+        Frame* submittedFrames;
+        unsigned char** inputBuffers;
+        unsigned char** outputBuffers;
+        unsigned long* outputBufferSizes;
+        unsigned long* outputLengths;
+
+        // JPEG quality and submit time of each submitted frame, time of the end of its compression
+        int* submittedQualities;
+        struct timespec* submittedTimespecs;
+        struct timespec* encodedTimespecs;
+
+        // Encoding thread, exits if stopping is set, signals frameEvent after each finished frame
+        pthread_t encodeThread;
+        pthread_mutex_t encodeMutex;
+        pthread_cond_t encodeCondition;
+        bool stopping;
+        FrameEvent* frameEvent;
+
+        // JPEG quality, set by the pipeline for the next submitted frames, the thread which compresses applies it if it changed
+        int quality;
+        int appliedQuality;
+
+        // libjpeg variables, only used by one thread at a time
+        struct jpeg_compress_struct jpegCompress;
+        struct jpeg_error_mgr jpegError;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// JFIF YCbCr (full range BT.601) of an RGB pixel, same conversion as libjpeg
+void convertRGBToYCbCr(const unsigned char* rgb, unsigned char* ycbcr);
+
+// libjpeg error handler, exits application like all other stage errors
+void jpegErrorExit(j_common_ptr jpegInfo);
+
+// Thread function of CPUFrameEncoder, compresses submitted frames in order
+void* CPUFrameEncoderThread(void* encoder);
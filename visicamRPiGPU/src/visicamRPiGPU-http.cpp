@@ -0,0 +1,487 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-http.h"
+
+// Arguments for client threads
+typedef struct
+{
+    HttpFramePublisher* publisher;
+    int clientSocket;
+} HttpClient;
+
+/* #####################################
+HTTP SERVER
+##################################### */
+
+HttpFramePublisher::HttpFramePublisher(std::string address, int port, int maxClients)
+{
+    this->address = address;
+    this->port = port;
+    this->maxClients = maxClients;
+    serverSocket = -1;
+    frameCounter = 0;
+    clientCount = 0;
+
+    for (int i = 0; i < HTTP_STREAM_COUNT; i++)
+    {
+        latestFrames[i] = NULL;
+    }
+}
+
+// Clients get the size of each frame in its JPEG data, the server does not depend on the resolution
+void HttpFramePublisher::resize(int, int)
+{
+}
+
+// Bind listening socket and start server thread
+void HttpFramePublisher::setup(int, int)
+{
+    pthread_mutex_init(&frameMutex, NULL);
+    monotonicConditionInit(&frameCondition);
+
+    // Setup server socket: Reuse address, the port is still blocked for a while after restarts otherwise
+    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (serverSocket == -1)
+    {
+        printf("HTTP Error: Create server socket - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    int reuseAddress = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    struct sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(port);
+
+    if (inet_pton(AF_INET, address.c_str(), &serverAddress.sin_addr) != 1)
+    {
+        printf("HTTP Error: Invalid server address %s - EXITING APPLICATION\n", address.c_str());
+        kill(getpid(), SIGKILL);
+    }
+
+    if (bind(serverSocket, (struct sockaddr*)(&serverAddress), sizeof(serverAddress)) == -1
+        || listen(serverSocket, maxClients) == -1)
+    {
+        printf("HTTP Error: Listen on %s:%d - EXITING APPLICATION\n", address.c_str(), port);
+        kill(getpid(), SIGKILL);
+    }
+
+    if (pthread_create(&serverThread, NULL, HttpFramePublisherThread, this))
+    {
+        printf("HTTP Error: Create server thread - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    printf("HTTP server listening on http://%s:%d/stream.mjpg\n", address.c_str(), port);
+}
+
+// Render thread: Copy frame into a shared frame and make it the latest frame of its stream
+void HttpFramePublisher::publish(const EncodedFrame* frame, const std::string&)
+{
+    int stream = (frame->original ? HTTP_STREAM_CAPTURED : HTTP_STREAM_PROCESSED);
+
+    pthread_mutex_lock(&frameMutex);
+
+    // Reuse unused frame, buffers only grow at the beginning because frame sizes are stable
+    SharedFrame* sharedFrame;
+
+    if (!freeFrames.empty())
+    {
+        sharedFrame = freeFrames.back();
+        freeFrames.pop_back();
+    }
+    else
+    {
+        sharedFrame = (SharedFrame*)(calloc(1, sizeof(SharedFrame)));
+    }
+
+    pthread_mutex_unlock(&frameMutex);
+
+    // Copy header and data without lock, frame is not visible to clients yet
+    size_t length = frame->headerLength + frame->length;
+
+    if (sharedFrame->size < length)
+    {
+        sharedFrame->data = (unsigned char*)(realloc(sharedFrame->data, length));
+        sharedFrame->size = length;
+    }
+
+    memcpy(sharedFrame->data, frame->header, frame->headerLength);
+    memcpy(sharedFrame->data + frame->headerLength, frame->data, frame->length);
+    sharedFrame->length = length;
+    sharedFrame->region.x = frame->offsetX;
+    sharedFrame->region.y = frame->offsetY;
+    sharedFrame->region.width = frame->width;
+    sharedFrame->region.height = frame->height;
+    sharedFrame->quality = frame->quality;
+    sharedFrame->sequence = frame->sequence;
+    sharedFrame->captureNanoseconds = timespecNanoseconds(&frame->captureTimespec);
+    sharedFrame->warpNanoseconds = timespecNanoseconds(&frame->warpTimespec);
+    sharedFrame->encodeNanoseconds = timespecNanoseconds(&frame->encodedTimespec);
+
+    pthread_mutex_lock(&frameMutex);
+
+    // Publisher holds one reference to the latest frame of each stream
+    sharedFrame->frameNumber = ++frameCounter;
+    sharedFrame->references = 1;
+
+    if (latestFrames[stream])
+    {
+        latestFrames[stream]->references--;
+
+        if (latestFrames[stream]->references == 0)
+        {
+            freeFrames.push_back(latestFrames[stream]);
+        }
+    }
+
+    latestFrames[stream] = sharedFrame;
+
+    pthread_cond_broadcast(&frameCondition);
+    pthread_mutex_unlock(&frameMutex);
+}
+
+// Client threads: Wait for a frame newer than frameNumber and take a reference
+SharedFrame* HttpFramePublisher::acquireFrame(int stream, unsigned int frameNumber, int timeoutSeconds)
+{
+    struct timespec timeoutTimespec;
+    monotonicDeadline(&timeoutTimespec, timeoutSeconds * 1000);
+
+    SharedFrame* sharedFrame = NULL;
+
+    pthread_mutex_lock(&frameMutex);
+
+    while (!latestFrames[stream] || latestFrames[stream]->frameNumber == frameNumber)
+    {
+        if (pthread_cond_timedwait(&frameCondition, &frameMutex, &timeoutTimespec) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    if (latestFrames[stream] && latestFrames[stream]->frameNumber != frameNumber)
+    {
+        sharedFrame = latestFrames[stream];
+        sharedFrame->references++;
+    }
+
+    pthread_mutex_unlock(&frameMutex);
+
+    return sharedFrame;
+}
+
+// Client threads: Return reference, frame is reused if it is not the latest one anymore
+void HttpFramePublisher::releaseFrame(SharedFrame* frame)
+{
+    pthread_mutex_lock(&frameMutex);
+
+    frame->references--;
+
+    if (frame->references == 0)
+    {
+        freeFrames.push_back(frame);
+    }
+
+    pthread_mutex_unlock(&frameMutex);
+}
+
+// Client threads: Read request and serve the requested endpoint
+void HttpFramePublisher::serveClient(int clientSocket)
+{
+    // Read request header, only the request line is evaluated
+    char request[2048];
+    size_t requestLength = 0;
+
+    while (requestLength < sizeof(request) - 1)
+    {
+        ssize_t received = recv(clientSocket, request + requestLength, sizeof(request) - 1 - requestLength, 0);
+
+        if (received <= 0)
+        {
+            return;
+        }
+
+        requestLength += received;
+        request[requestLength] = '\0';
+
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+        {
+            break;
+        }
+    }
+
+    // Request line: GET <path> HTTP/1.x, query strings are ignored
+    char method[8];
+    char path[256];
+
+    if (sscanf(request, "%7s %255s", method, path) != 2)
+    {
+        return;
+    }
+
+    char* query = strchr(path, '?');
+
+    if (query)
+    {
+        *query = '\0';
+    }
+
+    if (strcmp(method, "GET") != 0)
+    {
+        const char* response = "HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n";
+        httpSendAll(clientSocket, response, strlen(response));
+    }
+    else if (strcmp(path, "/stream.mjpg") == 0)
+    {
+        serveStream(clientSocket, HTTP_STREAM_PROCESSED);
+    }
+    else if (strcmp(path, "/captured.mjpg") == 0)
+    {
+        serveStream(clientSocket, HTTP_STREAM_CAPTURED);
+    }
+    else if (strcmp(path, "/snapshot.jpg") == 0)
+    {
+        serveSnapshot(clientSocket, HTTP_STREAM_PROCESSED);
+    }
+    else if (strcmp(path, "/captured.jpg") == 0)
+    {
+        serveSnapshot(clientSocket, HTTP_STREAM_CAPTURED);
+    }
+    else if (strcmp(path, "/metrics") == 0)
+    {
+        serveMetrics(clientSocket);
+    }
+    else
+    {
+        const char* response = "HTTP/1.0 404 Not Found\r\nConnection: close\r\nContent-Type: text/plain\r\n\r\n"
+            "Endpoints: /stream.mjpg /snapshot.jpg /captured.mjpg /captured.jpg /metrics\r\n";
+        httpSendAll(clientSocket, response, strlen(response));
+    }
+}
+
+// Client threads: Send latest frames as multipart/x-mixed-replace until the client disconnects
+// Captured images are only refreshed every refreshTimeSeconds, waiting for frames therefore never times out the connection
+bool HttpFramePublisher::serveStream(int clientSocket, int stream)
+{
+    const char* header = "HTTP/1.0 200 OK\r\nConnection: close\r\nCache-Control: no-cache\r\n"
+        "Content-Type: multipart/x-mixed-replace; boundary=" HTTP_MJPEG_BOUNDARY "\r\n\r\n";
+
+    if (!httpSendAll(clientSocket, header, strlen(header)))
+    {
+        return false;
+    }
+
+    unsigned int frameNumber = 0;
+
+    while (true)
+    {
+        SharedFrame* sharedFrame = acquireFrame(stream, frameNumber, 1);
+
+        // No new frame (static scene, trigger mode): Nothing is sent, a closed connection is only noticed by probing it
+        if (!sharedFrame)
+        {
+            if (httpPeerClosed(clientSocket))
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        frameNumber = sharedFrame->frameNumber;
+
+        char partHeader[384];
+        int partHeaderLength = snprintf(partHeader, sizeof(partHeader), "--" HTTP_MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\nX-Frame-Region: %d,%d,%d,%d\r\nX-Frame-Quality: %d\r\n"
+            "X-Frame-Sequence: %llu\r\nX-Frame-Times: capture=%llu warp=%llu encode=%llu\r\n\r\n",
+            (unsigned int)(sharedFrame->length), sharedFrame->region.x, sharedFrame->region.y, sharedFrame->region.width, sharedFrame->region.height, sharedFrame->quality,
+            sharedFrame->sequence, sharedFrame->captureNanoseconds, sharedFrame->warpNanoseconds, sharedFrame->encodeNanoseconds);
+
+        bool sent = httpSendAll(clientSocket, partHeader, partHeaderLength)
+            && httpSendAll(clientSocket, sharedFrame->data, sharedFrame->length)
+            && httpSendAll(clientSocket, "\r\n", 2);
+
+        releaseFrame(sharedFrame);
+
+        if (!sent)
+        {
+            return false;
+        }
+    }
+}
+
+// Client threads: Send latest frame as single JPEG image, waits for the first frame if there is none yet
+bool HttpFramePublisher::serveSnapshot(int clientSocket, int stream)
+{
+    SharedFrame* sharedFrame = acquireFrame(stream, 0, 5);
+
+    if (!sharedFrame)
+    {
+        const char* response = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+        return httpSendAll(clientSocket, response, strlen(response));
+    }
+
+    char header[416];
+    int headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nConnection: close\r\nCache-Control: no-cache\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\nX-Frame-Region: %d,%d,%d,%d\r\nX-Frame-Quality: %d\r\n"
+        "X-Frame-Sequence: %llu\r\nX-Frame-Times: capture=%llu warp=%llu encode=%llu\r\n\r\n",
+        (unsigned int)(sharedFrame->length), sharedFrame->region.x, sharedFrame->region.y, sharedFrame->region.width, sharedFrame->region.height, sharedFrame->quality,
+        sharedFrame->sequence, sharedFrame->captureNanoseconds, sharedFrame->warpNanoseconds, sharedFrame->encodeNanoseconds);
+
+    bool sent = httpSendAll(clientSocket, header, headerLength)
+        && httpSendAll(clientSocket, sharedFrame->data, sharedFrame->length);
+
+    releaseFrame(sharedFrame);
+
+    return sent;
+}
+
+// Client threads: Send latency histograms of the pipeline stages in Prometheus text format
+bool HttpFramePublisher::serveMetrics(int clientSocket)
+{
+    std::string metrics = latencyStats.formatPrometheus();
+
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nConnection: close\r\nCache-Control: no-cache\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\n\r\n",
+        (unsigned int)(metrics.size()));
+
+    return httpSendAll(clientSocket, header, headerLength)
+        && httpSendAll(clientSocket, metrics.data(), metrics.size());
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of HttpFramePublisher, accepts connections and starts a thread for each client
+void* HttpFramePublisherThread(void* publisher)
+{
+    HttpFramePublisher* httpPublisher = (HttpFramePublisher*)(publisher);
+
+    while (true)
+    {
+        int clientSocket = accept(httpPublisher->serverSocket, NULL, NULL);
+
+        if (clientSocket == -1)
+        {
+            continue;
+        }
+
+        // Clients which stop reading are disconnected after the send timeout
+        struct timeval socketTimeout;
+        socketTimeout.tv_sec = 10;
+        socketTimeout.tv_usec = 0;
+        setsockopt(clientSocket, SOL_SOCKET, SO_SNDTIMEO, &socketTimeout, sizeof(socketTimeout));
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &socketTimeout, sizeof(socketTimeout));
+
+        int noDelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        // Reject client if too many clients are connected
+        if (__atomic_add_fetch(&httpPublisher->clientCount, 1, __ATOMIC_RELAXED) > httpPublisher->maxClients)
+        {
+            const char* response = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+            httpSendAll(clientSocket, response, strlen(response));
+            close(clientSocket);
+            __atomic_sub_fetch(&httpPublisher->clientCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        HttpClient* client = new HttpClient;
+        client->publisher = httpPublisher;
+        client->clientSocket = clientSocket;
+
+        pthread_t clientThread;
+
+        if (pthread_create(&clientThread, NULL, HttpFramePublisherClientThread, client))
+        {
+            close(clientSocket);
+            delete client;
+            __atomic_sub_fetch(&httpPublisher->clientCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        pthread_detach(clientThread);
+    }
+
+    return NULL;
+}
+
+// Thread function for one client connection
+void* HttpFramePublisherClientThread(void* client)
+{
+    HttpClient* httpClient = (HttpClient*)(client);
+
+    httpClient->publisher->serveClient(httpClient->clientSocket);
+
+    close(httpClient->clientSocket);
+    __atomic_sub_fetch(&httpClient->publisher->clientCount, 1, __ATOMIC_RELAXED);
+    delete httpClient;
+
+    return NULL;
+}
+
+// Send whole buffer, MSG_NOSIGNAL avoids SIGPIPE for closed connections
+bool httpSendAll(int socket, const void* data, size_t length)
+{
+    const unsigned char* position = (const unsigned char*)(data);
+
+    while (length > 0)
+    {
+        ssize_t sent = send(socket, position, length, MSG_NOSIGNAL);
+
+        if (sent <= 0)
+        {
+            if (sent == -1 && errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        position += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+// Stream clients send nothing after their request, readable data is discarded, end of file means the client closed the connection
+bool httpPeerClosed(int socket)
+{
+    struct pollfd socketPoll;
+    socketPoll.fd = socket;
+    socketPoll.events = POLLIN | POLLRDHUP;
+    socketPoll.revents = 0;
+
+    if (poll(&socketPoll, 1, 0) <= 0)
+    {
+        return false;
+    }
+
+    if (socketPoll.revents & (POLLRDHUP | POLLHUP | POLLERR))
+    {
+        return true;
+    }
+
+    char buffer[256];
+    ssize_t received = recv(socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+    return (received == 0 || (received == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR));
+}
@@ -0,0 +1,114 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU-latency.h"
+#include "visicamRPiGPU-pipeline.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <vector>
+
+// Streams served by the HTTP server
+#define HTTP_STREAM_PROCESSED                   0
+#define HTTP_STREAM_CAPTURED                    1
+#define HTTP_STREAM_COUNT                       2
+
+// Boundary between the images of MJPEG streams
+#define HTTP_MJPEG_BOUNDARY                     "visicamRPiGPUframe"
+
+/* #####################################
+HTTP SERVER
+##################################### */
+
+// Encoded frame shared by the render thread and client threads, returned to the free list when no client uses it
+typedef struct
+{
+    unsigned char*      data;
+    size_t              size;
+    size_t              length;
+    unsigned int        frameNumber;
+    int                 references;
+    FrameRegion         region;
+    int                 quality;
+    unsigned long long  sequence;
+    unsigned long long  captureNanoseconds;
+    unsigned long long  warpNanoseconds;
+    unsigned long long  encodeNanoseconds;
+} SharedFrame;
+
+// Publisher: Embedded HTTP server for MJPEG streams and snapshots of the latest frames
+// Endpoints: /stream.mjpg and /snapshot.jpg (processed images), /captured.mjpg and /captured.jpg (original captured images)
+// Every client has its own thread which always sends the latest frame, slow clients skip frames and never block publishing
+class HttpFramePublisher : public FramePublisher
+{
+    public:
+        HttpFramePublisher(std::string address, int port, int maxClients);
+
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+
+        // Client threads: Wait for a frame newer than frameNumber and take a reference, NULL if waiting timed out
+        SharedFrame* acquireFrame(int stream, unsigned int frameNumber, int timeoutSeconds);
+        void releaseFrame(SharedFrame* frame);
+
+        // Client threads: Handle one connection
+        void serveClient(int clientSocket);
+        bool serveStream(int clientSocket, int stream);
+        bool serveSnapshot(int clientSocket, int stream);
+        bool serveMetrics(int clientSocket);
+
+        std::string address;
+        int port;
+        int maxClients;
+        int serverSocket;
+        pthread_t serverThread;
+
+        // Latest frame of each stream and unused frames, protected by frameMutex
+        // frameCondition is signaled for each new frame
+        pthread_mutex_t frameMutex;
+        pthread_cond_t frameCondition;
+        SharedFrame* latestFrames[HTTP_STREAM_COUNT];
+        std::vector<SharedFrame*> freeFrames;
+        unsigned int frameCounter;
+
+        // Connected clients, only changed with atomic operations
+        int clientCount;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of HttpFramePublisher, accepts connections
+void* HttpFramePublisherThread(void* publisher);
+
+// Thread function for one client connection
+void* HttpFramePublisherClientThread(void* client);
+
+// Send whole buffer, returns false if connection was closed or timed out
+bool httpSendAll(int socket, const void* data, size_t length);
+
+// Check without blocking if the client closed or reset the connection
+bool httpPeerClosed(int socket);
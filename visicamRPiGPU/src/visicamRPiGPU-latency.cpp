@@ -0,0 +1,231 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "visicamRPiGPU-latency.h"
+
+// Names of the stages in metrics
+static const char* latencyStageNames[LATENCY_STAGE_COUNT] =
+{
+    "frame",
+    "acquire",
+    "warp",
+    "readback",
+    "encode_submit",
+    "encode_input",
+    "encode",
+    "publish",
+    "write",
+    "capture_to_publish",
+    "recovery_downtime"
+};
+
+// Upper bounds of the buckets in seconds
+static const double latencyBucketBounds[LATENCY_BUCKET_COUNT] =
+{
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+LatencyStats latencyStats;
+
+/* #####################################
+LATENCY STATISTICS
+##################################### */
+
+LatencyHistogram::LatencyHistogram()
+{
+    memset(bucketCounts, 0, sizeof(bucketCounts));
+    count = 0;
+    sumMicroseconds = 0;
+}
+
+void LatencyHistogram::record(double seconds)
+{
+    int bucket = 0;
+
+    while (bucket < LATENCY_BUCKET_COUNT && seconds > latencyBucketBounds[bucket])
+    {
+        bucket++;
+    }
+
+    __atomic_add_fetch(&bucketCounts[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sumMicroseconds, (unsigned long long)(seconds > 0.0 ? seconds * 1000000.0 : 0.0), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i <= LATENCY_BUCKET_COUNT; i++)
+    {
+        __atomic_store_n(&bucketCounts[i], 0, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&sumMicroseconds, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&count, 0, __ATOMIC_RELAXED);
+}
+
+// Durations above the last bound are reported as the last bound
+double LatencyHistogram::quantile(double fraction)
+{
+    unsigned int total = 0;
+    unsigned int counts[LATENCY_BUCKET_COUNT + 1];
+
+    for (int i = 0; i <= LATENCY_BUCKET_COUNT; i++)
+    {
+        counts[i] = __atomic_load_n(&bucketCounts[i], __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+
+    if (total == 0)
+    {
+        return 0.0;
+    }
+
+    double rank = fraction * total;
+    unsigned int cumulative = 0;
+
+    for (int i = 0; i < LATENCY_BUCKET_COUNT; i++)
+    {
+        if (counts[i] > 0 && cumulative + counts[i] >= rank)
+        {
+            double lower = (i == 0 ? 0.0 : latencyBucketBounds[i - 1]);
+            return lower + (latencyBucketBounds[i] - lower) * ((rank - cumulative) / counts[i]);
+        }
+
+        cumulative += counts[i];
+    }
+
+    return latencyBucketBounds[LATENCY_BUCKET_COUNT - 1];
+}
+
+void LatencyStats::record(int stage, const struct timespec* startTimespec, const struct timespec* endTimespec)
+{
+    histograms[stage].record(elapsedSeconds(startTimespec, endTimespec));
+}
+
+void LatencyStats::record(int stage, double seconds)
+{
+    histograms[stage].record(seconds);
+}
+
+std::string LatencyStats::formatPrometheus()
+{
+    std::ostringstream output;
+
+    output << "# HELP visicam_stage_latency_seconds Latency of pipeline stages\n";
+    output << "# TYPE visicam_stage_latency_seconds histogram\n";
+
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        LatencyHistogram* histogram = &histograms[stage];
+        unsigned int cumulative = 0;
+
+        for (int i = 0; i <= LATENCY_BUCKET_COUNT; i++)
+        {
+            cumulative += __atomic_load_n(&histogram->bucketCounts[i], __ATOMIC_RELAXED);
+            output << "visicam_stage_latency_seconds_bucket{stage=\"" << latencyStageNames[stage] << "\",le=\"";
+
+            if (i < LATENCY_BUCKET_COUNT)
+            {
+                output << latencyBucketBounds[i];
+            }
+            else
+            {
+                output << "+Inf";
+            }
+
+            output << "\"} " << cumulative << "\n";
+        }
+
+        // Count is the one of the buckets, a sample recorded meanwhile is not counted twice
+        output << "visicam_stage_latency_seconds_sum{stage=\"" << latencyStageNames[stage] << "\"} "
+            << __atomic_load_n(&histogram->sumMicroseconds, __ATOMIC_RELAXED) / 1000000.0 << "\n";
+        output << "visicam_stage_latency_seconds_count{stage=\"" << latencyStageNames[stage] << "\"} " << cumulative << "\n";
+    }
+
+    output << "# HELP visicam_stage_latency_quantile_seconds Estimated quantiles of the latency of pipeline stages\n";
+    output << "# TYPE visicam_stage_latency_quantile_seconds gauge\n";
+
+    const double quantiles[3] = { 0.5, 0.95, 0.99 };
+
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            output << "visicam_stage_latency_quantile_seconds{stage=\"" << latencyStageNames[stage] << "\",quantile=\"" << quantiles[i] << "\"} "
+                << histograms[stage].quantile(quantiles[i]) << "\n";
+        }
+    }
+
+    return output.str();
+}
+
+std::string LatencyStats::formatSummary()
+{
+    std::ostringstream output;
+    output.setf(std::ios::fixed);
+    output.precision(2);
+
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        if (__atomic_load_n(&histograms[stage].count, __ATOMIC_RELAXED) == 0)
+        {
+            continue;
+        }
+
+        output << " " << latencyStageNames[stage] << "="
+            << histograms[stage].quantile(0.5) * 1000.0 << ","
+            << histograms[stage].quantile(0.95) * 1000.0 << ","
+            << histograms[stage].quantile(0.99) * 1000.0;
+    }
+
+    return output.str();
+}
+
+bool LatencyStats::writeFile(const std::string& path)
+{
+    std::string text = formatPrometheus();
+    std::string temporaryPath = path + ".tmp";
+
+    int file = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (file == -1)
+    {
+        return false;
+    }
+
+    bool written = (write(file, text.c_str(), text.size()) == (ssize_t)(text.size()));
+    close(file);
+
+    return (written && rename(temporaryPath.c_str(), path.c_str()) == 0);
+}
+
+void LatencyStats::reset()
+{
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        histograms[stage].reset();
+    }
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+const char* latencyStageName(int stage)
+{
+    return latencyStageNames[stage];
+}
@@ -0,0 +1,97 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "visicamRPiGPU-pipeline.h"
+
+#include <sstream>
+
+// Stages with latency histograms
+#define LATENCY_STAGE_FRAME                     0       // Time between two frames of the render loop
+#define LATENCY_STAGE_ACQUIRE                   1       // Source: Request until frame is delivered (egl_render FillThisBuffer to FillBufferDone, CPU backend: generation of the frame)
+#define LATENCY_STAGE_WARP                      2       // Warper: Warp call, GL backend only queues draw commands
+#define LATENCY_STAGE_READBACK                  3       // Warper: Readback into encoder input, GL backend waits for drawing in glReadPixels
+#define LATENCY_STAGE_ENCODE_SUBMIT             4       // Encoder: Encode call, waits for the oldest frame if all buffers are in use
+#define LATENCY_STAGE_ENCODE_INPUT              5       // Encoder: Submit until input frame was read (image_encode EmptyThisBuffer to EmptyBufferDone), not recorded by the CPU backend
+#define LATENCY_STAGE_ENCODE                    6       // Encoder: Submit until compression is finished (image_encode EmptyThisBuffer to FillBufferDone)
+#define LATENCY_STAGE_PUBLISH                   7       // Publisher: Publish call of the render thread, only queues the frame with PUBLISH_QUEUE_LENGTH
+#define LATENCY_STAGE_WRITE                     8       // Writer thread: Publish queued frame (PUBLISH_QUEUE_LENGTH only)
+#define LATENCY_STAGE_CAPTURE_TO_PUBLISH        9       // End to end: Source delivered the frame until its encoded image is handed to the publisher
+#define LATENCY_STAGE_RECOVERY_DOWNTIME         10      // Stage recovery: Last published frame before a stage failed until the first published frame after its re-setup
+#define LATENCY_STAGE_COUNT                     11
+
+// Upper bounds of histogram buckets from 100 us to 10 s, last bucket counts everything above
+#define LATENCY_BUCKET_COUNT                    16
+
+/* #####################################
+LATENCY STATISTICS
+##################################### */
+
+// Fixed bucket histogram of durations, each histogram is only recorded by one thread
+// Counters are changed atomically, readers on other threads see consistent values of each counter
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram();
+
+        // Add one duration
+        void record(double seconds);
+
+        // Remove all durations, durations recorded meanwhile might be kept partially
+        void reset();
+
+        // Estimated quantile (0 to 1) by linear interpolation inside of its bucket, 0 without samples
+        double quantile(double fraction);
+
+        unsigned int bucketCounts[LATENCY_BUCKET_COUNT + 1];
+        unsigned int count;
+        unsigned long long sumMicroseconds;
+};
+
+// Histograms of all stages, formatted as Prometheus text or one summary line
+class LatencyStats
+{
+    public:
+        // Add duration between monotonic timestamps to stage
+        void record(int stage, const struct timespec* startTimespec, const struct timespec* endTimespec);
+        void record(int stage, double seconds);
+
+        // Prometheus text format: Histogram with buckets, sum and count, p50, p95 and p99 as gauges
+        std::string formatPrometheus();
+
+        // Control socket: <stage>=<p50>,<p95>,<p99> in ms for each stage with samples
+        std::string formatSummary();
+
+        // Write Prometheus text to a temp file and rename it to path, readers always see a complete file
+        bool writeFile(const std::string& path);
+
+        // Remove durations of all stages, e.g. after warming up
+        void reset();
+
+        LatencyHistogram histograms[LATENCY_STAGE_COUNT];
+};
+
+// Latency statistics of the process, recorded by render and writer thread
+extern LatencyStats latencyStats;
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Name of stage in metrics and summaries
+const char* latencyStageName(int stage);
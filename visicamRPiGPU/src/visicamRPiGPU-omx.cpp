@@ -0,0 +1,1137 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-omx.h"
+
+/* #####################################
+OMX BACKEND
+##################################### */
+
+// Vertex shader of packed YUV420 pass, attribute and matrix are set by the programmable renderer of openFrameworks
+static const char* yuvVertexShaderSource =
+    "attribute vec4 position;\n"
+    "uniform mat4 modelViewProjectionMatrix;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = modelViewProjectionMatrix * position;\n"
+    "}\n";
+
+// Fragment shader of packed YUV420 pass, each texel holds 4 bytes of the planar frame of the region
+// Texel rows 0 to height - 1 are Y rows, each following texel row holds two chroma rows of the U plane, then of the V plane
+// Same mapping as the CPU backend: Inverse homography of pixel centers, black (Y = 0, neutral chroma) outside of the camera frame
+static const char* yuvFragmentShaderSource =
+    "precision highp float;\n"
+    "uniform sampler2D cameraTexture;\n"
+    "uniform vec3 inverseRow0;\n"
+    "uniform vec3 inverseRow1;\n"
+    "uniform vec3 inverseRow2;\n"
+    "uniform vec2 frameSize;\n"
+    "uniform vec2 textureScale;\n"
+    "uniform vec2 regionOffset;\n"
+    "uniform vec2 regionSize;\n"
+    "vec4 samplePixel(vec2 position)\n"
+    "{\n"
+    "    vec3 point = vec3(position + regionOffset, 1.0);\n"
+    "    vec3 mapped = vec3(dot(inverseRow0, point), dot(inverseRow1, point), dot(inverseRow2, point));\n"
+    "    vec2 source = mapped.xy / mapped.z;\n"
+    "    if (mapped.z <= 0.0 || source.x < 0.0 || source.y < 0.0 || source.x >= frameSize.x || source.y >= frameSize.y)\n"
+    "    {\n"
+    "        return vec4(0.0);\n"
+    "    }\n"
+    "    return vec4(texture2D(cameraTexture, source / frameSize * textureScale).rgb, 1.0);\n"
+    "}\n"
+    "float luma(vec2 position)\n"
+    "{\n"
+    "    return dot(samplePixel(position).rgb, vec3(0.299, 0.587, 0.114));\n"
+    "}\n"
+    "float chroma(vec2 position, vec3 weights)\n"
+    "{\n"
+    "    return 128.0 / 255.0 + dot(samplePixel(position).rgb, weights);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 texel = floor(gl_FragCoord.xy);\n"
+    "    if (texel.y < regionSize.y)\n"
+    "    {\n"
+    "        vec2 position = vec2(4.0 * texel.x + 0.5, texel.y + 0.5);\n"
+    "        gl_FragColor = vec4(luma(position), luma(position + vec2(1.0, 0.0)), luma(position + vec2(2.0, 0.0)), luma(position + vec2(3.0, 0.0)));\n"
+    "        return;\n"
+    "    }\n"
+    "    float planeRows = regionSize.y / 4.0;\n"
+    "    float row = texel.y - regionSize.y;\n"
+    "    vec3 weights = vec3(-0.168736, -0.331264, 0.5);\n"
+    "    if (row >= planeRows)\n"
+    "    {\n"
+    "        row -= planeRows;\n"
+    "        weights = vec3(0.5, -0.418688, -0.081312);\n"
+    "    }\n"
+    "    float column = 4.0 * texel.x;\n"
+    "    row *= 2.0;\n"
+    "    if (column >= regionSize.x / 2.0)\n"
+    "    {\n"
+    "        column -= regionSize.x / 2.0;\n"
+    "        row += 1.0;\n"
+    "    }\n"
+    "    vec2 position = vec2(2.0 * column + 1.0, 2.0 * row + 1.0);\n"
+    "    gl_FragColor = vec4(chroma(position, weights), chroma(position + vec2(2.0, 0.0), weights), chroma(position + vec2(4.0, 0.0), weights), chroma(position + vec2(6.0, 0.0), weights));\n"
+    "}\n";
+
+// Relative change of a camera value between two frames, change from 0 is always large
+static double relativeChange(OMX_U32 previous, OMX_U32 current)
+{
+    if (previous == 0)
+    {
+        return (current == 0 ? 0.0 : 1.0);
+    }
+
+    return fabs((double)(current) - (double)(previous)) / previous;
+}
+
+OMXFrameSource::OMXFrameSource()
+{
+    cameraRunning = false;
+    cameraSettled = false;
+    frameEvent = NULL;
+    memset(&OMXcameraComponent, 0, sizeof(OMXComponent));
+    memset(&OMXnullSinkComponent, 0, sizeof(OMXComponent));
+    memset(&OMXeglRenderComponent, 0, sizeof(OMXComponent));
+    OMXeglRenderOutputBufferHeader = NULL;
+    eglImage = EGL_NO_IMAGE_KHR;
+}
+
+// Bring up camera, null_sink and egl_render, start capturing into texture of eglRenderOutputFbo
+// Components process commands concurrently: Commands of a step are sent to all components before waiting for them
+// Setup stops at the first failed step, teardown only undoes the steps which were done
+// OMX_Init must have been called before
+bool OMXFrameSource::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    OMXeglRenderOutputBufferHeader = NULL;
+    eglImage = EGL_NO_IMAGE_KHR;
+    frameRequested = false;
+    requestedCount = 0;
+
+    // Initialize components: Initialize, set component id and name, set VCOS flags, register OMX handle
+    // All components are initialized before checking, teardown relies on the handles of all of them
+    OMXInitializeComponent(&OMXcameraComponent, OMX_COMPONENT_CAMERA_ID, OMX_COMPONENT_CAMERA_NAME);
+    OMXInitializeComponent(&OMXnullSinkComponent, OMX_COMPONENT_NULL_SINK_ID, OMX_COMPONENT_NULL_SINK_NAME);
+    OMXInitializeComponent(&OMXeglRenderComponent, OMX_COMPONENT_EGL_RENDER_ID, OMX_COMPONENT_EGL_RENDER_NAME);
+    OMXeglRenderComponent.frameEvent = frameEvent;
+
+    if (failed())
+    {
+        return false;
+    }
+
+    // Camera settles again after each setup
+    memset(&cameraExposure, 0, sizeof(OMX_CONFIG_CAMERASETTINGSTYPE));
+    cameraStableFrames = 0;
+    cameraSettled = false;
+
+    // Disable all ports of all components, completed commands are counted for each component
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, false);
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, false);
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_STILL_IMAGE_OUTPUT, false);
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_CLOCK_INPUT, false);
+
+    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_VIDEO_INPUT, false);
+    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_IMAGE_INPUT, false);
+    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_AUDIO_INPUT, false);
+
+    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_INPUT, false);
+    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, false);
+
+    // Setup OMXcameraComponent: Set camera device id, wait for device id set, configure sensor and port width and height, set encoding, brightness, sharpness, ...
+    // Component in state loaded and ports disabled, null_sink and egl_render disable their ports meanwhile
+    if (!VCOSwaitPortsDisabled(&OMXcameraComponent, 4)
+        || !OMXSetupCamera(&OMXcameraComponent, width, height, &cameraSettings)
+        || !VCOSwaitPortsDisabled(&OMXnullSinkComponent, 3)
+        || !VCOSwaitPortsDisabled(&OMXeglRenderComponent, 2))
+    {
+        return false;
+    }
+
+    // Setup tunnel: OMXcameraComponent (preview video output) => OMXnullSinkComponent (video input)
+    if (OMX_SetupTunnel(OMXcameraComponent.handle, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, OMXnullSinkComponent.handle, OMX_PORT_NULL_SINK_VIDEO_INPUT))
+    {
+        OMXFailComponent(&OMXcameraComponent, "OMX tunnel preview video out => null sink video in");
+        return false;
+    }
+
+    // Setup tunnel: OMXcameraComponent (real video output) => OMXeglRenderComponent (video input)
+    if (OMX_SetupTunnel(OMXcameraComponent.handle, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, OMXeglRenderComponent.handle, OMX_PORT_EGL_RENDER_VIDEO_INPUT))
+    {
+        OMXFailComponent(&OMXcameraComponent, "OMX tunnel real video out => egl render video in");
+        return false;
+    }
+
+    // Setup state: Set all components to state idle, wait for all of them
+    OMXSetStateComponent(&OMXcameraComponent, OMX_StateIdle);
+    OMXSetStateComponent(&OMXeglRenderComponent, OMX_StateIdle);
+    OMXSetStateComponent(&OMXnullSinkComponent, OMX_StateIdle);
+
+    if (!VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_STATE_SET)
+        || !VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_STATE_SET)
+        || !VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_STATE_SET))
+    {
+        return false;
+    }
+
+    // Setup ports: Enable all required ports of components
+    // Inconsistent behaviour on port enable, do not send port enabled event?
+    // Therefore, no waiting for port enable events here
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, true);
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, true);
+    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_INPUT, true);
+    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, true);
+    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_VIDEO_INPUT, true);
+
+    // Setup EGLImage: EGLImage needed for setting up OMXeglRenderComponent
+    eglRenderOutputFbo.allocate(width, height, GL_RGBA);
+    GLuint eglTextureID = eglRenderOutputFbo.getTextureReference().getTextureData().textureID;
+    ofAppEGLWindow* eglWindow = (ofAppEGLWindow*)(ofGetWindowPtr());
+    EGLDisplay eglDisplay = eglWindow->getEglDisplay();
+    EGLContext eglContext = eglWindow->getEglContext();
+    eglImage = eglCreateImageKHR(eglDisplay, eglContext, EGL_GL_TEXTURE_2D_KHR, (EGLClientBuffer)(eglTextureID), NULL);
+
+    if (eglImage == EGL_NO_IMAGE_KHR)
+    {
+        OMXFailComponent(&OMXeglRenderComponent, "EGL create image");
+        return false;
+    }
+
+    // Setup OMXeglRenderComponent: Setup output buffer and output eglImage object
+    // Component in state idle and ports enabled
+    if (!OMXSetupEGLRender(&OMXeglRenderComponent, &eglImage, &OMXeglRenderOutputBufferHeader))
+    {
+        OMXeglRenderOutputBufferHeader = NULL;
+        return false;
+    }
+
+    // Setup state: Set all components to state executing, wait for all of them
+    OMXSetStateComponent(&OMXcameraComponent, OMX_StateExecuting);
+    OMXSetStateComponent(&OMXeglRenderComponent, OMX_StateExecuting);
+    OMXSetStateComponent(&OMXnullSinkComponent, OMX_StateExecuting);
+
+    if (!VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_STATE_SET)
+        || !VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_STATE_SET)
+        || !VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_STATE_SET))
+    {
+        return false;
+    }
+
+    // Start camera capturing
+    // Component in state executing and ports enabled
+    if (!OMXStartCameraCapturing(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT))
+    {
+        return false;
+    }
+
+    cameraRunning = true;
+    return !failed();
+}
+
+// Request next camera frame from egl_render if it was not requested by release, output is written to texture of eglRenderOutputFbo
+// Frame must arrive within OMX_SOURCE_TIMEOUT_MS after the request, otherwise egl_render fails and frame is not changed
+void OMXFrameSource::acquire(Frame* frame)
+{
+    if (failed())
+    {
+        return;
+    }
+
+    if (!frameRequested)
+    {
+        requestFrame();
+    }
+
+    // OMXeglRenderComponent: Wait until output buffer is completely ready, component has processed input and hands output buffer back to application
+    // Output data is written to texture of eglRenderOutputFbo
+    struct timespec currentTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
+    int remainingMs = OMX_SOURCE_TIMEOUT_MS - (int)(elapsedSeconds(&requestedTimespec, &currentTimespec) * 1000.0);
+
+    if (failed() || !VCOSwaitBufferDone(&OMXeglRenderComponent, VCOS_EVENT_FILL_BUFFER_DONE, &OMXeglRenderComponent.fillBufferDoneCount, requestedCount, remainingMs))
+    {
+        return;
+    }
+
+    frameRequested = false;
+    takeFrame(frame);
+}
+
+// Frame is ready when egl_render returned the requested output buffer, FillBufferDone signals the frame event
+// Frame which is not ready OMX_SOURCE_TIMEOUT_MS after the request fails egl_render
+bool OMXFrameSource::poll(Frame* frame)
+{
+    if (failed())
+    {
+        return false;
+    }
+
+    if (!frameRequested)
+    {
+        requestFrame();
+    }
+
+    if ((OMX_S32)(__atomic_load_n(&OMXeglRenderComponent.fillBufferDoneCount, __ATOMIC_ACQUIRE) - requestedCount) < 0)
+    {
+        struct timespec currentTimespec;
+        clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
+
+        if (frameRequested && elapsedSeconds(&requestedTimespec, &currentTimespec) * 1000.0 >= OMX_SOURCE_TIMEOUT_MS)
+        {
+            OMXeglRenderComponent.timedOut = true;
+            OMXFailComponent(&OMXeglRenderComponent, "OMX frame deadline missed");
+        }
+
+        return false;
+    }
+
+    frameRequested = false;
+    takeFrame(frame);
+
+    return true;
+}
+
+// GPU must have finished reading the texture before egl_render writes the next frame into it
+void OMXFrameSource::release()
+{
+    if (frameRequested || failed())
+    {
+        return;
+    }
+
+    glFinish();
+    requestFrame();
+}
+
+void OMXFrameSource::setFrameEvent(FrameEvent* event)
+{
+    frameEvent = event;
+}
+
+// Any component of the tunnels might fail, errors which arrived since the last wait are taken here
+bool OMXFrameSource::failed()
+{
+    bool cameraHealthy = OMXCheckComponent(&OMXcameraComponent);
+    bool nullSinkHealthy = OMXCheckComponent(&OMXnullSinkComponent);
+    bool eglRenderHealthy = OMXCheckComponent(&OMXeglRenderComponent);
+
+    return (!cameraHealthy || !nullSinkHealthy || !eglRenderHealthy);
+}
+
+// OMXcameraComponent: Tunnel preview data to OMXnullSinkComponent and real video to OMXeglRenderComponent
+// OMXeglRenderComponent: Hand back the output buffer to the component, will write to texture of eglRenderOutputFbo
+void OMXFrameSource::requestFrame()
+{
+    if (OMX_FillThisBuffer(OMXeglRenderComponent.handle, OMXeglRenderOutputBufferHeader))
+    {
+        OMXFailComponent(&OMXeglRenderComponent, "OMX fill buffer");
+        return;
+    }
+
+    frameRequested = true;
+    requestedCount++;
+    clock_gettime(CLOCK_MONOTONIC, &requestedTimespec);
+}
+
+void OMXFrameSource::takeFrame(Frame* frame)
+{
+    // Frame only exists on the GPU
+    frame->data = NULL;
+    frame->handle = &eglRenderOutputFbo;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = 4 * width;
+    frame->format = FRAME_FORMAT_RGBA;
+    frame->original = false;
+    frame->offsetX = 0;
+    frame->offsetY = 0;
+
+    // Request time: FillThisBuffer of the taken output buffer, capture time: its FillBufferDone
+    frame->requestTimespec = requestedTimespec;
+    frame->captureTimespec = OMXeglRenderComponent.fillBufferDoneTimespecs[(requestedCount - 1) % OMX_BUFFER_DONE_TIMES];
+}
+
+// Camera settled once exposure time, gains and white balance gains stayed within OMX_CAM_SETTLE_TOLERANCE for OMX_CAM_SETTLE_FRAMES frames
+// Exposure time 0 is not taken as settled, the camera reports it before its first adjustments
+bool OMXFrameSource::settled()
+{
+    if (cameraSettled || !cameraRunning || failed())
+    {
+        return cameraSettled;
+    }
+
+    OMX_CONFIG_CAMERASETTINGSTYPE exposure;
+
+    if (!OMXGetCameraExposure(&OMXcameraComponent, &exposure))
+    {
+        return false;
+    }
+
+    bool stable = (exposure.nExposure > 0
+        && relativeChange(cameraExposure.nExposure, exposure.nExposure) <= OMX_CAM_SETTLE_TOLERANCE
+        && relativeChange(cameraExposure.nAnalogGain, exposure.nAnalogGain) <= OMX_CAM_SETTLE_TOLERANCE
+        && relativeChange(cameraExposure.nDigitalGain, exposure.nDigitalGain) <= OMX_CAM_SETTLE_TOLERANCE
+        && relativeChange(cameraExposure.nRedGain, exposure.nRedGain) <= OMX_CAM_SETTLE_TOLERANCE
+        && relativeChange(cameraExposure.nBlueGain, exposure.nBlueGain) <= OMX_CAM_SETTLE_TOLERANCE);
+
+    cameraExposure = exposure;
+    cameraStableFrames = (stable ? cameraStableFrames + 1 : 0);
+    cameraSettled = (cameraStableFrames >= OMX_CAM_SETTLE_FRAMES);
+    return cameraSettled;
+}
+
+// Remember camera settings for setup, running camera gets them as configs without stopping the tunnels
+void OMXFrameSource::setCameraSettings(const CameraSettings* settings)
+{
+    cameraSettings = *settings;
+
+    if (cameraRunning && !OMXSetupCameraSettings(&OMXcameraComponent, &cameraSettings))
+    {
+        printf("OMX Warning: Camera did not accept all settings\n");
+    }
+}
+
+// Stop capturing, bring camera, null_sink and egl_render back to state loaded and free them
+// Same steps as setup in reverse order, a requested output buffer of egl_render is returned by state idle
+// Failed source: Steps of timed out components do not wait, their handles are freed anyway
+// Steps which a failed setup did not reach are skipped, components without handle, the missing output buffer and EGLImage
+void OMXFrameSource::teardown()
+{
+    OMXStopCameraCapturing(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT);
+    cameraRunning = false;
+
+    // Setup state: Set all components to state idle
+    OMXSetStateComponent(&OMXcameraComponent, OMX_StateIdle);
+    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_STATE_SET);
+
+    OMXSetStateComponent(&OMXeglRenderComponent, OMX_StateIdle);
+    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_STATE_SET);
+
+    OMXSetStateComponent(&OMXnullSinkComponent, OMX_StateIdle);
+    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_STATE_SET);
+
+    // Disable ports: Both ports of a tunnel are disabled before waiting, tunneled buffers are freed by the components
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, false);
+    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_VIDEO_INPUT, false);
+    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_PORT_DISABLE);
+    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_PORT_DISABLE);
+
+    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, false);
+    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_INPUT, false);
+    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_PORT_DISABLE);
+    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_PORT_DISABLE);
+
+    // Output port of egl_render is disabled after its buffer is freed, buffer is missing if setup failed before
+    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, false);
+
+    if (OMXeglRenderOutputBufferHeader && OMX_FreeBuffer(OMXeglRenderComponent.handle, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, OMXeglRenderOutputBufferHeader))
+    {
+        OMXFailComponent(&OMXeglRenderComponent, "OMX free output buffer");
+    }
+
+    OMXeglRenderOutputBufferHeader = NULL;
+    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_PORT_DISABLE);
+
+    // Remove tunnels, components which could not be initialized have no handle
+    if (OMXcameraComponent.handle && OMXnullSinkComponent.handle && OMXeglRenderComponent.handle)
+    {
+        OMX_SetupTunnel(OMXcameraComponent.handle, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, NULL, 0);
+        OMX_SetupTunnel(OMXnullSinkComponent.handle, OMX_PORT_NULL_SINK_VIDEO_INPUT, NULL, 0);
+        OMX_SetupTunnel(OMXcameraComponent.handle, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, NULL, 0);
+        OMX_SetupTunnel(OMXeglRenderComponent.handle, OMX_PORT_EGL_RENDER_VIDEO_INPUT, NULL, 0);
+    }
+
+    // Setup state: Set all components to state loaded
+    OMXSetStateComponent(&OMXcameraComponent, OMX_StateLoaded);
+    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_STATE_SET);
+
+    OMXSetStateComponent(&OMXeglRenderComponent, OMX_StateLoaded);
+    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_STATE_SET);
+
+    OMXSetStateComponent(&OMXnullSinkComponent, OMX_StateLoaded);
+    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_STATE_SET);
+
+    OMXDeinitializeComponent(&OMXcameraComponent);
+    OMXDeinitializeComponent(&OMXeglRenderComponent);
+    OMXDeinitializeComponent(&OMXnullSinkComponent);
+
+    // EGLImage of the old FBO texture, setup allocates the FBO again
+    if (eglImage != EGL_NO_IMAGE_KHR)
+    {
+        ofAppEGLWindow* eglWindow = (ofAppEGLWindow*)(ofGetWindowPtr());
+        eglDestroyImageKHR(eglWindow->getEglDisplay(), eglImage);
+        eglImage = EGL_NO_IMAGE_KHR;
+    }
+}
+
+// Allocate default render FBO
+GLFrameWarper::GLFrameWarper(int frameFormat)
+{
+    this->frameFormat = frameFormat;
+    samplePixels = NULL;
+}
+
+void GLFrameWarper::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    if (frameFormat != FRAME_FORMAT_YUV420)
+    {
+        defaultRenderOutputFbo.allocate(width, height, GL_RGBA);
+        return;
+    }
+
+    // Planar YUV420: 1.5 bytes per pixel, 4 bytes per texel
+    yuvRenderOutputFbo.allocate(width / 4, (height * 3) / 2, GL_RGBA);
+
+    if (!yuvShader.setupShaderFromSource(GL_VERTEX_SHADER, yuvVertexShaderSource)
+        || !yuvShader.setupShaderFromSource(GL_FRAGMENT_SHADER, yuvFragmentShaderSource))
+    {
+        printf("GL Error: Compile YUV420 shader - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    yuvShader.bindDefaults();
+
+    if (!yuvShader.linkProgram())
+    {
+        printf("GL Error: Link YUV420 shader - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+}
+
+// FBOs are allocated again by setup, sample FBO does not depend on the resolution and is kept
+void GLFrameWarper::teardown()
+{
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        yuvShader.unload();
+    }
+}
+
+void GLFrameWarper::setHomography(const float* values)
+{
+    // Need to covert homography matrix in openCV format to openGL format
+    // Can ignore z-coordinate here, so just fill up with empty values for z
+    homographyInputMatrix.set(values[0], values[3], 0.0f, values[6],
+                              values[1], values[4], 0.0f, values[7],
+                              0.0f,      0.0f,      0.0f, 0.0f,
+                              values[2], values[5], 0.0f, values[8]);
+
+    // Shader maps output pixels back into the camera frame, singular matrix draws black like an empty FBO
+    double matrix[9];
+    double inverse[9];
+
+    for (int i = 0; i < 9; i++)
+    {
+        matrix[i] = values[i];
+    }
+
+    if (!invertMatrix3x3(matrix, inverse))
+    {
+        memset(inverse, 0, sizeof(inverse));
+    }
+
+    for (int i = 0; i < 9; i++)
+    {
+        inverseHomographyValues[i] = (float)(inverse[i]);
+    }
+}
+
+void GLFrameWarper::warp(const Frame* input, const FrameRegion* region)
+{
+    // Planar YUV420: Warp and convert region in one pass
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        drawPackedYUV((ofFbo*)(input->handle), inverseHomographyValues, region);
+        return;
+    }
+
+    // Draw into default render FBO
+    defaultRenderOutputFbo.begin();
+
+    // Perform homography matrix multiplication in modelview mode to texture of input FBO
+    ofSetMatrixMode(OF_MATRIX_MODELVIEW);
+    ofPushMatrix();
+
+    // Matrix multiplication with homography matrix in output image
+    ofMultMatrix(homographyInputMatrix);
+
+    // Draw image to modified modelview and restore previous matrix
+    ((ofFbo*)(input->handle))->draw(0, 0);
+    ofPopMatrix();
+
+    // Stop draw into default render FBO
+    defaultRenderOutputFbo.end();
+}
+
+void GLFrameWarper::readback(const Frame* input, bool original, Frame* output)
+{
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Planar YUV420: Original frame is converted with identity matrix, packed texels of the region are already the planar frame
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        if (original)
+        {
+            const float identity[9] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+            FrameRegion region;
+            region.x = output->offsetX;
+            region.y = output->offsetY;
+            region.width = output->width;
+            region.height = output->height;
+            drawPackedYUV((ofFbo*)(input->handle), identity, &region);
+        }
+
+        glBindFramebufferOES(GL_FRAMEBUFFER_OES, yuvRenderOutputFbo.getFbo());
+        glReadPixels(0, 0, output->width / 4, (output->height * 3) / 2, GL_RGBA, GL_UNSIGNED_BYTE, output->data);
+        glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
+        return;
+    }
+
+    // Bind FBO of input frame or default render FBO by using FBO id
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, (original ? ((ofFbo*)(input->handle))->getFbo() : defaultRenderOutputFbo.getFbo()));
+
+    // Read pixels of output region from bound FBO into memory buffer
+    // Rows of FBOs are stored top down in openFrameworks, so region offsets are used directly
+    glReadPixels(output->offsetX, output->offsetY, output->width, output->height, GL_RGBA, GL_UNSIGNED_BYTE, output->data);
+
+    // Reset to default FBO by using 0 for default FBO id
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
+}
+
+// Same homography as the RGBA warp, scaled down to the sample size, bilinear filtering averages 2 x 2 pixels
+// Works for both pixel formats, the small readback synchronizes with the GPU once per frame
+void GLFrameWarper::sampleLuma(const Frame* input, int sampleWidth, int sampleHeight, unsigned char* output)
+{
+    // Allocate sample FBO and memory on first call
+    if (!samplePixels)
+    {
+        sampleRenderOutputFbo.allocate(sampleWidth, sampleHeight, GL_RGBA);
+        samplePixels = (GLubyte*)(malloc(4 * sampleWidth * sampleHeight));
+    }
+
+    // Draw input with homography, area outside of the warped image is black
+    sampleRenderOutputFbo.begin();
+    ofClear(0, 0, 0, 255);
+    ofSetMatrixMode(OF_MATRIX_MODELVIEW);
+    ofPushMatrix();
+    ofScale((float)(sampleWidth) / width, (float)(sampleHeight) / height);
+    ofMultMatrix(homographyInputMatrix);
+    ((ofFbo*)(input->handle))->draw(0, 0);
+    ofPopMatrix();
+    sampleRenderOutputFbo.end();
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, sampleRenderOutputFbo.getFbo());
+    glReadPixels(0, 0, sampleWidth, sampleHeight, GL_RGBA, GL_UNSIGNED_BYTE, samplePixels);
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
+
+    // Luma with the weights of JFIF
+    for (int i = 0; i < sampleWidth * sampleHeight; i++)
+    {
+        output[i] = (unsigned char)((77 * samplePixels[4 * i + 0] + 150 * samplePixels[4 * i + 1] + 29 * samplePixels[4 * i + 2]) >> 8);
+    }
+}
+
+// Rows of FBOs are stored top down in openFrameworks, the rectangle covers the first texel rows which are read back
+void GLFrameWarper::drawPackedYUV(ofFbo* input, const float* inverse, const FrameRegion* region)
+{
+    ofTextureData& textureData = input->getTextureReference().getTextureData();
+
+    yuvRenderOutputFbo.begin();
+    yuvShader.begin();
+    yuvShader.setUniformTexture("cameraTexture", input->getTextureReference(), 0);
+    yuvShader.setUniform3f("inverseRow0", inverse[0], inverse[1], inverse[2]);
+    yuvShader.setUniform3f("inverseRow1", inverse[3], inverse[4], inverse[5]);
+    yuvShader.setUniform3f("inverseRow2", inverse[6], inverse[7], inverse[8]);
+    yuvShader.setUniform2f("frameSize", width, height);
+    yuvShader.setUniform2f("textureScale", textureData.tex_t, textureData.tex_u);
+    yuvShader.setUniform2f("regionOffset", region->x, region->y);
+    yuvShader.setUniform2f("regionSize", region->width, region->height);
+    ofRect(0, 0, region->width / 4, (region->height * 3) / 2);
+    yuvShader.end();
+    yuvRenderOutputFbo.end();
+}
+
+OMXFrameEncoder::OMXFrameEncoder(int bufferCount, int frameFormat)
+{
+    this->bufferCount = bufferCount;
+    this->frameFormat = frameFormat;
+    submittedCount = 0;
+    collectedCount = 0;
+    quality = OMX_JPEG_QUALITY;
+    encoderRunning = false;
+    frameEvent = NULL;
+    pendingQuality = -1;
+    qualityRefused = false;
+    qualityLocked = false;
+    memset(&OMXimageEncodeComponent, 0, sizeof(OMXComponent));
+}
+
+// Bring up image_encode with bufferCount input and output buffers
+// Does not use the GL context, the pipeline might call it on another thread than the render thread while the source is set up
+// Setup stops at the first failed step, teardown only frees the buffers which were allocated
+// OMX_Init must have been called before
+bool OMXFrameEncoder::setup(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    // Check buffer count, completion times are kept for OMX_BUFFER_DONE_TIMES buffers
+    if (bufferCount < 1 || bufferCount > OMX_BUFFER_DONE_TIMES)
+    {
+        printf("OMX Error: Image encode needs 1 to %d buffers - EXITING APPLICATION\n", OMX_BUFFER_DONE_TIMES);
+        kill(getpid(), SIGKILL);
+    }
+
+    // Allocate buffers for screen pixels and empty buffers
+    OMXscreenPixelBuffers = (GLubyte**)(malloc(bufferCount * sizeof(GLubyte*)));
+
+    for (int i = 0; i < bufferCount; i++)
+    {
+        OMXscreenPixelBuffers[i] = (GLubyte*)(malloc(frameBytes(width, height, frameFormat)));
+        memset(OMXscreenPixelBuffers[i], 0, frameBytes(width, height, frameFormat) * sizeof(GLubyte));
+    }
+
+    // Allocate ring of buffer headers and information about submitted frames
+    OMXimageEncodeInputBufferHeaders = (OMX_BUFFERHEADERTYPE**)(calloc(bufferCount, sizeof(OMX_BUFFERHEADERTYPE*)));
+    OMXimageEncodeOutputBufferHeaders = (OMX_BUFFERHEADERTYPE**)(calloc(bufferCount, sizeof(OMX_BUFFERHEADERTYPE*)));
+    submittedFrames = (Frame*)(malloc(bufferCount * sizeof(Frame)));
+    memset(submittedFrames, 0, bufferCount * sizeof(Frame));
+    submittedQualities = (int*)(calloc(bufferCount, sizeof(int)));
+    submittedTimespecs = (struct timespec*)(calloc(bufferCount, sizeof(struct timespec)));
+
+    // Initialize OMXimageEncodeComponent: Initialize, set component id and name, set VCOS flags, register OMX handle
+    // Disable all ports, wait for both port disables
+    // Ports are configured for the full frame as soon as the settings are sent
+    portWidth = width;
+    portHeight = height;
+
+    // Settings contain the quality, a new component is asked again for runtime changes
+    pendingQuality = -1;
+    qualityRefused = false;
+    qualityLocked = false;
+
+    if (!OMXInitializeComponent(&OMXimageEncodeComponent, OMX_COMPONENT_IMAGE_ENCODE_ID, OMX_COMPONENT_IMAGE_ENCODE_NAME))
+    {
+        return false;
+    }
+
+    OMXimageEncodeComponent.frameEvent = frameEvent;
+
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, false);
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, false);
+
+    // Setup OMXimageEncodeComponent: Set buffer counts, port width and height, color format, jpeg settings
+    // Component in state loaded and ports disabled
+    if (!VCOSwaitPortsDisabled(&OMXimageEncodeComponent, 2)
+        || !OMXSetupImageEncodeSettings(&OMXimageEncodeComponent, width, height, bufferCount, quality, frameFormat))
+    {
+        return false;
+    }
+
+    // Setup state: Set component to state idle
+    OMXSetStateComponent(&OMXimageEncodeComponent, OMX_StateIdle);
+
+    if (!VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_STATE_SET))
+    {
+        return false;
+    }
+
+    // Setup ports: Enable all required ports of component
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, true);
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, true);
+
+    // Setup OMXimageEncodeComponent: Allocate all input and output buffers
+    // Component in state idle and ports enabled
+    if (!OMXSetupImageEncodeAllocate(&OMXimageEncodeComponent, OMXscreenPixelBuffers, OMXimageEncodeInputBufferHeaders, OMXimageEncodeOutputBufferHeaders, bufferCount, width, height, frameFormat))
+    {
+        return false;
+    }
+
+    // Setup state: Set component to state executing
+    OMXSetStateComponent(&OMXimageEncodeComponent, OMX_StateExecuting);
+
+    if (!VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_STATE_SET))
+    {
+        return false;
+    }
+
+    encoderRunning = true;
+    return !failed();
+}
+
+// Input buffer of next slot is used directly as readback target
+void OMXFrameEncoder::getInputFrame(Frame* frame)
+{
+    int slot = submittedCount % bufferCount;
+
+    // Input buffer of this slot was submitted bufferCount frames ago, wait until component has read it
+    // Normally it is already finished, because its output was collected before
+    // Failed component: Buffer is still returned, the frame written into it is not encoded
+    if (submittedCount >= (OMX_U32)(bufferCount) && !failed())
+    {
+        VCOSwaitBufferDone(&OMXimageEncodeComponent, VCOS_EVENT_EMPTY_BUFFER_DONE, &OMXimageEncodeComponent.emptyBufferDoneCount, submittedCount - bufferCount + 1, OMX_ENCODE_TIMEOUT_MS);
+    }
+
+    frame->data = OMXscreenPixelBuffers[slot];
+    frame->handle = NULL;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = (frameFormat == FRAME_FORMAT_YUV420 ? width : 4 * width);
+    frame->format = frameFormat;
+    frame->original = false;
+    frame->offsetX = 0;
+    frame->offsetY = 0;
+}
+
+// Failed component: Nothing is submitted, output is empty with the original flag of input, the pipeline requests an original captured image again
+void OMXFrameEncoder::encode(const Frame* input, EncodedFrame* output)
+{
+    int slot = submittedCount % bufferCount;
+
+    output->data = NULL;
+    output->length = 0;
+    output->header = NULL;
+    output->headerLength = 0;
+    output->original = input->original;
+
+    if (failed())
+    {
+        return;
+    }
+
+    // Ports are configured for one frame size, pipeline flushed all frames before the size changed
+    if (input->width != portWidth || input->height != portHeight)
+    {
+        resizePorts(input->width, input->height);
+
+        if (failed())
+        {
+            return;
+        }
+    }
+
+    // Quality refused by the running component: Output buffers are only owned by the application while no frame is in flight
+    if (pendingQuality >= 0 && collectedCount == submittedCount)
+    {
+        reconfigureQuality();
+
+        if (failed())
+        {
+            return;
+        }
+    }
+
+    // Output buffer of this slot was collected before, it might have been returned by the previous call
+    // OMXimageEncodeComponent: Hand back the output buffer to the component
+    if (OMX_FillThisBuffer(OMXimageEncodeComponent.handle, OMXimageEncodeOutputBufferHeaders[slot]))
+    {
+        OMXFailComponent(&OMXimageEncodeComponent, "OMX fill buffer");
+        return;
+    }
+
+    // OMXimageEncodeComponent: Set filled length of input buffer to full length, hand back input buffer to the component and start reading
+    OMXimageEncodeInputBufferHeaders[slot]->nFilledLen = OMXimageEncodeInputBufferHeaders[slot]->nAllocLen;
+    if (OMX_EmptyThisBuffer(OMXimageEncodeComponent.handle, OMXimageEncodeInputBufferHeaders[slot]))
+    {
+        OMXFailComponent(&OMXimageEncodeComponent, "OMX empty buffer");
+        return;
+    }
+
+    // Remember information about submitted frame for output
+    submittedFrames[slot] = *input;
+    submittedQualities[slot] = quality;
+    clock_gettime(CLOCK_MONOTONIC, &submittedTimespecs[slot]);
+    submittedCount++;
+
+    // Nothing to return, if no frame is finished and there are still free buffers
+    output->original = false;
+
+    bool oldestFinished = ((OMX_S32)(__atomic_load_n(&OMXimageEncodeComponent.fillBufferDoneCount, __ATOMIC_ACQUIRE) - collectedCount) > 0);
+
+    if (!oldestFinished && (submittedCount - collectedCount) < (OMX_U32)(bufferCount))
+    {
+        return;
+    }
+
+    // OMXimageEncodeComponent: Wait until output buffer of oldest frame is completely ready, component has processed input and hands output buffer back to application
+    if (!VCOSwaitBufferDone(&OMXimageEncodeComponent, VCOS_EVENT_FILL_BUFFER_DONE, &OMXimageEncodeComponent.fillBufferDoneCount, collectedCount + 1, OMX_ENCODE_TIMEOUT_MS))
+    {
+        return;
+    }
+
+    int oldestSlot = collectedCount % bufferCount;
+    collectedCount++;
+    collectSlot(oldestSlot, output);
+}
+
+bool OMXFrameEncoder::flush(EncodedFrame* output)
+{
+    if (collectedCount == submittedCount || failed())
+    {
+        return false;
+    }
+
+    // OMXimageEncodeComponent: Wait until output buffer of oldest frame is completely ready
+    if (!VCOSwaitBufferDone(&OMXimageEncodeComponent, VCOS_EVENT_FILL_BUFFER_DONE, &OMXimageEncodeComponent.fillBufferDoneCount, collectedCount + 1, OMX_ENCODE_TIMEOUT_MS))
+    {
+        return false;
+    }
+
+    int oldestSlot = collectedCount % bufferCount;
+    collectedCount++;
+    collectSlot(oldestSlot, output);
+
+    return true;
+}
+
+// Oldest frame is finished if image_encode returned its output buffer, FillBufferDone signals the frame event
+bool OMXFrameEncoder::collect(EncodedFrame* output)
+{
+    if (collectedCount == submittedCount || failed())
+    {
+        return false;
+    }
+
+    if ((OMX_S32)(__atomic_load_n(&OMXimageEncodeComponent.fillBufferDoneCount, __ATOMIC_ACQUIRE) - collectedCount) <= 0)
+    {
+        return false;
+    }
+
+    int oldestSlot = collectedCount % bufferCount;
+    collectedCount++;
+    collectSlot(oldestSlot, output);
+
+    return true;
+}
+
+void OMXFrameEncoder::setFrameEvent(FrameEvent* event)
+{
+    frameEvent = event;
+}
+
+// Errors which arrived since the last wait are taken here
+bool OMXFrameEncoder::failed()
+{
+    return !OMXCheckComponent(&OMXimageEncodeComponent);
+}
+
+// Output of a finished slot with information of its submitted frame
+// Frames are read and finish in submit order, the collected frame is the one which was emptied and filled as number collectedCount - 1
+void OMXFrameEncoder::collectSlot(int slot, EncodedFrame* output)
+{
+    const struct timespec* inputTimespec = &OMXimageEncodeComponent.emptyBufferDoneTimespecs[(collectedCount - 1) % OMX_BUFFER_DONE_TIMES];
+    const struct timespec* doneTimespec = &OMXimageEncodeComponent.fillBufferDoneTimespecs[(collectedCount - 1) % OMX_BUFFER_DONE_TIMES];
+
+    // Valid bytes begin at pBuffer + nOffset of the output buffer header
+    // Length of valid bytes is stored in nFilledLen of the output buffer header
+    output->data = OMXimageEncodeOutputBufferHeaders[slot]->pBuffer + OMXimageEncodeOutputBufferHeaders[slot]->nOffset;
+    output->length = OMXimageEncodeOutputBufferHeaders[slot]->nFilledLen;
+    output->header = NULL;
+    output->headerLength = 0;
+    output->original = submittedFrames[slot].original;
+    output->width = submittedFrames[slot].width;
+    output->height = submittedFrames[slot].height;
+    output->offsetX = submittedFrames[slot].offsetX;
+    output->offsetY = submittedFrames[slot].offsetY;
+    output->sequence = submittedFrames[slot].sequence;
+    output->captureTimespec = submittedFrames[slot].captureTimespec;
+    output->warpTimespec = submittedFrames[slot].warpTimespec;
+    output->encodedTimespec = *doneTimespec;
+    output->quality = submittedQualities[slot];
+    output->inputSeconds = elapsedSeconds(&submittedTimespecs[slot], inputTimespec);
+    output->encodeSeconds = elapsedSeconds(&submittedTimespecs[slot], doneTimespec);
+}
+
+// Reconfigure ports of running image_encode for a new frame size
+// All frames must be collected, input buffers keep their memory (allocated for the full frame)
+void OMXFrameEncoder::resizePorts(int frameWidth, int frameHeight)
+{
+    // OMXimageEncodeComponent: Wait until component is finished with all input buffers
+    if (!VCOSwaitBufferDone(&OMXimageEncodeComponent, VCOS_EVENT_EMPTY_BUFFER_DONE, &OMXimageEncodeComponent.emptyBufferDoneCount, submittedCount, OMX_ENCODE_TIMEOUT_MS))
+    {
+        return;
+    }
+
+    // Disable ports, port is disabled after all of its buffers are freed
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, false);
+
+    freeBuffers(OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, OMXimageEncodeInputBufferHeaders);
+    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE);
+
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, false);
+    freeBuffers(OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, OMXimageEncodeOutputBufferHeaders);
+    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE);
+
+    // Same steps as in setup with the new size, component stays in state executing
+    portWidth = frameWidth;
+    portHeight = frameHeight;
+
+    if (!OMXSetupImageEncodeSettings(&OMXimageEncodeComponent, frameWidth, frameHeight, bufferCount, quality, frameFormat))
+    {
+        return;
+    }
+
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, true);
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, true);
+    OMXSetupImageEncodeAllocate(&OMXimageEncodeComponent, OMXscreenPixelBuffers, OMXimageEncodeInputBufferHeaders, OMXimageEncodeOutputBufferHeaders, bufferCount, frameWidth, frameHeight, frameFormat);
+}
+
+// Free buffers of port which were allocated, headers are NULL afterwards
+void OMXFrameEncoder::freeBuffers(OMX_U32 port, OMX_BUFFERHEADERTYPE** bufferHeaders)
+{
+    for (int i = 0; i < bufferCount; i++)
+    {
+        if (bufferHeaders[i] && OMX_FreeBuffer(OMXimageEncodeComponent.handle, port, bufferHeaders[i]))
+        {
+            OMXFailComponent(&OMXimageEncodeComponent, (port == OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT ? "OMX free input buffer" : "OMX free output buffer"));
+        }
+
+        bufferHeaders[i] = NULL;
+    }
+}
+
+void OMXFrameEncoder::setBufferCount(int bufferCount)
+{
+    this->bufferCount = bufferCount;
+}
+
+// Bring image_encode back to state loaded, free its buffers and the component
+// All frames were collected before, all output buffers are owned by the application
+// Failed component: Buffers in flight are returned by state idle, steps of a timed out component do not wait
+void OMXFrameEncoder::teardown()
+{
+    // OMXimageEncodeComponent: Wait until component is finished with all input buffers
+    if (!OMXimageEncodeComponent.failed)
+    {
+        VCOSwaitBufferDone(&OMXimageEncodeComponent, VCOS_EVENT_EMPTY_BUFFER_DONE, &OMXimageEncodeComponent.emptyBufferDoneCount, submittedCount, OMX_ENCODE_TIMEOUT_MS);
+    }
+
+    encoderRunning = false;
+
+    // Setup state: Set component to state idle
+    OMXSetStateComponent(&OMXimageEncodeComponent, OMX_StateIdle);
+    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_STATE_SET);
+
+    // Disable ports, port is disabled after all of its buffers are freed
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, false);
+    freeBuffers(OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, OMXimageEncodeInputBufferHeaders);
+    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE);
+
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, false);
+    freeBuffers(OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, OMXimageEncodeOutputBufferHeaders);
+    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE);
+
+    // Setup state: Set component to state loaded
+    OMXSetStateComponent(&OMXimageEncodeComponent, OMX_StateLoaded);
+    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_STATE_SET);
+    OMXDeinitializeComponent(&OMXimageEncodeComponent);
+
+    // Input buffers were used by the component, free them afterwards
+    for (int i = 0; i < bufferCount; i++)
+    {
+        free(OMXscreenPixelBuffers[i]);
+    }
+
+    free(OMXscreenPixelBuffers);
+    free(OMXimageEncodeInputBufferHeaders);
+    free(OMXimageEncodeOutputBufferHeaders);
+    free(submittedFrames);
+    free(submittedQualities);
+    free(submittedTimespecs);
+
+    // Done counters of the component start again with the next setup
+    submittedCount = 0;
+    collectedCount = 0;
+}
+
+// Remember quality for setup, running component gets it for the next submitted frames
+// Quality of submitted frames only changes after the component accepted it, rate control sees the quality which was used
+void OMXFrameEncoder::setQuality(int quality)
+{
+    if (!encoderRunning)
+    {
+        this->quality = quality;
+        return;
+    }
+
+    // Pipeline sets quality before each frame, only changes are passed to the component
+    pendingQuality = -1;
+
+    if (quality == this->quality || qualityLocked || OMXimageEncodeComponent.failed)
+    {
+        return;
+    }
+
+    if (!qualityRefused && OMXSetupImageEncodeQuality(&OMXimageEncodeComponent, quality))
+    {
+        this->quality = quality;
+        return;
+    }
+
+    // Component refused the change on the enabled output port, encode applies it with the port disabled
+    if (!qualityRefused)
+    {
+        printf("OMX Warning: Image encode component did not accept JPEG quality %d at runtime, output port is reconfigured for quality changes\n", quality);
+        qualityRefused = true;
+    }
+
+    pendingQuality = quality;
+}
+
+// Disable output port, set quality and enable it again, input port and state stay unchanged
+// Output buffers are freed and allocated again, no frame is in flight
+void OMXFrameEncoder::reconfigureQuality()
+{
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, false);
+    freeBuffers(OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, OMXimageEncodeOutputBufferHeaders);
+
+    if (!VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE))
+    {
+        return;
+    }
+
+    if (OMXSetupImageEncodeQuality(&OMXimageEncodeComponent, pendingQuality))
+    {
+        quality = pendingQuality;
+    }
+    else
+    {
+        printf("OMX Warning: Image encode component did not accept JPEG quality %d on the disabled output port, quality stays %d until the next setup\n", pendingQuality, quality);
+        qualityLocked = true;
+    }
+
+    pendingQuality = -1;
+
+    // Enable events of setup were never consumed, clear them to wait for this one
+    VCOS_UNSIGNED VCOSresult;
+    vcos_event_flags_get(&OMXimageEncodeComponent.vcos_flags, VCOS_EVENT_PORT_ENABLE, VCOS_OR_CONSUME, VCOS_NO_SUSPEND, &VCOSresult);
+
+    // Port is enabled after all of its buffers are allocated, buffers are filled again by the next encode
+    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, true);
+
+    if (OMXSetupImageEncodeAllocateOutput(&OMXimageEncodeComponent, OMXimageEncodeOutputBufferHeaders, bufferCount, portWidth, portHeight))
+    {
+        VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_ENABLE);
+    }
+}
@@ -0,0 +1,174 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU.h"
+
+/* #####################################
+OMX BACKEND
+##################################### */
+
+// Source: Camera tunneled to egl_render, frames are written into the texture of an FBO
+class OMXFrameSource : public FrameSource
+{
+    public:
+        OMXFrameSource();
+
+        bool setup(int width, int height);
+        void acquire(Frame* frame);
+        bool poll(Frame* frame);
+        void release();
+        void setFrameEvent(FrameEvent* event);
+        void setCameraSettings(const CameraSettings* settings);
+        bool settled();
+        bool failed();
+        void teardown();
+
+        // Hand output buffer to egl_render for the next frame
+        void requestFrame();
+
+        // Set frame to the texture of eglRenderOutputFbo
+        void takeFrame(Frame* frame);
+
+        int width;
+        int height;
+
+        // Output buffer was handed to egl_render and not taken yet, requests are counted like FillBufferDone
+        bool frameRequested;
+        OMX_U32 requestedCount;
+
+        // Time of the last request, the frame must be delivered within OMX_SOURCE_TIMEOUT_MS
+        struct timespec requestedTimespec;
+        FrameEvent* frameEvent;
+
+        // Camera settings, applied to the running camera when they change
+        CameraSettings cameraSettings;
+        bool cameraRunning;
+
+        // Settling of the camera: Exposure of the last frame and frames in a row without a larger change
+        OMX_CONFIG_CAMERASETTINGSTYPE cameraExposure;
+        int cameraStableFrames;
+        bool cameraSettled;
+
+        // OMX variables: Camera
+        OMXComponent OMXcameraComponent;
+
+        // OMX variables: Null sink
+        OMXComponent OMXnullSinkComponent;
+
+        // OMX variables: EGL render
+        OMXComponent OMXeglRenderComponent;
+        OMX_BUFFERHEADERTYPE* OMXeglRenderOutputBufferHeader;
+        EGLImageKHR eglImage;
+        ofFbo eglRenderOutputFbo;
+};
+
+// Warper: Draws input texture with homography matrix into an FBO, reads it back with glReadPixels
+// Planar YUV420: A shader warps the region and converts it in one pass, Y and chroma bytes are packed into the texels of an RGBA FBO
+class GLFrameWarper : public FrameWarper
+{
+    public:
+        GLFrameWarper(int frameFormat);
+
+        void setup(int width, int height);
+        void setHomography(const float* values);
+        void warp(const Frame* input, const FrameRegion* region);
+        void readback(const Frame* input, bool original, Frame* output);
+        void sampleLuma(const Frame* input, int sampleWidth, int sampleHeight, unsigned char* output);
+        void teardown();
+
+        // Draw region of input FBO with inverse homography (openCV format) as packed YUV420 into yuvRenderOutputFbo
+        void drawPackedYUV(ofFbo* input, const float* inverse, const FrameRegion* region);
+
+        int width;
+        int height;
+        int frameFormat;
+        ofMatrix4x4 homographyInputMatrix;
+        ofFbo defaultRenderOutputFbo;
+
+        // Planar YUV420: Inverse homography for the shader, FBO has width / 4 x height * 3 / 2 texels (4 bytes each)
+        float inverseHomographyValues[9];
+        ofShader yuvShader;
+        ofFbo yuvRenderOutputFbo;
+
+        // Change detection: Input drawn with homography into a small FBO, read back as RGBA
+        ofFbo sampleRenderOutputFbo;
+        GLubyte* samplePixels;
+};
+
+// Encoder: image_encode component with a ring of input and output buffers, input buffers are filled by the warper
+class OMXFrameEncoder : public FrameEncoder
+{
+    public:
+        OMXFrameEncoder(int bufferCount, int frameFormat);
+
+        bool setup(int width, int height);
+        void getInputFrame(Frame* frame);
+        void encode(const Frame* input, EncodedFrame* output);
+        bool flush(EncodedFrame* output);
+        bool collect(EncodedFrame* output);
+        void setFrameEvent(FrameEvent* event);
+        void setQuality(int quality);
+        void setBufferCount(int bufferCount);
+        bool failed();
+        void teardown();
+
+        // Set output to the finished frame of slot
+        void collectSlot(int slot, EncodedFrame* output);
+
+        // Reconfigure ports for frames of a warped region
+        void resizePorts(int frameWidth, int frameHeight);
+
+        // Free allocated buffers of port, headers of buffers which were not allocated are NULL
+        void freeBuffers(OMX_U32 port, OMX_BUFFERHEADERTYPE** bufferHeaders);
+
+        // Apply pendingQuality with the output port disabled, all frames must be collected
+        void reconfigureQuality();
+
+        int width;
+        int height;
+        int frameFormat;
+        int quality;
+        bool encoderRunning;
+
+        // Quality the running component refused, -1 if none, applied by reconfigureQuality
+        // Refused: Changes go through reconfigureQuality, locked: Component refused that too, quality stays until the next setup
+        int pendingQuality;
+        bool qualityRefused;
+        bool qualityLocked;
+        FrameEvent* frameEvent;
+
+        // Frame size the ports are configured for
+        int portWidth;
+        int portHeight;
+
+        // Ring of buffers, slot of a frame is its submit number modulo bufferCount
+        int bufferCount;
+        OMX_U32 submittedCount;
+        OMX_U32 collectedCount;
+        Frame* submittedFrames;
+
+        // JPEG quality and submit time of each submitted frame
+        int* submittedQualities;
+        struct timespec* submittedTimespecs;
+
+        // OMX variables: Image encoder
+        OMXComponent OMXimageEncodeComponent;
+        GLubyte** OMXscreenPixelBuffers;
+        OMX_BUFFERHEADERTYPE** OMXimageEncodeInputBufferHeaders;
+        OMX_BUFFERHEADERTYPE** OMXimageEncodeOutputBufferHeaders;
+};
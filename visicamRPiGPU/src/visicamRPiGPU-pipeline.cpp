@@ -0,0 +1,1870 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-pipeline.h"
+#include "visicamRPiGPU-control.h"
+#include "visicamRPiGPU-latency.h"
+#include "visicamRPiGPU-trigger.h"
+#include "visicamRPiGPU-watch.h"
+
+/* #####################################
+PIPELINE
+##################################### */
+
+Pipeline::Pipeline()
+{
+    // Stages are set by the application
+    source = NULL;
+    warper = NULL;
+    encoder = NULL;
+    publisher = NULL;
+    capturedEncoder = NULL;
+    stagesReady = false;
+    encodeBufferCount = ENCODE_BUFFER_COUNT;
+    pipelineMode = PIPELINE_MODE;
+    homographyWatcher = NULL;
+    controlServer = NULL;
+    configWatcher = NULL;
+    frameTrigger = NULL;
+
+    // Runtime settings are set by the application
+    memset(&cameraSettings, 0, sizeof(CameraSettings));
+    jpegQuality = 100;
+
+    // Startup metrics are measured from construction, the application constructs the pipeline at its start
+    clock_gettime(CLOCK_MONOTONIC, &launchTimespec);
+    setupSeconds = 0.0;
+    firstFrameSeconds = 0.0;
+    settledFrameSeconds = 0.0;
+    settledRefreshPending = false;
+}
+
+void Pipeline::setup()
+{
+    // Check if all stages were set by the application
+    if (!source || !warper || !encoder || !publisher)
+    {
+        printf("Pipeline Error: Missing pipeline stage - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        if (!outputVariants[i].encoder || !outputVariants[i].publisher)
+        {
+            printf("Pipeline Error: Missing stage of output variant %s - EXITING APPLICATION\n", outputVariants[i].path.c_str());
+            kill(getpid(), SIGKILL);
+        }
+    }
+
+    if (pipelineMode != PIPELINE_MODE_PIPELINED && pipelineMode != PIPELINE_MODE_SAME_ITERATION)
+    {
+        printf("Pipeline Error: Unknown pipeline mode %d - EXITING APPLICATION\n", pipelineMode);
+        kill(getpid(), SIGKILL);
+    }
+
+    // Initialize last refresh timespec
+    lastRefreshTimespec.tv_sec = 0;
+    lastRefreshTimespec.tv_nsec = 0;
+
+    // Initialize current timespec
+    currentTimespec.tv_sec = 0;
+    currentTimespec.tv_nsec = 0;
+
+    // Initialize forcedFirstRefresh
+    firstForcedRefresh = false;
+
+    // Initialize output captured original image with false, will be done in each refresh
+    outputCapturedOriginalImage = false;
+    capturedDrawPending = false;
+    sourceFrameAcquired = false;
+
+    // Initialize frames passed between stages
+    memset(&sourceFrame, 0, sizeof(Frame));
+    memset(&encodeInputFrame, 0, sizeof(Frame));
+    memset(&drawnCaptureTimespec, 0, sizeof(struct timespec));
+    drawnSequence = 0;
+    frameDrawn = false;
+    sourceSequence = 0;
+    memset(&encodedFrame, 0, sizeof(EncodedFrame));
+    memset(&capturedInputFrame, 0, sizeof(Frame));
+    memset(&capturedEncodedFrame, 0, sizeof(EncodedFrame));
+    encodedWidth = width;
+    encodedHeight = height;
+    commentHeader = NULL;
+    commentHeaderSize = 0;
+
+    // Initialize with identity matrix
+    homographyInputMatrixValues[0] = 1.0f; // Row 1
+    homographyInputMatrixValues[3] = 0.0f;
+    homographyInputMatrixValues[6] = 0.0f;
+    homographyInputMatrixValues[1] = 0.0f; // Row 2
+    homographyInputMatrixValues[4] = 1.0f;
+    homographyInputMatrixValues[7] = 0.0f;
+    homographyInputMatrixValues[2] = 0.0f; // Row 3
+    homographyInputMatrixValues[5] = 0.0f;
+    homographyInputMatrixValues[8] = 1.0f;
+
+    // Watch homography input file, fall back to reading it in each refresh if inotify is not available
+    homographyVersion = 0;
+
+    if (HOMOGRAPHY_WATCH_ENABLE)
+    {
+        homographyWatcher = new HomographyWatcher(homographyInputPath);
+
+        if (!homographyWatcher->setup())
+        {
+            printf("Pipeline Warning: Can not watch homography input file, it is read in each refresh\n");
+            delete homographyWatcher;
+            homographyWatcher = NULL;
+        }
+    }
+
+    // Initialize statistics
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+    lastFrameTimespec = startTimespec;
+    frameCount = 0;
+    publishedFrameCount = 0;
+    skippedFrameCount = 0;
+    frameIntervalAverage = 0.0;
+
+    // Latency statistics are written after the first interval
+    lastLatencyStatsTimespec = startTimespec;
+
+    // Initialize stage recovery
+    lastPublishedTimespec = startTimespec;
+    downtimeStartTimespec = startTimespec;
+    downtimePending = false;
+    recoveryCount = 0;
+    recoveryAttempts = 0;
+    recoveryDowntimeSeconds = 0.0;
+
+    // Initialize static scene detection, first processed image is always published
+    drawnSceneSample = NULL;
+    publishedSceneSample = NULL;
+    lastSceneTimespec.tv_sec = 0;
+    lastSceneTimespec.tv_nsec = 0;
+
+    if (STATIC_SCENE_SKIP_ENABLE)
+    {
+        drawnSceneSample = (unsigned char*)(malloc(STATIC_SCENE_SAMPLE_WIDTH * STATIC_SCENE_SAMPLE_HEIGHT));
+        publishedSceneSample = (unsigned char*)(malloc(STATIC_SCENE_SAMPLE_WIDTH * STATIC_SCENE_SAMPLE_HEIGHT));
+        memset(drawnSceneSample, 0, STATIC_SCENE_SAMPLE_WIDTH * STATIC_SCENE_SAMPLE_HEIGHT);
+        memset(publishedSceneSample, 0, STATIC_SCENE_SAMPLE_WIDTH * STATIC_SCENE_SAMPLE_HEIGHT);
+    }
+
+    // Configuration file: Its settings override the defaults before the stages are set up, changes are applied at frame boundaries
+    configVersion = 0;
+
+    if (!configPath.empty())
+    {
+        ConfigSettings settings;
+
+        if (readConfigFile(configPath, &settings))
+        {
+            applyConfig(&settings);
+        }
+        else
+        {
+            printf("Pipeline Warning: Can not read configuration file %s, defaults are used\n", configPath.c_str());
+        }
+
+        configWatcher = new ConfigWatcher(configPath);
+
+        if (!configWatcher->setup())
+        {
+            printf("Pipeline Warning: Can not watch configuration file, changes are only applied after a restart\n");
+            delete configWatcher;
+            configWatcher = NULL;
+        }
+    }
+
+    // Callback driven loop: Source and encoders wake the render loop when a frame is ready
+    if (FRAME_LOOP_CALLBACK_ENABLE)
+    {
+        source->setFrameEvent(&frameEvent);
+        encoder->setFrameEvent(&frameEvent);
+
+        if (capturedEncoder)
+        {
+            capturedEncoder->setFrameEvent(&frameEvent);
+        }
+    }
+
+    // Setup stages: Source first, it might need the longest time to start delivering frames
+    // Parallel setup: Encoders are set up in a thread meanwhile, source and warper need the GL context of the render thread
+    struct timespec setupStartTimespec;
+    struct timespec setupEndTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &setupStartTimespec);
+
+    setupQualityControllers();
+    applyQuality();
+
+    pthread_t setupThread;
+    bool setupThreadRunning = false;
+
+    if (PARALLEL_SETUP_ENABLE)
+    {
+        setupThreadRunning = !pthread_create(&setupThread, NULL, PipelineSetupEncodersThread, this);
+
+        if (!setupThreadRunning)
+        {
+            printf("Pipeline Warning: Can not create setup thread, stages are set up one after another\n");
+        }
+    }
+
+    source->setCameraSettings(&cameraSettings);
+    source->setup(width, height);
+    warper->setup(width, height);
+    applyHomography();
+    drawnRegion = warpedRegion;
+    publisher->setup(width, height);
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        outputVariants[i].publisher->setup(outputVariants[i].width, outputVariants[i].height);
+    }
+
+    if (setupThreadRunning)
+    {
+        pthread_join(setupThread, NULL);
+    }
+    else
+    {
+        setupEncoders();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &setupEndTimespec);
+    setupSeconds = elapsedSeconds(&setupStartTimespec, &setupEndTimespec);
+    printf("Pipeline: Stages set up in %.1f ms (%s)\n", setupSeconds * 1000.0, (setupThreadRunning ? "parallel" : "sequential"));
+
+    stagesReady = true;
+
+    // Trigger mode: Frames are only produced on request
+    triggerDrawn = false;
+    triggeredFrameCount = 0;
+    triggerLatencySeconds = 0.0;
+
+    if (TRIGGER_MODE_ENABLE)
+    {
+        frameTrigger = new FrameTrigger(TRIGGER_FIFO_PATH);
+
+        if (!frameTrigger->setup())
+        {
+            printf("Pipeline Error: Setup frame trigger - EXITING APPLICATION\n");
+            kill(getpid(), SIGKILL);
+        }
+    }
+
+    // Start control socket after all stages are ready, commands are executed in update
+    if (!controlSocketPath.empty())
+    {
+        controlServer = new ControlServer(controlSocketPath);
+        controlServer->frameTrigger = frameTrigger;
+
+        if (!controlServer->setup())
+        {
+            printf("Pipeline Warning: Can not create control socket %s, runtime settings are disabled\n", controlSocketPath.c_str());
+            delete controlServer;
+            controlServer = NULL;
+        }
+    }
+}
+
+// Note: update is always called before draw in infinite loop
+void Pipeline::update()
+{
+    // Set new current timer
+    clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
+
+    // Update statistics: Moving average of time between frames
+    double frameInterval = (currentTimespec.tv_sec - lastFrameTimespec.tv_sec) + (currentTimespec.tv_nsec - lastFrameTimespec.tv_nsec) / 1000000000.0;
+    frameIntervalAverage = (frameCount == 0 ? frameInterval : 0.9 * frameIntervalAverage + 0.1 * frameInterval);
+    lastFrameTimespec = currentTimespec;
+    frameCount++;
+
+    if (frameCount > 1)
+    {
+        latencyStats.record(LATENCY_STAGE_FRAME, frameInterval);
+    }
+
+    // Write latency statistics periodically
+    if (!latencyStatsPath.empty() && currentTimespec.tv_sec - lastLatencyStatsTimespec.tv_sec >= LATENCY_STATS_INTERVAL_SECONDS)
+    {
+        lastLatencyStatsTimespec = currentTimespec;
+
+        if (!latencyStats.writeFile(latencyStatsPath))
+        {
+            printf("Pipeline Warning: Can not write latency statistics to %s\n", latencyStatsPath.c_str());
+        }
+    }
+
+    // Frame boundary: Execute pending commands of the control socket
+    if (controlServer)
+    {
+        controlServer->processCommands(this);
+    }
+
+    // Frame boundary: Apply configuration file if the watcher thread read a changed one
+    // Trigger mode: A drawn frame is published first, a re-setup of the stages would drop it
+    if (configWatcher && !triggerDrawn)
+    {
+        ConfigSettings settings;
+
+        if (configWatcher->takeSettings(&configVersion, &settings))
+        {
+            applyConfig(&settings);
+        }
+    }
+
+    // Frame boundary: Set up failed stages again, before the refresh check, a new camera starts with the forced first refresh
+    recoverFailedStages();
+
+    // Check against last refresh timer, if we need to refresh. 0 values => was just initialized, need to refresh aswell
+    // Early refresh: Forced first refresh as soon as the camera settled, source is asked once per frame until then
+    bool startupRefresh = (lastRefreshTimespec.tv_sec == 0 && lastRefreshTimespec.tv_nsec == 0);
+    bool sourceSettled = (EARLY_REFRESH_ENABLE && (startupRefresh || firstForcedRefresh) && source->settled());
+
+    if (startupRefresh
+        || (firstForcedRefresh && (sourceSettled || currentTimespec.tv_sec - lastRefreshTimespec.tv_sec >= FIRST_FORCED_REFRESH_SECONDS))
+        || (currentTimespec.tv_sec - lastRefreshTimespec.tv_sec >= refreshTimeSeconds))
+    {
+        // Application is just starting, force first refresh after FIRST_FORCED_REFRESH_SECONDS as next refresh
+        // Camera needs some time to adjust settings correctly, otherwise it would take the full refresh amount for the first correct original image
+        // Source which is settled already (no camera adjustments) needs no forced refresh
+        firstForcedRefresh = (startupRefresh && !sourceSettled);
+
+        // Startup metric: Original captured image of this refresh is the first one of the settled camera
+        if (!firstForcedRefresh && settledFrameSeconds == 0.0)
+        {
+            settledRefreshPending = true;
+        }
+
+        // Set new last refresh timer
+        clock_gettime(CLOCK_MONOTONIC, &lastRefreshTimespec);
+
+        // Check if parent PID is alive, if it is set
+        if (parentCheckPid)
+        {
+            // Check if parent PID is running by sending 0 signal with kill
+            if (kill(parentCheckPid, 0))
+            {
+                // Kill self if parent is not running anymore
+                printf("Parent PID application with PID %u does not run anymore - EXITING APPLICATION\n", parentCheckPid);
+                kill(getpid(), SIGKILL);
+            }
+        }
+
+        // Set flag for original captured image output
+        outputCapturedOriginalImage = true;
+
+        // Read homography matrix if its file is not watched, otherwise it is taken at the frame boundary below
+        if (!homographyWatcher && readHomographyFile(homographyInputPath, homographyInputMatrixValues))
+        {
+            applyHomography();
+        }
+    }
+
+    // Frame boundary: Take homography matrix if the watcher thread read a new one
+    if (homographyWatcher && homographyWatcher->takeMatrix(&homographyVersion, homographyInputMatrixValues))
+    {
+        applyHomography();
+    }
+
+    // Trigger mode: Stages are idle until a frame is requested
+    if (frameTrigger)
+    {
+        updateTrigger();
+        return;
+    }
+
+    // Input image (for next iteration), a failed source is set up again in the next update
+    if (!acquireSourceFrame())
+    {
+        return;
+    }
+
+    // Same iteration: Warp the frame now, it is read back below
+    if (pipelineMode == PIPELINE_MODE_SAME_ITERATION)
+    {
+        drawSourceFrame();
+    }
+
+    // Static scene: Skip readback, encode and publish of processed image if the warped image did not change
+    // Frames in flight are published first, otherwise they would wait for the next change
+    if (STATIC_SCENE_SKIP_ENABLE && !outputCapturedOriginalImage && !checkSceneChanged())
+    {
+        flushEncodedFrames();
+        skippedFrameCount++;
+        return;
+    }
+
+    // Check if we should output warped image or original captured image, reset flag for output captured original image
+    bool original = outputCapturedOriginalImage;
+    outputCapturedOriginalImage = false;
+
+    // Original captured image replaces the processed image of this iteration
+    if (!capturedEncoder)
+    {
+        processFrame(original);
+        return;
+    }
+
+    // Dual output: Processed image of each iteration, original captured image of the same camera frame in addition
+    // Pipelined mode reads back the frame drawn in the previous iteration, the original captured image is taken in draw before the warp of this source frame
+    // Nothing was drawn yet after setup of the warper, there is only the original captured image
+    if (frameDrawn)
+    {
+        processFrame(false);
+    }
+
+    if (original && pipelineMode == PIPELINE_MODE_SAME_ITERATION)
+    {
+        processFrame(true);
+    }
+    else if (original)
+    {
+        capturedDrawPending = true;
+    }
+}
+
+// Blocking wait for the next frame of the source
+// Callback driven loop: Sleeps until source or encoders signal, count is taken before polling, signals in between are not lost
+// Sleeps end after STAGE_DEADLINE_CHECK_MS, the source fails in poll if its frame is late
+bool Pipeline::acquireSourceFrame()
+{
+    if (FRAME_LOOP_CALLBACK_ENABLE)
+    {
+        while (true)
+        {
+            unsigned int eventCount = frameEvent.count();
+
+            if (source->poll(&sourceFrame) || source->failed())
+            {
+                break;
+            }
+
+            publishFinishedFrames();
+            frameEvent.wait(eventCount, STAGE_DEADLINE_CHECK_MS);
+        }
+
+        // Dual output: Source with a frame ready at once never waits, original captured images which finished meanwhile are taken here
+        if (capturedEncoder)
+        {
+            publishFinishedFrames();
+        }
+    }
+    else
+    {
+        source->acquire(&sourceFrame);
+
+        // Dual output: Original captured images finish while the loop continues, nothing else collects them
+        if (capturedEncoder)
+        {
+            publishFinishedFrames();
+        }
+    }
+
+    // Source failed: sourceFrame is not changed, the last frame is not drawn again
+    sourceFrameAcquired = !source->failed();
+
+    if (!sourceFrameAcquired)
+    {
+        return false;
+    }
+
+    // Acquire latency is taken from the source, the loop might have requested the frame an iteration before it waits for it
+    sourceFrame.sequence = ++sourceSequence;
+    latencyStats.record(LATENCY_STAGE_ACQUIRE, &sourceFrame.requestTimespec, &sourceFrame.captureTimespec);
+
+    return true;
+}
+
+// Read output image into input memory of encoder, compress and publish it
+// Warped images only cover the warped region, original captured images the full frame
+// Dual output: Original captured images have their own encoder, the encoder of processed images keeps the size of the warped region
+void Pipeline::processFrame(bool original)
+{
+    FrameRegion region = drawnRegion;
+
+    if (original)
+    {
+        region.x = 0;
+        region.y = 0;
+        region.width = width;
+        region.height = height;
+    }
+
+    bool dualOutput = (original && capturedEncoder);
+    FrameEncoder* frameEncoder = (dualOutput ? capturedEncoder : encoder);
+    Frame* inputFrame = (dualOutput ? &capturedInputFrame : &encodeInputFrame);
+    EncodedFrame* outputFrame = (dualOutput ? &capturedEncodedFrame : &encodedFrame);
+
+    frameEncoder->getInputFrame(inputFrame);
+    inputFrame->width = region.width;
+    inputFrame->height = region.height;
+    inputFrame->stride = (inputFrame->format == FRAME_FORMAT_YUV420 ? region.width : 4 * region.width);
+    inputFrame->offsetX = region.x;
+    inputFrame->offsetY = region.y;
+    inputFrame->sequence = (original ? sourceFrame.sequence : drawnSequence);
+    inputFrame->captureTimespec = (original ? sourceFrame.captureTimespec : drawnCaptureTimespec);
+    struct timespec startTimespec;
+    struct timespec endTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+    warper->readback(&sourceFrame, original, inputFrame);
+    inputFrame->original = original;
+    clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+    inputFrame->warpTimespec = endTimespec;
+    latencyStats.record(LATENCY_STAGE_READBACK, &startTimespec, &endTimespec);
+
+    // Frame size changes: Publish frames in flight first, encoder might need to be reconfigured for the new size
+    if (!dualOutput && (inputFrame->width != encodedWidth || inputFrame->height != encodedHeight))
+    {
+        while (encoder->flush(&encodedFrame))
+        {
+            publishEncodedFrame(&encodedFrame);
+        }
+
+        encodedWidth = inputFrame->width;
+        encodedHeight = inputFrame->height;
+    }
+
+    // Compress output image with quality of its output, returns an older image if encoder buffers are pipelined
+    frameEncoder->setQuality(original ? capturedQualityController.quality : processedQualityController.quality);
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+    frameEncoder->encode(inputFrame, outputFrame);
+    clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+    latencyStats.record(LATENCY_STAGE_ENCODE_SUBMIT, &startTimespec, &endTimespec);
+
+    // Output variants of processed images, encoder only reads the input frame in the meantime
+    if (!original)
+    {
+        updateOutputVariants();
+    }
+
+    // Write output image
+    publishEncodedFrame(outputFrame);
+}
+
+// Requested frames are captured after the request: Acquired in one iteration, drawn and then read back in the next one
+// Same iteration mode: Acquired, drawn and read back in one iteration
+// Frames in flight are published at once, the latency is measured from taking the request to the published frame
+void Pipeline::updateTrigger()
+{
+    // Idle: Wait for requests, the loop continues for control commands and refreshes
+    if (!triggerDrawn)
+    {
+        if (!frameTrigger->wait(TRIGGER_IDLE_WAIT_MS))
+        {
+            return;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &triggerTimespec);
+
+        // Source might deliver frames which were captured before the request
+        // Failed source: Request stays pending, it is served after the source was set up again
+        for (int i = 0; i < TRIGGER_DISCARD_FRAMES; i++)
+        {
+            if (!acquireSourceFrame())
+            {
+                return;
+            }
+        }
+
+        if (!acquireSourceFrame())
+        {
+            return;
+        }
+
+        triggerDrawn = true;
+
+        if (pipelineMode != PIPELINE_MODE_SAME_ITERATION)
+        {
+            return;
+        }
+
+        drawSourceFrame();
+    }
+
+    // Processed image first, drawing the original captured image might overwrite the warped frame (GL backend, YUV420)
+    triggerDrawn = false;
+    processFrame(false);
+
+    if (outputCapturedOriginalImage)
+    {
+        outputCapturedOriginalImage = false;
+        processFrame(true);
+    }
+
+    flushEncodedFrames();
+
+    struct timespec publishedTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &publishedTimespec);
+    triggerLatencySeconds = (publishedTimespec.tv_sec - triggerTimespec.tv_sec) + (publishedTimespec.tv_nsec - triggerTimespec.tv_nsec) / 1000000000.0;
+    triggeredFrameCount++;
+    frameTrigger->complete(triggerLatencySeconds);
+
+    printf("Trigger: Frame %u published %.1f ms after request\n", triggeredFrameCount, triggerLatencySeconds * 1000.0);
+}
+
+// Note: draw is always called after update in infinite loop
+void Pipeline::draw()
+{
+    // Source failed in update: No new frame to draw
+    if (!sourceFrameAcquired)
+    {
+        return;
+    }
+
+    // Same iteration: Frame was already drawn and read back in update
+    if (pipelineMode == PIPELINE_MODE_SAME_ITERATION)
+    {
+        releaseSourceFrame();
+        return;
+    }
+
+    // Trigger mode: Only the requested frame is drawn
+    if (frameTrigger && !triggerDrawn)
+    {
+        return;
+    }
+
+    // Dual output: Read back original captured image before the warp, it might overwrite the warped frame (GL backend, YUV420)
+    if (capturedDrawPending)
+    {
+        capturedDrawPending = false;
+        processFrame(true);
+    }
+
+    drawSourceFrame();
+    releaseSourceFrame();
+}
+
+void Pipeline::drawSourceFrame()
+{
+    // Perform homography on the input image of this iteration, output is read back in the next iteration
+    struct timespec startTimespec;
+    struct timespec endTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+    drawnRegion = warpedRegion;
+    drawnCaptureTimespec = sourceFrame.captureTimespec;
+    drawnSequence = sourceFrame.sequence;
+    warper->warp(&sourceFrame, &drawnRegion);
+    frameDrawn = true;
+    clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+    latencyStats.record(LATENCY_STAGE_WARP, &startTimespec, &endTimespec);
+
+    // Thumbnail for static scene detection in the next iteration
+    if (STATIC_SCENE_SKIP_ENABLE)
+    {
+        warper->sampleLuma(&sourceFrame, STATIC_SCENE_SAMPLE_WIDTH, STATIC_SCENE_SAMPLE_HEIGHT, drawnSceneSample);
+    }
+}
+
+// Pipelined: Source fills the next frame while this one is read back, encoded and published
+// Same iteration: Source fills the next frame while the loop handles control commands and waits
+void Pipeline::releaseSourceFrame()
+{
+    if (FRAME_LOOP_CALLBACK_ENABLE)
+    {
+        source->release();
+    }
+}
+
+void Pipeline::applyHomography()
+{
+    warper->setHomography(homographyInputMatrixValues);
+
+    // Warped region changes with the homography, full frame if it is disabled
+    if (WARPED_REGION_ENABLE)
+    {
+        computeWarpedRegion(homographyInputMatrixValues, width, height, &warpedRegion);
+    }
+    else
+    {
+        warpedRegion.x = 0;
+        warpedRegion.y = 0;
+        warpedRegion.width = width;
+        warpedRegion.height = height;
+    }
+}
+
+// Rate control: Targets of output variants are scaled by their area, if they are not set
+void Pipeline::setupQualityControllers()
+{
+    int targetBytes = (RATE_CONTROL_ENABLE ? RATE_CONTROL_TARGET_BYTES : 0);
+    double targetEncodeSeconds = (RATE_CONTROL_ENABLE ? RATE_CONTROL_TARGET_ENCODE_MS / 1000.0 : 0.0);
+
+    processedQualityController.setup(targetBytes, targetEncodeSeconds, RATE_CONTROL_MIN_QUALITY, RATE_CONTROL_MAX_QUALITY);
+    capturedQualityController.setup((RATE_CONTROL_ENABLE ? RATE_CONTROL_CAPTURED_TARGET_BYTES : 0), 0.0, RATE_CONTROL_MIN_QUALITY, RATE_CONTROL_MAX_QUALITY);
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+        double area = ((double)(variant->width) * variant->height) / ((double)(width) * height);
+        int variantTargetBytes = (variant->targetBytes > 0 ? variant->targetBytes : (int)(targetBytes * area));
+        variant->qualityController.setup((RATE_CONTROL_ENABLE ? variantTargetBytes : 0), targetEncodeSeconds * area, RATE_CONTROL_MIN_QUALITY, RATE_CONTROL_MAX_QUALITY);
+    }
+}
+
+void Pipeline::applyQuality()
+{
+    processedQualityController.reset(jpegQuality);
+    capturedQualityController.reset(jpegQuality);
+    encoder->setQuality(jpegQuality);
+
+    if (capturedEncoder)
+    {
+        capturedEncoder->setQuality(jpegQuality);
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        outputVariants[i].qualityController.reset(jpegQuality);
+        outputVariants[i].encoder->setQuality(jpegQuality);
+    }
+}
+
+void Pipeline::updateOutputVariants()
+{
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+
+        // Variants always cover the full frame, their size does not change with the warped region
+        variant->encoder->getInputFrame(&variant->inputFrame);
+        downscaleFrame(&encodeInputFrame, width, height, &variant->inputFrame, variant->downscaleColumns, variant->downscaleColumnSums);
+        variant->inputFrame.sequence = encodeInputFrame.sequence;
+        variant->inputFrame.captureTimespec = encodeInputFrame.captureTimespec;
+        variant->inputFrame.warpTimespec = encodeInputFrame.warpTimespec;
+        variant->encoder->setQuality(variant->qualityController.quality);
+        variant->encoder->encode(&variant->inputFrame, &variant->encodedFrame);
+        publishOutputVariant(variant);
+    }
+}
+
+void Pipeline::publishOutputVariant(OutputVariant* variant)
+{
+    if (variant->encodedFrame.length > 0)
+    {
+        variant->qualityController.update(&variant->encodedFrame);
+        addFrameComment(&variant->encodedFrame, variant->width, variant->height);
+        variant->publisher->publish(&variant->encodedFrame, variant->path);
+    }
+}
+
+void Pipeline::publishEncodedFrame(EncodedFrame* frame)
+{
+    // Check if there is data to write
+    if (frame->length > 0)
+    {
+        // Determine filepath
+        std::string outputPath = (frame->original ? capturedOutputPath : processedOutputPath);
+
+        // Rate control: Quality of the next frames of this output
+        (frame->original ? &capturedQualityController : &processedQualityController)->update(frame);
+
+        if (frame->inputSeconds >= 0.0)
+        {
+            latencyStats.record(LATENCY_STAGE_ENCODE_INPUT, frame->inputSeconds);
+        }
+
+        latencyStats.record(LATENCY_STAGE_ENCODE, frame->encodeSeconds);
+
+        addFrameComment(frame, width, height);
+
+        // Publish image
+        struct timespec startTimespec;
+        struct timespec endTimespec;
+        clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+        publisher->publish(frame, outputPath);
+        publishedFrameCount++;
+        clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+        latencyStats.record(LATENCY_STAGE_PUBLISH, &startTimespec, &endTimespec);
+        latencyStats.record(LATENCY_STAGE_CAPTURE_TO_PUBLISH, &frame->captureTimespec, &startTimespec);
+
+        // Startup metrics: Time to the first published image and to the first original captured image of the settled camera
+        if (firstFrameSeconds == 0.0)
+        {
+            firstFrameSeconds = elapsedSeconds(&launchTimespec, &endTimespec);
+            printf("Pipeline: First frame published %.1f ms after start\n", firstFrameSeconds * 1000.0);
+        }
+
+        if (settledRefreshPending && frame->original)
+        {
+            settledFrameSeconds = elapsedSeconds(&launchTimespec, &endTimespec);
+            settledRefreshPending = false;
+            printf("Pipeline: First original captured image of the settled camera published %.1f ms after start\n", settledFrameSeconds * 1000.0);
+        }
+
+        // Stage recovery: First published frame after a failure ends the downtime
+        lastPublishedTimespec = endTimespec;
+        recoveryAttempts = 0;
+
+        if (downtimePending)
+        {
+            double downtimeSeconds = elapsedSeconds(&downtimeStartTimespec, &endTimespec);
+            recoveryDowntimeSeconds += downtimeSeconds;
+            downtimePending = false;
+            latencyStats.record(LATENCY_STAGE_RECOVERY_DOWNTIME, downtimeSeconds);
+            printf("Pipeline: Frames are published again after %.1f ms\n", downtimeSeconds * 1000.0);
+        }
+    }
+    else if (frame->original)
+    {
+        // Original captured image could not be encoded, try again with next image
+        outputCapturedOriginalImage = true;
+    }
+}
+
+// Consumers find the position of a warped region, the chosen quality and the frame information in a JPEG comment
+// Only SOI (and JFIF APP0) are copied into the comment header, publishers write header and remaining encoded data
+// Frame information: Sequence number of the source frame and its capture, warp and encoded times (CLOCK_MONOTONIC nanoseconds)
+// Sequence numbers are shared by all outputs of a source frame, consumers skip frames they already processed by reading the comment only
+void Pipeline::addFrameComment(EncodedFrame* frame, int frameWidth, int frameHeight)
+{
+    if (!WARPED_REGION_ENABLE && !RATE_CONTROL_ENABLE && !FRAME_INFO_ENABLE)
+    {
+        return;
+    }
+
+    char comment[256];
+    int commentLength = snprintf(comment, sizeof(comment), "visicamRPiGPU region=%d,%d,%d,%d frame=%d,%d quality=%d",
+        frame->offsetX, frame->offsetY, frame->width, frame->height, frameWidth, frameHeight, frame->quality);
+
+    if (FRAME_INFO_ENABLE)
+    {
+        snprintf(comment + commentLength, sizeof(comment) - commentLength, " sequence=%llu capture=%llu warp=%llu encode=%llu",
+            frame->sequence, timespecNanoseconds(&frame->captureTimespec), timespecNanoseconds(&frame->warpTimespec), timespecNanoseconds(&frame->encodedTimespec));
+    }
+
+    size_t position = jpegCommentPosition(frame->data, frame->length);
+
+    if (position == 0)
+    {
+        return;
+    }
+
+    // Header size only changes if the encoder writes a different APP0 segment
+    if (commentHeaderSize < position + sizeof(comment) + 4)
+    {
+        commentHeaderSize = position + sizeof(comment) + 4;
+        commentHeader = (unsigned char*)(realloc(commentHeader, commentHeaderSize));
+    }
+
+    size_t headerLength = buildJpegCommentHeader(frame->data, position, comment, commentHeader);
+
+    if (headerLength > 0)
+    {
+        frame->header = commentHeader;
+        frame->headerLength = headerLength;
+        frame->data += position;
+        frame->length -= position;
+    }
+}
+
+void Pipeline::flushEncodedFrames()
+{
+    while (encoder->flush(&encodedFrame))
+    {
+        publishEncodedFrame(&encodedFrame);
+    }
+
+    while (capturedEncoder && capturedEncoder->flush(&capturedEncodedFrame))
+    {
+        publishEncodedFrame(&capturedEncodedFrame);
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+
+        while (variant->encoder->flush(&variant->encodedFrame))
+        {
+            publishOutputVariant(variant);
+        }
+    }
+}
+
+void Pipeline::publishFinishedFrames()
+{
+    while (encoder->collect(&encodedFrame))
+    {
+        publishEncodedFrame(&encodedFrame);
+    }
+
+    while (capturedEncoder && capturedEncoder->collect(&capturedEncodedFrame))
+    {
+        publishEncodedFrame(&capturedEncodedFrame);
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+
+        while (variant->encoder->collect(&variant->encodedFrame))
+        {
+            publishOutputVariant(variant);
+        }
+    }
+}
+
+// Values which did not change since the last applied file are skipped, settings changed by the control socket stay until the file changes them
+// Invalid values are reported and ignored, all other settings of the file are still applied
+void Pipeline::applyConfig(const ConfigSettings* settings)
+{
+    int newWidth = width;
+    int newHeight = height;
+    int newBufferCount = encodeBufferCount;
+    int changedCount = 0;
+
+    for (size_t i = 0; i < settings->size(); i++)
+    {
+        const std::string& key = (*settings)[i].first;
+        const std::string& value = (*settings)[i].second;
+        bool changed = true;
+
+        for (size_t j = 0; j < appliedConfig.size(); j++)
+        {
+            if (appliedConfig[j].first == key)
+            {
+                changed = (appliedConfig[j].second != value);
+            }
+        }
+
+        if (!changed)
+        {
+            continue;
+        }
+
+        changedCount++;
+
+        // Settings which need a re-setup of stages: Same limits as the arguments of main and ENCODE_BUFFER_COUNT
+        if (key == "width" || key == "height" || key == "encode_buffers")
+        {
+            char* valueEnd;
+            long integerValue = strtol(value.c_str(), &valueEnd, 0);
+            bool valid = (!value.empty() && *valueEnd == '\0');
+
+            if (key == "width" && valid && integerValue >= 640 && integerValue <= 1920 && (integerValue % 32) == 0)
+            {
+                newWidth = integerValue;
+            }
+            else if (key == "height" && valid && integerValue >= 480 && integerValue <= 1080 && (integerValue % 16) == 0)
+            {
+                newHeight = integerValue;
+            }
+            else if (key == "encode_buffers" && valid && integerValue >= 1 && integerValue <= 8)
+            {
+                newBufferCount = integerValue;
+            }
+            else
+            {
+                printf("Pipeline Warning: Configuration %s = %s is invalid\n", key.c_str(), value.c_str());
+            }
+
+            continue;
+        }
+
+        std::string error = controlSetSetting(this, key, value);
+
+        if (!error.empty())
+        {
+            printf("Pipeline Warning: Configuration %s = %s: %s\n", key.c_str(), value.c_str(), error.c_str());
+        }
+    }
+
+    appliedConfig = *settings;
+
+    if (changedCount > 0)
+    {
+        printf("Pipeline: Configuration file %s applied\n", configPath.c_str());
+    }
+
+    if (newWidth == width && newHeight == height && newBufferCount == encodeBufferCount)
+    {
+        return;
+    }
+
+    if (stagesReady)
+    {
+        resetupStages(newWidth, newHeight, newBufferCount);
+        return;
+    }
+
+    width = newWidth;
+    height = newHeight;
+    encodeBufferCount = newBufferCount;
+    resizeOutputVariants();
+}
+
+// Frames in flight are published first, only encoders are set up again if the resolution stays the same
+// Warped frame of the last draw is lost with a new resolution, next image is the original captured image of the new source
+void Pipeline::resetupStages(int newWidth, int newHeight, int newBufferCount)
+{
+    bool resized = (newWidth != width || newHeight != height);
+
+    printf("Pipeline: Re-setup of %s for %dx%d with %d encoder buffers\n", (resized ? "all stages" : "encoders"), newWidth, newHeight, newBufferCount);
+
+    flushEncodedFrames();
+    encoder->teardown();
+
+    if (capturedEncoder)
+    {
+        capturedEncoder->teardown();
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        outputVariants[i].encoder->teardown();
+    }
+
+    if (resized)
+    {
+        warper->teardown();
+        source->teardown();
+
+        width = newWidth;
+        height = newHeight;
+        resizeOutputVariants();
+
+        source->setCameraSettings(&cameraSettings);
+        source->setup(width, height);
+        warper->setup(width, height);
+        frameDrawn = false;
+        applyHomography();
+        drawnRegion = warpedRegion;
+        setupQualityControllers();
+        publisher->resize(width, height);
+
+        for (size_t i = 0; i < outputVariants.size(); i++)
+        {
+            outputVariants[i].publisher->resize(outputVariants[i].width, outputVariants[i].height);
+        }
+
+        outputCapturedOriginalImage = true;
+    }
+
+    encodeBufferCount = newBufferCount;
+    encoder->setBufferCount(encodeBufferCount);
+    encoder->setup(width, height);
+    encodedWidth = width;
+    encodedHeight = height;
+
+    if (capturedEncoder)
+    {
+        capturedEncoder->setBufferCount(CAPTURED_ENCODE_BUFFER_COUNT);
+        capturedEncoder->setup(width, height);
+        memset(&capturedInputFrame, 0, sizeof(Frame));
+        memset(&capturedEncodedFrame, 0, sizeof(EncodedFrame));
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+        variant->encoder->setBufferCount(encodeBufferCount);
+        variant->encoder->setup(variant->width, variant->height);
+        allocateDownscaleBuffers(variant);
+        memset(&variant->inputFrame, 0, sizeof(Frame));
+        memset(&variant->encodedFrame, 0, sizeof(EncodedFrame));
+    }
+}
+
+// Frames in flight in a failed encoder are lost, a failed source loses the frame it was filling
+// Publishers, warper and its FBOs stay, in pipelined mode the frame drawn before the failure is still read back
+// Camera of a new source needs time to adjust settings like at startup, refresh timer starts again with the forced first refresh
+void Pipeline::recoverFailedStages()
+{
+    bool sourceFailed = source->failed();
+    bool encoderFailed = encoder->failed();
+    bool capturedEncoderFailed = (capturedEncoder && capturedEncoder->failed());
+    bool variantFailed = false;
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        variantFailed = (variantFailed || outputVariants[i].encoder->failed());
+    }
+
+    if (!sourceFailed && !encoderFailed && !capturedEncoderFailed && !variantFailed)
+    {
+        return;
+    }
+
+    recoveryCount++;
+    recoveryAttempts++;
+
+    if (recoveryAttempts > STAGE_RECOVERY_MAX_ATTEMPTS)
+    {
+        printf("Pipeline Error: Stages failed %d times without a published frame - EXITING APPLICATION\n", STAGE_RECOVERY_MAX_ATTEMPTS);
+        kill(getpid(), SIGKILL);
+    }
+
+    if (!downtimePending)
+    {
+        downtimeStartTimespec = lastPublishedTimespec;
+        downtimePending = true;
+    }
+
+    struct timespec startTimespec;
+    struct timespec endTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+
+    if (sourceFailed)
+    {
+        printf("Pipeline: Recovery %u: Re-setup of source\n", recoveryCount);
+        source->teardown();
+        source->setCameraSettings(&cameraSettings);
+
+        // Failed setup leaves the source failed, next update tries again and counts the attempt
+        if (!source->setup(width, height))
+        {
+            printf("Pipeline Warning: Recovery %u: Re-setup of source failed\n", recoveryCount);
+        }
+
+        lastRefreshTimespec.tv_sec = 0;
+        lastRefreshTimespec.tv_nsec = 0;
+    }
+
+    if (encoderFailed)
+    {
+        printf("Pipeline: Recovery %u: Re-setup of encoder\n", recoveryCount);
+        encoder->teardown();
+        encoder->setBufferCount(encodeBufferCount);
+
+        if (!encoder->setup(width, height))
+        {
+            printf("Pipeline Warning: Recovery %u: Re-setup of encoder failed\n", recoveryCount);
+        }
+
+        encodedWidth = width;
+        encodedHeight = height;
+        memset(&encodeInputFrame, 0, sizeof(Frame));
+        memset(&encodedFrame, 0, sizeof(EncodedFrame));
+    }
+
+    if (capturedEncoderFailed)
+    {
+        printf("Pipeline: Recovery %u: Re-setup of encoder of original captured images\n", recoveryCount);
+        capturedEncoder->teardown();
+        capturedEncoder->setBufferCount(CAPTURED_ENCODE_BUFFER_COUNT);
+
+        if (!capturedEncoder->setup(width, height))
+        {
+            printf("Pipeline Warning: Recovery %u: Re-setup of encoder of original captured images failed\n", recoveryCount);
+        }
+
+        memset(&capturedInputFrame, 0, sizeof(Frame));
+        memset(&capturedEncodedFrame, 0, sizeof(EncodedFrame));
+    }
+
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+
+        if (variant->encoder->failed())
+        {
+            printf("Pipeline: Recovery %u: Re-setup of encoder of output variant %s\n", recoveryCount, variant->path.c_str());
+            variant->encoder->teardown();
+            variant->encoder->setBufferCount(encodeBufferCount);
+
+            if (!variant->encoder->setup(variant->width, variant->height))
+            {
+                printf("Pipeline Warning: Recovery %u: Re-setup of encoder of output variant %s failed\n", recoveryCount, variant->path.c_str());
+            }
+
+            memset(&variant->inputFrame, 0, sizeof(Frame));
+            memset(&variant->encodedFrame, 0, sizeof(EncodedFrame));
+        }
+    }
+
+    // Original captured image in flight might have been lost
+    if (encoderFailed || capturedEncoderFailed)
+    {
+        outputCapturedOriginalImage = true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+    printf("Pipeline: Recovery %u finished after %.1f ms\n", recoveryCount, elapsedSeconds(&startTimespec, &endTimespec) * 1000.0);
+}
+
+// Encoders read only resolution, buffer counts and output variants, which do not change during setup
+void Pipeline::setupEncoders()
+{
+    encoder->setBufferCount(encodeBufferCount);
+    encoder->setup(width, height);
+
+    // Dual output: Encoder of original captured images always encodes the full frame
+    if (capturedEncoder)
+    {
+        capturedEncoder->setBufferCount(CAPTURED_ENCODE_BUFFER_COUNT);
+        capturedEncoder->setup(width, height);
+        printf("Pipeline: Original captured images are encoded in addition to processed images\n");
+    }
+
+    // Encoders of output variants only need memory for the variant resolution
+    for (size_t i = 0; i < outputVariants.size(); i++)
+    {
+        OutputVariant* variant = &outputVariants[i];
+        variant->encoder->setBufferCount(encodeBufferCount);
+        variant->encoder->setFrameEvent(FRAME_LOOP_CALLBACK_ENABLE ? &frameEvent : NULL);
+        variant->encoder->setup(variant->width, variant->height);
+        allocateDownscaleBuffers(variant);
+        memset(&variant->inputFrame, 0, sizeof(Frame));
+        memset(&variant->encodedFrame, 0, sizeof(EncodedFrame));
+        printf("Pipeline: Output variant %dx%d to %s\n", variant->width, variant->height, variant->path.c_str());
+    }
+}
+
+// Variants are parsed again for the new resolution, the list has the same entries in the same order
+void Pipeline::resizeOutputVariants()
+{
+    std::vector<OutputVariant> resizedVariants;
+    parseOutputVariants(OUTPUT_VARIANTS, width, height, &resizedVariants);
+
+    for (size_t i = 0; i < outputVariants.size() && i < resizedVariants.size(); i++)
+    {
+        outputVariants[i].width = resizedVariants[i].width;
+        outputVariants[i].height = resizedVariants[i].height;
+    }
+}
+
+// Output columns are bounded by the variant width, column sums of a row by the frame width, the warped region is never wider
+void Pipeline::allocateDownscaleBuffers(OutputVariant* variant)
+{
+    free(variant->downscaleColumns);
+    free(variant->downscaleColumnSums);
+    variant->downscaleColumns = (int*)(malloc(DOWNSCALE_COLUMNS_SIZE(variant->width) * sizeof(int)));
+    variant->downscaleColumnSums = (int*)(malloc(DOWNSCALE_COLUMN_SUMS_SIZE(width) * sizeof(int)));
+}
+
+// Sum of absolute luma differences, differences up to STATIC_SCENE_NOISE_LEVEL are ignored as sensor noise
+// Slow changes add up against the reference until they exceed the threshold
+bool Pipeline::checkSceneChanged()
+{
+    bool keepAlive = ((lastSceneTimespec.tv_sec == 0 && lastSceneTimespec.tv_nsec == 0)
+        || (currentTimespec.tv_sec - lastSceneTimespec.tv_sec >= STATIC_SCENE_KEEPALIVE_SECONDS));
+    int differenceSum = 0;
+
+    for (int i = 0; i < STATIC_SCENE_SAMPLE_WIDTH * STATIC_SCENE_SAMPLE_HEIGHT; i++)
+    {
+        int difference = abs((int)(drawnSceneSample[i]) - (int)(publishedSceneSample[i]));
+        differenceSum += (difference > STATIC_SCENE_NOISE_LEVEL ? difference : 0);
+    }
+
+    if (!keepAlive && differenceSum <= STATIC_SCENE_SAD_THRESHOLD)
+    {
+        return false;
+    }
+
+    memcpy(publishedSceneSample, drawnSceneSample, STATIC_SCENE_SAMPLE_WIDTH * STATIC_SCENE_SAMPLE_HEIGHT);
+    lastSceneTimespec = currentTimespec;
+    return true;
+}
+
+/* #####################################
+FRAME EVENT
+##################################### */
+
+FrameEvent::FrameEvent()
+{
+    pthread_mutex_init(&eventMutex, NULL);
+    monotonicConditionInit(&eventCondition);
+    signalCount = 0;
+}
+
+FrameEvent::~FrameEvent()
+{
+    pthread_mutex_destroy(&eventMutex);
+    pthread_cond_destroy(&eventCondition);
+}
+
+void FrameEvent::signal()
+{
+    pthread_mutex_lock(&eventMutex);
+    signalCount++;
+    pthread_cond_broadcast(&eventCondition);
+    pthread_mutex_unlock(&eventMutex);
+}
+
+unsigned int FrameEvent::count()
+{
+    pthread_mutex_lock(&eventMutex);
+    unsigned int currentCount = signalCount;
+    pthread_mutex_unlock(&eventMutex);
+
+    return currentCount;
+}
+
+bool FrameEvent::wait(unsigned int count, int timeoutMs)
+{
+    struct timespec timeoutTimespec;
+    monotonicDeadline(&timeoutTimespec, timeoutMs);
+
+    pthread_mutex_lock(&eventMutex);
+
+    while (signalCount == count)
+    {
+        if (pthread_cond_timedwait(&eventCondition, &eventMutex, &timeoutTimespec) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    bool signalled = (signalCount != count);
+    pthread_mutex_unlock(&eventMutex);
+
+    return signalled;
+}
+
+/* #####################################
+RATE CONTROL
+##################################### */
+
+QualityController::QualityController()
+{
+    quality = 100;
+    targetBytes = 0;
+    targetEncodeSeconds = 0.0;
+    minimumQuality = 0;
+    maximumQuality = 100;
+}
+
+void QualityController::setup(int targetBytes, double targetEncodeSeconds, int minimumQuality, int maximumQuality)
+{
+    this->targetBytes = targetBytes;
+    this->targetEncodeSeconds = targetEncodeSeconds;
+    this->minimumQuality = minimumQuality;
+    this->maximumQuality = maximumQuality;
+}
+
+void QualityController::reset(int quality)
+{
+    this->quality = quality;
+}
+
+// Ratio of the frame to its targets decides, the larger one of size and encode time
+// Step is taken from the quality of the frame, not the current one, frames in flight do not add up their corrections
+void QualityController::update(const EncodedFrame* frame)
+{
+    double ratio = 0.0;
+
+    if (targetBytes > 0)
+    {
+        ratio = (double)(frame->length) / targetBytes;
+    }
+
+    if (targetEncodeSeconds > 0.0 && frame->encodeSeconds / targetEncodeSeconds > ratio)
+    {
+        ratio = frame->encodeSeconds / targetEncodeSeconds;
+    }
+
+    // No targets or within tolerance: Keep quality, avoids oscillation between neighbouring values
+    if (ratio <= 0.0 || fabs(ratio - 1.0) <= RATE_CONTROL_TOLERANCE)
+    {
+        return;
+    }
+
+    // About 10 quality steps per factor 2, at most 10 and at least 1 step per frame
+    int step = (int)(floor(10.0 * log(ratio) / log(2.0) + 0.5));
+    step = (step > 10 ? 10 : (step < -10 ? -10 : step));
+    step = (step != 0 ? step : (ratio > 1.0 ? 1 : -1));
+
+    int nextQuality = frame->quality - step;
+    quality = (nextQuality < minimumQuality ? minimumQuality : (nextQuality > maximumQuality ? maximumQuality : nextQuality));
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of parallel setup, sets up the encoders of the pipeline
+void* PipelineSetupEncodersThread(void* pipeline)
+{
+    ((Pipeline*)(pipeline))->setupEncoders();
+    return NULL;
+}
+
+// Check if file exists
+bool fileExists(std::string path)
+{
+    return (access(path.c_str(), F_OK) != -1);
+}
+
+unsigned long long timespecNanoseconds(const struct timespec* timespec)
+{
+    return (unsigned long long)(timespec->tv_sec) * 1000000000ULL + timespec->tv_nsec;
+}
+
+double elapsedSeconds(const struct timespec* startTimespec, const struct timespec* endTimespec)
+{
+    return (endTimespec->tv_sec - startTimespec->tv_sec) + (endTimespec->tv_nsec - startTimespec->tv_nsec) / 1000000000.0;
+}
+
+void monotonicConditionInit(pthread_cond_t* condition)
+{
+    pthread_condattr_t conditionAttributes;
+    pthread_condattr_init(&conditionAttributes);
+    pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC);
+    pthread_cond_init(condition, &conditionAttributes);
+    pthread_condattr_destroy(&conditionAttributes);
+}
+
+void monotonicDeadline(struct timespec* timespec, int timeoutMs)
+{
+    clock_gettime(CLOCK_MONOTONIC, timespec);
+    timespec->tv_sec += timeoutMs / 1000;
+    timespec->tv_nsec += (timeoutMs % 1000) * 1000000L;
+
+    if (timespec->tv_nsec >= 1000000000L)
+    {
+        timespec->tv_sec++;
+        timespec->tv_nsec -= 1000000000L;
+    }
+}
+
+// Read homography matrix from file in openCV format (9 lines, row by row), file is locked during reading
+// Values are only changed if the file is valid
+bool readHomographyFile(std::string path, float* values)
+{
+    bool valid = false;
+    float fileValues[9];
+
+    // Check if homography input path file exists
+    if (fileExists(path))
+    {
+        // Open file
+        int homographyInputFile = open(path.c_str(), O_RDWR);
+        if (homographyInputFile != -1)
+        {
+            // Lock file
+            if (lockf(homographyInputFile, F_LOCK, 0) != -1)
+            {
+                // Open input filestream
+                std::ifstream homographyInputStream(path.c_str());
+
+                // Opening was successful
+                if (homographyInputStream)
+                {
+                    // Counter which indicates if how many values were read
+                    int valuesCounter = 0;
+
+                    // Read matrix values from file, seperator is newline \n
+                    std::string inputLine;
+                    while (std::getline(homographyInputStream, inputLine))
+                    {
+                        // Increase counter
+                        valuesCounter++;
+
+                        // Something went wrong, file has more lines than expected
+                        if (valuesCounter > 9)
+                        {
+                            break;
+                        }
+
+                        // Set values
+                        fileValues[valuesCounter-1] = atof(inputLine.c_str());
+                    }
+
+                    // Matrix is only valid if exactly 9 values were read
+                    valid = (valuesCounter == 9);
+
+                    // Always close stream if opened successfully
+                    homographyInputStream.close();
+                }
+
+                // Unlock file
+                if (lockf(homographyInputFile, F_ULOCK, 0) == -1)
+                {
+                    // Suppress compiler warning by this check, error in file unlocking, but we can not do anything about it anyways
+                }
+            }
+
+            // Always close file if opened successfully
+            close(homographyInputFile);
+        }
+    }
+
+    if (valid)
+    {
+        memcpy(values, fileValues, sizeof(fileValues));
+    }
+
+    return valid;
+}
+
+// Read configuration file: One <key> = <value> per line, empty lines and text after # are ignored
+// Values are trimmed and may contain spaces (homography), file is only valid if all lines are valid
+bool readConfigFile(std::string path, ConfigSettings* settings)
+{
+    std::ifstream configInputStream(path.c_str());
+
+    if (!configInputStream)
+    {
+        return false;
+    }
+
+    ConfigSettings fileSettings;
+    std::string inputLine;
+
+    while (std::getline(configInputStream, inputLine))
+    {
+        inputLine = inputLine.substr(0, inputLine.find('#'));
+        size_t lineStart = inputLine.find_first_not_of(" \t\r");
+
+        if (lineStart == std::string::npos)
+        {
+            continue;
+        }
+
+        size_t separator = inputLine.find('=');
+
+        if (separator == std::string::npos)
+        {
+            return false;
+        }
+
+        std::string key = inputLine.substr(0, separator);
+        std::string value = inputLine.substr(separator + 1);
+        size_t keyEnd = key.find_last_not_of(" \t");
+        size_t valueStart = value.find_first_not_of(" \t");
+        size_t valueEnd = value.find_last_not_of(" \t\r");
+
+        if (keyEnd == std::string::npos || keyEnd < lineStart || valueStart == std::string::npos)
+        {
+            return false;
+        }
+
+        fileSettings.push_back(std::make_pair(key.substr(lineStart, keyEnd + 1 - lineStart), value.substr(valueStart, valueEnd + 1 - valueStart)));
+    }
+
+    *settings = fileSettings;
+    return true;
+}
+
+// Invert 3 x 3 matrix (row by row), returns false if matrix is singular
+bool invertMatrix3x3(const double* matrix, double* inverse)
+{
+    double cofactor0 = matrix[4] * matrix[8] - matrix[5] * matrix[7];
+    double cofactor1 = matrix[5] * matrix[6] - matrix[3] * matrix[8];
+    double cofactor2 = matrix[3] * matrix[7] - matrix[4] * matrix[6];
+    double determinant = matrix[0] * cofactor0 + matrix[1] * cofactor1 + matrix[2] * cofactor2;
+
+    if (fabs(determinant) < 1e-12)
+    {
+        return false;
+    }
+
+    inverse[0] = cofactor0 / determinant;
+    inverse[1] = (matrix[2] * matrix[7] - matrix[1] * matrix[8]) / determinant;
+    inverse[2] = (matrix[1] * matrix[5] - matrix[2] * matrix[4]) / determinant;
+    inverse[3] = cofactor1 / determinant;
+    inverse[4] = (matrix[0] * matrix[8] - matrix[2] * matrix[6]) / determinant;
+    inverse[5] = (matrix[2] * matrix[3] - matrix[0] * matrix[5]) / determinant;
+    inverse[6] = cofactor2 / determinant;
+    inverse[7] = (matrix[1] * matrix[6] - matrix[0] * matrix[7]) / determinant;
+    inverse[8] = (matrix[0] * matrix[4] - matrix[1] * matrix[3]) / determinant;
+
+    return true;
+}
+
+// Output variants: Comma separated list of <size>:<path>
+bool parseOutputVariants(const std::string& text, int width, int height, std::vector<OutputVariant>* variants)
+{
+    size_t position = 0;
+
+    while (position < text.size())
+    {
+        size_t end = text.find(',', position);
+        end = (end == std::string::npos ? text.size() : end);
+        std::string entry = text.substr(position, end - position);
+        position = end + 1;
+
+        size_t separator = entry.find(':');
+
+        if (separator == std::string::npos || separator + 1 >= entry.size())
+        {
+            return false;
+        }
+
+        std::string size = entry.substr(0, separator);
+        int variantWidth = 0;
+        int variantHeight = 0;
+
+        if (size == "full")
+        {
+            variantWidth = width;
+            variantHeight = height;
+        }
+        else if (size == "half")
+        {
+            variantWidth = width / 2;
+            variantHeight = height / 2;
+        }
+        else if (size == "quarter")
+        {
+            variantWidth = width / 4;
+            variantHeight = height / 4;
+        }
+        else if (sscanf(size.c_str(), "%dx%d", &variantWidth, &variantHeight) != 2)
+        {
+            return false;
+        }
+
+        // Round to alignment of encoder input, at least one aligned block and at most the full frame
+        variantWidth = ((variantWidth + FRAME_REGION_ALIGN_WIDTH / 2) / FRAME_REGION_ALIGN_WIDTH) * FRAME_REGION_ALIGN_WIDTH;
+        variantHeight = ((variantHeight + FRAME_REGION_ALIGN_HEIGHT / 2) / FRAME_REGION_ALIGN_HEIGHT) * FRAME_REGION_ALIGN_HEIGHT;
+        variantWidth = (variantWidth < FRAME_REGION_ALIGN_WIDTH ? FRAME_REGION_ALIGN_WIDTH : (variantWidth > width ? width : variantWidth));
+        variantHeight = (variantHeight < FRAME_REGION_ALIGN_HEIGHT ? FRAME_REGION_ALIGN_HEIGHT : (variantHeight > height ? height : variantHeight));
+
+        // Optional target size for rate control after the last separator, if it only consists of digits
+        std::string path = entry.substr(separator + 1);
+        size_t targetSeparator = path.rfind(':');
+        int targetBytes = 0;
+
+        if (targetSeparator != std::string::npos && targetSeparator + 1 < path.size()
+            && path.find_first_not_of("0123456789", targetSeparator + 1) == std::string::npos)
+        {
+            targetBytes = atoi(path.c_str() + targetSeparator + 1);
+            path = path.substr(0, targetSeparator);
+        }
+
+        if (path.empty())
+        {
+            return false;
+        }
+
+        OutputVariant variant;
+        memset(&variant.inputFrame, 0, sizeof(Frame));
+        memset(&variant.encodedFrame, 0, sizeof(EncodedFrame));
+        variant.width = variantWidth;
+        variant.height = variantHeight;
+        variant.path = path;
+        variant.targetBytes = targetBytes;
+        variant.encoder = NULL;
+        variant.publisher = NULL;
+        variant.downscaleColumns = NULL;
+        variant.downscaleColumnSums = NULL;
+        variants->push_back(variant);
+    }
+
+    return true;
+}
+
+// Each output pixel averages the input pixels of its area in the full frame (rounded to whole pixels)
+// Input rows of an output row are summed up per column first, then the columns of each output pixel
+// Area outside of the region counts as black, RGBA: (0, 0, 0, 255), YUV420: Y = 0 and neutral chroma
+void downscaleFrame(const Frame* input, int frameWidth, int frameHeight, Frame* output, int* columns, int* columnSums)
+{
+    bool planar = (input->format == FRAME_FORMAT_YUV420);
+    int channels = (planar ? 1 : 4);
+
+    for (int plane = 0; plane < (planar ? 3 : 1); plane++)
+    {
+        // Plane sizes of chroma planes are halved
+        int scale = (plane == 0 ? 1 : 2);
+        int planeFrameWidth = frameWidth / scale;
+        int planeFrameHeight = frameHeight / scale;
+        int regionX = input->offsetX / scale;
+        int regionY = input->offsetY / scale;
+        int regionWidth = input->width / scale;
+        int regionHeight = input->height / scale;
+        int inputStride = input->stride / scale;
+        int outputWidth = output->width / scale;
+        int outputHeight = output->height / scale;
+        int outputStride = output->stride / scale;
+        const unsigned char* inputPlane = (planar ? framePlane(input->data, input->stride, input->height, plane) : input->data);
+        unsigned char* outputPlane = (planar ? framePlane(output->data, output->stride, output->height, plane) : output->data);
+        int black[4] = { 0, 0, 0, 255 };
+
+        if (planar)
+        {
+            black[0] = (plane == 0 ? 0 : 128);
+        }
+
+        // Columns of each output pixel: Width of its area in the frame, first and last + 1 column inside of the region
+
+        for (int x = 0; x < outputWidth; x++)
+        {
+            int frameLeft = (x * planeFrameWidth) / outputWidth;
+            int frameRight = ((x + 1) * planeFrameWidth) / outputWidth;
+            frameRight = (frameRight > frameLeft ? frameRight : frameLeft + 1);
+            int left = (frameLeft - regionX < 0 ? 0 : (frameLeft - regionX > regionWidth ? regionWidth : frameLeft - regionX));
+            int right = (frameRight - regionX < left ? left : (frameRight - regionX > regionWidth ? regionWidth : frameRight - regionX));
+            columns[3 * x + 0] = frameRight - frameLeft;
+            columns[3 * x + 1] = left;
+            columns[3 * x + 2] = right;
+        }
+
+        for (int y = 0; y < outputHeight; y++)
+        {
+            // Rows of output row in the frame and inside of the region
+            int frameTop = (y * planeFrameHeight) / outputHeight;
+            int frameBottom = ((y + 1) * planeFrameHeight) / outputHeight;
+            frameBottom = (frameBottom > frameTop ? frameBottom : frameTop + 1);
+            int top = (frameTop - regionY < 0 ? 0 : (frameTop - regionY > regionHeight ? regionHeight : frameTop - regionY));
+            int bottom = (frameBottom - regionY < top ? top : (frameBottom - regionY > regionHeight ? regionHeight : frameBottom - regionY));
+
+            memset(columnSums, 0, regionWidth * channels * sizeof(int));
+
+            for (int inputY = top; inputY < bottom; inputY++)
+            {
+                const unsigned char* inputRow = inputPlane + inputStride * inputY;
+
+                for (int i = 0; i < regionWidth * channels; i++)
+                {
+                    columnSums[i] += inputRow[i];
+                }
+            }
+
+            unsigned char* outputRow = outputPlane + outputStride * y;
+
+            for (int x = 0; x < outputWidth; x++)
+            {
+                int left = columns[3 * x + 1];
+                int right = columns[3 * x + 2];
+                int area = (frameBottom - frameTop) * columns[3 * x + 0];
+                int outside = area - (bottom - top) * (right - left);
+                float inverseArea = 1.0f / area;
+
+                for (int c = 0; c < channels; c++)
+                {
+                    int sum = outside * black[c];
+
+                    for (int inputX = left; inputX < right; inputX++)
+                    {
+                        sum += columnSums[channels * inputX + c];
+                    }
+
+                    outputRow[channels * x + c] = (unsigned char)(sum * inverseArea + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+// RGBA: 4 bytes per pixel, YUV420: 1.5 bytes per pixel
+int frameBytes(int width, int height, int format)
+{
+    return (format == FRAME_FORMAT_YUV420 ? width * height + 2 * (width / 2) * (height / 2) : 4 * width * height);
+}
+
+// Planes follow each other without gaps, chroma planes have half width and height
+unsigned char* framePlane(unsigned char* data, int stride, int height, int plane)
+{
+    return data + (plane > 0 ? stride * height : 0) + (plane > 1 ? (stride / 2) * (height / 2) : 0);
+}
+
+// Bounding box of the input frame corners mapped by the homography, clamped to the output frame
+void computeWarpedRegion(const float* values, int width, int height, FrameRegion* region)
+{
+    // Full frame if the homography can not be bounded
+    region->x = 0;
+    region->y = 0;
+    region->width = width;
+    region->height = height;
+
+    double cornersX[4] = { 0.0, (double)(width), (double)(width), 0.0 };
+    double cornersY[4] = { 0.0, 0.0, (double)(height), (double)(height) };
+    double minX = width;
+    double minY = height;
+    double maxX = 0.0;
+    double maxY = 0.0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        double mappedW = values[6] * cornersX[i] + values[7] * cornersY[i] + values[8];
+
+        // Corner behind the camera, warped frame reaches to infinity
+        if (mappedW <= 0.0)
+        {
+            return;
+        }
+
+        double mappedX = (values[0] * cornersX[i] + values[1] * cornersY[i] + values[2]) / mappedW;
+        double mappedY = (values[3] * cornersX[i] + values[4] * cornersY[i] + values[5]) / mappedW;
+        minX = (mappedX < minX ? mappedX : minX);
+        minY = (mappedY < minY ? mappedY : minY);
+        maxX = (mappedX > maxX ? mappedX : maxX);
+        maxY = (mappedY > maxY ? mappedY : maxY);
+    }
+
+    // Clamp to output frame, empty if warped frame is completely outside
+    int left = (minX > 0.0 ? (int)(floor(minX)) : 0);
+    int top = (minY > 0.0 ? (int)(floor(minY)) : 0);
+    int right = (maxX < width ? (int)(ceil(maxX)) : width);
+    int bottom = (maxY < height ? (int)(ceil(maxY)) : height);
+    right = (right > left ? right : left);
+    bottom = (bottom > top ? bottom : top);
+
+    // Planar YUV frames: Offsets are even, chroma samples of the region are also chroma samples of the full frame
+    left &= ~1;
+    top &= ~1;
+
+    // Round size up to alignment, at least one aligned block, move region back into the frame if it gets too large
+    int alignedWidth = ((right - left + FRAME_REGION_ALIGN_WIDTH - 1) / FRAME_REGION_ALIGN_WIDTH) * FRAME_REGION_ALIGN_WIDTH;
+    int alignedHeight = ((bottom - top + FRAME_REGION_ALIGN_HEIGHT - 1) / FRAME_REGION_ALIGN_HEIGHT) * FRAME_REGION_ALIGN_HEIGHT;
+    alignedWidth = (alignedWidth < FRAME_REGION_ALIGN_WIDTH ? FRAME_REGION_ALIGN_WIDTH : (alignedWidth > width ? width : alignedWidth));
+    alignedHeight = (alignedHeight < FRAME_REGION_ALIGN_HEIGHT ? FRAME_REGION_ALIGN_HEIGHT : (alignedHeight > height ? height : alignedHeight));
+
+    region->x = (left + alignedWidth > width ? width - alignedWidth : left);
+    region->y = (top + alignedHeight > height ? height - alignedHeight : top);
+    region->width = alignedWidth;
+    region->height = alignedHeight;
+}
+
+// JPEG images start with SOI (FF D8), COM segment (FF FE, 16 bit length including itself, text) is inserted after it
+// JFIF requires its APP0 segment (FF E0) directly after SOI, then COM is inserted after APP0
+size_t jpegCommentPosition(const unsigned char* data, size_t length)
+{
+    if (length < 2 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return 0;
+    }
+
+    size_t position = 2;
+
+    if (length >= 6 && data[2] == 0xFF && data[3] == 0xE0)
+    {
+        position = 4 + ((data[4] << 8) | data[5]);
+    }
+
+    if (position > length)
+    {
+        return 0;
+    }
+
+    return position;
+}
+
+// Header is the copied JPEG data up to position and the COM segment, data behind position follows it unchanged
+size_t buildJpegCommentHeader(const unsigned char* data, size_t position, const char* comment, unsigned char* header)
+{
+    size_t commentLength = strlen(comment);
+
+    if (commentLength + 2 > 0xFFFF)
+    {
+        return 0;
+    }
+
+    memcpy(header, data, position);
+    header[position + 0] = 0xFF;
+    header[position + 1] = 0xFE;
+    header[position + 2] = (unsigned char)((commentLength + 2) >> 8);
+    header[position + 3] = (unsigned char)((commentLength + 2) & 0xFF);
+    memcpy(header + position + 4, comment, commentLength);
+
+    return position + commentLength + 4;
+}
@@ -0,0 +1,617 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Note: This file and all stages it includes must not depend on openFrameworks or OMX,
+// it is also compiled on systems without Raspberry Pi hardware (CPU backend)
+#include "visicamRPiGPU-settings.h"
+
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/* #####################################
+PIPELINE
+##################################### */
+
+// Backends for the pipeline stages
+#define PIPELINE_BACKEND_OMX                    0
+#define PIPELINE_BACKEND_CPU                    1
+
+// Scheduling of warp and readback of a frame
+#define PIPELINE_MODE_PIPELINED                 0       // Warped in draw, read back and encoded in the next iteration, GPU work overlaps the wait for the next frame
+#define PIPELINE_MODE_SAME_ITERATION            1       // Warped, read back and encoded in the iteration it was acquired, one iteration less latency
+
+// Output modes of the publisher
+#define PUBLISH_MODE_FILE                       0
+#define PUBLISH_MODE_SHM                        1
+#define PUBLISH_MODE_RENAME                     2
+
+// Pixel formats of raw frames
+#define FRAME_FORMAT_RGBA                       0
+#define FRAME_FORMAT_YUV420                     1       // Y plane (stride), U and V planes (stride / 2) with half width and height, no gaps between planes
+
+// Size of warped regions is a multiple of these values (image_encode: format.image.nStride, format.image.nSliceHeight)
+#define FRAME_REGION_ALIGN_WIDTH                32
+#define FRAME_REGION_ALIGN_HEIGHT               16
+
+// Rectangle in output frame coordinates
+typedef struct
+{
+    int                 x;
+    int                 y;
+    int                 width;
+    int                 height;
+} FrameRegion;
+
+// Raw frame, pixels are either in CPU memory (data) or only exist on the GPU (handle)
+// Frames of a warped region are smaller than the output frame, offsets are their position in it
+// Stride is the row length in bytes of the first plane
+// Request time is the monotonic time the source asked for the camera frame, sources which generate frames on demand take the start of generating it
+// Capture time is the monotonic time the source delivered the camera frame, frames derived from it keep it and its sequence number
+// Warp time is the monotonic time the warped or original pixels were read back for the encoder
+typedef struct
+{
+    unsigned char*      data;
+    void*               handle;
+    int                 width;
+    int                 height;
+    int                 stride;
+    int                 format;
+    bool                original;
+    int                 offsetX;
+    int                 offsetY;
+    unsigned long long  sequence;
+    struct timespec     requestTimespec;
+    struct timespec     captureTimespec;
+    struct timespec     warpTimespec;
+} Frame;
+
+// Encoded JPEG frame, memory is owned by the encoder and valid until its next encode call
+// Flag original, size and offsets are taken from the input frame, encoders might return frames of previous calls
+// Quality, sequence number, capture and warp time are the ones of the submitted frame, times are measured from submitting it until its input was read and until the end of its compression
+// Input time is negative for encoders which read the input only while compressing it, there is no separate input event
+// Encoded time is the monotonic time its compression ended
+// Published bytes are header followed by data, header is set by the pipeline to insert a JPEG comment without copying data (NULL and length 0 otherwise)
+typedef struct
+{
+    unsigned char*      data;
+    size_t              length;
+    unsigned char*      header;
+    size_t              headerLength;
+    bool                original;
+    int                 width;
+    int                 height;
+    int                 offsetX;
+    int                 offsetY;
+    int                 quality;
+    double              inputSeconds;
+    double              encodeSeconds;
+    unsigned long long  sequence;
+    struct timespec     captureTimespec;
+    struct timespec     warpTimespec;
+    struct timespec     encodedTimespec;
+} EncodedFrame;
+
+// Camera settings which can be changed at runtime, initialized from the OMX_CAM_* settings
+// All values use the units and ranges of the settings file, enumerations are the numeric OMX values
+typedef struct
+{
+    int                 sharpness;
+    int                 contrast;
+    int                 brightness;
+    int                 saturation;
+    int                 iso;
+    int                 isoAuto;
+    int                 exposureCompensation;
+    int                 shutterSpeed;
+    int                 shutterSpeedAuto;
+    int                 exposure;
+    int                 metering;
+    int                 whiteBalance;
+    int                 whiteBalanceRedGain;
+    int                 whiteBalanceBlueGain;
+    int                 roiTop;
+    int                 roiLeft;
+    int                 roiWidth;
+    int                 roiHeight;
+    int                 framerate;
+    int                 drc;
+} CameraSettings;
+
+// Wakes the render loop when a stage completed work, signalled by callbacks and threads of the stages
+// The count is taken before the stages are checked, wait returns at once if there was a signal in between
+// Timeouts of wait use the monotonic clock, changes of the wall clock do not shorten or extend them
+class FrameEvent
+{
+    public:
+        FrameEvent();
+        ~FrameEvent();
+
+        // Any thread: Increase count and wake the waiting thread
+        void signal();
+
+        // Render thread: Current count of signals
+        unsigned int count();
+
+        // Render thread: Block until the count differs from the given one or timeoutMs passed, returns false on timeout
+        bool wait(unsigned int count, int timeoutMs);
+
+        pthread_mutex_t eventMutex;
+        pthread_cond_t eventCondition;
+        unsigned int signalCount;
+};
+
+// Stage: Delivers camera frames
+class FrameSource
+{
+    public:
+        virtual ~FrameSource() {}
+
+        // Prepare source for frames with the given resolution
+        // Returns false if the source failed during setup, teardown releases the steps which were done and setup can be tried again
+        virtual bool setup(int width, int height) = 0;
+
+        // Blocking wait for the next frame
+        virtual void acquire(Frame* frame) = 0;
+
+        // Take the next frame if it is ready, never blocks, returns false otherwise
+        virtual bool poll(Frame* frame) = 0;
+
+        // Render thread: Last acquired frame is not used anymore, source may fill the next one before it is acquired
+        virtual void release() = 0;
+
+        // Signalled when a frame is ready for poll, called before setup, NULL disables it
+        virtual void setFrameEvent(FrameEvent* event) = 0;
+
+        // Set camera settings, called before setup and at frame boundaries
+        virtual void setCameraSettings(const CameraSettings* settings) = 0;
+
+        // Camera adjusted exposure and white balance since setup, called once per frame until it returns true
+        // Sources without automatic camera adjustments are settled at once
+        virtual bool settled() = 0;
+
+        // Source missed a deadline or reported an error, it delivers no frames until teardown and setup
+        // Acquire returns without a new frame and poll returns false while it failed
+        virtual bool failed() = 0;
+
+        // Stop delivering frames and release everything of setup, setup can be called again with another resolution
+        virtual void teardown() = 0;
+};
+
+// Stage: Applies the homography matrix and provides the result in CPU memory
+class FrameWarper
+{
+    public:
+        virtual ~FrameWarper() {}
+
+        // Prepare warper for frames with the given resolution
+        virtual void setup(int width, int height) = 0;
+
+        // Set homography matrix, values are in openCV format (3 x 3, row by row)
+        virtual void setHomography(const float* values) = 0;
+
+        // Warp region of output frame, result is kept until the next call
+        virtual void warp(const Frame* input, const FrameRegion* region) = 0;
+
+        // Copy region of output frame (offsets, width and height) of last warped frame (or original input frame) to CPU memory of output frame
+        // Warped frames are read back with the region of the last warp call, output frame has the pixel format of the warper
+        virtual void readback(const Frame* input, bool original, Frame* output) = 0;
+
+        // Downsample luma of the full output frame of the last warp call to sampleWidth x sampleHeight pixels in CPU memory
+        // Used for change detection, black outside of the warped region
+        virtual void sampleLuma(const Frame* input, int sampleWidth, int sampleHeight, unsigned char* output) = 0;
+
+        // Release everything of setup, setup can be called again with another resolution
+        virtual void teardown() = 0;
+};
+
+// Stage: Compresses raw frames to JPEG
+class FrameEncoder
+{
+    public:
+        virtual ~FrameEncoder() {}
+
+        // Prepare encoder for frames with the given resolution
+        // Returns false if the encoder failed during setup, teardown releases the steps which were done and setup can be tried again
+        virtual bool setup(int width, int height) = 0;
+
+        // Get frame with CPU memory for the next input image of the encoder, memory has space for a full frame
+        virtual void getInputFrame(Frame* frame) = 0;
+
+        // Submit input frame and return the oldest finished frame, frames are returned in submit order
+        // Up to bufferCount frames are in flight, only blocks if all buffers are in use
+        // Output length is 0 if no frame is finished yet or if nothing was encoded
+        // Input frames may be smaller than the setup resolution, all frames must be flushed before the size changes
+        virtual void encode(const Frame* input, EncodedFrame* output) = 0;
+
+        // Wait for the oldest frame in flight and return it, returns false if no frame is in flight
+        virtual bool flush(EncodedFrame* output) = 0;
+
+        // Return the oldest frame in flight if it is finished, never blocks, returns false otherwise
+        virtual bool collect(EncodedFrame* output) = 0;
+
+        // Signalled when a frame in flight is finished, called before setup, NULL disables it
+        virtual void setFrameEvent(FrameEvent* event) = 0;
+
+        // Set JPEG quality (0 to 100) for the next submitted frames, called before setup and at frame boundaries
+        virtual void setQuality(int quality) = 0;
+
+        // Set number of buffers (frames in flight), called before setup
+        virtual void setBufferCount(int bufferCount) = 0;
+
+        // Encoder missed a deadline or reported an error, frames in flight are lost and nothing is encoded until teardown and setup
+        // Encode returns no frame, flush and collect return false while it failed
+        virtual bool failed() = 0;
+
+        // Release everything of setup, all frames must be flushed before unless it failed, setup can be called again with another resolution
+        virtual void teardown() = 0;
+};
+
+// Stage: Makes encoded frames available for consumers
+class FramePublisher
+{
+    public:
+        virtual ~FramePublisher() {}
+
+        // Prepare publisher for frames with the given resolution
+        virtual void setup(int width, int height) = 0;
+
+        // Publish encoded frame to path
+        virtual void publish(const EncodedFrame* frame, const std::string& path) = 0;
+
+        // Render thread: Following frames have another resolution, frames of the old resolution might still be published
+        virtual void resize(int width, int height) = 0;
+};
+
+// Rate control of one output: Adjusts JPEG quality between frames to hold a target size and encode time
+// Targets of 0 disable them, quality stays constant without targets
+class QualityController
+{
+    public:
+        QualityController();
+
+        // Set targets and quality range of the controller
+        void setup(int targetBytes, double targetEncodeSeconds, int minimumQuality, int maximumQuality);
+
+        // Start again from quality, e.g. after it was changed by the control socket
+        void reset(int quality);
+
+        // Compute quality for the next frames from a finished frame of this output
+        void update(const EncodedFrame* frame);
+
+        int quality;
+        int targetBytes;
+        double targetEncodeSeconds;
+        int minimumQuality;
+        int maximumQuality;
+};
+
+// Scratch memory of downscaleFrame in ints: Three values per output column, column sums of one input row (up to 4 channels) and one more for empty regions
+#define DOWNSCALE_COLUMNS_SIZE(outputWidth)     (3 * (outputWidth))
+#define DOWNSCALE_COLUMN_SUMS_SIZE(frameWidth)  (4 * (frameWidth) + 1)
+
+// Processed images in another resolution: Downscaled from the read back frame, encoded and published by own stages
+// Target size of 0 scales the target of processed images by the area of the variant
+// Scratch memory of the downscale is allocated with the encoder of the variant for its size and the frame size
+typedef struct
+{
+    int                 width;
+    int                 height;
+    std::string         path;
+    int                 targetBytes;
+    FrameEncoder*       encoder;
+    FramePublisher*     publisher;
+    QualityController   qualityController;
+    Frame               inputFrame;
+    EncodedFrame        encodedFrame;
+    int*                downscaleColumns;
+    int*                downscaleColumnSums;
+} OutputVariant;
+
+// Settings of the configuration file in file order, key and value of each <key> = <value> line
+typedef std::vector<std::pair<std::string, std::string> > ConfigSettings;
+
+class ConfigWatcher;
+class ControlServer;
+class FrameTrigger;
+class HomographyWatcher;
+
+// Capture, warp, encode and publish chain with exchangeable stages
+class Pipeline
+{
+    public:
+        Pipeline();
+
+        // Same call order as openFrameworks: setup once, then update and draw in infinite loop
+        void setup();
+        void update();
+        void draw();
+
+        // Warp sourceFrame, read back in the same or the next iteration depending on pipelineMode
+        void drawSourceFrame();
+
+        // Callback driven loop: Hand buffer of sourceFrame back to the source after its last use
+        void releaseSourceFrame();
+
+        // Acquire sourceFrame from source, returns false if the source failed
+        // Callback driven loop: Frames of the encoders which finish while waiting for the source are published at once
+        bool acquireSourceFrame();
+
+        // Read back drawn frame (or original captured image of source frame), encode and publish it
+        // Original captured images use capturedEncoder if it is set, their compression runs while the loop continues
+        void processFrame(bool original);
+
+        // Trigger mode: Wait for requests, capture and publish one frame for them
+        void updateTrigger();
+
+        // Set homographyInputMatrixValues in warper and update warped region
+        void applyHomography();
+
+        // Set targets of quality controllers of output and output variants from settings
+        void setupQualityControllers();
+
+        // Reset quality controllers of output and output variants to jpegQuality
+        void applyQuality();
+
+        // Downscale read back processed image for each output variant, encode and publish it
+        void updateOutputVariants();
+
+        // Publish encodedFrame of output variant, if there is one
+        void publishOutputVariant(OutputVariant* variant);
+
+        // Build JPEG header with a comment (region, quality and frame information) in commentHeader, if any of them is enabled
+        // Frame data is not copied, it is advanced behind the header bytes which are replaced
+        void addFrameComment(EncodedFrame* frame, int frameWidth, int frameHeight);
+
+        // Publish encoded frame of the output, request original captured image again if it was not encoded
+        void publishEncodedFrame(EncodedFrame* frame);
+
+        // Publish all frames in flight in the encoders of output, original captured images and output variants
+        void flushEncodedFrames();
+
+        // Publish finished frames of the encoders of output, original captured images and output variants, never waits
+        void publishFinishedFrames();
+
+        // Apply settings of the configuration file which changed since the last applied file
+        // Resolution and encoder buffers are set directly before setup, afterwards they re-setup the affected stages
+        void applyConfig(const ConfigSettings* settings);
+
+        // Tear down and setup again the stages which depend on resolution and encoder buffers, publishers keep running
+        void resetupStages(int newWidth, int newHeight, int newBufferCount);
+
+        // Sizes of output variants for the current resolution
+        void resizeOutputVariants();
+
+        // Allocate scratch memory of the downscale of an output variant for its size and the frame size, frees the old one
+        void allocateDownscaleBuffers(OutputVariant* variant);
+
+        // Tear down and setup again the source and encoders which failed, all other stages keep running
+        void recoverFailedStages();
+
+        // Set up encoders of output, original captured images and output variants with their buffer counts
+        // Encoders do not use the GL context, setup might run them on another thread than the render thread
+        void setupEncoders();
+
+        // Compare thumbnail of the last drawn frame with the one of the last published processed image
+        // Returns true and takes the thumbnail as new reference if the scene changed or the keep-alive interval is over
+        bool checkSceneChanged();
+
+        // Input arguments for main
+        int width;
+        int height;
+        int refreshTimeSeconds;
+        int parentCheckPid;
+        std::string homographyInputPath;
+        std::string processedOutputPath;
+        std::string capturedOutputPath;
+        std::string latencyStatsPath;
+
+        // Stages, set by the application before setup
+        FrameSource* source;
+        FrameWarper* warper;
+        FrameEncoder* encoder;
+        FramePublisher* publisher;
+
+        // Dual output: Encoder of original captured images, refresh frames publish the processed and the original captured image
+        // of the same camera frame, NULL if the original captured image replaces the processed image of a refresh frame
+        FrameEncoder* capturedEncoder;
+        bool stagesReady;
+
+        // Frames in flight in each encoder, set by the application before setup
+        int encodeBufferCount;
+
+        // Scheduling of warp and readback (PIPELINE_MODE_*), set by the application before setup
+        int pipelineMode;
+
+        // Callback driven loop: Signalled by source and encoders, the render loop waits for it instead of a frame rate limiter
+        FrameEvent frameEvent;
+
+        // Additional processed outputs, stages are set by the application before setup
+        std::vector<OutputVariant> outputVariants;
+
+        // Runtime settings, changed by the control socket at frame boundaries
+        CameraSettings cameraSettings;
+        int jpegQuality;
+
+        // Rate control of processed and original captured images, quality stays jpegQuality if it is disabled
+        QualityController processedQualityController;
+        QualityController capturedQualityController;
+        std::string controlSocketPath;
+
+        // Frames passed between stages
+        Frame sourceFrame;
+        Frame encodeInputFrame;
+        EncodedFrame encodedFrame;
+        Frame capturedInputFrame;
+        EncodedFrame capturedEncodedFrame;
+
+        // Other variables
+        struct timespec lastRefreshTimespec;
+        struct timespec currentTimespec;
+        bool firstForcedRefresh;
+        bool outputCapturedOriginalImage;
+
+        // Dual output, pipelined mode: Original captured image is read back in draw before the warp of the same source frame
+        bool capturedDrawPending;
+
+        // Source delivered a frame in the last update, draw is skipped after it failed
+        bool sourceFrameAcquired;
+        float homographyInputMatrixValues[9];
+
+        // Region of output frame covered by the warped input frame, full frame if WARPED_REGION_ENABLE is false
+        // Region of the last warp call is read back in the next iteration, homography might change in between
+        FrameRegion warpedRegion;
+        FrameRegion drawnRegion;
+        struct timespec drawnCaptureTimespec;
+        unsigned long long drawnSequence;
+
+        // Warper output contains a drawn frame, false after setup of the warper until the first draw
+        bool frameDrawn;
+        int encodedWidth;
+        int encodedHeight;
+
+        // Sequence number of the last acquired source frame, starts with 1
+        unsigned long long sourceSequence;
+
+        // JPEG header with region and frame information comment, published before the encoded frame data
+        unsigned char* commentHeader;
+        size_t commentHeaderSize;
+
+        // Watcher of homography input file, NULL if the file is read in each refresh
+        HomographyWatcher* homographyWatcher;
+        unsigned int homographyVersion;
+
+        // Control socket, NULL if it is disabled
+        ControlServer* controlServer;
+
+        // Configuration file, empty path disables it, watcher is NULL if changes are not detected
+        std::string configPath;
+        ConfigWatcher* configWatcher;
+        unsigned int configVersion;
+        ConfigSettings appliedConfig;
+
+        // Trigger mode, NULL if it is disabled
+        // Frame of a request was acquired and is drawn if triggerDrawn is set, it is published in the next update
+        FrameTrigger* frameTrigger;
+        bool triggerDrawn;
+        struct timespec triggerTimespec;
+        unsigned int triggeredFrameCount;
+        double triggerLatencySeconds;
+
+        // Static scene detection: Luma thumbnails of the last drawn frame and of the last published processed image
+        unsigned char* drawnSceneSample;
+        unsigned char* publishedSceneSample;
+        struct timespec lastSceneTimespec;
+
+        // Statistics
+        struct timespec startTimespec;
+        struct timespec lastFrameTimespec;
+        unsigned int frameCount;
+        unsigned int publishedFrameCount;
+        unsigned int skippedFrameCount;
+        double frameIntervalAverage;
+        struct timespec lastLatencyStatsTimespec;
+
+        // Stage recovery: Downtime lasts from the last published frame before a failure until the next published frame
+        // Attempts count recoveries since the last published frame
+        struct timespec lastPublishedTimespec;
+        struct timespec downtimeStartTimespec;
+        bool downtimePending;
+        unsigned int recoveryCount;
+        unsigned int recoveryAttempts;
+        double recoveryDowntimeSeconds;
+
+        // Startup: Duration of the stage setups, times from construction (start of the application) to the first published image
+        // and to the first original captured image after the camera settled, 0 until they were published
+        struct timespec launchTimespec;
+        double setupSeconds;
+        double firstFrameSeconds;
+        double settledFrameSeconds;
+        bool settledRefreshPending;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of parallel setup, sets up the encoders of the pipeline
+void* PipelineSetupEncodersThread(void* pipeline);
+
+// Check if file exists
+bool fileExists(std::string path);
+
+// Nanoseconds of a monotonic timestamp
+unsigned long long timespecNanoseconds(const struct timespec* timespec);
+
+// Seconds between two monotonic timestamps
+double elapsedSeconds(const struct timespec* startTimespec, const struct timespec* endTimespec);
+
+// Initialize condition variable for timed waits with monotonic deadlines, changes of the wall clock do not move them
+void monotonicConditionInit(pthread_cond_t* condition);
+
+// Monotonic deadline timeoutMs from now for pthread_cond_timedwait on conditions of monotonicConditionInit
+void monotonicDeadline(struct timespec* timespec, int timeoutMs);
+
+// Read homography matrix from file, returns false and keeps values if the file is invalid
+bool readHomographyFile(std::string path, float* values);
+
+// Read configuration file (<key> = <value> lines, # starts a comment), returns false if it can not be read or has an invalid line
+bool readConfigFile(std::string path, ConfigSettings* settings);
+
+// Invert 3 x 3 matrix (row by row), returns false if matrix is singular
+bool invertMatrix3x3(const double* matrix, double* inverse);
+
+// Parse output variants (comma separated <size>:<path>[:<target bytes>], size is full, half, quarter or <width>x<height>) for frames of width x height
+// Sizes are rounded to multiples of FRAME_REGION_ALIGN_*, returns false if the list is invalid, stages of variants are NULL
+bool parseOutputVariants(const std::string& text, int width, int height, std::vector<OutputVariant>* variants);
+
+// Downscale input frame (region of a frame with frameWidth x frameHeight) to full output frame with box filter, same pixel format
+// Parts of the output frame outside of the region are black
+// Scratch memory of the caller: columns has DOWNSCALE_COLUMNS_SIZE(output width), columnSums DOWNSCALE_COLUMN_SUMS_SIZE(frameWidth) ints
+void downscaleFrame(const Frame* input, int frameWidth, int frameHeight, Frame* output, int* columns, int* columnSums);
+
+// Bytes of a frame with pixel format
+int frameBytes(int width, int height, int format);
+
+// Start of plane (0: Y, 1: U, 2: V) of FRAME_FORMAT_YUV420 data, stride and height are the ones of the Y plane
+unsigned char* framePlane(unsigned char* data, int stride, int height, int plane);
+
+// Bounding box of the input frame warped by homography (openCV format), aligned to FRAME_REGION_ALIGN_*
+// Full frame if the homography maps a corner behind the camera
+void computeWarpedRegion(const float* values, int width, int height, FrameRegion* region);
+
+// Position of a COM marker after SOI (and JFIF APP0) of JPEG data, returns 0 if data is not a JPEG image
+size_t jpegCommentPosition(const unsigned char* data, size_t length);
+
+// Copy JPEG data up to position to header and append a COM segment, returns header length or 0 if comment is too long
+// Header needs space for position + strlen(comment) + 4 bytes
+size_t buildJpegCommentHeader(const unsigned char* data, size_t position, const char* comment, unsigned char* header);
@@ -0,0 +1,660 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-publish.h"
+
+/* #####################################
+PUBLISHERS
+##################################### */
+
+// Nothing to prepare, files are opened for each frame
+void FileFramePublisher::setup(int, int)
+{
+}
+
+// Files do not depend on the resolution
+void FileFramePublisher::resize(int, int)
+{
+}
+
+// Write encoded frame to file, file is locked during truncate and write
+void FileFramePublisher::publish(const EncodedFrame* frame, const std::string& path)
+{
+    // Create file if neccessary
+    if (!fileExists(path))
+    {
+        int createOutputFile = open(path.c_str(), O_CREAT, 0644);
+
+        if (createOutputFile != -1)
+        {
+            close(createOutputFile);
+        }
+    }
+
+    // Open file
+    // Do not use O_CREAT or O_TRUNC here, writing access out of file locked area!
+    int imageOutputFile = open(path.c_str(), O_RDWR);
+
+    // File open successful
+    if (imageOutputFile != -1)
+    {
+        // Lock file
+        if (lockf(imageOutputFile, F_LOCK, 0) != -1)
+        {
+            // Truncate file
+            if (ftruncate(imageOutputFile, 0) == -1)
+            {
+                // Suppress compiler warning by this check, error in file truncating, but we can not do anything about it anyways
+            }
+
+            // Write all valid bytes of the encoded frame, header and data with one call
+            struct iovec parts[2] = { { frame->header, frame->headerLength }, { frame->data, frame->length } };
+
+            if (pwritev(imageOutputFile, parts, 2, 0) == -1)
+            {
+                // Suppress compiler warning by this check, error in file writing, but we can not do anything about it anyways
+            }
+
+            // Unlock file
+            if (lockf(imageOutputFile, F_ULOCK, 0) == -1)
+            {
+                // Suppress compiler warning by this check, error in file unlocking, but we can not do anything about it anyways
+            }
+        }
+
+        // Always close file if opened successfully
+        close(imageOutputFile);
+    }
+
+    if (FRAME_INFO_SIDECAR_ENABLE)
+    {
+        writeFrameInfoFile(frame, path);
+    }
+}
+
+RenameFramePublisher::RenameFramePublisher(int tempFileCount)
+{
+    this->tempFileCount = tempFileCount;
+    exchangeSupported = true;
+}
+
+// Temp files are created on first publish of each path
+void RenameFramePublisher::setup(int, int)
+{
+    // Check temp file count, the replaced output file is reused as temp file and must not be written in the next publish
+    if (tempFileCount < 2)
+    {
+        printf("Publish Error: Rename publishing needs at least 2 temp files - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+}
+
+// Temp files do not depend on the resolution
+void RenameFramePublisher::resize(int, int)
+{
+}
+
+// Write frame to the next temp file, then exchange it with the output file
+// The replaced output file becomes the temp file, it is written again after tempFileCount frames
+// Readers which opened it before have this time to finish reading
+void RenameFramePublisher::publish(const EncodedFrame* frame, const std::string& path)
+{
+    // Get temp files of path, create them on first use
+    std::map<std::string, RenameTarget>::iterator targetIterator = targets.find(path);
+    RenameTarget* target = (targetIterator != targets.end() ? &targetIterator->second : createTarget(path));
+
+    const std::string& tempPath = target->tempPaths[target->nextTemp];
+    target->nextTemp = (target->nextTemp + 1) % tempFileCount;
+
+    // Open existing temp file, only recreated if plain rename had to be used
+    int tempFile = open(tempPath.c_str(), O_WRONLY);
+
+    if (tempFile == -1)
+    {
+        tempFile = open(tempPath.c_str(), O_WRONLY | O_CREAT, 0644);
+
+        if (tempFile == -1)
+        {
+            return;
+        }
+    }
+
+    // Overwrite content with header and data and cut remaining bytes of larger previous frames
+    size_t length = frame->headerLength + frame->length;
+    struct iovec parts[2] = { { frame->header, frame->headerLength }, { frame->data, frame->length } };
+    bool written = (pwritev(tempFile, parts, 2, 0) == (ssize_t)(length))
+        && (ftruncate(tempFile, length) != -1);
+    close(tempFile);
+
+    if (!written)
+    {
+        return;
+    }
+
+    // Exchange keeps both files, plain rename removes the temp file
+    if (!exchangeFiles(tempPath, path))
+    {
+        if (rename(tempPath.c_str(), path.c_str()) == -1)
+        {
+            // Suppress compiler warning by this check, error in file renaming, but we can not do anything about it anyways
+        }
+    }
+    if (FRAME_INFO_SIDECAR_ENABLE)
+    {
+        writeFrameInfoFile(frame, path);
+    }
+}
+
+// Create all temp files for path, they are siblings of the output file so that rename stays on the same file system
+RenameTarget* RenameFramePublisher::createTarget(const std::string& path)
+{
+    RenameTarget* target = &targets[path];
+    target->nextTemp = 0;
+
+    for (int i = 0; i < tempFileCount; i++)
+    {
+        char tempSuffix[16];
+        snprintf(tempSuffix, sizeof(tempSuffix), ".tmp%d", i);
+        target->tempPaths.push_back(path + tempSuffix);
+
+        int tempFile = open(target->tempPaths[i].c_str(), O_WRONLY | O_CREAT, 0644);
+
+        if (tempFile != -1)
+        {
+            close(tempFile);
+        }
+    }
+
+    return target;
+}
+
+// Atomically swap temp file and output file with renameat2
+bool RenameFramePublisher::exchangeFiles(const std::string& tempPath, const std::string& path)
+{
+    #ifdef SYS_renameat2
+    if (exchangeSupported)
+    {
+        if (syscall(SYS_renameat2, AT_FDCWD, tempPath.c_str(), AT_FDCWD, path.c_str(), RENAME_EXCHANGE) == 0)
+        {
+            return true;
+        }
+
+        // Output file does not exist yet, plain rename creates it
+        if (errno == ENOENT)
+        {
+            return false;
+        }
+
+        // Kernel or file system does not support exchange, always use plain rename
+        printf("Publish Warning: Exchange of files is not supported, temp files are recreated for each frame\n");
+        exchangeSupported = false;
+    }
+    #endif
+
+    return false;
+}
+
+ShmFramePublisher::ShmFramePublisher(int slotCount)
+{
+    this->slotCount = slotCount;
+    droppedCount = 0;
+}
+
+// Determine layout, JPEG images are smaller than raw RGB images of the same resolution
+void ShmFramePublisher::setup(int width, int height)
+{
+    // Check slot count, readers need at least one slot which is not written next
+    if (slotCount < 2)
+    {
+        printf("Publish Error: Shared memory ring needs at least 2 slots - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    pthread_mutex_init(&resizeMutex, NULL);
+    resizedWidth = width;
+    resizedHeight = height;
+    resizeRegions(width, height);
+}
+
+// Render thread: Request new layout, publish applies it before the next frame
+// Publish might run on a writer thread, it is the only thread which touches the regions
+void ShmFramePublisher::resize(int width, int height)
+{
+    pthread_mutex_lock(&resizeMutex);
+    resizedWidth = width;
+    resizedHeight = height;
+    pthread_mutex_unlock(&resizeMutex);
+}
+
+// Regions of the old layout are closed, not truncated: Attached readers keep valid pages until they open the renamed new file
+void ShmFramePublisher::resizeRegions(int width, int height)
+{
+    for (std::map<std::string, unsigned char*>::iterator regionIterator = regions.begin(); regionIterator != regions.end(); regionIterator++)
+    {
+        if (regionIterator->second)
+        {
+            closeRegion(regionIterator->second);
+            munmap(regionIterator->second, regionSize);
+        }
+    }
+
+    regions.clear();
+
+    frameWidth = width;
+    frameHeight = height;
+    slotSize = width * height * 3;
+    slotStride = shmFrameRingSlotStride(slotSize);
+    regionSize = shmFrameRingSize(slotCount, slotStride);
+}
+
+// Write frame into the slot after the latest one, then make it the latest frame
+void ShmFramePublisher::publish(const EncodedFrame* frame, const std::string& path)
+{
+    // Resolution changed: Regions are created again in new files with the slot size of the new resolution
+    pthread_mutex_lock(&resizeMutex);
+    int width = resizedWidth;
+    int height = resizedHeight;
+    pthread_mutex_unlock(&resizeMutex);
+
+    if (width != frameWidth || height != frameHeight)
+    {
+        resizeRegions(width, height);
+    }
+
+    // Get region of path, create it on first use
+    std::map<std::string, unsigned char*>::iterator regionIterator = regions.find(path);
+    unsigned char* region;
+
+    if (regionIterator != regions.end())
+    {
+        region = regionIterator->second;
+    }
+    else
+    {
+        region = createRegion(path);
+        regions[path] = region;
+    }
+
+    // Region could not be created, error was already reported
+    if (!region)
+    {
+        return;
+    }
+
+    // Frame does not fit into slot, skip it
+    size_t length = frame->headerLength + frame->length;
+
+    if (length > (size_t)(slotSize))
+    {
+        droppedCount++;
+        printf("Publish Warning: Frame with %u bytes does not fit into shared memory slot, %u frames dropped\n", (unsigned int)(length), droppedCount);
+        return;
+    }
+
+    ShmFrameRingHeader* header = (ShmFrameRingHeader*)(region);
+    uint32_t slot = (header->latestSlot + 1) % slotCount;
+    ShmFrameSlotHeader* slotHeader = (ShmFrameSlotHeader*)(region + SHM_FRAME_RING_HEADER_SIZE + (size_t)(slot) * slotStride);
+    uint64_t frameNumber = header->latestFrameNumber + 1;
+
+    struct timespec publishTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &publishTimespec);
+    uint64_t timestampNanoseconds = timespecNanoseconds(&publishTimespec);
+
+    // Write slot: Odd sequence while data is changed
+    uint32_t slotSequence = slotHeader->sequence;
+    __atomic_store_n(&slotHeader->sequence, slotSequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    unsigned char* slotData = (unsigned char*)(slotHeader) + SHM_FRAME_SLOT_HEADER_SIZE;
+    memcpy(slotData, frame->header, frame->headerLength);
+    memcpy(slotData + frame->headerLength, frame->data, frame->length);
+    slotHeader->length = length;
+    slotHeader->frameNumber = frameNumber;
+    slotHeader->timestampNanoseconds = timestampNanoseconds;
+    slotHeader->original = (frame->original ? 1 : 0);
+    slotHeader->regionX = frame->offsetX;
+    slotHeader->regionY = frame->offsetY;
+    slotHeader->regionWidth = frame->width;
+    slotHeader->regionHeight = frame->height;
+    slotHeader->frameWidth = frameWidth;
+    slotHeader->frameHeight = frameHeight;
+    slotHeader->sourceSequence = frame->sequence;
+    slotHeader->captureNanoseconds = timespecNanoseconds(&frame->captureTimespec);
+    slotHeader->warpNanoseconds = timespecNanoseconds(&frame->warpTimespec);
+    slotHeader->encodeNanoseconds = timespecNanoseconds(&frame->encodedTimespec);
+
+    __atomic_store_n(&slotHeader->sequence, slotSequence + 2, __ATOMIC_RELEASE);
+
+    // Update latest values of ring header: Odd sequence while values are changed
+    uint32_t headerSequence = header->sequence;
+    __atomic_store_n(&header->sequence, headerSequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    header->latestSlot = slot;
+    header->latestLength = length;
+    header->latestFrameNumber = frameNumber;
+    header->latestTimestampNanoseconds = timestampNanoseconds;
+
+    __atomic_store_n(&header->sequence, headerSequence + 2, __ATOMIC_RELEASE);
+}
+
+// Create region in a temp file and rename it to path, a region of a previous run is closed
+// The live file is never truncated: Readers which still map the replaced file keep valid pages and reopen path when they see the cleared magic
+unsigned char* ShmFramePublisher::createRegion(const std::string& path)
+{
+    std::string tempPath = path + ".tmp";
+    int regionFile = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (regionFile == -1)
+    {
+        printf("Publish Error: Open shared memory file %s - frames for this path are not published\n", tempPath.c_str());
+        return NULL;
+    }
+
+    if (ftruncate(regionFile, regionSize) == -1)
+    {
+        printf("Publish Error: Resize shared memory file %s - frames for this path are not published\n", tempPath.c_str());
+        close(regionFile);
+        unlink(tempPath.c_str());
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, regionFile, 0);
+    close(regionFile);
+
+    if (mapping == MAP_FAILED)
+    {
+        printf("Publish Error: Map shared memory file %s - frames for this path are not published\n", tempPath.c_str());
+        unlink(tempPath.c_str());
+        return NULL;
+    }
+
+    // File is zero filled, latestSlot starts with the last slot so that the first frame is written to slot 0
+    unsigned char* region = (unsigned char*)(mapping);
+    ShmFrameRingHeader* header = (ShmFrameRingHeader*)(region);
+    header->version = SHM_FRAME_RING_VERSION;
+    header->slotCount = slotCount;
+    header->slotSize = slotSize;
+    header->slotStride = slotStride;
+    header->latestSlot = slotCount - 1;
+
+    // Magic last, readers check it to detect initialized regions
+    __atomic_store_n(&header->magic, SHM_FRAME_RING_MAGIC, __ATOMIC_RELEASE);
+
+    // Replace file of a previous run, its readers keep the old file until they reopen path
+    closeRegionFile(path);
+
+    if (rename(tempPath.c_str(), path.c_str()) == -1)
+    {
+        printf("Publish Error: Rename shared memory file %s - frames for this path are not published\n", tempPath.c_str());
+        munmap(mapping, regionSize);
+        unlink(tempPath.c_str());
+        return NULL;
+    }
+
+    return region;
+}
+
+// Clear magic of an existing region file, only its header is mapped and the file keeps its size
+void ShmFramePublisher::closeRegionFile(const std::string& path)
+{
+    int regionFile = open(path.c_str(), O_RDWR);
+
+    if (regionFile == -1)
+    {
+        return;
+    }
+
+    struct stat fileStat;
+
+    if (fstat(regionFile, &fileStat) == -1 || fileStat.st_size < SHM_FRAME_RING_HEADER_SIZE)
+    {
+        close(regionFile);
+        return;
+    }
+
+    void* mapping = mmap(NULL, SHM_FRAME_RING_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, regionFile, 0);
+    close(regionFile);
+
+    if (mapping != MAP_FAILED)
+    {
+        closeRegion((unsigned char*)(mapping));
+        munmap(mapping, SHM_FRAME_RING_HEADER_SIZE);
+    }
+}
+
+// Readers check the magic on each read, they open path again if it is cleared
+void ShmFramePublisher::closeRegion(unsigned char* region)
+{
+    ShmFrameRingHeader* header = (ShmFrameRingHeader*)(region);
+    __atomic_store_n(&header->magic, SHM_FRAME_RING_CLOSED_MAGIC, __ATOMIC_RELEASE);
+}
+
+// Setup all publishers
+void MultiFramePublisher::setup(int width, int height)
+{
+    for (size_t i = 0; i < publishers.size(); i++)
+    {
+        publishers[i]->setup(width, height);
+    }
+}
+
+void MultiFramePublisher::resize(int width, int height)
+{
+    for (size_t i = 0; i < publishers.size(); i++)
+    {
+        publishers[i]->resize(width, height);
+    }
+}
+
+// Publish frame with all publishers
+void MultiFramePublisher::publish(const EncodedFrame* frame, const std::string& path)
+{
+    for (size_t i = 0; i < publishers.size(); i++)
+    {
+        publishers[i]->publish(frame, path);
+    }
+}
+
+AsyncFramePublisher::AsyncFramePublisher(FramePublisher* target, int queueLength, int dropPolicy)
+{
+    this->target = target;
+    this->queueLength = queueLength;
+    this->dropPolicy = dropPolicy;
+    queuedCount = 0;
+    publishedCount = 0;
+    droppedCount = 0;
+}
+
+// Allocate slots, setup target publisher and start writer thread
+void AsyncFramePublisher::setup(int width, int height)
+{
+    // Check queue length
+    if (queueLength < 1)
+    {
+        printf("Publish Error: Queue length must be at least 1 - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    target->setup(width, height);
+
+    // Slot buffers start empty, they grow to the largest frame size and are reused afterwards
+    slotCount = queueLength + 2;
+    slotFrames = (EncodedFrame*)(calloc(slotCount, sizeof(EncodedFrame)));
+    slotSizes = (size_t*)(calloc(slotCount, sizeof(size_t)));
+    slotPaths = new std::string[slotCount];
+
+    // All slots are free at the beginning
+    queuedSlots.setup(queueLength);
+    freeSlots.setup(slotCount);
+
+    for (int i = 0; i < slotCount; i++)
+    {
+        freeSlots.push(i);
+    }
+
+    if (sem_init(&queuedSemaphore, 0, 0))
+    {
+        printf("Publish Error: Create writer semaphore - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    if (pthread_create(&writerThread, NULL, AsyncFramePublisherThread, this))
+    {
+        printf("Publish Error: Create writer thread - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+}
+
+// Render thread: Copy frame into a free slot and queue it, never blocks
+// Target gets the new resolution at once, queued frames of the old resolution are written afterwards
+void AsyncFramePublisher::resize(int width, int height)
+{
+    target->resize(width, height);
+}
+
+void AsyncFramePublisher::publish(const EncodedFrame* frame, const std::string& path)
+{
+    unsigned int slot = 0;
+    bool slotFound = false;
+
+    // Queue is full: Drop this frame or take slot of oldest queued frame
+    // Oldest frame might just have been taken by writer thread, then a free slot is available
+    if (queuedSlots.size() >= (unsigned int)(queueLength))
+    {
+        if (dropPolicy == PUBLISH_DROP_NEWEST)
+        {
+            countDroppedFrame();
+            return;
+        }
+
+        if (queuedSlots.pop(&slot))
+        {
+            countDroppedFrame();
+            slotFound = true;
+        }
+    }
+
+    // Queue is not full, there is always a free slot
+    if (!slotFound && !freeSlots.pop(&slot))
+    {
+        countDroppedFrame();
+        return;
+    }
+
+    // Enlarge slot buffer if needed, frame sizes are stable so this only happens at the beginning
+    size_t length = frame->headerLength + frame->length;
+
+    if (slotSizes[slot] < length)
+    {
+        slotFrames[slot].data = (unsigned char*)(realloc(slotFrames[slot].data, length));
+        slotSizes[slot] = length;
+    }
+
+    // Copy frame with all its information, data pointer stays the slot buffer which holds header and data
+    unsigned char* slotData = slotFrames[slot].data;
+    slotFrames[slot] = *frame;
+    slotFrames[slot].data = slotData;
+    slotFrames[slot].length = length;
+    slotFrames[slot].header = NULL;
+    slotFrames[slot].headerLength = 0;
+    memcpy(slotData, frame->header, frame->headerLength);
+    memcpy(slotData + frame->headerLength, frame->data, frame->length);
+    slotPaths[slot] = path;
+
+    // Queue has space, either it was not full or oldest frame was removed
+    queuedSlots.push(slot);
+    __atomic_add_fetch(&queuedCount, 1, __ATOMIC_RELAXED);
+    sem_post(&queuedSemaphore);
+}
+
+// Render thread: Increase drop counter, report first drop and every 100th drop
+void AsyncFramePublisher::countDroppedFrame()
+{
+    unsigned int dropped = __atomic_add_fetch(&droppedCount, 1, __ATOMIC_RELAXED);
+
+    if (dropped == 1 || dropped % 100 == 0)
+    {
+        printf("Publish Warning: Writer thread is too slow, %u frames dropped, %u frames published\n", dropped, __atomic_load_n(&publishedCount, __ATOMIC_RELAXED));
+    }
+}
+
+// Writer thread: Publish all queued frames with target publisher and return slots
+void AsyncFramePublisher::writeQueuedFrames()
+{
+    unsigned int slot;
+
+    while (queuedSlots.pop(&slot))
+    {
+        struct timespec startTimespec;
+        struct timespec endTimespec;
+        clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+        target->publish(&slotFrames[slot], slotPaths[slot]);
+        clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+        latencyStats.record(LATENCY_STAGE_WRITE, &startTimespec, &endTimespec);
+        __atomic_add_fetch(&publishedCount, 1, __ATOMIC_RELAXED);
+        freeSlots.push(slot);
+    }
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of AsyncFramePublisher
+void* AsyncFramePublisherThread(void* publisher)
+{
+    AsyncFramePublisher* asyncPublisher = (AsyncFramePublisher*)(publisher);
+
+    while (true)
+    {
+        // Wait until frames were queued, semaphore might count frames which were dropped later
+        if (sem_wait(&asyncPublisher->queuedSemaphore) == -1)
+        {
+            continue;
+        }
+
+        asyncPublisher->writeQueuedFrames();
+    }
+
+    return NULL;
+}
+
+void writeFrameInfoFile(const EncodedFrame* frame, const std::string& path)
+{
+    std::string infoPath = path + ".info";
+    std::string tempPath = infoPath + ".tmp";
+
+    char info[256];
+    int infoLength = snprintf(info, sizeof(info), "sequence=%llu\noriginal=%d\nregion=%d,%d,%d,%d\nquality=%d\ncapture=%llu\nwarp=%llu\nencode=%llu\nlength=%u\n",
+        frame->sequence, (frame->original ? 1 : 0), frame->offsetX, frame->offsetY, frame->width, frame->height, frame->quality,
+        timespecNanoseconds(&frame->captureTimespec), timespecNanoseconds(&frame->warpTimespec), timespecNanoseconds(&frame->encodedTimespec), (unsigned int)(frame->headerLength + frame->length));
+
+    int infoFile = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (infoFile == -1)
+    {
+        return;
+    }
+
+    bool written = (write(infoFile, info, infoLength) == infoLength);
+    close(infoFile);
+
+    if (written && rename(tempPath.c_str(), infoPath.c_str()) == -1)
+    {
+        // Suppress compiler warning by this check, error in file renaming, but we can not do anything about it anyways
+    }
+}
@@ -0,0 +1,184 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU-latency.h"
+#include "visicamRPiGPU-pipeline.h"
+#include "visicamRPiGPU-ring.h"
+#include "visicamRPiGPU-shm.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <map>
+#include <pthread.h>
+#include <semaphore.h>
+#include <vector>
+
+// Flag of renameat2, not defined by older C library headers
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE                         (1 << 1)
+#endif
+
+// Policies for full publish queues
+#define PUBLISH_DROP_OLDEST                     0
+#define PUBLISH_DROP_NEWEST                     1
+
+/* #####################################
+PUBLISHERS
+##################################### */
+
+// Publisher: Rewrites output file in place, readers and writer synchronize with lockf
+class FileFramePublisher : public FramePublisher
+{
+    public:
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+};
+
+// Temp files of an output path for RenameFramePublisher
+typedef struct
+{
+    std::vector<std::string>    tempPaths;
+    int                         nextTemp;
+} RenameTarget;
+
+// Publisher: Writes frame to a sibling temp file and renames it over the output file
+// Readers always see complete files without locking, temp files are created once and reused
+class RenameFramePublisher : public FramePublisher
+{
+    public:
+        RenameFramePublisher(int tempFileCount);
+
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+
+        // Create temp files for path
+        RenameTarget* createTarget(const std::string& path);
+
+        // Swap temp file and output file, returns false if the kernel does not support it
+        bool exchangeFiles(const std::string& tempPath, const std::string& path);
+
+        int tempFileCount;
+        bool exchangeSupported;
+        std::map<std::string, RenameTarget> targets;
+};
+
+// Publisher: Writes frames into a ring of slots in a memory mapped file for each path (see visicamRPiGPU-shm.h)
+// Readers use seqlocks and never block the writer, writer never blocks
+class ShmFramePublisher : public FramePublisher
+{
+    public:
+        ShmFramePublisher(int slotCount);
+
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+
+        // Create region in a new file and rename it to path
+        unsigned char* createRegion(const std::string& path);
+
+        // Clear magic of the region file at path, if there is one
+        void closeRegionFile(const std::string& path);
+
+        // Clear magic of a mapped region, readers of it open path again
+        void closeRegion(unsigned char* region);
+
+        // Thread which publishes: Close and unmap all regions and compute layout for frames of width x height, regions are created again in new files on publish
+        void resizeRegions(int width, int height);
+
+        int slotCount;
+        int slotSize;
+        int slotStride;
+        size_t regionSize;
+        int frameWidth;
+        int frameHeight;
+
+        // Mapped regions by path, created on first publish
+        std::map<std::string, unsigned char*> regions;
+        unsigned int droppedCount;
+
+        // Resolution requested by resize, taken by the thread which publishes, protected by resizeMutex
+        pthread_mutex_t resizeMutex;
+        int resizedWidth;
+        int resizedHeight;
+};
+
+// Publisher: Passes frames to several publishers in order
+class MultiFramePublisher : public FramePublisher
+{
+    public:
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+
+        std::vector<FramePublisher*> publishers;
+};
+
+// Publisher: Hands copies of encoded frames to a writer thread, which publishes them with another publisher
+// Render thread never waits for I/O, if the queue is full a frame is dropped according to dropPolicy
+class AsyncFramePublisher : public FramePublisher
+{
+    public:
+        AsyncFramePublisher(FramePublisher* target, int queueLength, int dropPolicy);
+
+        void setup(int width, int height);
+        void publish(const EncodedFrame* frame, const std::string& path);
+        void resize(int width, int height);
+
+        // Render thread: Increase drop counter and report drops
+        void countDroppedFrame();
+
+        // Writer thread: Publish all queued frames with target publisher
+        void writeQueuedFrames();
+
+        FramePublisher* target;
+        int queueLength;
+        int dropPolicy;
+
+        // Slots with copies of encoded frames
+        // One slot is filled by the render thread, one is written by the writer thread, the rest can be queued
+        int slotCount;
+        EncodedFrame* slotFrames;
+        size_t* slotSizes;
+        std::string* slotPaths;
+
+        // Queued slots (render thread => writer thread) and free slots (writer thread => render thread)
+        SlotRing queuedSlots;
+        SlotRing freeSlots;
+        sem_t queuedSemaphore;
+        pthread_t writerThread;
+
+        // Statistics, only increased
+        unsigned int queuedCount;
+        unsigned int publishedCount;
+        unsigned int droppedCount;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of AsyncFramePublisher
+void* AsyncFramePublisherThread(void* publisher);
+
+// Write sequence number and times of frame to <path>.info (<key>=<value> lines) with temp file and rename
+// Readers check it before the image and skip frames with a sequence number they already processed
+void writeFrameInfoFile(const EncodedFrame* frame, const std::string& path);
@@ -0,0 +1,98 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdlib.h>
+
+/* #####################################
+RING
+##################################### */
+
+// Bounded lock-free ring of slot numbers between two threads
+// One producer thread pushes, one consumer thread pops
+// The producer thread may also pop, e.g. to drop the oldest entry, therefore pop uses compare and swap
+class SlotRing
+{
+    public:
+        SlotRing()
+        {
+            capacity = 0;
+            values = NULL;
+            head = 0;
+            tail = 0;
+        }
+
+        // Allocate ring for up to capacity entries
+        void setup(unsigned int capacity)
+        {
+            this->capacity = capacity;
+            values = (unsigned int*)(calloc(capacity, sizeof(unsigned int)));
+            head = 0;
+            tail = 0;
+        }
+
+        // Producer only: Append value, returns false if ring is full
+        bool push(unsigned int value)
+        {
+            unsigned int currentHead = __atomic_load_n(&head, __ATOMIC_RELAXED);
+            unsigned int currentTail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+            if (currentHead - currentTail >= capacity)
+            {
+                return false;
+            }
+
+            __atomic_store_n(&values[currentHead % capacity], value, __ATOMIC_RELAXED);
+            __atomic_store_n(&head, currentHead + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        // Remove oldest value, returns false if ring is empty
+        bool pop(unsigned int* value)
+        {
+            while (true)
+            {
+                unsigned int currentTail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+                unsigned int currentHead = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+                if (currentTail == currentHead)
+                {
+                    return false;
+                }
+
+                // Value might be overwritten after reading it, compare and swap fails in this case
+                unsigned int currentValue = __atomic_load_n(&values[currentTail % capacity], __ATOMIC_RELAXED);
+
+                if (__atomic_compare_exchange_n(&tail, &currentTail, currentTail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    *value = currentValue;
+                    return true;
+                }
+            }
+        }
+
+        // Number of entries, only a snapshot if the other thread is active
+        unsigned int size()
+        {
+            return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        }
+
+        unsigned int capacity;
+        unsigned int* values;
+        unsigned int head;
+        unsigned int tail;
+};
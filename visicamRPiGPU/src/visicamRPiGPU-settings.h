@@ -20,11 +20,80 @@
 MISC DEFINES
 ##################################### */
 #define FIRST_FORCED_REFRESH_SECONDS            3
+#define EARLY_REFRESH_ENABLE                    true    // Force the first refresh as soon as exposure and white balance of the camera settled, FIRST_FORCED_REFRESH_SECONDS is the upper bound
+#define HOMOGRAPHY_WATCH_ENABLE                 true    // Read homography input file on changes (inotify) instead of in each refresh
+#define CONTROL_SOCKET_PATH                     ""      // Unix domain socket for runtime settings, e.g. "/run/shm/visicamRPiGPU.sock", empty string disables it
+#define CONTROL_SOCKET_MODE                     0600    // Permissions of the control socket file, connecting needs write permission
+#define CONFIG_FILE_PATH                        ""      // Configuration file (<key> = <value> lines, keys of the control socket), read at startup and on changes, empty string disables it
+#define LATENCY_STATS_PATH                      ""      // Latency histograms of the pipeline stages in Prometheus text format, e.g. "/run/shm/visicamRPiGPU.prom", empty string disables the file
+#define LATENCY_STATS_INTERVAL_SECONDS          10      // Interval for writing LATENCY_STATS_PATH
+#define TRIGGER_MODE_ENABLE                     false   // Only produce a frame when it is requested (SIGUSR1, TRIGGER_FIFO_PATH or control socket command trigger)
+#define TRIGGER_FIFO_PATH                       ""      // Trigger mode: FIFO, each write requests a frame, e.g. "/run/shm/visicamRPiGPU.trigger", empty string disables it
+#define TRIGGER_DISCARD_FRAMES                  1       // Trigger mode: Frames which are dropped after a request, they might have been captured before it
+#define TRIGGER_IDLE_WAIT_MS                    100     // Trigger mode: Maximum time the idle loop sleeps, control commands and refreshes are handled in between
+
+/* #####################################
+PIPELINE
+##################################### */
+#define PIPELINE_BACKEND                        PIPELINE_BACKEND_OMX    // Allowed values: PIPELINE_BACKEND_OMX, PIPELINE_BACKEND_CPU
+#define PIPELINE_FRAME_FORMAT                   FRAME_FORMAT_RGBA       // Allowed values: FRAME_FORMAT_RGBA, FRAME_FORMAT_YUV420 (planar, warp writes 1.5 instead of 4 bytes per pixel)
+#define PIPELINE_MODE                           PIPELINE_MODE_PIPELINED // Allowed values: PIPELINE_MODE_PIPELINED (throughput, frame is read back one iteration later), PIPELINE_MODE_SAME_ITERATION (latency)
+#define FRAME_LOOP_CALLBACK_ENABLE              true                    // Process frames as soon as the source delivers them and publish encoded frames when they finish, false: fixed frame rate of openFrameworks
+#define CPU_SOURCE_PATH                         ""                      // CPU backend: JPEG input file, empty string for synthetic test frames
+#define CPU_WARP_THREAD_COUNT                   0                       // CPU backend: Threads for warping, 0 for one thread per CPU core
+#define CPU_WARP_REMAP_MAX_BYTES                (32 * 1024 * 1024)      // CPU backend: Memory limit of all remap tables (two per plane size, 8 bytes per pixel each), 0 computes the mapping in each frame
+#define CPU_WARP_REPORT_FRAMES                  100                     // CPU backend: Warp throughput (MP/s) is printed once after this number of frames
+#define WARPED_REGION_ENABLE                    false                   // Read back, encode and publish only the bounding box of the warped image, position is in a JPEG comment
+#define FRAME_INFO_ENABLE                       true                    // Add sequence number and capture, warp and encode times (CLOCK_MONOTONIC nanoseconds) of each published image to its JPEG comment
+#define FRAME_INFO_SIDECAR_ENABLE               false                   // File and rename output modes: Also write them to <path>.info after each image, shared memory and HTTP outputs always carry them
+#define OUTPUT_VARIANTS                         ""                      // Additional downscaled processed outputs: Comma separated <size>:<path>[:<target bytes>], size is full, half, quarter or <width>x<height>
+#define RATE_CONTROL_ENABLE                     false                   // Adjust JPEG quality between frames to hold the targets below, quality is reported in the JPEG comment
+#define RATE_CONTROL_TARGET_BYTES               200000                  // Target size of processed images, output variants scale it by their area if they have no own target, 0 disables it
+#define RATE_CONTROL_TARGET_ENCODE_MS           0                       // Target time from submitting a processed image to the end of its compression, 0 disables it
+#define RATE_CONTROL_CAPTURED_TARGET_BYTES      0                       // Target size of original captured images, 0 keeps their quality constant
+#define RATE_CONTROL_MIN_QUALITY                40                      // Allowed values: 0 to 100, quality floor of the controller
+#define RATE_CONTROL_MAX_QUALITY                95                      // Allowed values: 0 to 100, quality ceiling of the controller
+#define RATE_CONTROL_TOLERANCE                  0.1                     // Quality is kept while size and encode time are within this fraction of their targets
+#define STATIC_SCENE_SKIP_ENABLE                false                   // Skip readback, encode and publish of processed images while the warped image does not change
+#define STATIC_SCENE_SAMPLE_WIDTH               64                      // Size of the luma thumbnails compared for change detection
+#define STATIC_SCENE_SAMPLE_HEIGHT              48
+#define STATIC_SCENE_NOISE_LEVEL                8                       // Luma differences of a thumbnail pixel up to this value are ignored as sensor noise
+#define STATIC_SCENE_SAD_THRESHOLD              256                     // Scene changed if the sum of the remaining absolute luma differences exceeds this value
+#define STATIC_SCENE_KEEPALIVE_SECONDS          10                      // Publish a processed image at least once in this interval, even if the scene is static
+#define ENCODE_BUFFER_COUNT                     2                       // Allowed values: 1 (no pipelining) to 8, frames in flight in the encoder
+#define DUAL_OUTPUT_ENABLE                      false                   // Refresh frames: Publish the processed image and in addition the original captured image of the same camera frame with a second encoder, false: original replaces the processed image
+#define CAPTURED_ENCODE_BUFFER_COUNT            2                       // Dual output: Frames in flight in the encoder of original captured images, 2 or more let the loop continue during its compression
+#define STAGE_RECOVERY_ENABLE                   true                    // Tear down and set up again only the source or encoder which missed a deadline or reported an error, false exits the application
+#define STAGE_RECOVERY_MAX_ATTEMPTS             5                       // Exit the application after this many recoveries without a published frame in between
+#define STAGE_DEADLINE_CHECK_MS                 100                     // Callback driven loop: Longest sleep while waiting for a frame, the deadline of the source is checked in between
+#define PARALLEL_SETUP_ENABLE                   true                    // Set up the encoders in a thread while the render thread sets up source and warper (GL context), false sets up one stage after another
+#define PUBLISH_MODE                            PUBLISH_MODE_FILE       // Allowed values: PUBLISH_MODE_FILE (rewrite files with lockf), PUBLISH_MODE_RENAME (write temp file and rename), PUBLISH_MODE_SHM (ring in memory mapped files)
+#define PUBLISH_RENAME_TEMP_COUNT               3                       // PUBLISH_MODE_RENAME: Allowed values: 2 to 16, temp files for each output path
+#define PUBLISH_SHM_SLOT_COUNT                  4                       // PUBLISH_MODE_SHM: Allowed values: 2 to 64, frames kept in each ring
+#define PUBLISH_QUEUE_LENGTH                    4                       // Allowed values: 0 (publish on render thread) to 64, frames waiting for the writer thread
+#define PUBLISH_DROP_POLICY                     PUBLISH_DROP_OLDEST     // Allowed values: PUBLISH_DROP_OLDEST, PUBLISH_DROP_NEWEST
+
+/* #####################################
+HTTP SERVER
+##################################### */
+#define HTTP_SERVER_ENABLE                      false                   // Serve MJPEG streams and snapshots in addition to the output mode
+#define HTTP_SERVER_ADDRESS                     "127.0.0.1"             // Interface to listen on, "0.0.0.0" for all interfaces
+#define HTTP_SERVER_PORT                        8080
+#define HTTP_SERVER_MAX_CLIENTS                 8
 
 /* #####################################
 OMX
 ##################################### */
 
+// Deadlines of waits for components, a component which misses one fails (see STAGE_RECOVERY_ENABLE)
+#define OMX_COMMAND_TIMEOUT_MS                  2000    // State changes, port enable and disable, camera configuration
+#define OMX_SOURCE_TIMEOUT_MS                   2000    // Camera frame from egl_render (FillBufferDone) after the buffer was requested
+#define OMX_ENCODE_TIMEOUT_MS                   2000    // image_encode: Input buffer (EmptyBufferDone) or JPEG image (FillBufferDone) of a submitted frame
+
+// Settling of the camera after setup (EARLY_REFRESH_ENABLE): Exposure, gains and white balance gains of the camera are compared between frames
+#define OMX_CAM_SETTLE_FRAMES                   5       // Camera settled after this many frames in a row without a larger change
+#define OMX_CAM_SETTLE_TOLERANCE                0.02    // Largest relative change of a value between two frames
+
 // JPEG settings
 #define OMX_JPEG_QUALITY                        100     // Allowed values: 0 to 100
 #define OMX_JPEG_EXIF_ENABLE                    OMX_FALSE
@@ -64,4 +133,4 @@ OMX
 #define OMX_CAM_WHITE_BALANCE_RED_GAIN          1000
 #define OMX_CAM_WHITE_BALANCE_BLUE_GAIN         1000
 #define OMX_CAM_IMAGE_FILTER                    OMX_ImageFilterNone
-#define OMX_CAM_DRC                             OMX_DynRangeExpOff
\ No newline at end of file
+#define OMX_CAM_DRC                             OMX_DynRangeExpOff      // Allowed values: OMX_DynRangeExpOff, OMX_DynRangeExpLow, OMX_DynRangeExpMedium, OMX_DynRangeExpHigh
\ No newline at end of file
@@ -0,0 +1,372 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Note: This file is self-contained, consumers can copy it to read frames of visicamRPiGPU
+// Layout of the frame ring and header-only reader for output mode PUBLISH_MODE_SHM
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* #####################################
+LAYOUT
+##################################### */
+
+// Region: ring header, then slotCount slots, each with slot header and JPEG data
+// All sequence numbers are seqlocks: odd while the writer changes the protected values, readers retry in that case
+#define SHM_FRAME_RING_MAGIC                    0x52435656      // "VVCR" in little endian memory
+#define SHM_FRAME_RING_CLOSED_MAGIC             0               // Writer replaced the region with a new file at the same path (restart or new resolution)
+#define SHM_FRAME_RING_VERSION                  2               // 2: Slot header with source sequence number and capture, warp and encoded times
+#define SHM_FRAME_RING_HEADER_SIZE              64
+#define SHM_FRAME_SLOT_HEADER_SIZE              128
+
+// Ring header at offset 0, magic is written last after all other values are valid
+// Files are never truncated while they are in use, a replaced region keeps its size and gets SHM_FRAME_RING_CLOSED_MAGIC
+typedef struct
+{
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            slotCount;
+    uint32_t            slotSize;                       // Maximum JPEG length of a slot
+    uint32_t            slotStride;                     // Distance of slots in bytes, slot i starts at SHM_FRAME_RING_HEADER_SIZE + i * slotStride
+    uint32_t            sequence;                       // Seqlock for all latest values
+    uint32_t            latestSlot;
+    uint32_t            latestLength;
+    uint64_t            latestFrameNumber;              // Starts at 1, 0 means no frame published yet
+    uint64_t            latestTimestampNanoseconds;     // CLOCK_MONOTONIC of publishing
+} ShmFrameRingHeader;
+
+// Slot header, JPEG data follows at offset SHM_FRAME_SLOT_HEADER_SIZE of the slot
+typedef struct
+{
+    uint32_t            sequence;                       // Seqlock for slot header values and data
+    uint32_t            length;
+    uint64_t            frameNumber;
+    uint64_t            timestampNanoseconds;
+    uint32_t            original;                       // 1 for original captured images, 0 for processed images
+    uint32_t            regionX;                        // Position and size of the image in the output frame, images of a warped region are smaller
+                                                        // Older writers did not set these values, they are 0 then
+    uint32_t            regionY;
+    uint32_t            regionWidth;
+    uint32_t            regionHeight;
+    uint32_t            frameWidth;                     // Size of the output frame
+    uint32_t            frameHeight;
+    uint32_t            reserved;
+    uint64_t            sourceSequence;                 // Sequence number of the source frame, shared by processed and original images of it
+    uint64_t            captureNanoseconds;             // CLOCK_MONOTONIC of camera frame delivery, readback for the encoder and end of compression
+    uint64_t            warpNanoseconds;
+    uint64_t            encodeNanoseconds;
+} ShmFrameSlotHeader;
+
+// Information about a frame returned by the reader
+typedef struct
+{
+    uint32_t            slot;
+    uint32_t            sequence;                       // Slot sequence when the frame was read, for zero copy validation
+    uint32_t            length;
+    uint64_t            frameNumber;
+    uint64_t            timestampNanoseconds;
+    bool                original;
+    uint32_t            regionX;
+    uint32_t            regionY;
+    uint32_t            regionWidth;
+    uint32_t            regionHeight;
+    uint32_t            frameWidth;
+    uint32_t            frameHeight;
+    uint64_t            sourceSequence;
+    uint64_t            captureNanoseconds;
+    uint64_t            warpNanoseconds;
+    uint64_t            encodeNanoseconds;
+} ShmFrameInfo;
+
+// Results of ShmFrameRingReader::readLatestInfo
+#define SHM_FRAME_READ_NONE                     0               // No frame published yet
+#define SHM_FRAME_READ_OK                       1
+#define SHM_FRAME_READ_REOPEN                   2               // Region was closed or is invalid, open path again
+
+// Size of whole region in bytes
+inline size_t shmFrameRingSize(uint32_t slotCount, uint32_t slotStride)
+{
+    return SHM_FRAME_RING_HEADER_SIZE + (size_t)(slotCount) * slotStride;
+}
+
+// Distance of slots in bytes for maximum JPEG length slotSize, slots are aligned to 64 bytes
+inline uint32_t shmFrameRingSlotStride(uint32_t slotSize)
+{
+    return SHM_FRAME_SLOT_HEADER_SIZE + ((slotSize + 63) & ~63u);
+}
+
+/* #####################################
+READER
+##################################### */
+
+// Reads the latest frame without any locks, writer is never blocked
+// Usage: open once, then readLatest (copy) or peekLatest + isValid (zero copy) for each frame, open again if the writer replaced the region
+// Layout is taken from the header only in open, slots and lengths are checked against the mapped size on every read
+class ShmFrameRingReader
+{
+    public:
+        ShmFrameRingReader()
+        {
+            region = NULL;
+            regionSize = 0;
+            slotCount = 0;
+            slotSize = 0;
+            slotStride = 0;
+        }
+
+        ~ShmFrameRingReader()
+        {
+            close();
+        }
+
+        // Map region of path, returns false if the writer did not create it yet
+        bool open(const char* path)
+        {
+            close();
+
+            int file = ::open(path, O_RDONLY);
+
+            if (file == -1)
+            {
+                return false;
+            }
+
+            struct stat fileStat;
+
+            if (fstat(file, &fileStat) == -1 || fileStat.st_size < SHM_FRAME_RING_HEADER_SIZE)
+            {
+                ::close(file);
+                return false;
+            }
+
+            void* mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, file, 0);
+            ::close(file);
+
+            if (mapping == MAP_FAILED)
+            {
+                return false;
+            }
+
+            region = (unsigned char*)(mapping);
+            regionSize = fileStat.st_size;
+
+            // Check if writer finished initialization and region matches the layout
+            const ShmFrameRingHeader* header = getHeader();
+
+            if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_FRAME_RING_MAGIC
+                || header->version != SHM_FRAME_RING_VERSION
+                || header->slotStride < SHM_FRAME_SLOT_HEADER_SIZE + header->slotSize
+                || shmFrameRingSize(header->slotCount, header->slotStride) > regionSize)
+            {
+                close();
+                return false;
+            }
+
+            slotCount = header->slotCount;
+            slotSize = header->slotSize;
+            slotStride = header->slotStride;
+
+            return true;
+        }
+
+        // Unmap region
+        void close()
+        {
+            if (region)
+            {
+                munmap(region, regionSize);
+                region = NULL;
+                regionSize = 0;
+            }
+        }
+
+        // Check if writer published a frame after lastFrameNumber
+        bool hasNewFrame(uint64_t lastFrameNumber)
+        {
+            ShmFrameInfo info;
+            return (readLatestInfo(&info) == SHM_FRAME_READ_OK && info.frameNumber != lastFrameNumber);
+        }
+
+        // Check if the writer replaced the region, then path has to be opened again
+        bool isClosed()
+        {
+            return (!region || __atomic_load_n(&getHeader()->magic, __ATOMIC_ACQUIRE) != SHM_FRAME_RING_MAGIC);
+        }
+
+        // Copy latest frame to buffer
+        // Returns length of frame, 0 if there is no frame, -1 if buffer is too small and -2 if path has to be opened again
+        long readLatest(unsigned char* buffer, size_t bufferSize, ShmFrameInfo* info)
+        {
+            while (true)
+            {
+                int status = readLatestInfo(info);
+
+                if (status != SHM_FRAME_READ_OK)
+                {
+                    return (status == SHM_FRAME_READ_REOPEN ? -2 : 0);
+                }
+
+                if (info->length > bufferSize)
+                {
+                    return -1;
+                }
+
+                memcpy(buffer, getSlotData(info->slot), info->length);
+
+                // Slot was overwritten during the copy, try again with the new latest frame
+                if (isValid(info))
+                {
+                    return info->length;
+                }
+            }
+        }
+
+        // Zero copy: Pointer to JPEG data of the latest frame, NULL if there is no frame (check isClosed then)
+        // Data may be overwritten by the writer at any time, check isValid after processing it
+        const unsigned char* peekLatest(ShmFrameInfo* info)
+        {
+            if (readLatestInfo(info) != SHM_FRAME_READ_OK)
+            {
+                return NULL;
+            }
+
+            return getSlotData(info->slot);
+        }
+
+        // Check if slot of info was not changed by the writer since it was read
+        bool isValid(const ShmFrameInfo* info)
+        {
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            return (__atomic_load_n(&getSlotHeader(info->slot)->sequence, __ATOMIC_RELAXED) == info->sequence);
+        }
+
+        // Read consistent values of the latest frame and its slot sequence, returns SHM_FRAME_READ_*
+        int readLatestInfo(ShmFrameInfo* info)
+        {
+            if (!region)
+            {
+                return SHM_FRAME_READ_REOPEN;
+            }
+
+            const ShmFrameRingHeader* header = getHeader();
+
+            while (true)
+            {
+                // Writer replaced the region, it is not written anymore
+                if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_FRAME_RING_MAGIC)
+                {
+                    return SHM_FRAME_READ_REOPEN;
+                }
+
+                // Latest values of ring header
+                uint32_t headerSequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+
+                if (headerSequence & 1)
+                {
+                    continue;
+                }
+
+                uint32_t slot = header->latestSlot;
+                uint64_t frameNumber = header->latestFrameNumber;
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+                if (__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) != headerSequence)
+                {
+                    continue;
+                }
+
+                if (frameNumber == 0)
+                {
+                    return SHM_FRAME_READ_NONE;
+                }
+
+                // Layout of open is used, slot must be inside the mapping
+                if (slot >= slotCount
+                    || SHM_FRAME_RING_HEADER_SIZE + (size_t)(slot) * slotStride + SHM_FRAME_SLOT_HEADER_SIZE > regionSize)
+                {
+                    return SHM_FRAME_READ_REOPEN;
+                }
+
+                // Values of slot header, slot might already be reused for a newer frame, then use that one
+                const ShmFrameSlotHeader* slotHeader = getSlotHeader(slot);
+                uint32_t slotSequence = __atomic_load_n(&slotHeader->sequence, __ATOMIC_ACQUIRE);
+
+                if (slotSequence & 1)
+                {
+                    continue;
+                }
+
+                info->slot = slot;
+                info->sequence = slotSequence;
+                info->length = slotHeader->length;
+                info->frameNumber = slotHeader->frameNumber;
+                info->timestampNanoseconds = slotHeader->timestampNanoseconds;
+                info->original = (slotHeader->original != 0);
+                info->regionX = slotHeader->regionX;
+                info->regionY = slotHeader->regionY;
+                info->regionWidth = slotHeader->regionWidth;
+                info->regionHeight = slotHeader->regionHeight;
+                info->frameWidth = slotHeader->frameWidth;
+                info->frameHeight = slotHeader->frameHeight;
+                info->sourceSequence = slotHeader->sourceSequence;
+                info->captureNanoseconds = slotHeader->captureNanoseconds;
+                info->warpNanoseconds = slotHeader->warpNanoseconds;
+                info->encodeNanoseconds = slotHeader->encodeNanoseconds;
+
+                if (!isValid(info))
+                {
+                    continue;
+                }
+
+                if (info->length > slotSize
+                    || SHM_FRAME_RING_HEADER_SIZE + (size_t)(slot) * slotStride + SHM_FRAME_SLOT_HEADER_SIZE + info->length > regionSize)
+                {
+                    return SHM_FRAME_READ_REOPEN;
+                }
+
+                return SHM_FRAME_READ_OK;
+            }
+        }
+
+        const ShmFrameRingHeader* getHeader()
+        {
+            return (const ShmFrameRingHeader*)(region);
+        }
+
+        const ShmFrameSlotHeader* getSlotHeader(uint32_t slot)
+        {
+            return (const ShmFrameSlotHeader*)(region + SHM_FRAME_RING_HEADER_SIZE + (size_t)(slot) * slotStride);
+        }
+
+        const unsigned char* getSlotData(uint32_t slot)
+        {
+            return ((const unsigned char*)(getSlotHeader(slot)) + SHM_FRAME_SLOT_HEADER_SIZE);
+        }
+
+        unsigned char* region;
+        size_t regionSize;
+
+        // Layout read in open
+        uint32_t slotCount;
+        uint32_t slotSize;
+        uint32_t slotStride;
+};
@@ -0,0 +1,201 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "visicamRPiGPU-trigger.h"
+
+// Trigger of the signal handler, signal handlers have no context
+static FrameTrigger* signalFrameTrigger = NULL;
+
+/* #####################################
+FRAME TRIGGER
+##################################### */
+
+FrameTrigger::FrameTrigger(std::string fifoPath)
+{
+    this->fifoPath = fifoPath;
+    fifoFile = -1;
+    wakePipe[0] = -1;
+    wakePipe[1] = -1;
+    requestedCount = 0;
+    servingCount = 0;
+    completedCount = 0;
+    lastLatencySeconds = 0.0;
+}
+
+bool FrameTrigger::setup()
+{
+    // Wake pipe: Non blocking, a full pipe already wakes the render thread
+    if (pipe(wakePipe) == -1)
+    {
+        return false;
+    }
+
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    pthread_mutex_init(&completeMutex, NULL);
+    monotonicConditionInit(&completeCondition);
+
+    // Signal handler requests frames, interrupted system calls are restarted
+    signalFrameTrigger = this;
+
+    struct sigaction signalAction;
+    memset(&signalAction, 0, sizeof(signalAction));
+    signalAction.sa_handler = frameTriggerSignalHandler;
+    signalAction.sa_flags = SA_RESTART;
+    sigemptyset(&signalAction.sa_mask);
+
+    if (sigaction(SIGUSR1, &signalAction, NULL) == -1)
+    {
+        return false;
+    }
+
+    // FIFO is opened for reading and writing, so that it never reports end of file when writers close it
+    if (!fifoPath.empty())
+    {
+        if (mkfifo(fifoPath.c_str(), 0666) == -1 && errno != EEXIST)
+        {
+            printf("Trigger Warning: Can not create FIFO %s\n", fifoPath.c_str());
+        }
+        else
+        {
+            fifoFile = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK);
+
+            if (fifoFile == -1)
+            {
+                printf("Trigger Warning: Can not open FIFO %s\n", fifoPath.c_str());
+            }
+        }
+    }
+
+    return true;
+}
+
+// Only async signal safe calls, also used by the signal handler
+unsigned int FrameTrigger::request()
+{
+    unsigned int number = __atomic_add_fetch(&requestedCount, 1, __ATOMIC_ACQ_REL);
+    char wakeByte = 0;
+
+    if (write(wakePipe[1], &wakeByte, 1) == -1)
+    {
+        // Pipe is full, render thread is woken up anyways
+    }
+
+    return number;
+}
+
+bool FrameTrigger::wait(int timeoutMilliseconds)
+{
+    // Sleep only if there are no requests yet
+    if (__atomic_load_n(&requestedCount, __ATOMIC_ACQUIRE) == completedCount)
+    {
+        struct pollfd pollFiles[2];
+        int pollFileCount = 1;
+        pollFiles[0].fd = wakePipe[0];
+        pollFiles[0].events = POLLIN;
+
+        if (fifoFile != -1)
+        {
+            pollFiles[1].fd = fifoFile;
+            pollFiles[1].events = POLLIN;
+            pollFileCount = 2;
+        }
+
+        if (poll(pollFiles, pollFileCount, timeoutMilliseconds) <= 0)
+        {
+            return false;
+        }
+    }
+
+    // Empty pipe and FIFO, any data written to the FIFO is one request
+    char buffer[64];
+
+    while (read(wakePipe[0], buffer, sizeof(buffer)) > 0)
+    {
+    }
+
+    if (fifoFile != -1)
+    {
+        bool fifoRequest = false;
+
+        while (read(fifoFile, buffer, sizeof(buffer)) > 0)
+        {
+            fifoRequest = true;
+        }
+
+        if (fifoRequest)
+        {
+            __atomic_add_fetch(&requestedCount, 1, __ATOMIC_ACQ_REL);
+        }
+    }
+
+    // Serve all requests up to now
+    servingCount = __atomic_load_n(&requestedCount, __ATOMIC_ACQUIRE);
+
+    return (servingCount != completedCount);
+}
+
+void FrameTrigger::complete(double latencySeconds)
+{
+    pthread_mutex_lock(&completeMutex);
+    completedCount = servingCount;
+    lastLatencySeconds = latencySeconds;
+    pthread_cond_broadcast(&completeCondition);
+    pthread_mutex_unlock(&completeMutex);
+}
+
+bool FrameTrigger::waitCompleted(unsigned int number, int timeoutSeconds, double* latencySeconds)
+{
+    struct timespec timeoutTimespec;
+    monotonicDeadline(&timeoutTimespec, timeoutSeconds * 1000);
+
+    pthread_mutex_lock(&completeMutex);
+
+    // Counters wrap around, compare their difference
+    while ((int)(completedCount - number) < 0)
+    {
+        if (pthread_cond_timedwait(&completeCondition, &completeMutex, &timeoutTimespec) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    bool completed = ((int)(completedCount - number) >= 0);
+    *latencySeconds = lastLatencySeconds;
+
+    pthread_mutex_unlock(&completeMutex);
+
+    return completed;
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Signal handler of SIGUSR1, requests a frame from the trigger which was set up last
+void frameTriggerSignalHandler(int)
+{
+    int savedErrno = errno;
+
+    if (signalFrameTrigger)
+    {
+        signalFrameTrigger->request();
+    }
+
+    errno = savedErrno;
+}
@@ -0,0 +1,74 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "visicamRPiGPU-pipeline.h"
+
+#include <sys/time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+
+/* #####################################
+FRAME TRIGGER
+##################################### */
+
+// Requests for single frames in trigger mode: SIGUSR1, a line written to a FIFO or the control socket command trigger
+// Requests are counted, all requests which arrived before the render thread takes them are served by the same frame
+// Each request writes a byte into a pipe, the idle render thread sleeps in poll on the pipe and the FIFO
+class FrameTrigger
+{
+    public:
+        FrameTrigger(std::string fifoPath);
+
+        // Create wake pipe and install SIGUSR1 handler, returns false if this fails
+        // FIFO is created if it does not exist, trigger mode works without it if it can not be opened
+        bool setup();
+
+        // Any thread or signal handler: Request a frame, returns number of the request
+        unsigned int request();
+
+        // Render thread: Wait up to timeoutMilliseconds for requests, returns true if there are requests which are served now
+        bool wait(int timeoutMilliseconds);
+
+        // Render thread: Frame of the served requests is published
+        void complete(double latencySeconds);
+
+        // Any thread: Wait until request number was served, returns false after timeoutSeconds
+        bool waitCompleted(unsigned int number, int timeoutSeconds, double* latencySeconds);
+
+        std::string fifoPath;
+        int fifoFile;
+        int wakePipe[2];
+
+        // Counters of requests: requestedCount is increased atomically, others are only changed by the render thread
+        // completedCount and lastLatencySeconds are protected by completeMutex
+        unsigned int requestedCount;
+        unsigned int servingCount;
+        unsigned int completedCount;
+        double lastLatencySeconds;
+        pthread_mutex_t completeMutex;
+        pthread_cond_t completeCondition;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Signal handler of SIGUSR1, requests a frame from the trigger which was set up last
+void frameTriggerSignalHandler(int signalNumber);
@@ -0,0 +1,864 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-warp.h"
+
+// Arguments for worker threads
+typedef struct
+{
+    WarpThreadPool* pool;
+    int band;
+} WarpWorker;
+
+// Fixed point constants
+#define WARP_FIXED_HALF                         (1 << (WARP_FIXED_BITS - 1))
+#define WARP_WEIGHT_ONE                         (1 << WARP_WEIGHT_BITS)
+#define WARP_WEIGHT_SHIFT                       (WARP_FIXED_BITS - WARP_WEIGHT_BITS)
+#define WARP_BLEND_SHIFT                        (2 * WARP_WEIGHT_BITS)
+#define WARP_BLEND_ROUND                        (1 << (WARP_BLEND_SHIFT - 1))
+
+// Coordinates farther outside are not stepped in fixed point, mapping is strongly non linear there
+#define WARP_SPAN_LIMIT                         16384.0
+
+// Maximum deviation of linear stepping from exact mapping in pixels, one interpolation weight step
+#define WARP_SPAN_TOLERANCE                     (1.0 / (1 << WARP_WEIGHT_BITS))
+
+// Sample position (input pixel coordinates - 0.5) or projective coordinates with their w
+typedef struct
+{
+    double x;
+    double y;
+    double w;
+} WarpPoint;
+
+/* #####################################
+KERNELS
+##################################### */
+
+// Bilinear blend of pixels x0, x1 in rows row0, row1
+// All kernels use the same exact integer arithmetic and produce identical results
+static inline void warpBlendScalar(const unsigned char* row0, const unsigned char* row1, int x0, int x1, int weightX, int weightY, unsigned char* output)
+{
+    int inverseX = WARP_WEIGHT_ONE - weightX;
+    int inverseY = WARP_WEIGHT_ONE - weightY;
+
+    for (int c = 0; c < 4; c++)
+    {
+        int left = row0[4 * x0 + c] * inverseY + row1[4 * x0 + c] * weightY;
+        int right = row0[4 * x1 + c] * inverseY + row1[4 * x1 + c] * weightY;
+        output[c] = (unsigned char)((left * inverseX + right * weightX + WARP_BLEND_ROUND) >> WARP_BLEND_SHIFT);
+    }
+}
+
+// Bilinear blend of pixels x0, x1 in rows row0, row1 of a plane, same arithmetic as for RGBA pixels
+static inline unsigned char warpBlendPlane(const unsigned char* row0, const unsigned char* row1, int x0, int x1, int weightX, int weightY)
+{
+    int left = row0[x0] * (WARP_WEIGHT_ONE - weightY) + row1[x0] * weightY;
+    int right = row0[x1] * (WARP_WEIGHT_ONE - weightY) + row1[x1] * weightY;
+    return (unsigned char)((left * (WARP_WEIGHT_ONE - weightX) + right * weightX + WARP_BLEND_ROUND) >> WARP_BLEND_SHIFT);
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+// Bilinear blend of two adjacent pixels in top and bottom row, one pixel per 128 bit register
+static inline void warpBlendAdjacent(const unsigned char* top, const unsigned char* bottom, int weightX, int weightY, unsigned char* output)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    // Vertical blend of left and right pixel: 8 x 16 bit, maximum 255 * 128
+    __m128i topPixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(top)), zero);
+    __m128i bottomPixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(bottom)), zero);
+    __m128i vertical = _mm_add_epi16(_mm_mullo_epi16(topPixels, _mm_set1_epi16(WARP_WEIGHT_ONE - weightY)), _mm_mullo_epi16(bottomPixels, _mm_set1_epi16(weightY)));
+
+    // Horizontal blend: Interleave left and right channels, multiply and add pairs to 4 x 32 bit
+    __m128i pairs = _mm_unpacklo_epi16(vertical, _mm_srli_si128(vertical, 8));
+    __m128i sum = _mm_madd_epi16(pairs, _mm_set1_epi32((weightX << 16) | (WARP_WEIGHT_ONE - weightX)));
+    sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(WARP_BLEND_ROUND)), WARP_BLEND_SHIFT);
+
+    // Pack 32 bit channels to bytes
+    sum = _mm_packs_epi32(sum, sum);
+    sum = _mm_packus_epi16(sum, sum);
+
+    int pixel = _mm_cvtsi128_si32(sum);
+    memcpy(output, &pixel, 4);
+}
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+// Bilinear blend of two adjacent pixels in top and bottom row
+static inline void warpBlendAdjacent(const unsigned char* top, const unsigned char* bottom, int weightX, int weightY, unsigned char* output)
+{
+    // Vertical blend of left and right pixel: 8 x 16 bit, maximum 255 * 128
+    uint16x8_t vertical = vmull_u8(vld1_u8(top), vdup_n_u8(WARP_WEIGHT_ONE - weightY));
+    vertical = vmlal_u8(vertical, vld1_u8(bottom), vdup_n_u8(weightY));
+
+    // Horizontal blend: Left pixel is in low half, right pixel in high half, 4 x 32 bit
+    uint32x4_t sum = vmull_n_u16(vget_low_u16(vertical), WARP_WEIGHT_ONE - weightX);
+    sum = vmlal_n_u16(sum, vget_high_u16(vertical), weightX);
+
+    // Rounding shift and narrowing to bytes
+    uint16x4_t narrow = vrshrn_n_u32(sum, WARP_BLEND_SHIFT);
+    uint8x8_t packed = vmovn_u16(vcombine_u16(narrow, narrow));
+
+    vst1_lane_u32((uint32_t*)(output), vreinterpret_u32_u8(packed), 0);
+}
+
+#else
+
+// Bilinear blend of two adjacent pixels in top and bottom row
+static inline void warpBlendAdjacent(const unsigned char* top, const unsigned char* bottom, int weightX, int weightY, unsigned char* output)
+{
+    warpBlendScalar(top, bottom, 0, 1, weightX, weightY, output);
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+// Bilinear blend of two output pixels at once, one pixel per 128 bit lane
+static inline void warpBlendAdjacentPair(const unsigned char* topA, const unsigned char* bottomA, int weightXA, int weightYA,
+    const unsigned char* topB, const unsigned char* bottomB, int weightXB, int weightYB, unsigned char* output)
+{
+    // Vertical blend: 2 x 8 x 16 bit
+    __m256i topPixels = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(topA)), _mm_loadl_epi64((const __m128i*)(topB))));
+    __m256i bottomPixels = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(bottomA)), _mm_loadl_epi64((const __m128i*)(bottomB))));
+    __m256i inverseY = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(WARP_WEIGHT_ONE - weightYA)), _mm_set1_epi16(WARP_WEIGHT_ONE - weightYB), 1);
+    __m256i weightY = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(weightYA)), _mm_set1_epi16(weightYB), 1);
+    __m256i vertical = _mm256_add_epi16(_mm256_mullo_epi16(topPixels, inverseY), _mm256_mullo_epi16(bottomPixels, weightY));
+
+    // Horizontal blend in each lane: 2 x 4 x 32 bit
+    __m256i pairs = _mm256_unpacklo_epi16(vertical, _mm256_srli_si256(vertical, 8));
+    __m256i weightsX = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi32((weightXA << 16) | (WARP_WEIGHT_ONE - weightXA))), _mm_set1_epi32((weightXB << 16) | (WARP_WEIGHT_ONE - weightXB)), 1);
+    __m256i sum = _mm256_madd_epi16(pairs, weightsX);
+    sum = _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(WARP_BLEND_ROUND)), WARP_BLEND_SHIFT);
+
+    // Pack each lane to bytes, pixel A is in lane 0 and pixel B in lane 1
+    sum = _mm256_packs_epi32(sum, sum);
+    sum = _mm256_packus_epi16(sum, sum);
+
+    int pixels[2];
+    pixels[0] = _mm_cvtsi128_si32(_mm256_castsi256_si128(sum));
+    pixels[1] = _mm_cvtsi128_si32(_mm256_extracti128_si256(sum, 1));
+    memcpy(output, pixels, 8);
+}
+
+#endif
+
+/* #####################################
+WARP
+##################################### */
+
+// Convert source coordinate to fixed point, far outside coordinates are clamped (outside of every frame anyway)
+static inline int32_t warpToFixed(double value)
+{
+    if (value > 30000.0)
+    {
+        value = 30000.0;
+    }
+    else if (value < -30000.0)
+    {
+        value = -30000.0;
+    }
+
+    return (int32_t)(floor(value * (1 << WARP_FIXED_BITS) + 0.5));
+}
+
+// Remap entry of an output pixel without source pixels
+static inline void warpRemapBlack(WarpRemapEntry* entry)
+{
+    entry->offset = 0;
+    entry->weightX = 0;
+    entry->weightY = 0;
+    entry->flags = WARP_REMAP_BLACK;
+    entry->reserved = 0;
+}
+
+// Remap entry of fixed point sample position (input pixel coordinates - 0.5), clamp to edge
+static inline void warpRemapEntry(const WarpJob* job, int32_t u, int32_t v, WarpRemapEntry* entry)
+{
+    // Output pixel is black if its mapped center is outside of the input frame
+    if (u < -WARP_FIXED_HALF || v < -WARP_FIXED_HALF
+        || u >= (job->inputWidth << WARP_FIXED_BITS) - WARP_FIXED_HALF
+        || v >= (job->inputHeight << WARP_FIXED_BITS) - WARP_FIXED_HALF)
+    {
+        warpRemapBlack(entry);
+        return;
+    }
+
+    int x0 = u >> WARP_FIXED_BITS;
+    int y0 = v >> WARP_FIXED_BITS;
+    entry->weightX = (uint8_t)((u >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1));
+    entry->weightY = (uint8_t)((v >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1));
+    entry->flags = 0;
+    entry->reserved = 0;
+
+    // Neighbours outside of the input frame are clamped to the edge pixel
+    if (x0 < 0)
+    {
+        x0 = 0;
+    }
+    else if (x0 + 1 < job->inputWidth)
+    {
+        entry->flags |= WARP_REMAP_RIGHT;
+    }
+
+    if (y0 < 0)
+    {
+        y0 = 0;
+    }
+    else if (y0 + 1 < job->inputHeight)
+    {
+        entry->flags |= WARP_REMAP_BOTTOM;
+    }
+
+    entry->offset = (uint32_t)(job->inputStride * y0 + job->bytesPerPixel * x0);
+}
+
+// Sample one RGBA pixel as described by its remap entry
+static inline void warpRemapPixel(const WarpJob* job, const WarpRemapEntry* entry, unsigned char* output)
+{
+    const unsigned char* top = job->input + entry->offset;
+    const int stride = job->inputStride;
+
+    if (entry->flags == (WARP_REMAP_RIGHT | WARP_REMAP_BOTTOM))
+    {
+        warpBlendAdjacent(top, top + stride, entry->weightX, entry->weightY, output);
+    }
+    else if (entry->flags & WARP_REMAP_BLACK)
+    {
+        memcpy(output, job->blackPixel, 4);
+    }
+    else
+    {
+        const unsigned char* bottom = ((entry->flags & WARP_REMAP_BOTTOM) ? top + stride : top);
+        warpBlendScalar(top, bottom, 0, ((entry->flags & WARP_REMAP_RIGHT) ? 1 : 0), entry->weightX, entry->weightY, output);
+    }
+}
+
+// Sample one plane pixel as described by its remap entry
+static inline void warpRemapPlanePixel(const WarpJob* job, const WarpRemapEntry* entry, unsigned char* output)
+{
+    const unsigned char* top = job->input + entry->offset;
+
+    if (entry->flags & WARP_REMAP_BLACK)
+    {
+        *output = job->blackPixel[0];
+        return;
+    }
+
+    const unsigned char* bottom = ((entry->flags & WARP_REMAP_BOTTOM) ? top + job->inputStride : top);
+    *output = warpBlendPlane(top, bottom, 0, ((entry->flags & WARP_REMAP_RIGHT) ? 1 : 0), entry->weightX, entry->weightY);
+}
+
+// Sample one pixel at fixed point sample position, clamp to edge
+static void warpPixel(const WarpJob* job, int32_t u, int32_t v, unsigned char* output)
+{
+    WarpRemapEntry entry;
+    warpRemapEntry(job, u, v, &entry);
+
+    if (job->bytesPerPixel == 1)
+    {
+        warpRemapPlanePixel(job, &entry, output);
+    }
+    else
+    {
+        warpRemapPixel(job, &entry, output);
+    }
+}
+
+// Sample count pixels, fixed point sample position starts at u, v and changes by du, dv per pixel
+static inline void warpSpan(const WarpJob* job, int32_t u, int32_t v, int32_t du, int32_t dv, int count, unsigned char* output)
+{
+    // Fast path: Both neighbours are inside, as unsigned comparison this also excludes negative positions
+    const uint32_t fastLimitU = (uint32_t)(job->inputWidth - 1) << WARP_FIXED_BITS;
+    const uint32_t fastLimitV = (uint32_t)(job->inputHeight - 1) << WARP_FIXED_BITS;
+    const unsigned char* input = job->input;
+    const int stride = job->inputStride;
+    int i = 0;
+
+    // Plane: One byte per pixel, scalar blend
+    if (job->bytesPerPixel == 1)
+    {
+        for (; i < count; i++, u += du, v += dv, output++)
+        {
+            if ((uint32_t)(u) < fastLimitU && (uint32_t)(v) < fastLimitV)
+            {
+                const unsigned char* top = input + stride * (v >> WARP_FIXED_BITS) + (u >> WARP_FIXED_BITS);
+                *output = warpBlendPlane(top, top + stride, 0, 1, (u >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1), (v >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1));
+            }
+            else
+            {
+                warpPixel(job, u, v, output);
+            }
+        }
+
+        return;
+    }
+
+#if defined(__AVX2__)
+    for (; i + 1 < count; i += 2, u += 2 * du, v += 2 * dv, output += 8)
+    {
+        int32_t uB = u + du;
+        int32_t vB = v + dv;
+
+        if ((uint32_t)(u) < fastLimitU && (uint32_t)(v) < fastLimitV && (uint32_t)(uB) < fastLimitU && (uint32_t)(vB) < fastLimitV)
+        {
+            const unsigned char* topA = input + stride * (v >> WARP_FIXED_BITS) + 4 * (u >> WARP_FIXED_BITS);
+            const unsigned char* topB = input + stride * (vB >> WARP_FIXED_BITS) + 4 * (uB >> WARP_FIXED_BITS);
+            warpBlendAdjacentPair(topA, topA + stride, (u >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1), (v >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1),
+                topB, topB + stride, (uB >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1), (vB >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1), output);
+        }
+        else
+        {
+            warpPixel(job, u, v, output);
+            warpPixel(job, uB, vB, output + 4);
+        }
+    }
+#endif
+
+    for (; i < count; i++, u += du, v += dv, output += 4)
+    {
+        if ((uint32_t)(u) < fastLimitU && (uint32_t)(v) < fastLimitV)
+        {
+            const unsigned char* top = input + stride * (v >> WARP_FIXED_BITS) + 4 * (u >> WARP_FIXED_BITS);
+            warpBlendAdjacent(top, top + stride, (u >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1), (v >> WARP_WEIGHT_SHIFT) & (WARP_WEIGHT_ONE - 1), output);
+        }
+        else
+        {
+            warpPixel(job, u, v, output);
+        }
+    }
+}
+
+// Store results for count output pixels starting at x, y: Either pixels or remap entries if the job builds a remap table
+static void warpStoreBlack(const WarpJob* job, int y, int x, int count)
+{
+    if (job->remapOutput)
+    {
+        WarpRemapEntry* entry = job->remapOutput + job->outputWidth * y + x;
+
+        for (int i = 0; i < count; i++)
+        {
+            warpRemapBlack(entry + i);
+        }
+
+        return;
+    }
+
+    unsigned char* output = job->output + job->outputStride * y + job->bytesPerPixel * x;
+
+    if (job->bytesPerPixel == 1)
+    {
+        memset(output, job->blackPixel[0], count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(output + 4 * i, job->blackPixel, 4);
+    }
+}
+
+static void warpStoreSpan(const WarpJob* job, int y, int x, int32_t u, int32_t v, int32_t du, int32_t dv, int count)
+{
+    if (job->remapOutput)
+    {
+        WarpRemapEntry* entry = job->remapOutput + job->outputWidth * y + x;
+
+        for (int i = 0; i < count; i++, u += du, v += dv)
+        {
+            warpRemapEntry(job, u, v, entry + i);
+        }
+
+        return;
+    }
+
+    warpSpan(job, u, v, du, dv, count, job->output + job->outputStride * y + job->bytesPerPixel * x);
+}
+
+// Exact mapping of output pixel x in a row, projective coordinates of the row are at x = 0
+static inline void warpMapPixel(const double* matrix, const WarpPoint* row, int x, WarpPoint* point)
+{
+    point->w = row->w + matrix[6] * x;
+    point->x = (row->x + matrix[0] * x) / point->w - 0.5;
+    point->y = (row->y + matrix[3] * x) / point->w - 0.5;
+}
+
+// Warp count pixels between exactly mapped start and end (first pixel after span)
+// Span is halved until the exact mapping of its middle pixel deviates less than WARP_SPAN_TOLERANCE from linear stepping
+static void warpSpanAdaptive(const WarpJob* job, const WarpPoint* row, int y, int x, int count, const WarpPoint* start, const WarpPoint* end)
+{
+    const double* matrix = job->inverseMatrix;
+
+    // Horizon of the homography or far outside: Exact mapping for each pixel
+    if (start->w <= 0.0 || end->w <= 0.0
+        || fabs(start->x) > WARP_SPAN_LIMIT || fabs(start->y) > WARP_SPAN_LIMIT
+        || fabs(end->x) > WARP_SPAN_LIMIT || fabs(end->y) > WARP_SPAN_LIMIT)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            WarpPoint point;
+            warpMapPixel(matrix, row, x + i, &point);
+
+            if (point.w <= 0.0)
+            {
+                warpStoreBlack(job, y, x + i, 1);
+                continue;
+            }
+
+            warpStoreSpan(job, y, x + i, warpToFixed(point.x), warpToFixed(point.y), 0, 0, 1);
+        }
+
+        return;
+    }
+
+    // Homographies map lines to lines: Span is black if start and end are outside of the same input frame edge
+    if ((start->x < -0.5 && end->x < -0.5) || (start->y < -0.5 && end->y < -0.5)
+        || (start->x >= job->inputWidth - 0.5 && end->x >= job->inputWidth - 0.5)
+        || (start->y >= job->inputHeight - 0.5 && end->y >= job->inputHeight - 0.5))
+    {
+        warpStoreBlack(job, y, x, count);
+        return;
+    }
+
+    if (count > 1)
+    {
+        int half = count / 2;
+        WarpPoint middle;
+        warpMapPixel(matrix, row, x + half, &middle);
+
+        double linearX = start->x + (end->x - start->x) * half / count;
+        double linearY = start->y + (end->y - start->y) * half / count;
+
+        if (fabs(middle.x - linearX) > WARP_SPAN_TOLERANCE || fabs(middle.y - linearY) > WARP_SPAN_TOLERANCE)
+        {
+            warpSpanAdaptive(job, row, y, x, half, start, &middle);
+            warpSpanAdaptive(job, row, y, x + half, count - half, &middle, end);
+            return;
+        }
+    }
+
+    int32_t u = warpToFixed(start->x);
+    int32_t v = warpToFixed(start->y);
+    warpStoreSpan(job, y, x, u, v, (warpToFixed(end->x) - u) / count, (warpToFixed(end->y) - v) / count, count);
+}
+
+// Warp pixels xStart to xEnd - 1 of output row y
+// Exact projective mapping at span ends, fixed point stepping in between
+static void warpRowSegment(const WarpJob* job, int y, int xStart, int xEnd)
+{
+    const double* matrix = job->inverseMatrix;
+
+    // Projective coordinates of output pixel center x + 0.5 are row.x + matrix[0] * x, ...
+    WarpPoint row;
+    double outputY = y + 0.5;
+    row.x = matrix[0] * 0.5 + matrix[1] * outputY + matrix[2];
+    row.y = matrix[3] * 0.5 + matrix[4] * outputY + matrix[5];
+    row.w = matrix[6] * 0.5 + matrix[7] * outputY + matrix[8];
+
+    // End of a span is start of next span
+    WarpPoint start;
+    WarpPoint end;
+    warpMapPixel(matrix, &row, xStart, &start);
+
+    for (int x = xStart; x < xEnd; x += WARP_SPAN)
+    {
+        int count = (xEnd - x < WARP_SPAN ? xEnd - x : WARP_SPAN);
+        warpMapPixel(matrix, &row, x + count, &end);
+        warpSpanAdaptive(job, &row, y, x, count, &start, &end);
+        start = end;
+    }
+}
+
+// Warp output rows with a remap table, sequential reads of the table
+static void warpRemapRows(const WarpJob* job, int rowStart, int rowEnd)
+{
+    const unsigned char* input = job->input;
+    const int stride = job->inputStride;
+
+    // Plane: One byte per pixel
+    if (job->bytesPerPixel == 1)
+    {
+        for (int y = rowStart; y < rowEnd; y++)
+        {
+            const WarpRemapEntry* entry = job->remapTable + job->outputWidth * y;
+            unsigned char* output = job->output + job->outputStride * y;
+
+            for (int x = 0; x < job->outputWidth; x++)
+            {
+                if (entry[x].flags == (WARP_REMAP_RIGHT | WARP_REMAP_BOTTOM))
+                {
+                    const unsigned char* top = input + entry[x].offset;
+                    output[x] = warpBlendPlane(top, top + stride, 0, 1, entry[x].weightX, entry[x].weightY);
+                }
+                else
+                {
+                    warpRemapPlanePixel(job, entry + x, output + x);
+                }
+            }
+        }
+
+        return;
+    }
+
+    for (int y = rowStart; y < rowEnd; y++)
+    {
+        const WarpRemapEntry* entry = job->remapTable + job->outputWidth * y;
+        unsigned char* output = job->output + job->outputStride * y;
+        int x = 0;
+
+#if defined(__AVX2__)
+        for (; x + 1 < job->outputWidth; x += 2, entry += 2, output += 8)
+        {
+            if (entry[0].flags == (WARP_REMAP_RIGHT | WARP_REMAP_BOTTOM) && entry[1].flags == (WARP_REMAP_RIGHT | WARP_REMAP_BOTTOM))
+            {
+                const unsigned char* topA = input + entry[0].offset;
+                const unsigned char* topB = input + entry[1].offset;
+                warpBlendAdjacentPair(topA, topA + stride, entry[0].weightX, entry[0].weightY, topB, topB + stride, entry[1].weightX, entry[1].weightY, output);
+            }
+            else
+            {
+                warpRemapPixel(job, entry, output);
+                warpRemapPixel(job, entry + 1, output + 4);
+            }
+        }
+#endif
+
+        for (; x < job->outputWidth; x++, entry++, output += 4)
+        {
+            warpRemapPixel(job, entry, output);
+        }
+    }
+}
+
+WarpThreadPool::WarpThreadPool()
+{
+    threadCount = 1;
+    workerThreads = NULL;
+    currentJob = NULL;
+    generation = 0;
+    pendingBands = 0;
+}
+
+// Start worker threads, the calling thread is the first one
+void WarpThreadPool::setup(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    this->threadCount = (threadCount < 1 ? 1 : threadCount);
+
+    pthread_mutex_init(&poolMutex, NULL);
+    pthread_cond_init(&startCondition, NULL);
+    pthread_cond_init(&doneCondition, NULL);
+
+    workerThreads = (pthread_t*)(malloc(this->threadCount * sizeof(pthread_t)));
+
+    for (int band = 1; band < this->threadCount; band++)
+    {
+        WarpWorker* worker = new WarpWorker;
+        worker->pool = this;
+        worker->band = band;
+
+        if (pthread_create(&workerThreads[band], NULL, WarpThreadPoolWorker, worker))
+        {
+            printf("CPU Error: Create warp thread - EXITING APPLICATION\n");
+            kill(getpid(), SIGKILL);
+        }
+    }
+}
+
+// Start all workers, warp first band and wait for the other bands
+void WarpThreadPool::run(const WarpJob* job)
+{
+    if (threadCount > 1)
+    {
+        pthread_mutex_lock(&poolMutex);
+        currentJob = job;
+        pendingBands = threadCount - 1;
+        generation++;
+        pthread_cond_broadcast(&startCondition);
+        pthread_mutex_unlock(&poolMutex);
+    }
+
+    warpRows(job, 0, job->outputHeight / threadCount);
+
+    if (threadCount > 1)
+    {
+        pthread_mutex_lock(&poolMutex);
+
+        while (pendingBands > 0)
+        {
+            pthread_cond_wait(&doneCondition, &poolMutex);
+        }
+
+        pthread_mutex_unlock(&poolMutex);
+    }
+}
+
+// Worker threads: Wait for next job, warp band of rows
+void WarpThreadPool::workerLoop(int band)
+{
+    unsigned int finishedGeneration = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&poolMutex);
+
+        while (generation == finishedGeneration)
+        {
+            pthread_cond_wait(&startCondition, &poolMutex);
+        }
+
+        finishedGeneration = generation;
+        const WarpJob* job = currentJob;
+        pthread_mutex_unlock(&poolMutex);
+
+        warpRows(job, job->outputHeight * band / threadCount, job->outputHeight * (band + 1) / threadCount);
+
+        pthread_mutex_lock(&poolMutex);
+        pendingBands--;
+
+        if (pendingBands == 0)
+        {
+            pthread_cond_signal(&doneCondition);
+        }
+
+        pthread_mutex_unlock(&poolMutex);
+    }
+}
+
+WarpRemapCache::WarpRemapCache()
+{
+    enabled = false;
+    tableBytes = 0;
+    tables[0] = NULL;
+    tables[1] = NULL;
+    requestedVersion = 0;
+    builtVersion = 0;
+    readyVersion = 0;
+    readyTable = -1;
+    activeTable = -1;
+    stopping = false;
+}
+
+void WarpRemapCache::setup(int width, int height, size_t maxBytes)
+{
+    tableBytes = (size_t)(width) * height * sizeof(WarpRemapEntry);
+
+    // Memory of tables is bounded, mapping is computed in each frame otherwise
+    if (2 * tableBytes > maxBytes)
+    {
+        printf("CPU warp: Remap tables need %.1f MB, limit is %.1f MB, mapping is computed in each frame\n", 2 * tableBytes / 1048576.0, maxBytes / 1048576.0);
+        return;
+    }
+
+    tables[0] = (WarpRemapEntry*)(malloc(tableBytes));
+    tables[1] = (WarpRemapEntry*)(malloc(tableBytes));
+    memset(&requestedJob, 0, sizeof(WarpJob));
+
+    pthread_mutex_init(&cacheMutex, NULL);
+    pthread_cond_init(&requestCondition, NULL);
+
+    if (pthread_create(&builderThread, NULL, WarpRemapCacheBuilder, this))
+    {
+        printf("CPU Error: Create remap table thread - EXITING APPLICATION\n");
+        kill(getpid(), SIGKILL);
+    }
+
+    enabled = true;
+    printf("CPU warp: Remap tables use %.1f MB\n", 2 * tableBytes / 1048576.0);
+}
+
+// Called by the render thread for each frame, only compares and copies the mapping
+const WarpRemapEntry* WarpRemapCache::getTable(const WarpJob* job)
+{
+    if (!enabled)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cacheMutex);
+
+    // Request new table if homography, input or output geometry changed
+    if (requestedVersion == 0 || job->bytesPerPixel != requestedJob.bytesPerPixel
+        || job->outputWidth != requestedJob.outputWidth || job->outputHeight != requestedJob.outputHeight
+        || job->inputWidth != requestedJob.inputWidth || job->inputHeight != requestedJob.inputHeight
+        || job->inputStride != requestedJob.inputStride || job->inverseValid != requestedJob.inverseValid
+        || memcmp(job->inverseMatrix, requestedJob.inverseMatrix, sizeof(job->inverseMatrix)))
+    {
+        requestedJob = *job;
+        requestedJob.input = NULL;
+        requestedJob.output = NULL;
+        requestedJob.remapTable = NULL;
+        requestedJob.remapOutput = NULL;
+        __atomic_store_n(&requestedVersion, requestedVersion + 1, __ATOMIC_RELEASE);
+        readyTable = -1;
+        pthread_cond_signal(&requestCondition);
+    }
+
+    // Use ready table only if it belongs to the current mapping
+    activeTable = ((readyTable >= 0 && readyVersion == requestedVersion) ? readyTable : -1);
+    const WarpRemapEntry* table = (activeTable >= 0 ? tables[activeTable] : NULL);
+
+    pthread_mutex_unlock(&cacheMutex);
+
+    return table;
+}
+
+// Version is increased for stopping, a table which is being built is aborted after the current chunk
+void WarpRemapCache::teardown()
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cacheMutex);
+    stopping = true;
+    __atomic_store_n(&requestedVersion, requestedVersion + 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&requestCondition);
+    pthread_mutex_unlock(&cacheMutex);
+
+    pthread_join(builderThread, NULL);
+    pthread_mutex_destroy(&cacheMutex);
+    pthread_cond_destroy(&requestCondition);
+
+    free(tables[0]);
+    free(tables[1]);
+    tables[0] = NULL;
+    tables[1] = NULL;
+    enabled = false;
+    requestedVersion = 0;
+    builtVersion = 0;
+    readyVersion = 0;
+    readyTable = -1;
+    activeTable = -1;
+    stopping = false;
+}
+
+// Build requested table into the table which is not used by the warp
+void WarpRemapCache::builderLoop()
+{
+    pthread_mutex_lock(&cacheMutex);
+
+    while (true)
+    {
+        while (builtVersion == requestedVersion && !stopping)
+        {
+            pthread_cond_wait(&requestCondition, &cacheMutex);
+        }
+
+        if (stopping)
+        {
+            pthread_mutex_unlock(&cacheMutex);
+            return;
+        }
+
+        unsigned int version = requestedVersion;
+        int target = (activeTable == 0 ? 1 : 0);
+        WarpJob job = requestedJob;
+        job.remapOutput = tables[target];
+        pthread_mutex_unlock(&cacheMutex);
+
+        struct timespec startTimespec;
+        struct timespec endTimespec;
+        clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+
+        // Build chunk by chunk, stop early if the mapping changed again
+        bool complete = true;
+
+        for (int row = 0; row < job.outputHeight; row += WARP_REMAP_BUILD_ROWS)
+        {
+            if (__atomic_load_n(&requestedVersion, __ATOMIC_ACQUIRE) != version)
+            {
+                complete = false;
+                break;
+            }
+
+            warpRows(&job, row, (row + WARP_REMAP_BUILD_ROWS < job.outputHeight ? row + WARP_REMAP_BUILD_ROWS : job.outputHeight));
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &endTimespec);
+
+        pthread_mutex_lock(&cacheMutex);
+        builtVersion = version;
+
+        if (complete && version == requestedVersion)
+        {
+            readyTable = target;
+            readyVersion = version;
+            printf("CPU warp: Remap table built in %.1f ms\n", (endTimespec.tv_sec - startTimespec.tv_sec) * 1000.0 + (endTimespec.tv_nsec - startTimespec.tv_nsec) / 1000000.0);
+        }
+    }
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Warp output rows rowStart to rowEnd - 1 tile by tile, or with the remap table of the job
+void warpRows(const WarpJob* job, int rowStart, int rowEnd)
+{
+    if (job->remapTable)
+    {
+        warpRemapRows(job, rowStart, rowEnd);
+        return;
+    }
+
+    // Singular matrix can not be drawn by the GL backend either, output is black
+    if (!job->inverseValid)
+    {
+        for (int y = rowStart; y < rowEnd; y++)
+        {
+            warpStoreBlack(job, y, 0, job->outputWidth);
+        }
+
+        return;
+    }
+
+    for (int tileY = rowStart; tileY < rowEnd; tileY += WARP_TILE_HEIGHT)
+    {
+        int tileEndY = (tileY + WARP_TILE_HEIGHT < rowEnd ? tileY + WARP_TILE_HEIGHT : rowEnd);
+
+        for (int tileX = 0; tileX < job->outputWidth; tileX += WARP_TILE_WIDTH)
+        {
+            int tileEndX = (tileX + WARP_TILE_WIDTH < job->outputWidth ? tileX + WARP_TILE_WIDTH : job->outputWidth);
+
+            for (int y = tileY; y < tileEndY; y++)
+            {
+                warpRowSegment(job, y, tileX, tileEndX);
+            }
+        }
+    }
+}
+
+// Thread function of WarpThreadPool
+void* WarpThreadPoolWorker(void* argument)
+{
+    WarpWorker* worker = (WarpWorker*)(argument);
+    worker->pool->workerLoop(worker->band);
+    return NULL;
+}
+
+// Thread function of WarpRemapCache
+void* WarpRemapCacheBuilder(void* cache)
+{
+    ((WarpRemapCache*)(cache))->builderLoop();
+    return NULL;
+}
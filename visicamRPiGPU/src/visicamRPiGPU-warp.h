@@ -0,0 +1,171 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU-pipeline.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// Vector instruction set of the warp kernel, selected at compile time
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WARP_KERNEL_NAME                        "AVX2"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define WARP_KERNEL_NAME                        "SSE2"
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WARP_KERNEL_NAME                        "NEON"
+#else
+#define WARP_KERNEL_NAME                        "scalar"
+#endif
+
+// Output is processed in tiles, source pixels of a tile stay in cache
+#define WARP_TILE_WIDTH                         64
+#define WARP_TILE_HEIGHT                        16
+
+// Projective coordinates are computed exactly every WARP_SPAN pixels and stepped linearly in fixed point in between
+// Spans are subdivided where the perspective is too strong for linear stepping
+#define WARP_SPAN                               16
+
+// Source coordinates are 16.16 fixed point, interpolation weights have 7 bits
+#define WARP_FIXED_BITS                         16
+#define WARP_WEIGHT_BITS                        7
+
+// Remap tables are built in chunks of rows, a newer homography aborts the build after the current chunk
+#define WARP_REMAP_BUILD_ROWS                   16
+
+// Flags of remap table entries
+#define WARP_REMAP_RIGHT                        1       // Right neighbour is inside, otherwise left pixel is repeated
+#define WARP_REMAP_BOTTOM                       2       // Bottom neighbour is inside, otherwise top pixel is repeated
+#define WARP_REMAP_BLACK                        4       // Output pixel is outside of the input frame
+
+/* #####################################
+WARP
+##################################### */
+
+// Remap table entry of one output pixel: Byte offset of top left source pixel, interpolation weights, flags
+typedef struct
+{
+    uint32_t                offset;
+    uint8_t                 weightX;
+    uint8_t                 weightY;
+    uint8_t                 flags;
+    uint8_t                 reserved;
+} WarpRemapEntry;
+
+// Inverse mapping of output pixels into an RGBA input frame or a single plane (1 byte per pixel) of a planar frame
+// With remapTable, the mapping is taken from the table; with remapOutput, remap entries are written instead of pixels
+typedef struct
+{
+    int                     bytesPerPixel;
+    unsigned char           blackPixel[4];
+    const unsigned char*    input;
+    int                     inputWidth;
+    int                     inputHeight;
+    int                     inputStride;
+    unsigned char*          output;
+    int                     outputWidth;
+    int                     outputHeight;
+    int                     outputStride;
+    bool                    inverseValid;
+    double                  inverseMatrix[9];
+    const WarpRemapEntry*   remapTable;
+    WarpRemapEntry*         remapOutput;
+} WarpJob;
+
+// Persistent worker threads, each warps a band of output rows
+// The calling thread warps the first band itself
+class WarpThreadPool
+{
+    public:
+        WarpThreadPool();
+
+        // Start threadCount - 1 workers, 0 uses one thread per CPU core
+        void setup(int threadCount);
+
+        // Warp all rows of job, returns when all bands are finished
+        void run(const WarpJob* job);
+
+        // Worker threads: Wait for jobs and warp their band
+        void workerLoop(int band);
+
+        int threadCount;
+        pthread_t* workerThreads;
+
+        // Current job, protected by poolMutex
+        pthread_mutex_t poolMutex;
+        pthread_cond_t startCondition;
+        pthread_cond_t doneCondition;
+        const WarpJob* currentJob;
+        unsigned int generation;
+        int pendingBands;
+};
+
+// Remap tables for the current homography and input geometry, built by a background thread
+// Two tables: The builder thread writes one while the warp uses the other
+class WarpRemapCache
+{
+    public:
+        WarpRemapCache();
+
+        // Allocate tables for the output resolution and start builder thread
+        // Tables are disabled if both together need more than maxBytes
+        void setup(int width, int height, size_t maxBytes);
+
+        // Table for mapping of job, valid until the next call
+        // Requests a new table if the mapping changed, returns NULL while it is being built
+        const WarpRemapEntry* getTable(const WarpJob* job);
+
+        // Stop builder thread and free tables, setup can be called again
+        void teardown();
+
+        // Builder thread: Build requested tables chunk by chunk
+        void builderLoop();
+
+        bool enabled;
+        size_t tableBytes;
+        WarpRemapEntry* tables[2];
+
+        // Requested mapping and tables, protected by cacheMutex
+        // Builder thread never writes activeTable, which is used by the warp, it exits if stopping is set
+        pthread_t builderThread;
+        pthread_mutex_t cacheMutex;
+        pthread_cond_t requestCondition;
+        WarpJob requestedJob;
+        unsigned int requestedVersion;
+        unsigned int builtVersion;
+        unsigned int readyVersion;
+        int readyTable;
+        int activeTable;
+        bool stopping;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Warp output rows rowStart to rowEnd - 1 tile by tile, or with the remap table of the job
+void warpRows(const WarpJob* job, int rowStart, int rowEnd);
+
+// Thread function of WarpThreadPool
+void* WarpThreadPoolWorker(void* argument);
+
+// Thread function of WarpRemapCache
+void* WarpRemapCacheBuilder(void* cache);
@@ -0,0 +1,223 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "visicamRPiGPU-watch.h"
+
+/* #####################################
+FILE WATCHER
+##################################### */
+
+FileWatcher::FileWatcher(std::string path)
+{
+    this->path = path;
+    inotifyFile = -1;
+
+    // Split path into directory and file name
+    size_t separator = path.find_last_of('/');
+
+    if (separator == std::string::npos)
+    {
+        directoryPath = ".";
+        fileName = path;
+    }
+    else
+    {
+        directoryPath = (separator == 0 ? "/" : path.substr(0, separator));
+        fileName = path.substr(separator + 1);
+    }
+}
+
+// Add inotify watch for directory and start watcher thread
+bool FileWatcher::setup()
+{
+    inotifyFile = inotify_init();
+
+    if (inotifyFile == -1)
+    {
+        return false;
+    }
+
+    // In place writes and new files (modify) and replacing files (moved to)
+    // Close after write is not watched, readers which lock the file need write access and would trigger it themselves
+    if (inotify_add_watch(inotifyFile, directoryPath.c_str(), IN_MODIFY | IN_MOVED_TO) == -1)
+    {
+        close(inotifyFile);
+        inotifyFile = -1;
+        return false;
+    }
+
+    if (pthread_create(&watcherThread, NULL, FileWatcherThread, this))
+    {
+        close(inotifyFile);
+        inotifyFile = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// Watcher thread: Read events, all pending events of the file result in one fileChanged call
+void FileWatcher::watchEvents()
+{
+    // Buffer for at least one event with maximum name length, aligned for inotify_event
+    union
+    {
+        struct inotify_event event;
+        char bytes[sizeof(struct inotify_event) + NAME_MAX + 1];
+    } eventBuffer[8];
+
+    fileChanged();
+
+    while (true)
+    {
+        ssize_t length = read(inotifyFile, eventBuffer, sizeof(eventBuffer));
+
+        if (length <= 0)
+        {
+            continue;
+        }
+
+        bool changed = false;
+        char* position = (char*)(eventBuffer);
+
+        while (position < (char*)(eventBuffer) + length)
+        {
+            struct inotify_event* event = (struct inotify_event*)(position);
+
+            if (event->len > 0 && fileName == event->name)
+            {
+                changed = true;
+            }
+
+            position += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (changed)
+        {
+            fileChanged();
+        }
+    }
+}
+
+HomographyWatcher::HomographyWatcher(std::string path) : FileWatcher(path)
+{
+    writingVersion = 0;
+    publishedVersion = 0;
+}
+
+// Watcher thread: Parse file and publish matrix, files with invalid content are ignored
+void HomographyWatcher::fileChanged()
+{
+    float values[9];
+
+    if (!readHomographyFile(path, values))
+    {
+        return;
+    }
+
+    // Announce write of next version before its buffer is changed, render thread detects it during copying
+    unsigned int version = publishedVersion + 1;
+    __atomic_store_n(&writingVersion, version, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (int i = 0; i < 9; i++)
+    {
+        __atomic_store(&matrixBuffers[version % 2][i], &values[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&publishedVersion, version, __ATOMIC_RELEASE);
+}
+
+// Render thread: Copy published matrix if it is newer than version
+bool HomographyWatcher::takeMatrix(unsigned int* version, float* values)
+{
+    while (true)
+    {
+        unsigned int currentVersion = __atomic_load_n(&publishedVersion, __ATOMIC_ACQUIRE);
+
+        if (currentVersion == *version)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < 9; i++)
+        {
+            __atomic_load(&matrixBuffers[currentVersion % 2][i], &values[i], __ATOMIC_RELAXED);
+        }
+
+        // Buffer is only reused by the version after the next one, retry if that one was started meanwhile
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&writingVersion, __ATOMIC_RELAXED) - currentVersion < 2)
+        {
+            *version = currentVersion;
+            return true;
+        }
+    }
+}
+
+ConfigWatcher::ConfigWatcher(std::string path) : FileWatcher(path)
+{
+    pthread_mutex_init(&settingsMutex, NULL);
+    fileVersion = 0;
+}
+
+// Watcher thread: Parse file and publish settings, files with invalid content are ignored
+void ConfigWatcher::fileChanged()
+{
+    ConfigSettings settings;
+
+    if (!readConfigFile(path, &settings))
+    {
+        printf("Config watcher Warning: Configuration file %s is invalid, previous settings stay active\n", path.c_str());
+        return;
+    }
+
+    pthread_mutex_lock(&settingsMutex);
+    fileSettings = settings;
+    fileVersion++;
+    pthread_mutex_unlock(&settingsMutex);
+}
+
+// Render thread: Copy published settings if they are newer than version
+bool ConfigWatcher::takeSettings(unsigned int* version, ConfigSettings* settings)
+{
+    bool changed = false;
+
+    pthread_mutex_lock(&settingsMutex);
+
+    if (fileVersion != *version)
+    {
+        *settings = fileSettings;
+        *version = fileVersion;
+        changed = true;
+    }
+
+    pthread_mutex_unlock(&settingsMutex);
+
+    return changed;
+}
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of FileWatcher
+void* FileWatcherThread(void* watcher)
+{
+    ((FileWatcher*)(watcher))->watchEvents();
+    return NULL;
+}
@@ -0,0 +1,97 @@
+//    This file is part of visicamRPiGPU. (https://github.com/FroChr123/visicamRPiGPU)
+//    Please note the additional licenses and references to other projects in the file LICENSE-ADDITIONAL.
+//
+//    visicamRPiGPU is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    visicamRPiGPU is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "visicamRPiGPU-pipeline.h"
+
+#include <sys/inotify.h>
+#include <limits.h>
+#include <pthread.h>
+
+/* #####################################
+FILE WATCHER
+##################################### */
+
+// Watches a file with inotify on a background thread, fileChanged is called on this thread
+// The directory is watched so that files which are created later or replaced by rename are detected
+class FileWatcher
+{
+    public:
+        FileWatcher(std::string path);
+        virtual ~FileWatcher() {}
+
+        // Start watching, returns false if inotify is not available for the directory of path
+        // fileChanged is called once after start, the file might already exist
+        bool setup();
+
+        // Watcher thread: File was written, created or replaced
+        virtual void fileChanged() = 0;
+
+        // Watcher thread: Wait for events and call fileChanged
+        void watchEvents();
+
+        std::string path;
+        std::string directoryPath;
+        std::string fileName;
+        int inotifyFile;
+        pthread_t watcherThread;
+};
+
+// Reads homography matrix when its file changes and hands it to the render thread
+// Double buffered: Watcher thread writes the buffer which is not published, render thread copies the published one
+// Render thread never waits, it retries the copy of 9 values if the watcher thread reused the buffer meanwhile
+class HomographyWatcher : public FileWatcher
+{
+    public:
+        HomographyWatcher(std::string path);
+
+        void fileChanged();
+
+        // Render thread: Copy matrix if a newer one than version was published, version is updated
+        bool takeMatrix(unsigned int* version, float* values);
+
+        // Buffer of version v is matrixBuffers[v % 2]
+        // writingVersion is increased before a buffer is written, publishedVersion after it was written
+        float matrixBuffers[2][9];
+        unsigned int writingVersion;
+        unsigned int publishedVersion;
+};
+
+// Reads configuration file when it changes and hands its settings to the render thread
+// Settings are parsed on the watcher thread, the render thread only copies them under settingsMutex
+class ConfigWatcher : public FileWatcher
+{
+    public:
+        ConfigWatcher(std::string path);
+
+        void fileChanged();
+
+        // Render thread: Copy settings if a newer version than version was read, version is updated
+        bool takeSettings(unsigned int* version, ConfigSettings* settings);
+
+        // Settings of the last valid file, protected by settingsMutex
+        pthread_mutex_t settingsMutex;
+        ConfigSettings fileSettings;
+        unsigned int fileVersion;
+};
+
+/* #####################################
+CUSTOM FUNCTIONS
+##################################### */
+
+// Thread function of FileWatcher
+void* FileWatcherThread(void* watcher);
@@ -15,6 +15,10 @@
 //    along with visicamRPiGPU.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "visicamRPiGPU.h"
+#include "visicamRPiGPU-cpu.h"
+#include "visicamRPiGPU-http.h"
+#include "visicamRPiGPU-omx.h"
+#include "visicamRPiGPU-publish.h"
 
 /* #####################################
 OMX
@@ -39,6 +43,7 @@ OMX_ERRORTYPE OMXEventHandler(OMX_IN OMX_HANDLETYPE hComponent, OMX_IN OMX_PTR p
                     VCOSsendEvent(component, VCOS_EVENT_PORT_ENABLE);
                     break;
                 case OMX_CommandPortDisable:
+                    __atomic_add_fetch(&component->portDisableCount, 1, __ATOMIC_RELEASE);
                     VCOSsendEvent(component, VCOS_EVENT_PORT_DISABLE);
                     break;
                 case OMX_CommandFlush:
@@ -69,6 +74,8 @@ OMX_ERRORTYPE OMXEventHandler(OMX_IN OMX_HANDLETYPE hComponent, OMX_IN OMX_PTR p
 OMX_ERRORTYPE OMXEmptyBufferDone(OMX_IN OMX_HANDLETYPE hComponent, OMX_IN OMX_PTR pAppData, OMX_IN OMX_BUFFERHEADERTYPE* pBuffer)
 {
     OMXComponent* component = (OMXComponent*)(pAppData);
+    clock_gettime(CLOCK_MONOTONIC, &component->emptyBufferDoneTimespecs[component->emptyBufferDoneCount % OMX_BUFFER_DONE_TIMES]);
+    __atomic_add_fetch(&component->emptyBufferDoneCount, 1, __ATOMIC_RELEASE);
     VCOSsendEvent(component, VCOS_EVENT_EMPTY_BUFFER_DONE);
     return OMX_ErrorNone;
 }
@@ -77,7 +84,16 @@ OMX_ERRORTYPE OMXEmptyBufferDone(OMX_IN OMX_HANDLETYPE hComponent, OMX_IN OMX_PT
 OMX_ERRORTYPE OMXFillBufferDone(OMX_OUT OMX_HANDLETYPE hComponent, OMX_OUT OMX_PTR pAppData, OMX_OUT OMX_BUFFERHEADERTYPE* pBuffer)
 {
     OMXComponent* component = (OMXComponent*)(pAppData);
+    clock_gettime(CLOCK_MONOTONIC, &component->fillBufferDoneTimespecs[component->fillBufferDoneCount % OMX_BUFFER_DONE_TIMES]);
+    __atomic_add_fetch(&component->fillBufferDoneCount, 1, __ATOMIC_RELEASE);
     VCOSsendEvent(component, VCOS_EVENT_FILL_BUFFER_DONE);
+
+    // Wake callback driven render loop
+    if (component->frameEvent)
+    {
+        component->frameEvent->signal();
+    }
+
     return OMX_ErrorNone;
 }
 
@@ -87,24 +103,86 @@ void VCOSsendEvent(OMXComponent* component, VCOS_UNSIGNED sendEvents)
     vcos_event_flags_set(&component->vcos_flags, sendEvents, VCOS_OR);
 }
 
-// OMX function which uses VCOS to wait for events for components
-void VCOSwaitEvent(OMXComponent* component, VCOS_UNSIGNED waitEvents)
+// OMX function which uses VCOS to wait for events for components, state changes, port commands and flushes must finish within OMX_COMMAND_TIMEOUT_MS
+bool VCOSwaitEvent(OMXComponent* component, VCOS_UNSIGNED waitEvents)
+{
+    return VCOSwaitEventTimeout(component, waitEvents, OMX_COMMAND_TIMEOUT_MS);
+}
+
+// OMX function which uses VCOS to wait for events for components, returns false if the component failed
+// Error events and waits longer than timeoutMs fail the component, waits of a timed out or not initialized component return at once
+bool VCOSwaitEventTimeout(OMXComponent* component, VCOS_UNSIGNED waitEvents, int timeoutMs)
 {
     VCOS_UNSIGNED VCOSresult;
 
+    if (component->timedOut || !component->handle)
+    {
+        return false;
+    }
+
     // Wait until any of waitEvents or VCOS_EVENT_ERROR is contained in vcos_flag
-    if (vcos_event_flags_get(&component->vcos_flags, waitEvents | VCOS_EVENT_ERROR, VCOS_OR_CONSUME, VCOS_SUSPEND, &VCOSresult))
+    VCOS_STATUS_T VCOSstatus = vcos_event_flags_get(&component->vcos_flags, waitEvents | VCOS_EVENT_ERROR, VCOS_OR_CONSUME, (timeoutMs > 0 ? (VCOS_UNSIGNED)(timeoutMs) : VCOS_NO_SUSPEND), &VCOSresult);
+
+    if (VCOSstatus == VCOS_EAGAIN)
+    {
+        component->timedOut = true;
+        OMXFailComponent(component, "OMX wait event timeout");
+        return false;
+    }
+
+    if (VCOSstatus != VCOS_SUCCESS)
     {
         printf("OMX Error: VCOS wait event - EXITING APPLICATION\n");
         kill(getpid(), SIGKILL);
     }
 
-    // If result contains error, exit application
+    // If result contains error, the component failed
     if (VCOSresult & VCOS_EVENT_ERROR)
     {
-        printf("OMX Error: VCOS wait event error - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX event error");
+        return false;
     }
+
+    return true;
+}
+
+// OMX function which uses VCOS to wait until a buffer done counter of a component reaches target, returns false if the component failed
+// Components return buffers of a port in the same order as they were handed to them, counters identify the buffer
+// Deadline of timeoutMs covers the whole wait, events of other buffers do not extend it
+bool VCOSwaitBufferDone(OMXComponent* component, VCOS_UNSIGNED waitEvent, volatile OMX_U32* counter, OMX_U32 target, int timeoutMs)
+{
+    struct timespec startTimespec;
+    struct timespec currentTimespec;
+    clock_gettime(CLOCK_MONOTONIC, &startTimespec);
+
+    // Counter is increased before the event is sent, compare difference to handle overflow of counter
+    while ((OMX_S32)(__atomic_load_n(counter, __ATOMIC_ACQUIRE) - target) < 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
+        int remainingMs = timeoutMs - (int)(elapsedSeconds(&startTimespec, &currentTimespec) * 1000.0);
+
+        if (!VCOSwaitEventTimeout(component, waitEvent, remainingMs))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// OMX function which uses VCOS to wait until target port disable commands of a component are completed, returns false if the component failed
+// Event of the last commands is consumed, no port disable command is pending afterwards and following single commands wait with VCOSwaitEvent again
+bool VCOSwaitPortsDisabled(OMXComponent* component, OMX_U32 target)
+{
+    VCOS_UNSIGNED VCOSresult;
+
+    if (!VCOSwaitBufferDone(component, VCOS_EVENT_PORT_DISABLE, &component->portDisableCount, target, OMX_COMMAND_TIMEOUT_MS))
+    {
+        return false;
+    }
+
+    vcos_event_flags_get(&component->vcos_flags, VCOS_EVENT_PORT_DISABLE, VCOS_OR_CONSUME, VCOS_NO_SUSPEND, &VCOSresult);
+    return true;
 }
 
 // OMX function to initialize OMX structs correctly
@@ -119,18 +197,28 @@ template<typename T> void OMXinitializeStruct(T* OMXstruct)
     OMXstruct->nVersion.s.nStep = OMX_VERSION_STEP;
 }
 
-// OMX function to initialize components correctly
-void OMXInitializeComponent(OMXComponent* component, OMX_U32 id, const char* name)
+// OMX function to initialize components correctly, returns false if the component failed
+// Handle stays NULL if the component could not be initialized, all other OMX functions skip it then
+bool OMXInitializeComponent(OMXComponent* component, OMX_U32 id, const char* name)
 {
     // Setup component: Set id and name
     component->id = id;
     component->name = (OMX_STRING)(name);
+    component->handle = NULL;
+    component->emptyBufferDoneCount = 0;
+    component->fillBufferDoneCount = 0;
+    component->portDisableCount = 0;
+    memset(component->emptyBufferDoneTimespecs, 0, sizeof(component->emptyBufferDoneTimespecs));
+    memset(component->fillBufferDoneTimespecs, 0, sizeof(component->fillBufferDoneTimespecs));
+    component->frameEvent = NULL;
+    component->failed = false;
+    component->timedOut = false;
 
     // Setup component: VCOS flags
     if (vcos_event_flags_create(&component->vcos_flags, name))
     {
-        printf("OMX Error: VCOS flags component %s - EXITING APPLICATION\n", component->name);
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "VCOS flags");
+        return false;
     }
 
     // Setup component: Callbacks
@@ -142,36 +230,98 @@ void OMXInitializeComponent(OMXComponent* component, OMX_U32 id, const char* nam
     // Setup component: Register handle in OMX
     if (OMX_GetHandle(&component->handle, component->name, component, &OMXcallbacks))
     {
-        printf("OMX Error: OMX get component %s handle - EXITING APPLICATION\n", component->name);
-        kill(getpid(), SIGKILL);
+        component->handle = NULL;
+        vcos_event_flags_delete(&component->vcos_flags);
+        OMXFailComponent(component, "OMX get handle");
+        return false;
+    }
+
+    return true;
+}
+
+// OMX function to free component handle and VCOS flags
+// Component in state loaded, OMXInitializeComponent can be called again
+void OMXDeinitializeComponent(OMXComponent* component)
+{
+    if (!component->handle)
+    {
+        return;
     }
+
+    if (OMX_FreeHandle(component->handle))
+    {
+        OMXFailComponent(component, "OMX free handle");
+    }
+
+    vcos_event_flags_delete(&component->vcos_flags);
+    component->handle = NULL;
 }
 
 // OMX function to set component state and optionally wait
 void OMXSetStateComponent(OMXComponent* component, OMX_STATETYPE state)
 {
+    if (!component->handle)
+    {
+        return;
+    }
+
     // Send command to change state
     if (OMX_SendCommand(component->handle, OMX_CommandStateSet, state, NULL))
     {
-        printf("OMX Error: OMX set state on component %s - EXITING APPLICATION\n", component->name);
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set state");
     }
 }
 
 // OMX function to enable or disable component port and optionally wait
 void OMXPortEnableDisableComponent(OMXComponent* component, OMX_U32 port, bool enable)
 {
+    if (!component->handle)
+    {
+        return;
+    }
+
     // Send command to enable or disable component port
     if (OMX_SendCommand(component->handle, (enable ? OMX_CommandPortEnable : OMX_CommandPortDisable), port, NULL))
     {
-        printf("OMX Error: OMX enable or disable port on component %s - EXITING APPLICATION\n", component->name);
+        OMXFailComponent(component, "OMX enable or disable port");
+    }
+}
+
+// OMX function to mark a component as failed, exits the application if failed stages are not set up again
+// Only the first failure of a component is reported, following steps of its teardown fail as well
+void OMXFailComponent(OMXComponent* component, const char* reason)
+{
+    if (!STAGE_RECOVERY_ENABLE)
+    {
+        printf("OMX Error: %s on component %s - EXITING APPLICATION\n", reason, component->name);
         kill(getpid(), SIGKILL);
     }
+
+    if (!component->failed)
+    {
+        printf("OMX Warning: %s on component %s, stage is set up again\n", reason, component->name);
+    }
+
+    component->failed = true;
+}
+
+// OMX function to take error events which arrived while nothing waited for the component, never blocks
+// Returns false if the component failed
+bool OMXCheckComponent(OMXComponent* component)
+{
+    VCOS_UNSIGNED VCOSresult;
+
+    if (!component->failed && component->handle && vcos_event_flags_get(&component->vcos_flags, VCOS_EVENT_ERROR, VCOS_OR_CONSUME, VCOS_NO_SUSPEND, &VCOSresult) == VCOS_SUCCESS)
+    {
+        OMXFailComponent(component, "OMX event error");
+    }
+
+    return !component->failed;
 }
 
 // OMX function to setup camera correctly
-// Component in state loaded and ports disabled
-void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
+// Component in state loaded and ports disabled, returns false if the component failed
+bool OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight, const CameraSettings* settings)
 {
     // Setup camera component: Check for correct component
     if (component->id != OMX_COMPONENT_CAMERA_ID)
@@ -189,8 +339,8 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigRequestCallback, &OMXcameraCallbackConfigParamEnable))
     {
-        printf("OMX Error: OMX enable config and parameter callback camera - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX enable config and parameter callback camera");
+        return false;
     }
 
     // Setup camera component: Set device id 0
@@ -201,12 +351,15 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamCameraDeviceNumber, &OMXcameraParameterDevice))
     {
-        printf("OMX Error: OMX set camera device id - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set camera device id");
+        return false;
     }
 
     // Setup camera component: Blocking wait for setting camera device id
-    VCOSwaitEvent(component, VCOS_EVENT_PARAM_OR_CONFIG_CHANGED);
+    if (!VCOSwaitEvent(component, VCOS_EVENT_PARAM_OR_CONFIG_CHANGED))
+    {
+        return false;
+    }
 
     // Setup camera component: Sensor settings
     OMX_PARAM_SENSORMODETYPE OMXcameraSensor;
@@ -217,8 +370,8 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
 
     if (OMX_GetParameter(component->handle, OMX_IndexParamCommonSensorMode, &OMXcameraSensor))
     {
-        printf("OMX Error: OMX get camera sensor settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX get camera sensor settings");
+        return false;
     }
 
     OMXcameraSensor.bOneShot = OMX_FALSE;
@@ -227,8 +380,8 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamCommonSensorMode, &OMXcameraSensor))
     {
-        printf("OMX Error: OMX set camera sensor settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set camera sensor settings");
+        return false;
     }
 
     // Setup camera component: Get port settings, real video port
@@ -238,8 +391,8 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
 
     if (OMX_GetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXcameraPortRealVideo))
     {
-        printf("OMX Error: OMX get camera real video port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX get camera real video port settings");
+        return false;
     }
 
     // Setup camera component: Set port settings, real video port
@@ -247,14 +400,14 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
     OMXcameraPortRealVideo.format.video.nFrameHeight = cameraHeight;
     OMXcameraPortRealVideo.format.video.eCompressionFormat = OMX_VIDEO_CodingUnused;
     OMXcameraPortRealVideo.format.video.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
-    OMXcameraPortRealVideo.format.video.xFramerate = OMX_CAM_FRAMERATE << 16;
+    OMXcameraPortRealVideo.format.video.xFramerate = settings->framerate << 16;
     OMXcameraPortRealVideo.format.video.nStride = cameraWidth;
     OMXcameraPortRealVideo.format.video.nStride = cameraWidth;
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXcameraPortRealVideo))
     {
-        printf("OMX Error: OMX set camera real video port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set camera real video port settings");
+        return false;
     }
 
     // Setup camera component: Get port settings, preview video port
@@ -264,8 +417,8 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
 
     if (OMX_GetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXcameraPortPreview))
     {
-        printf("OMX Error: OMX get camera preview video port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX get camera preview video port settings");
+        return false;
     }
 
     // Setup camera component: Set port settings, preview video port
@@ -275,246 +428,324 @@ void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight)
     OMXcameraPortPreview.format.video.nFrameHeight = OMX_CAM_PREVIEW_HEIGHT;
     OMXcameraPortPreview.format.video.eCompressionFormat = OMX_VIDEO_CodingUnused;
     OMXcameraPortPreview.format.video.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
-    OMXcameraPortPreview.format.video.xFramerate = OMX_CAM_FRAMERATE << 16;
+    OMXcameraPortPreview.format.video.xFramerate = settings->framerate << 16;
     OMXcameraPortPreview.format.video.nStride = OMX_CAM_PREVIEW_WIDTH;
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXcameraPortPreview))
     {
-        printf("OMX Error: OMX set camera preview video port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set camera preview video port settings");
+        return false;
+    }
+
+    // Setup camera component: Settings which can be changed at runtime
+    if (!OMXSetupCameraSettings(component, settings))
+    {
+        OMXFailComponent(component, "OMX set camera settings");
+        return false;
+    }
+
+    // Setup camera component: Frame stabilisation
+    OMX_CONFIG_FRAMESTABTYPE OMXcameraFrameStabilisation;
+    OMXinitializeStruct<OMX_CONFIG_FRAMESTABTYPE>(&OMXcameraFrameStabilisation);
+    OMXcameraFrameStabilisation.nPortIndex = OMX_ALL;
+    OMXcameraFrameStabilisation.bStab = OMX_CAM_FRAME_STABILIZATION;
+
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonFrameStabilisation, &OMXcameraFrameStabilisation))
+    {
+        OMXFailComponent(component, "OMX set camera setting Frame stabilisation");
+        return false;
+    }
+
+    // Setup camera component: Image filter
+    OMX_CONFIG_IMAGEFILTERTYPE OMXcameraImageFilter;
+    OMXinitializeStruct<OMX_CONFIG_IMAGEFILTERTYPE>(&OMXcameraImageFilter);
+    OMXcameraImageFilter.nPortIndex = OMX_ALL;
+    OMXcameraImageFilter.eImageFilter = OMX_CAM_IMAGE_FILTER;
+
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonImageFilter, &OMXcameraImageFilter))
+    {
+        OMXFailComponent(component, "OMX set camera setting Image filter");
+        return false;
+    }
+
+    // Setup camera component: Mirror
+    OMX_CONFIG_MIRRORTYPE OMXcameraMirror;
+    OMXinitializeStruct<OMX_CONFIG_MIRRORTYPE>(&OMXcameraMirror);
+    OMXcameraMirror.nPortIndex = OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT;
+    OMXcameraMirror.eMirror = OMX_CAM_MIRROR;
+
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonMirror, &OMXcameraMirror))
+    {
+        OMXFailComponent(component, "OMX set camera setting Mirror");
+        return false;
     }
 
-    // Setup camera component: Sharpness
+    // Setup camera component: Rotation
+    OMX_CONFIG_ROTATIONTYPE OMXcameraRotation;
+    OMXinitializeStruct<OMX_CONFIG_ROTATIONTYPE>(&OMXcameraRotation);
+    OMXcameraRotation.nPortIndex = OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT;
+    OMXcameraRotation.nRotation = OMX_CAM_ROTATION;
+
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonRotate, &OMXcameraRotation))
+    {
+        OMXFailComponent(component, "OMX set camera setting Rotation");
+        return false;
+    }
+
+    // Setup camera component: Color enhancement
+    OMX_CONFIG_COLORENHANCEMENTTYPE OMXcameraColorEnhancement;
+    OMXinitializeStruct<OMX_CONFIG_COLORENHANCEMENTTYPE>(&OMXcameraColorEnhancement);
+    OMXcameraColorEnhancement.nPortIndex = OMX_ALL;
+    OMXcameraColorEnhancement.bColorEnhancement = OMX_CAM_COLOR_ENABLE;
+    OMXcameraColorEnhancement.nCustomizedU = OMX_CAM_COLOR_U;
+    OMXcameraColorEnhancement.nCustomizedV = OMX_CAM_COLOR_V;
+
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonColorEnhancement, &OMXcameraColorEnhancement))
+    {
+        OMXFailComponent(component, "OMX set camera setting Color enhancement");
+        return false;
+    }
+
+    // Setup camera component: Denoise
+    OMX_CONFIG_BOOLEANTYPE OMXcameraDenoise;
+    OMXinitializeStruct<OMX_CONFIG_BOOLEANTYPE>(&OMXcameraDenoise);
+    OMXcameraDenoise.bEnabled = OMX_CAM_NOISE_REDUCTION;
+
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigStillColourDenoiseEnable, &OMXcameraDenoise))
+    {
+        OMXFailComponent(component, "OMX set camera setting Denoise");
+        return false;
+    }
+
+    return true;
+}
+
+// OMX function to apply camera settings which can be changed at runtime
+// Component in state loaded or executing, returns false if a setting was rejected
+bool OMXSetupCameraSettings(OMXComponent* component, const CameraSettings* settings)
+{
+    // Setup camera settings: Sharpness
     OMX_CONFIG_SHARPNESSTYPE OMXcameraSharpness;
     OMXinitializeStruct<OMX_CONFIG_SHARPNESSTYPE>(&OMXcameraSharpness);
     OMXcameraSharpness.nPortIndex = OMX_ALL;
-    OMXcameraSharpness.nSharpness = OMX_CAM_SHARPNESS;
+    OMXcameraSharpness.nSharpness = settings->sharpness;
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonSharpness, &OMXcameraSharpness))
     {
-        printf("OMX Error: OMX set camera setting Sharpness - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Sharpness\n");
+        return false;
     }
 
-    // Setup camera component: Contrast
+    // Setup camera settings: Contrast
     OMX_CONFIG_CONTRASTTYPE OMXcameraContrast;
     OMXinitializeStruct<OMX_CONFIG_CONTRASTTYPE>(&OMXcameraContrast);
     OMXcameraContrast.nPortIndex = OMX_ALL;
-    OMXcameraContrast.nContrast = OMX_CAM_CONTRAST;
+    OMXcameraContrast.nContrast = settings->contrast;
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonContrast, &OMXcameraContrast))
     {
-        printf("OMX Error: OMX set camera setting Contrast - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Contrast\n");
+        return false;
     }
 
-    // Setup camera component: Saturation
+    // Setup camera settings: Saturation
     OMX_CONFIG_SATURATIONTYPE OMXcameraSaturation;
     OMXinitializeStruct<OMX_CONFIG_SATURATIONTYPE>(&OMXcameraSaturation);
     OMXcameraSaturation.nPortIndex = OMX_ALL;
-    OMXcameraSaturation.nSaturation = OMX_CAM_SATURATION;
+    OMXcameraSaturation.nSaturation = settings->saturation;
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonSaturation, &OMXcameraSaturation))
     {
-        printf("OMX Error: OMX set camera setting Saturation - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Saturation\n");
+        return false;
     }
 
-    // Setup camera component: Brightness
+    // Setup camera settings: Brightness
     OMX_CONFIG_BRIGHTNESSTYPE OMXcameraBrightness;
     OMXinitializeStruct<OMX_CONFIG_BRIGHTNESSTYPE>(&OMXcameraBrightness);
     OMXcameraBrightness.nPortIndex = OMX_ALL;
-    OMXcameraBrightness.nBrightness = OMX_CAM_BRIGHTNESS;
+    OMXcameraBrightness.nBrightness = settings->brightness;
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonBrightness, &OMXcameraBrightness))
     {
-        printf("OMX Error: OMX set camera setting Brightness - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Brightness\n");
+        return false;
     }
 
-    // Setup camera component: Exposure value
+    // Setup camera settings: Exposure value
     OMX_CONFIG_EXPOSUREVALUETYPE OMXcameraExposureValue;
     OMXinitializeStruct<OMX_CONFIG_EXPOSUREVALUETYPE>(&OMXcameraExposureValue);
     OMXcameraExposureValue.nPortIndex = OMX_ALL;
-    OMXcameraExposureValue.eMetering = OMX_CAM_METERING;
-    OMXcameraExposureValue.xEVCompensation = (OMX_CAM_EXPOSURE_COMPENSATION << 16) / 6;
-    OMXcameraExposureValue.nShutterSpeedMsec = OMX_CAM_SHUTTER_SPEED;
-    OMXcameraExposureValue.bAutoShutterSpeed = OMX_CAM_SHUTTER_SPEED_AUTO;
-    OMXcameraExposureValue.nSensitivity = OMX_CAM_ISO;
-    OMXcameraExposureValue.bAutoSensitivity = OMX_CAM_ISO_AUTO;
+    OMXcameraExposureValue.eMetering = (OMX_METERINGTYPE)(settings->metering);
+    OMXcameraExposureValue.xEVCompensation = (settings->exposureCompensation << 16) / 6;
+    OMXcameraExposureValue.nShutterSpeedMsec = settings->shutterSpeed;
+    OMXcameraExposureValue.bAutoShutterSpeed = (settings->shutterSpeedAuto ? OMX_TRUE : OMX_FALSE);
+    OMXcameraExposureValue.nSensitivity = settings->iso;
+    OMXcameraExposureValue.bAutoSensitivity = (settings->isoAuto ? OMX_TRUE : OMX_FALSE);
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonExposureValue, &OMXcameraExposureValue))
     {
-        printf("OMX Error: OMX set camera setting Exposure value - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Exposure value\n");
+        return false;
     }
 
-    // Setup camera component: Exposure control
+    // Setup camera settings: Exposure control
     OMX_CONFIG_EXPOSURECONTROLTYPE OMXcameraExposureControl;
     OMXinitializeStruct<OMX_CONFIG_EXPOSURECONTROLTYPE>(&OMXcameraExposureControl);
     OMXcameraExposureControl.nPortIndex = OMX_ALL;
-    OMXcameraExposureControl.eExposureControl = OMX_CAM_EXPOSURE;
+    OMXcameraExposureControl.eExposureControl = (OMX_EXPOSURECONTROLTYPE)(settings->exposure);
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonExposure, &OMXcameraExposureControl))
     {
-        printf("OMX Error: OMX set camera setting Exposure control - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Exposure control\n");
+        return false;
     }
 
-    // Setup camera component: Frame stabilisation
-    OMX_CONFIG_FRAMESTABTYPE OMXcameraFrameStabilisation;
-    OMXinitializeStruct<OMX_CONFIG_FRAMESTABTYPE>(&OMXcameraFrameStabilisation);
-    OMXcameraFrameStabilisation.nPortIndex = OMX_ALL;
-    OMXcameraFrameStabilisation.bStab = OMX_CAM_FRAME_STABILIZATION;
-
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonFrameStabilisation, &OMXcameraFrameStabilisation))
-    {
-        printf("OMX Error: OMX set camera setting Frame stabilisation - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
-    }
-
-    // Setup camera component: White balance
+    // Setup camera settings: White balance
     OMX_CONFIG_WHITEBALCONTROLTYPE OMXcameraWhiteBalance;
     OMXinitializeStruct<OMX_CONFIG_WHITEBALCONTROLTYPE>(&OMXcameraWhiteBalance);
     OMXcameraWhiteBalance.nPortIndex = OMX_ALL;
-    OMXcameraWhiteBalance.eWhiteBalControl = OMX_CAM_WHITE_BALANCE;
+    OMXcameraWhiteBalance.eWhiteBalControl = (OMX_WHITEBALCONTROLTYPE)(settings->whiteBalance);
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonWhiteBalance, &OMXcameraWhiteBalance))
     {
-        printf("OMX Error: OMX set camera setting White balance - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting White balance\n");
+        return false;
     }
 
-    // Setup camera component: White balance gains (if white balance is set to off)
-    if (!OMX_CAM_WHITE_BALANCE)
+    // Setup camera settings: White balance gains (if white balance is set to off)
+    if (!settings->whiteBalance)
     {
         OMX_CONFIG_CUSTOMAWBGAINSTYPE OMXcameraWhiteBalanceGains;
         OMXinitializeStruct<OMX_CONFIG_CUSTOMAWBGAINSTYPE>(&OMXcameraWhiteBalanceGains);
-        OMXcameraWhiteBalanceGains.xGainR = (OMX_CAM_WHITE_BALANCE_RED_GAIN << 16) / 1000;
-        OMXcameraWhiteBalanceGains.xGainB = (OMX_CAM_WHITE_BALANCE_BLUE_GAIN << 16) / 1000;
+        OMXcameraWhiteBalanceGains.xGainR = (settings->whiteBalanceRedGain << 16) / 1000;
+        OMXcameraWhiteBalanceGains.xGainB = (settings->whiteBalanceBlueGain << 16) / 1000;
 
         if (OMX_SetConfig(component->handle, OMX_IndexConfigCustomAwbGains, &OMXcameraWhiteBalanceGains))
         {
-            printf("OMX Error: OMX set camera setting White balance gains - EXITING APPLICATION\n");
-            kill(getpid(), SIGKILL);
+            printf("OMX Error: OMX set camera setting White balance gains\n");
+            return false;
         }
     }
 
-    // Setup camera component: Image filter
-    OMX_CONFIG_IMAGEFILTERTYPE OMXcameraImageFilter;
-    OMXinitializeStruct<OMX_CONFIG_IMAGEFILTERTYPE>(&OMXcameraImageFilter);
-    OMXcameraImageFilter.nPortIndex = OMX_ALL;
-    OMXcameraImageFilter.eImageFilter = OMX_CAM_IMAGE_FILTER;
+    // Setup camera settings: ROI
+    OMX_CONFIG_INPUTCROPTYPE OMXcameraRoi;
+    OMXinitializeStruct<OMX_CONFIG_INPUTCROPTYPE>(&OMXcameraRoi);
+    OMXcameraRoi.nPortIndex = OMX_ALL;
+    OMXcameraRoi.xLeft = (settings->roiLeft << 16) / 100;
+    OMXcameraRoi.xTop = (settings->roiTop << 16) / 100;
+    OMXcameraRoi.xWidth = (settings->roiWidth << 16) / 100;
+    OMXcameraRoi.xHeight = (settings->roiHeight << 16) / 100;
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonImageFilter, &OMXcameraImageFilter))
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigInputCropPercentages, &OMXcameraRoi))
     {
-        printf("OMX Error: OMX set camera setting Image filter - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting ROI\n");
+        return false;
     }
 
-    // Setup camera component: Mirror
-    OMX_CONFIG_MIRRORTYPE OMXcameraMirror;
-    OMXinitializeStruct<OMX_CONFIG_MIRRORTYPE>(&OMXcameraMirror);
-    OMXcameraMirror.nPortIndex = OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT;
-    OMXcameraMirror.eMirror = OMX_CAM_MIRROR;
+    // Setup camera settings: Framerate of real video port
+    OMX_CONFIG_FRAMERATETYPE OMXcameraFramerate;
+    OMXinitializeStruct<OMX_CONFIG_FRAMERATETYPE>(&OMXcameraFramerate);
+    OMXcameraFramerate.nPortIndex = OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT;
+    OMXcameraFramerate.xEncodeFramerate = settings->framerate << 16;
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonMirror, &OMXcameraMirror))
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigVideoFramerate, &OMXcameraFramerate))
     {
-        printf("OMX Error: OMX set camera setting Mirror - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting Framerate\n");
+        return false;
     }
 
-    // Setup camera component: Rotation
-    OMX_CONFIG_ROTATIONTYPE OMXcameraRotation;
-    OMXinitializeStruct<OMX_CONFIG_ROTATIONTYPE>(&OMXcameraRotation);
-    OMXcameraRotation.nPortIndex = OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT;
-    OMXcameraRotation.nRotation = OMX_CAM_ROTATION;
+    // Setup camera settings: DRC
+    OMX_CONFIG_DYNAMICRANGEEXPANSIONTYPE OMXcameraDrc;
+    OMXinitializeStruct<OMX_CONFIG_DYNAMICRANGEEXPANSIONTYPE>(&OMXcameraDrc);
+    OMXcameraDrc.eMode = (OMX_DYNAMICRANGEEXPANSIONMODETYPE)(settings->drc);
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonRotate, &OMXcameraRotation))
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigDynamicRangeExpansion, &OMXcameraDrc))
     {
-        printf("OMX Error: OMX set camera setting Rotation - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        printf("OMX Error: OMX set camera setting DRC\n");
+        return false;
     }
 
-    // Setup camera component: Color enhancement
-    OMX_CONFIG_COLORENHANCEMENTTYPE OMXcameraColorEnhancement;
-    OMXinitializeStruct<OMX_CONFIG_COLORENHANCEMENTTYPE>(&OMXcameraColorEnhancement);
-    OMXcameraColorEnhancement.nPortIndex = OMX_ALL;
-    OMXcameraColorEnhancement.bColorEnhancement = OMX_CAM_COLOR_ENABLE;
-    OMXcameraColorEnhancement.nCustomizedU = OMX_CAM_COLOR_U;
-    OMXcameraColorEnhancement.nCustomizedV = OMX_CAM_COLOR_V;
+    return true;
+}
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigCommonColorEnhancement, &OMXcameraColorEnhancement))
+// OMX function to read exposure time, analog and digital gain and white balance gains the camera currently uses
+// Component in state executing, returns false if the camera does not report them
+bool OMXGetCameraExposure(OMXComponent* component, OMX_CONFIG_CAMERASETTINGSTYPE* exposure)
+{
+    // Setup camera component: Check for correct component
+    if (component->id != OMX_COMPONENT_CAMERA_ID)
     {
-        printf("OMX Error: OMX set camera setting Color enhancement - EXITING APPLICATION\n");
+        printf("OMX Error: Get camera exposure called on wrong component %s - EXITING APPLICATION\n", component->name);
         kill(getpid(), SIGKILL);
     }
 
-    // Setup camera component: Denoise
-    OMX_CONFIG_BOOLEANTYPE OMXcameraDenoise;
-    OMXinitializeStruct<OMX_CONFIG_BOOLEANTYPE>(&OMXcameraDenoise);
-    OMXcameraDenoise.bEnabled = OMX_CAM_NOISE_REDUCTION;
+    OMXinitializeStruct<OMX_CONFIG_CAMERASETTINGSTYPE>(exposure);
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigStillColourDenoiseEnable, &OMXcameraDenoise))
+    if (OMX_GetConfig(component->handle, OMX_IndexConfigCameraSettings, exposure))
     {
-        printf("OMX Error: OMX set camera setting Denoise - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        return false;
     }
 
-    // Setup camera component: ROI
-    OMX_CONFIG_INPUTCROPTYPE OMXcameraRoi;
-    OMXinitializeStruct<OMX_CONFIG_INPUTCROPTYPE>(&OMXcameraRoi);
-    OMXcameraRoi.nPortIndex = OMX_ALL;
-    OMXcameraRoi.xLeft = (OMX_CAM_ROI_LEFT << 16) / 100;
-    OMXcameraRoi.xTop = (OMX_CAM_ROI_TOP << 16) / 100;
-    OMXcameraRoi.xWidth = (OMX_CAM_ROI_WIDTH << 16) / 100;
-    OMXcameraRoi.xHeight = (OMX_CAM_ROI_HEIGHT << 16) / 100;
+    return true;
+}
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigInputCropPercentages, &OMXcameraRoi))
+// OMX function to start camera capturing
+// Component in state executing and ports enabled, returns false if the component failed
+bool OMXStartCameraCapturing(OMXComponent* component, int port)
+{
+    // Setup camera component: Check for correct component
+    if (component->id != OMX_COMPONENT_CAMERA_ID)
     {
-        printf("OMX Error: OMX set camera setting ROI - EXITING APPLICATION\n");
+        printf("OMX Error: Start camera called on wrong component %s - EXITING APPLICATION\n", component->name);
         kill(getpid(), SIGKILL);
     }
 
     // Setup camera component: DRC
-    OMX_CONFIG_DYNAMICRANGEEXPANSIONTYPE OMXcameraDrc;
-    OMXinitializeStruct<OMX_CONFIG_DYNAMICRANGEEXPANSIONTYPE>(&OMXcameraDrc);
-    OMXcameraDrc.eMode = OMX_CAM_DRC;
+    OMX_CONFIG_PORTBOOLEANTYPE OMXcameraCapturePort;
+    OMXinitializeStruct<OMX_CONFIG_PORTBOOLEANTYPE>(&OMXcameraCapturePort);
+    OMXcameraCapturePort.nPortIndex = port;
+    OMXcameraCapturePort.bEnabled = OMX_TRUE;
 
-    if (OMX_SetConfig(component->handle, OMX_IndexConfigDynamicRangeExpansion, &OMXcameraDrc))
+    if (OMX_SetConfig(component->handle, OMX_IndexConfigPortCapturing, &OMXcameraCapturePort))
     {
-        printf("OMX Error: OMX set camera setting DRC - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX start camera capturing");
+        return false;
     }
+
+    return true;
 }
 
-// OMX function to start camera capturing
+// OMX function to stop camera capturing
 // Component in state executing and ports enabled
-void OMXStartCameraCapturing(OMXComponent* component, int port)
+void OMXStopCameraCapturing(OMXComponent* component, int port)
 {
     // Setup camera component: Check for correct component
     if (component->id != OMX_COMPONENT_CAMERA_ID)
     {
-        printf("OMX Error: Start camera called on wrong component %s - EXITING APPLICATION\n", component->name);
+        printf("OMX Error: Stop camera called on wrong component %s - EXITING APPLICATION\n", component->name);
         kill(getpid(), SIGKILL);
     }
 
-    // Setup camera component: DRC
+    if (!component->handle)
+    {
+        return;
+    }
+
     OMX_CONFIG_PORTBOOLEANTYPE OMXcameraCapturePort;
     OMXinitializeStruct<OMX_CONFIG_PORTBOOLEANTYPE>(&OMXcameraCapturePort);
     OMXcameraCapturePort.nPortIndex = port;
-    OMXcameraCapturePort.bEnabled = OMX_TRUE;
+    OMXcameraCapturePort.bEnabled = OMX_FALSE;
 
     if (OMX_SetConfig(component->handle, OMX_IndexConfigPortCapturing, &OMXcameraCapturePort))
     {
-        printf("OMX Error: OMX start camera capturing - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX stop camera capturing");
     }
 }
 
 // OMX function to setup egl render correctly
-// Component in state idle and ports enabled
-void OMXSetupEGLRender(OMXComponent* component, EGLImageKHR* eglImage, OMX_BUFFERHEADERTYPE** outputBufferHeader)
+// Component in state idle and ports enabled, returns false if the component failed
+bool OMXSetupEGLRender(OMXComponent* component, EGLImageKHR* eglImage, OMX_BUFFERHEADERTYPE** outputBufferHeader)
 {
     // Setup egl render component: Check for correct component
     if (component->id != OMX_COMPONENT_EGL_RENDER_ID)
@@ -526,14 +757,16 @@ void OMXSetupEGLRender(OMXComponent* component, EGLImageKHR* eglImage, OMX_BUFFE
     // Setup egl render component: Set output buffer and output eglImage
     if (OMX_UseEGLImage(component->handle, outputBufferHeader, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, NULL, (*eglImage)))
     {
-        printf("OMX Error: OMX setup egl render image - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX setup egl render image");
+        return false;
     }
+
+    return true;
 }
 
 // OMX function to setup egl render correctly
-// Component in state loading and ports disabled
-void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int cameraHeight)
+// Component in state loading and ports disabled, returns false if the component failed
+bool OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int cameraHeight, int bufferCount, int quality, int frameFormat)
 {
     // Setup image encode component settings: Check for correct component
     if (component->id != OMX_COMPONENT_IMAGE_ENCODE_ID)
@@ -550,8 +783,8 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
     // Setup image encode component settings: Get current information for input port
     if (OMX_GetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXimageEncodeInputPort))
     {
-        printf("OMX Error: OMX get image encode input port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX get image encode input port settings");
+        return false;
     }
 
     // Setup image encode component settings: Change settings for image encoding
@@ -566,11 +799,27 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
     OMXimageEncodeInputPort.format.image.eCompressionFormat = OMX_IMAGE_CodingUnused;
     OMXimageEncodeInputPort.format.image.eColorFormat = OMX_COLOR_Format32bitABGR8888;
 
+    // Planar YUV420 frames are encoded without color conversion: Y plane with stride of frame width, U and V planes follow with half stride
+    if (frameFormat == FRAME_FORMAT_YUV420)
+    {
+        OMXimageEncodeInputPort.format.image.nStride = cameraWidth;
+        OMXimageEncodeInputPort.format.image.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+    }
+
+    // Setup image encode component settings: Number of input buffers, each one holds a frame in flight
+    if ((OMX_U32)(bufferCount) < OMXimageEncodeInputPort.nBufferCountMin)
+    {
+        printf("OMX Error: OMX image encode input port needs at least %u buffers - EXITING APPLICATION\n", OMXimageEncodeInputPort.nBufferCountMin);
+        kill(getpid(), SIGKILL);
+    }
+
+    OMXimageEncodeInputPort.nBufferCountActual = bufferCount;
+
     // Setup image encode component settings: Send changed settings for input port
     if (OMX_SetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXimageEncodeInputPort))
     {
-        printf("OMX Error: OMX set image encode input port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set image encode input port settings");
+        return false;
     }
 
     // Setup image encode component settings: Prepare structure for output port
@@ -581,8 +830,8 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
     // Setup image encode component settings: Get current information for output port
     if (OMX_GetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXimageEncodeOutputPort))
     {
-        printf("OMX Error: OMX get image encode output port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX get image encode output port settings");
+        return false;
     }
 
     // Setup image encode component settings: Change settings for image encoding
@@ -593,23 +842,27 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
     OMXimageEncodeOutputPort.format.image.eCompressionFormat = OMX_IMAGE_CodingJPEG;
     OMXimageEncodeOutputPort.format.image.eColorFormat = OMX_COLOR_FormatUnused;
 
+    // Setup image encode component settings: Number of output buffers, same as input buffers
+    if ((OMX_U32)(bufferCount) < OMXimageEncodeOutputPort.nBufferCountMin)
+    {
+        printf("OMX Error: OMX image encode output port needs at least %u buffers - EXITING APPLICATION\n", OMXimageEncodeOutputPort.nBufferCountMin);
+        kill(getpid(), SIGKILL);
+    }
+
+    OMXimageEncodeOutputPort.nBufferCountActual = bufferCount;
+
     // Setup image encode component settings: Send changed settings for output port
     if (OMX_SetParameter(component->handle, OMX_IndexParamPortDefinition, &OMXimageEncodeOutputPort))
     {
-        printf("OMX Error: OMX set image encode output port settings - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set image encode output port settings");
+        return false;
     }
 
     // Setup image encode component settings: JPEG quality
-    OMX_IMAGE_PARAM_QFACTORTYPE OMXimageEncodeQuality;
-    OMXinitializeStruct<OMX_IMAGE_PARAM_QFACTORTYPE>(&OMXimageEncodeQuality);
-    OMXimageEncodeQuality.nPortIndex = OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT;
-    OMXimageEncodeQuality.nQFactor = OMX_JPEG_QUALITY;
-
-    if (OMX_SetParameter(component->handle, OMX_IndexParamQFactor, &OMXimageEncodeQuality))
+    if (!OMXSetupImageEncodeQuality(component, quality))
     {
-        printf("OMX Error: OMX set image encode JPEG quality - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set image encode JPEG quality");
+        return false;
     }
 
     // Setup image encode component settings: JPEG EXIF
@@ -619,8 +872,8 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamBrcmDisableEXIF, &OMXimageEncodeExif))
     {
-        printf("OMX Error: OMX set image encode JPEG EXIF - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set image encode JPEG EXIF");
+        return false;
     }
 
     // Setup image encode component settings: JPEG IJG
@@ -631,8 +884,8 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamBrcmEnableIJGTableScaling, &OMXimageEncodeIjg))
     {
-        printf("OMX Error: OMX set image encode JPEG IJG - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set image encode JPEG IJG");
+        return false;
     }
 
     // Setup image encode component settings: JPEG Thumbnail
@@ -645,14 +898,28 @@ void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int c
 
     if (OMX_SetParameter(component->handle, OMX_IndexParamBrcmThumbnail, &OMXimageEncodeThumbnail))
     {
-        printf("OMX Error: OMX set image encode JPEG thumbnail - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        OMXFailComponent(component, "OMX set image encode JPEG thumbnail");
+        return false;
     }
+
+    return true;
 }
 
-// OMX function to setup egl render correctly
-// Component in state idle and ports enabled
-void OMXSetupImageEncodeAllocate(OMXComponent* component, GLubyte* inputBuffer, OMX_BUFFERHEADERTYPE** inputBufferHeader, OMX_BUFFERHEADERTYPE** outputBufferHeader, int cameraWidth, int cameraHeight)
+// OMX function to set JPEG quality of image encode output port
+// Returns false if the component rejected the quality
+bool OMXSetupImageEncodeQuality(OMXComponent* component, int quality)
+{
+    OMX_IMAGE_PARAM_QFACTORTYPE OMXimageEncodeQuality;
+    OMXinitializeStruct<OMX_IMAGE_PARAM_QFACTORTYPE>(&OMXimageEncodeQuality);
+    OMXimageEncodeQuality.nPortIndex = OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT;
+    OMXimageEncodeQuality.nQFactor = quality;
+
+    return (OMX_SetParameter(component->handle, OMX_IndexParamQFactor, &OMXimageEncodeQuality) == OMX_ErrorNone);
+}
+
+// OMX function to setup image encode buffers correctly
+// Component in state idle and ports enabled, returns false if the component failed, headers of buffers which could not be allocated are NULL
+bool OMXSetupImageEncodeAllocate(OMXComponent* component, GLubyte** inputBuffers, OMX_BUFFERHEADERTYPE** inputBufferHeaders, OMX_BUFFERHEADERTYPE** outputBufferHeaders, int bufferCount, int cameraWidth, int cameraHeight, int frameFormat)
 {
     // Setup image encode component allocate: Check for correct component
     if (component->id != OMX_COMPONENT_IMAGE_ENCODE_ID)
@@ -661,32 +928,44 @@ void OMXSetupImageEncodeAllocate(OMXComponent* component, GLubyte* inputBuffer,
         kill(getpid(), SIGKILL);
     }
 
-    // Setup image encode component allocate: Set allocated buffer for input port
-    if (OMX_UseBuffer(component->handle, inputBufferHeader, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, NULL, 4 * cameraWidth * cameraHeight, inputBuffer))
+    for (int i = 0; i < bufferCount; i++)
     {
-        printf("OMX Error: OMX allocate input buffer image encode - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        // Setup image encode component allocate: Set allocated buffer for input port, one frame in the input color format
+        if (OMX_UseBuffer(component->handle, &inputBufferHeaders[i], OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, NULL, frameBytes(cameraWidth, cameraHeight, frameFormat), inputBuffers[i]))
+        {
+            inputBufferHeaders[i] = NULL;
+            OMXFailComponent(component, "OMX allocate input buffer image encode");
+            return false;
+        }
+
     }
 
-    // Setup image encode component allocate: Allocate output buffer for output port
-    // Just allocate 2 * cameraWidth * cameraHeight bytes for output, JPEG performs compression of raw input bytes
-    if (OMX_AllocateBuffer(component->handle, outputBufferHeader, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, NULL, 2 * cameraWidth * cameraHeight))
+    return OMXSetupImageEncodeAllocateOutput(component, outputBufferHeaders, bufferCount, cameraWidth, cameraHeight);
+}
+
+// OMX function to allocate image encode output buffers, used alone when only the output port is enabled again
+// Component in state idle or executing and output port enabled, returns false if the component failed, headers of buffers which could not be allocated are NULL
+bool OMXSetupImageEncodeAllocateOutput(OMXComponent* component, OMX_BUFFERHEADERTYPE** outputBufferHeaders, int bufferCount, int cameraWidth, int cameraHeight)
+{
+    for (int i = 0; i < bufferCount; i++)
     {
-        printf("OMX Error: OMX allocate output buffer image encode - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        // Setup image encode component allocate: Allocate output buffer for output port
+        // Just allocate 2 * cameraWidth * cameraHeight bytes for output, JPEG performs compression of raw input bytes
+        if (OMX_AllocateBuffer(component->handle, &outputBufferHeaders[i], OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, NULL, 2 * cameraWidth * cameraHeight))
+        {
+            outputBufferHeaders[i] = NULL;
+            OMXFailComponent(component, "OMX allocate output buffer image encode");
+            return false;
+        }
     }
+
+    return true;
 }
 
 /* #####################################
 CUSTOM FUNCTIONS
 ##################################### */
 
-// Check if file exists
-bool fileExists(std::string path)
-{
-    return (access(path.c_str(), F_OK) != -1);
-}
-
 // Catch kill signals, send SIGKILL to self (might not stop otherwise)
 void signalHandler(int signal)
 {
@@ -706,6 +985,75 @@ void signalHandler(int signal)
     }
 }
 
+// Initialize camera settings with the OMX_CAM_* settings
+void initializeCameraSettings(CameraSettings* settings)
+{
+    settings->sharpness = OMX_CAM_SHARPNESS;
+    settings->contrast = OMX_CAM_CONTRAST;
+    settings->brightness = OMX_CAM_BRIGHTNESS;
+    settings->saturation = OMX_CAM_SATURATION;
+    settings->iso = OMX_CAM_ISO;
+    settings->isoAuto = OMX_CAM_ISO_AUTO;
+    settings->exposureCompensation = OMX_CAM_EXPOSURE_COMPENSATION;
+    settings->shutterSpeed = OMX_CAM_SHUTTER_SPEED;
+    settings->shutterSpeedAuto = OMX_CAM_SHUTTER_SPEED_AUTO;
+    settings->exposure = OMX_CAM_EXPOSURE;
+    settings->metering = OMX_CAM_METERING;
+    settings->whiteBalance = OMX_CAM_WHITE_BALANCE;
+    settings->whiteBalanceRedGain = OMX_CAM_WHITE_BALANCE_RED_GAIN;
+    settings->whiteBalanceBlueGain = OMX_CAM_WHITE_BALANCE_BLUE_GAIN;
+    settings->roiTop = OMX_CAM_ROI_TOP;
+    settings->roiLeft = OMX_CAM_ROI_LEFT;
+    settings->roiWidth = OMX_CAM_ROI_WIDTH;
+    settings->roiHeight = OMX_CAM_ROI_HEIGHT;
+    settings->framerate = OMX_CAM_FRAMERATE;
+    settings->drc = OMX_CAM_DRC;
+}
+
+// Create encoder of backend for frames of PIPELINE_FRAME_FORMAT
+FrameEncoder* createFrameEncoder(int backend)
+{
+    if (backend == PIPELINE_BACKEND_OMX)
+    {
+        return new OMXFrameEncoder(ENCODE_BUFFER_COUNT, PIPELINE_FRAME_FORMAT);
+    }
+
+    return new CPUFrameEncoder(ENCODE_BUFFER_COUNT, PIPELINE_FRAME_FORMAT);
+}
+
+// Create publisher of PUBLISH_MODE, with writer thread if PUBLISH_QUEUE_LENGTH is set
+FramePublisher* createFramePublisher()
+{
+    FramePublisher* publisher = NULL;
+
+    switch (PUBLISH_MODE)
+    {
+        case PUBLISH_MODE_RENAME:
+        {
+            publisher = new RenameFramePublisher(PUBLISH_RENAME_TEMP_COUNT);
+            break;
+        }
+        case PUBLISH_MODE_SHM:
+        {
+            publisher = new ShmFramePublisher(PUBLISH_SHM_SLOT_COUNT);
+            break;
+        }
+        default:
+        {
+            publisher = new FileFramePublisher();
+            break;
+        }
+    }
+
+    // Publish on render thread or hand frames to writer thread
+    if (PUBLISH_QUEUE_LENGTH > 0)
+    {
+        publisher = new AsyncFramePublisher(publisher, PUBLISH_QUEUE_LENGTH, PUBLISH_DROP_POLICY);
+    }
+
+    return publisher;
+}
+
 /* #####################################
 MAIN APP
 ##################################### */
@@ -722,7 +1070,10 @@ void visicamRPiGPU::setup()
     signal(SIGTSTP, signalHandler);
 
     // Settings
-    ofSetFrameRate(30);
+    // Callback driven loop: No frame rate limiter and no wait for vertical sync, update blocks until the source delivers a frame
+    appliedFrameRate = (FRAME_LOOP_CALLBACK_ENABLE ? 0 : OMX_CAM_FRAMERATE);
+    ofSetFrameRate(appliedFrameRate);
+    ofSetVerticalSync(!FRAME_LOOP_CALLBACK_ENABLE);
     ofBackground(0, 0, 0);
     ofSetColor(255);
     ofDisableAlphaBlending();
@@ -733,412 +1084,109 @@ void visicamRPiGPU::setup()
     ofDisableSmoothing();
     ofHideCursor();
 
-    // Initialize last refresh timespec
-    lastRefreshTimespec.tv_sec = 0;
-    lastRefreshTimespec.tv_nsec = 0;
-
-    // Initialize current timespec
-    currentTimespec.tv_sec = 0;
-    currentTimespec.tv_sec = 0;
-
-    // Initialize forcedFirstRefresh
-    firstForcedRefresh = false;
-
-    // Initialize output captured original image with false, will be done in each refresh
-    outputCapturedOriginalImage = false;
-
-    // Initialize with identity matrix
-    homographyInputMatrixValues[0] = 1.0f; // Row 1
-    homographyInputMatrixValues[3] = 0.0f;
-    homographyInputMatrixValues[6] = 0.0f;
-    homographyInputMatrixValues[1] = 0.0f; // Row 2
-    homographyInputMatrixValues[4] = 1.0f;
-    homographyInputMatrixValues[7] = 0.0f;
-    homographyInputMatrixValues[2] = 0.0f; // Row 3
-    homographyInputMatrixValues[5] = 0.0f;
-    homographyInputMatrixValues[8] = 1.0f;
-
-    // Need to covert homography matrix in openCV format to openGL format
-    // Can ignore z-coordinate here, so just fill up with empty values for z
-    homographyInputMatrix.set(homographyInputMatrixValues[0], homographyInputMatrixValues[3], 0.0f, homographyInputMatrixValues[6],
-                              homographyInputMatrixValues[1], homographyInputMatrixValues[4], 0.0f, homographyInputMatrixValues[7],
-                              0.0f,                           0.0f,                           0.0f,                           0.0f,
-                              homographyInputMatrixValues[2], homographyInputMatrixValues[5], 0.0f, homographyInputMatrixValues[8]);
-
-    // Allocate default render FBO
-    defaultRenderOutputFbo.allocate(width, height, GL_RGBA);
-
-    // Allocate buffer for screen pixels and empty buffer
-    OMXscreenPixelBuffer = (GLubyte*)(malloc(4 * width * height));
-    memset(OMXscreenPixelBuffer, 0, 4 * width * height * sizeof(GLubyte));
-
-    // Initialize OMX main components
-    bcm_host_init();
-
-    if (OMX_Init())
-    {
-        printf("OMX Error: OMX init - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
-    }
-
-    // Initialize OMXcameraComponent: Initialize, set component id and name, set VCOS flags, register OMX handle
-    // Disable all ports, wait for port disable
-    OMXInitializeComponent(&OMXcameraComponent, OMX_COMPONENT_CAMERA_ID, OMX_COMPONENT_CAMERA_NAME);
-
-    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, false);
-    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, false);
-    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_STILL_IMAGE_OUTPUT, false);
-    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_CLOCK_INPUT, false);
-    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_PORT_DISABLE);
-
-    // Initialize OMXnullSinkComponent: Initialize, set component id and name, set VCOS flags, register OMX handle
-    // Disable all ports, wait for port disable
-    OMXInitializeComponent(&OMXnullSinkComponent, OMX_COMPONENT_NULL_SINK_ID, OMX_COMPONENT_NULL_SINK_NAME);
-
-    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_VIDEO_INPUT, false);
-    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_IMAGE_INPUT, false);
-    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_AUDIO_INPUT, false);
-    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_PORT_DISABLE);
-
-    // Initialize OMXeglRenderComponent: Initialize, set component id and name, set VCOS flags, register OMX handle
-    // Disable all ports, wait for port disable
-    OMXInitializeComponent(&OMXeglRenderComponent, OMX_COMPONENT_EGL_RENDER_ID, OMX_COMPONENT_EGL_RENDER_NAME);
-
-    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_INPUT, false);
-    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, false);
-    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_PORT_DISABLE);
-
-    // Initialize OMXimageEncodeComponent: Initialize, set component id and name, set VCOS flags, register OMX handle
-    // Disable all ports, wait for port disable
-    OMXInitializeComponent(&OMXimageEncodeComponent, OMX_COMPONENT_IMAGE_ENCODE_ID, OMX_COMPONENT_IMAGE_ENCODE_NAME);
-
-    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, false);
-    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE);
-
-    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, false);
-    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_PORT_DISABLE);
-
-    // Setup OMXcameraComponent: Set camera device id, wait for device id set, configure sensor and port width and height, set encoding, brightness, sharpness, ...
-    // Component in state loaded and ports disabled
-    OMXSetupCamera(&OMXcameraComponent, width, height);
-
-    // Setup OMXimageEncodeComponent: Set buffer sizes, port width and height, color format, jpeg settings
-    // Component in state loaded and ports disabled
-    OMXSetupImageEncodeSettings(&OMXimageEncodeComponent, width, height);
-
-    // Setup tunnel: OMXcameraComponent (preview video output) => OMXnullSinkComponent (video input)
-    if (OMX_SetupTunnel(OMXcameraComponent.handle, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, OMXnullSinkComponent.handle, OMX_PORT_NULL_SINK_VIDEO_INPUT))
-    {
-        printf("OMX Error: OMX tunnel OMXcameraComponent (preview video out) => OMXnullSinkComponent (video in) - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
-    }
-
-    // Setup tunnel: OMXcameraComponent (real video output) => OMXeglRenderComponent (video input)
-    if (OMX_SetupTunnel(OMXcameraComponent.handle, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, OMXeglRenderComponent.handle, OMX_PORT_EGL_RENDER_VIDEO_INPUT))
-    {
-        printf("OMX Error: OMX tunnel OMXcameraComponent (real video out) => OMXeglRenderComponent (video in) - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
-    }
-
-    // Setup state: Set all components to state idle
-    OMXSetStateComponent(&OMXcameraComponent, OMX_StateIdle);
-    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_STATE_SET);
-    OMXSetStateComponent(&OMXeglRenderComponent, OMX_StateIdle);
-    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_STATE_SET);
-
-    OMXSetStateComponent(&OMXnullSinkComponent, OMX_StateIdle);
-    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_STATE_SET);
-
-    OMXSetStateComponent(&OMXimageEncodeComponent, OMX_StateIdle);
-    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_STATE_SET);
-
-    // Setup ports: Enable all required ports of components
-    // Inconsistent behaviour on port enable, do not send port enabled event?
-    // Therefore, no waiting for port enable events here
-    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_PREVIEW_VIDEO_OUTPUT, true);
-    OMXPortEnableDisableComponent(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT, true);
-    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_INPUT, true);
-    OMXPortEnableDisableComponent(&OMXeglRenderComponent, OMX_PORT_EGL_RENDER_VIDEO_OUTPUT, true);
-    OMXPortEnableDisableComponent(&OMXnullSinkComponent, OMX_PORT_NULL_SINK_VIDEO_INPUT, true);
-    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT, true);
-    OMXPortEnableDisableComponent(&OMXimageEncodeComponent, OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT, true);
-
-    // Setup EGLImage: EGLImage needed for setting up OMXeglRenderComponent
-    eglRenderOutputFbo.allocate(width, height, GL_RGBA);
-    GLuint eglTextureID = eglRenderOutputFbo.getTextureReference().getTextureData().textureID;
-    ofAppEGLWindow* eglWindow = (ofAppEGLWindow*)(ofGetWindowPtr());
-    EGLDisplay eglDisplay = eglWindow->getEglDisplay();
-    EGLContext eglContext = eglWindow->getEglContext();
-    eglImage = eglCreateImageKHR(eglDisplay, eglContext, EGL_GL_TEXTURE_2D_KHR, (EGLClientBuffer)(eglTextureID), NULL);
-
-    if (!eglImage)
-    {
-        printf("OMX Error: OMX create egl image - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
-    }
-
-    // Setup OMXeglRenderComponent: Setup output buffer and output eglImage object
-    // Component in state idle and ports enabled
-    OMXSetupEGLRender(&OMXeglRenderComponent, &eglImage, &OMXeglRenderOutputBufferHeader);
-
-    // Setup OMXimageEncodeComponent: Allocate input and output buffers
-    // Component in state idle and ports enabled
-    OMXSetupImageEncodeAllocate(&OMXimageEncodeComponent, OMXscreenPixelBuffer, &OMXimageEncodeInputBufferHeader, &OMXimageEncodeOutputBufferHeader, width, height);
-
-    // Setup state: Set all components to state executing
-    OMXSetStateComponent(&OMXcameraComponent, OMX_StateExecuting);
-    VCOSwaitEvent(&OMXcameraComponent, VCOS_EVENT_STATE_SET);
-
-    OMXSetStateComponent(&OMXeglRenderComponent, OMX_StateExecuting);
-    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_STATE_SET);
-
-    OMXSetStateComponent(&OMXnullSinkComponent, OMX_StateExecuting);
-    VCOSwaitEvent(&OMXnullSinkComponent, VCOS_EVENT_STATE_SET);
-
-    OMXSetStateComponent(&OMXimageEncodeComponent, OMX_StateExecuting);
-    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_STATE_SET);
-
-    // Start camera capturing
-    // Component in state executing and ports enabled
-    OMXStartCameraCapturing(&OMXcameraComponent, OMX_PORT_CAMERA_REAL_VIDEO_OUTPUT);
-}
-
-// Note: update is always called before draw in infinite loop
-void visicamRPiGPU::update()
-{
-    // Set new current timer
-    clock_gettime(CLOCK_MONOTONIC, &currentTimespec);
-
-    // Check against last refresh timer, if we need to refresh. 0 values => was just initialized, need to refresh aswell
-    if ((lastRefreshTimespec.tv_sec == 0 && lastRefreshTimespec.tv_nsec == 0)
-        || (firstForcedRefresh && (currentTimespec.tv_sec - lastRefreshTimespec.tv_sec >= FIRST_FORCED_REFRESH_SECONDS))
-        || (currentTimespec.tv_sec - lastRefreshTimespec.tv_sec >= refreshTimeSeconds))
+    // Input arguments for pipeline
+    pipeline.width = width;
+    pipeline.height = height;
+    pipeline.refreshTimeSeconds = refreshTimeSeconds;
+    pipeline.parentCheckPid = parentCheckPid;
+    pipeline.homographyInputPath = homographyInputPath;
+    pipeline.processedOutputPath = processedOutputPath;
+    pipeline.capturedOutputPath = capturedOutputPath;
+    pipeline.latencyStatsPath = LATENCY_STATS_PATH;
+
+    // Runtime settings for pipeline, can be changed with the control socket
+    initializeCameraSettings(&pipeline.cameraSettings);
+    pipeline.jpegQuality = OMX_JPEG_QUALITY;
+    pipeline.controlSocketPath = CONTROL_SOCKET_PATH;
+    pipeline.configPath = CONFIG_FILE_PATH;
+    pipeline.encodeBufferCount = ENCODE_BUFFER_COUNT;
+    pipeline.pipelineMode = PIPELINE_MODE;
+
+    // Create pipeline stages for selected backend
+    backend = PIPELINE_BACKEND;
+
+    switch (backend)
     {
-        // Application is just starting, force first refresh after FIRST_FORCED_REFRESH_SECONDS as next refresh
-        // Camera needs some time to adjust settings correctly, otherwise it would take the full refresh amount for the first correct original image
-        if (lastRefreshTimespec.tv_sec == 0 && lastRefreshTimespec.tv_nsec == 0)
-        {
-            firstForcedRefresh = true;
-        }
-        else
+        case PIPELINE_BACKEND_OMX:
         {
-            firstForcedRefresh = false;
-        }
-
-        // Set new last refresh timer
-        clock_gettime(CLOCK_MONOTONIC, &lastRefreshTimespec);
+            // Initialize OMX main components
+            bcm_host_init();
 
-        // Check if parent PID is alive, if it is set
-        if (parentCheckPid)
-        {
-            // Check if parent PID is running by sending 0 signal with kill
-            if (kill(parentCheckPid, 0))
+            if (OMX_Init())
             {
-                // Kill self if parent is not running anymore
-                printf("Parent PID application with PID %u does not run anymore - EXITING APPLICATION\n", parentCheckPid);
+                printf("OMX Error: OMX init - EXITING APPLICATION\n");
                 kill(getpid(), SIGKILL);
             }
-        }
-
-        // Set flag for original captured image output
-        outputCapturedOriginalImage = true;
 
-        // Check if homography input path file exists
-        if (fileExists(homographyInputPath))
+            pipeline.source = new OMXFrameSource();
+            pipeline.warper = new GLFrameWarper(PIPELINE_FRAME_FORMAT);
+            pipeline.encoder = createFrameEncoder(backend);
+            break;
+        }
+        case PIPELINE_BACKEND_CPU:
         {
-            // Open file
-            int homographyInputFile = open(homographyInputPath.c_str(), O_RDWR);
-            if (homographyInputFile != -1)
-            {
-                // Lock file
-                if (lockf(homographyInputFile, F_LOCK, 0) != -1)
-                {
-                    // Open input filestream
-                    std::ifstream homographyInputStream(homographyInputPath.c_str());
-
-                    // Opening was successful
-                    if (homographyInputStream)
-                    {
-                        // Counter which indicates if how many values were read
-                        int valuesCounter = 0;
-
-                        // Read matrix values from file, seperator is newline \n
-                        std::string inputLine;
-                        while (std::getline(homographyInputStream, inputLine))
-                        {
-                            // Increase counter
-                            valuesCounter++;
-
-                            // Something went wrong, file has more lines than expected
-                            if (valuesCounter > 9)
-                            {
-                                break;
-                            }
-
-                            // Set values
-                            homographyInputMatrixValues[valuesCounter-1] = atof(inputLine.c_str());
-                        }
-
-                        // If exactly 9 values were read write them to final matrix and set flag for original captured image output
-                        if (valuesCounter == 9)
-                        {
-                            // Need to covert homography matrix in openCV format to openGL format
-                            // Can ignore z-coordinate here, so just fill up with empty values for z
-                            homographyInputMatrix.set(homographyInputMatrixValues[0], homographyInputMatrixValues[3], 0.0f, homographyInputMatrixValues[6],
-                                                      homographyInputMatrixValues[1], homographyInputMatrixValues[4], 0.0f, homographyInputMatrixValues[7],
-                                                      0.0f,                           0.0f,                           0.0f,                           0.0f,
-                                                      homographyInputMatrixValues[2], homographyInputMatrixValues[5], 0.0f, homographyInputMatrixValues[8]);
-                        }
-
-                        // Always close stream if opened successfully
-                        homographyInputStream.close();
-                    }
-
-                    // Unlock file
-                    if (lockf(homographyInputFile, F_ULOCK, 0) == -1)
-                    {
-                        // Suppress compiler warning by this check, error in file unlocking, but we can not do anything about it anyways
-                    }
-                }
-
-                // Always close file if opened successfully
-                close(homographyInputFile);
-            }
+            pipeline.source = new CPUFrameSource(CPU_SOURCE_PATH, PIPELINE_FRAME_FORMAT);
+            pipeline.warper = new CPUFrameWarper(CPU_WARP_THREAD_COUNT, PIPELINE_FRAME_FORMAT);
+            pipeline.encoder = createFrameEncoder(backend);
+            break;
+        }
+        default:
+        {
+            printf("Pipeline Error: Unknown backend %d - EXITING APPLICATION\n", backend);
+            kill(getpid(), SIGKILL);
         }
     }
 
-    // Input image (for next iteration)
-    // OMXcameraComponent: Tunnel preview data to OMXnullSinkComponent and real video to OMXeglRenderComponent
-    // OMXeglRenderComponent: Hand back the output buffer to the component, will write to texture of eglRenderOutputFbo
-    if (OMX_FillThisBuffer(OMXeglRenderComponent.handle, OMXeglRenderOutputBufferHeader))
+    // Setup publisher for the output mode
+    pipeline.publisher = createFramePublisher();
+
+    // Serve frames over HTTP in addition, copying a frame for the HTTP server never blocks
+    if (HTTP_SERVER_ENABLE)
     {
-        printf("OMX Error: OMX egl render component fill buffer failed - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        MultiFramePublisher* multiPublisher = new MultiFramePublisher();
+        multiPublisher->publishers.push_back(pipeline.publisher);
+        multiPublisher->publishers.push_back(new HttpFramePublisher(HTTP_SERVER_ADDRESS, HTTP_SERVER_PORT, HTTP_SERVER_MAX_CLIENTS));
+        pipeline.publisher = multiPublisher;
     }
 
-    // OMXeglRenderComponent: Wait until output buffer is completely ready, component has processed input and hands output buffer back to application
-    // Output data is written to texture of eglRenderOutputFbo
-    VCOSwaitEvent(&OMXeglRenderComponent, VCOS_EVENT_FILL_BUFFER_DONE);
-
-    // Prepare output image (from previous iteration)
-    // Check if we should output rendered image or original captured image, choose correct FBO
-    // Bind eglRenderOutputFbo by using FBO id
-    glBindFramebufferOES(GL_FRAMEBUFFER_OES, (outputCapturedOriginalImage ? eglRenderOutputFbo.getFbo() : defaultRenderOutputFbo.getFbo()));
-
-    // Read pixels from eglRenderOutputFbo into memory buffer
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, OMXscreenPixelBuffer);
-
-    // Reset to default FBO by using 0 for default FBO id
-    glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
-
-    // OMXimageEncodeComponent: Hand back the output buffer to the component
-    if (OMX_FillThisBuffer(OMXimageEncodeComponent.handle, OMXimageEncodeOutputBufferHeader))
+    // Output variants: Own encoder and publisher for each variant, encode work follows the variant resolution
+    if (!parseOutputVariants(OUTPUT_VARIANTS, width, height, &pipeline.outputVariants))
     {
-        printf("OMX Error: OMX image encode component fill buffer failed - EXITING APPLICATION\n");
+        printf("Pipeline Error: Invalid output variants %s - EXITING APPLICATION\n", OUTPUT_VARIANTS);
         kill(getpid(), SIGKILL);
     }
 
-    // OMXimageEncodeComponent: Set filled length of input buffer to full length, hand back input buffer to the component and start reading
-    OMXimageEncodeInputBufferHeader->nFilledLen = OMXimageEncodeInputBufferHeader->nAllocLen;
-    if (OMX_EmptyThisBuffer(OMXimageEncodeComponent.handle, OMXimageEncodeInputBufferHeader))
+    for (size_t i = 0; i < pipeline.outputVariants.size(); i++)
     {
-        printf("OMX Error: OMX image encode component empty buffer failed - EXITING APPLICATION\n");
-        kill(getpid(), SIGKILL);
+        pipeline.outputVariants[i].encoder = createFrameEncoder(backend);
+        pipeline.outputVariants[i].publisher = createFramePublisher();
     }
 
-    // OMXimageEncodeComponent: Wait until input buffer is completely read, component processes input and hands input buffer back to application
-    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_EMPTY_BUFFER_DONE);
-
-    // OMXimageEncodeComponent: Wait until output buffer is completely ready, component has processed input and hands output buffer back to application
-    VCOSwaitEvent(&OMXimageEncodeComponent, VCOS_EVENT_FILL_BUFFER_DONE);
-
-    // Write output image (from previous iteration)
-    // Check if there is data to write
-    if (OMXimageEncodeOutputBufferHeader->nFilledLen > 0)
+    // Dual output: Second encoder, original captured images are compressed while processed images continue
+    if (DUAL_OUTPUT_ENABLE)
     {
-        // Determine filepath
-        std::string outputPath = (outputCapturedOriginalImage ? capturedOutputPath : processedOutputPath);
-
-        // Create file if neccessary
-        if (!fileExists(outputPath))
-        {
-            int createOutputFile = open(outputPath.c_str(), O_CREAT, 0644);
-
-            if (createOutputFile != -1)
-            {
-                close(createOutputFile);
-            }
-        }
-
-        // Open file
-        // Do not use O_CREAT or O_TRUNC here, writing access out of file locked area!
-        int imageOutputFile = open(outputPath.c_str(), O_RDWR);
+        pipeline.capturedEncoder = createFrameEncoder(backend);
+    }
 
-        // Reset flag for output captured original image
-        outputCapturedOriginalImage = false;
+    // Setup all pipeline stages
+    pipeline.setup();
+}
 
-        // File open successful
-        if (imageOutputFile != -1)
-        {
-            // Lock file
-            if (lockf(imageOutputFile, F_LOCK, 0) != -1)
-            {
-                // Truncate file
-                if (ftruncate(imageOutputFile, 0) == -1)
-                {
-                    // Suppress compiler warning by this check, error in file truncating, but we can not do anything about it anyways
-                }
-
-                // Valid bytes begin at OMXimageEncodeOutputBufferHeader->pBuffer + OMXimageEncodeOutputBufferHeader->nOffset
-                // Length of valid bytes is stored in OMXimageEncodeOutputBufferHeader->nFilledLen
-                if (pwrite(imageOutputFile, OMXimageEncodeOutputBufferHeader->pBuffer + OMXimageEncodeOutputBufferHeader->nOffset, OMXimageEncodeOutputBufferHeader->nFilledLen, 0) == -1)
-                {
-                    // Suppress compiler warning by this check, error in file writing, but we can not do anything about it anyways
-                }
-
-                // Unlock file
-                if (lockf(imageOutputFile, F_ULOCK, 0) == -1)
-                {
-                    // Suppress compiler warning by this check, error in file unlocking, but we can not do anything about it anyways
-                }
-            }
+// Note: update is always called before draw in infinite loop
+void visicamRPiGPU::update()
+{
+    pipeline.update();
 
-            // Always close file if opened successfully
-            close(imageOutputFile);
-        }
+    // Frame rate might have been changed with the control socket, callback driven loop follows the camera by itself
+    if (!FRAME_LOOP_CALLBACK_ENABLE && pipeline.cameraSettings.framerate != appliedFrameRate)
+    {
+        appliedFrameRate = pipeline.cameraSettings.framerate;
+        ofSetFrameRate(appliedFrameRate);
     }
 }
 
 // Note: draw is always called after update in infinite loop
 void visicamRPiGPU::draw()
 {
-    // Draw into default render FBO
-    defaultRenderOutputFbo.begin();
-
-    // Perform homography matrix multiplication in modelview mode to texture of eglRenderOutputFbo
-    ofSetMatrixMode(OF_MATRIX_MODELVIEW);
-    ofPushMatrix();
-
-    // Matrix multiplication with homography matrix in output image
-    ofMultMatrix(homographyInputMatrix);
-
-    // Draw image to modified modelview and restore previous matrix
-    eglRenderOutputFbo.draw(0, 0);
-    ofPopMatrix();
-
-    // Stop draw into default render FBO
-    defaultRenderOutputFbo.end();
-}
\ No newline at end of file
+    pipeline.draw();
+}
@@ -19,6 +19,7 @@
 #include "ofMain.h"
 #include "ofAppEGLWindow.h"
 #include "visicamRPiGPU-settings.h"
+#include "visicamRPiGPU-pipeline.h"
 
 #include <bcm_host.h>
 #include <IL/OMX_Broadcom.h>
@@ -78,13 +79,30 @@ OMX
 #define OMX_PORT_IMAGE_ENCODE_IMAGE_INPUT       340
 #define OMX_PORT_IMAGE_ENCODE_IMAGE_OUTPUT      341
 
+// Completion times of the last emptied and filled buffers, at least the maximum ENCODE_BUFFER_COUNT
+#define OMX_BUFFER_DONE_TIMES                   8
+
 // OMX component struct definition
+// Completion time of buffer n is in empty/fillBufferDoneTimespecs[n % OMX_BUFFER_DONE_TIMES], written before the counter is increased
+// Frame event is signalled after each FillBufferDone, NULL if the render loop does not wait for it
+// Completed port disable commands are counted, commands for several ports of a component can be sent before waiting for all of them
+// Failed: Component reported an error or missed a deadline, it is freed and initialized again by the stage (STAGE_RECOVERY_ENABLE)
+// Waits of a timed out component return at once, it is not expected to answer anymore
+// Handle is NULL while the component is not initialized, commands and waits skip it
 typedef struct
 {
     OMX_U32             id;
     OMX_STRING          name;
     OMX_HANDLETYPE      handle;
     VCOS_EVENT_FLAGS_T  vcos_flags;
+    volatile OMX_U32    emptyBufferDoneCount;
+    volatile OMX_U32    fillBufferDoneCount;
+    volatile OMX_U32    portDisableCount;
+    struct timespec     emptyBufferDoneTimespecs[OMX_BUFFER_DONE_TIMES];
+    struct timespec     fillBufferDoneTimespecs[OMX_BUFFER_DONE_TIMES];
+    FrameEvent*         frameEvent;
+    bool                failed;
+    bool                timedOut;
 } OMXComponent;
 
 // OMX functions
@@ -95,28 +113,45 @@ OMX_ERRORTYPE OMXEmptyBufferDone(OMX_IN OMX_HANDLETYPE hComponent, OMX_IN OMX_PT
 OMX_ERRORTYPE OMXFillBufferDone(OMX_OUT OMX_HANDLETYPE hComponent, OMX_OUT OMX_PTR pAppData, OMX_OUT OMX_BUFFERHEADERTYPE* pBuffer);
 
 void VCOSsendEvent(OMXComponent* OMXcomponent, VCOS_UNSIGNED sendEvents);
-void VCOSwaitEvent(OMXComponent* OMXcomponent, VCOS_UNSIGNED waitEvents);
+bool VCOSwaitEvent(OMXComponent* OMXcomponent, VCOS_UNSIGNED waitEvents);
+bool VCOSwaitEventTimeout(OMXComponent* OMXcomponent, VCOS_UNSIGNED waitEvents, int timeoutMs);
+bool VCOSwaitBufferDone(OMXComponent* OMXcomponent, VCOS_UNSIGNED waitEvent, volatile OMX_U32* counter, OMX_U32 target, int timeoutMs);
+bool VCOSwaitPortsDisabled(OMXComponent* OMXcomponent, OMX_U32 target);
 
-void OMXInitializeComponent(OMXComponent* component, OMX_U32 id, OMX_STRING name);
+bool OMXInitializeComponent(OMXComponent* component, OMX_U32 id, const char* name);
+void OMXDeinitializeComponent(OMXComponent* component);
 void OMXSetStateComponent(OMXComponent* component, OMX_STATETYPE state);
 void OMXPortEnableDisableComponent(OMXComponent* component, OMX_U32 port, bool enable);
-
-void OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight);
-void OMXStartCameraCapturing(OMXComponent* component, int port);
-void OMXSetupEGLRender(OMXComponent* component, EGLImageKHR* eglImage, OMX_BUFFERHEADERTYPE** outputBufferHeader);
-void OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int cameraHeight);
-void OMXSetupImageEncodeAllocate(OMXComponent* component, GLubyte* inputBuffer, OMX_BUFFERHEADERTYPE** inputBufferHeader, OMX_BUFFERHEADERTYPE** outputBufferHeader, int cameraWidth, int cameraHeight);
+void OMXFailComponent(OMXComponent* component, const char* reason);
+bool OMXCheckComponent(OMXComponent* component);
+
+bool OMXSetupCamera(OMXComponent* component, int cameraWidth, int cameraHeight, const CameraSettings* settings);
+bool OMXSetupCameraSettings(OMXComponent* component, const CameraSettings* settings);
+bool OMXGetCameraExposure(OMXComponent* component, OMX_CONFIG_CAMERASETTINGSTYPE* exposure);
+bool OMXStartCameraCapturing(OMXComponent* component, int port);
+void OMXStopCameraCapturing(OMXComponent* component, int port);
+bool OMXSetupEGLRender(OMXComponent* component, EGLImageKHR* eglImage, OMX_BUFFERHEADERTYPE** outputBufferHeader);
+bool OMXSetupImageEncodeSettings(OMXComponent* component, int cameraWidth, int cameraHeight, int bufferCount, int quality, int frameFormat);
+bool OMXSetupImageEncodeQuality(OMXComponent* component, int quality);
+bool OMXSetupImageEncodeAllocate(OMXComponent* component, GLubyte** inputBuffers, OMX_BUFFERHEADERTYPE** inputBufferHeaders, OMX_BUFFERHEADERTYPE** outputBufferHeaders, int bufferCount, int cameraWidth, int cameraHeight, int frameFormat);
+bool OMXSetupImageEncodeAllocateOutput(OMXComponent* component, OMX_BUFFERHEADERTYPE** outputBufferHeaders, int bufferCount, int cameraWidth, int cameraHeight);
 
 /* #####################################
 CUSTOM FUNCTIONS
 ##################################### */
 
-// Check if file exists
-bool fileExists(std::string path);
-
 // Catch kill signals, send SIGKILL to self (might not stop otherwise)
 void signalHandler(int signal);
 
+// Initialize camera settings with the OMX_CAM_* settings
+void initializeCameraSettings(CameraSettings* settings);
+
+// Create encoder of backend for frames of PIPELINE_FRAME_FORMAT
+FrameEncoder* createFrameEncoder(int backend);
+
+// Create publisher of PUBLISH_MODE, with writer thread if PUBLISH_QUEUE_LENGTH is set
+FramePublisher* createFramePublisher();
+
 /* #####################################
 MAIN APP
 ##################################### */
@@ -138,30 +173,12 @@ class visicamRPiGPU : public ofBaseApp
         std::string processedOutputPath;
         std::string capturedOutputPath;
 
-        // OMX variables: Camera
-        OMXComponent OMXcameraComponent;
-
-        // OMX variables: Null sink
-        OMXComponent OMXnullSinkComponent;
-
-        // OMX variables: EGL render
-        OMXComponent OMXeglRenderComponent;
-        OMX_BUFFERHEADERTYPE* OMXeglRenderOutputBufferHeader;
-        EGLImageKHR eglImage;
-        ofFbo eglRenderOutputFbo;
-
-        // OMX variables: Image encoder
-        OMXComponent OMXimageEncodeComponent;
-        GLubyte* OMXscreenPixelBuffer;
-        OMX_BUFFERHEADERTYPE* OMXimageEncodeInputBufferHeader;
-        OMX_BUFFERHEADERTYPE* OMXimageEncodeOutputBufferHeader;
-
-        // Other variables
-        struct timespec lastRefreshTimespec;
-        struct timespec currentTimespec;
-        bool firstForcedRefresh;
-        bool outputCapturedOriginalImage;
-        float homographyInputMatrixValues[9];
-        ofMatrix4x4 homographyInputMatrix;
-        ofFbo defaultRenderOutputFbo;
+        // Selected backend for the pipeline stages
+        int backend;
+
+        // Frame rate of the openFrameworks loop, follows the camera frame rate, 0 (unlimited) for the callback driven loop
+        int appliedFrameRate;
+
+        // Capture, warp, encode and publish chain
+        Pipeline pipeline;
 };
\ No newline at end of file